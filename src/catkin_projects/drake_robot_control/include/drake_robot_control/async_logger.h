@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <Eigen/Dense>
+
+#include <drake_robot_control/bounded_mpmc_queue.h>
+#include <drake_robot_control/event_notifier.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+enum class LogLevel : int { kDebug = 0, kInfo, kWarn, kError };
+
+// Parses "debug", "info", "warn" or "error", returns kInfo otherwise.
+LogLevel LogLevelFromString(const std::string &level);
+
+/**
+ * Process-wide asynchronous logger for the control path.
+ *
+ * Log() formats the message straight into a slot of a BoundedMpmcQueue,
+ * used with a single consumer, and returns. It never blocks and never allocates. A background thread drains
+ * the ring to stdout, so a slow terminal or roslaunch log cannot stall the
+ * control thread. If the ring is full the message is dropped and the drain
+ * thread reports how many were lost.
+ *
+ * Use the PLAN_RUNNER_LOG* macros below rather than calling Log() directly.
+ */
+class AsyncLogger {
+public:
+  // Longer messages are truncated.
+  static constexpr size_t kMaxMessageLength = 512;
+  // Number of ring slots, must be a power of two.
+  static constexpr size_t kCapacity = 1024;
+
+  // The first call creates the ring and starts the drain thread, so it should
+  // happen during startup rather than on the control thread.
+  static AsyncLogger &Get();
+
+  AsyncLogger(const AsyncLogger &) = delete;
+  AsyncLogger &operator=(const AsyncLogger &) = delete;
+
+  bool IsEnabled(LogLevel level) const {
+    return static_cast<int>(level) >=
+           min_level_.load(std::memory_order_relaxed);
+  }
+  void set_min_level(LogLevel level) {
+    min_level_.store(static_cast<int>(level), std::memory_order_relaxed);
+  }
+
+  /**
+   * printf-style logging. Thread safe.
+   * @param num_suppressed number of messages from the same call site that
+   * were skipped by rate limiting since the last one logged
+   */
+  void Log(LogLevel level, uint64_t num_suppressed, const char *format, ...)
+      __attribute__((format(printf, 4, 5)));
+
+  // Blocks until everything logged so far has been written out.
+  void Flush();
+
+private:
+  struct Record {
+    LogLevel level;
+    uint32_t length;
+    uint64_t num_suppressed;
+    char text[kMaxMessageLength];
+  };
+
+  AsyncLogger();
+
+  // worker method of the drain thread
+  void Drain();
+  // Writes out all records currently in the ring. Drain thread only.
+  // @return number of records written
+  size_t DrainOnce();
+
+  BoundedMpmcQueue<Record, kCapacity> records_;
+  // records written out so far, Flush waits on it
+  std::atomic<size_t> num_written_;
+  std::atomic<uint64_t> num_dropped_;
+  std::atomic<int> min_level_;
+  EventNotifier notifier_;
+};
+
+/**
+ * Per-call-site rate limit, see PLAN_RUNNER_LOG_THROTTLE. Lock free, so it
+ * can be shared by all threads that reach the same call site.
+ */
+class LogRateLimiter {
+public:
+  explicit LogRateLimiter(double period_s)
+      : period_ns_(static_cast<int64_t>(period_s * 1e9)), next_allowed_ns_(0),
+        num_suppressed_(0) {}
+
+  /**
+   * @param num_suppressed set to the number of calls rejected since the last
+   * allowed one
+   * @return true if at least period_s elapsed since the last allowed call
+   */
+  bool Allow(uint64_t *num_suppressed);
+
+private:
+  const int64_t period_ns_;
+  std::atomic<int64_t> next_allowed_ns_;
+  std::atomic<uint64_t> num_suppressed_;
+};
+
+/**
+ * Formats a matrix or vector into a fixed-size buffer, one row per line, so
+ * Eigen types can be passed to the PLAN_RUNNER_LOG macros without going
+ * through an ostream, e.g.
+ *
+ *   PLAN_RUNNER_LOG(kDebug, "q_commanded:\n%s", MatrixString(q).c_str());
+ */
+class MatrixString {
+public:
+  explicit MatrixString(const Eigen::Ref<const Eigen::MatrixXd> &m);
+  const char *c_str() const { return buffer_; }
+
+private:
+  char buffer_[AsyncLogger::kMaxMessageLength];
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
+
+// level is one of kDebug, kInfo, kWarn, kError.
+#define PLAN_RUNNER_LOG(level, ...)                                            \
+  do {                                                                         \
+    ::drake::robot_plan_runner::AsyncLogger &plan_runner_logger =              \
+        ::drake::robot_plan_runner::AsyncLogger::Get();                        \
+    if (plan_runner_logger.IsEnabled(                                          \
+            ::drake::robot_plan_runner::LogLevel::level)) {                    \
+      plan_runner_logger.Log(::drake::robot_plan_runner::LogLevel::level, 0,   \
+                             __VA_ARGS__);                                     \
+    }                                                                          \
+  } while (0)
+
+// Logs at most once every period_s seconds from this call site. The next
+// message that gets through reports how many were suppressed in between.
+#define PLAN_RUNNER_LOG_THROTTLE(level, period_s, ...)                         \
+  do {                                                                         \
+    static ::drake::robot_plan_runner::LogRateLimiter plan_runner_limiter(     \
+        period_s);                                                             \
+    ::drake::robot_plan_runner::AsyncLogger &plan_runner_logger =              \
+        ::drake::robot_plan_runner::AsyncLogger::Get();                        \
+    uint64_t plan_runner_num_suppressed;                                       \
+    if (plan_runner_logger.IsEnabled(                                          \
+            ::drake::robot_plan_runner::LogLevel::level) &&                    \
+        plan_runner_limiter.Allow(&plan_runner_num_suppressed)) {              \
+      plan_runner_logger.Log(::drake::robot_plan_runner::LogLevel::level,      \
+                             plan_runner_num_suppressed, __VA_ARGS__);         \
+    }                                                                          \
+  } while (0)
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include <Eigen/Dense>
+
+#include <drake/common/trajectories/piecewise_polynomial.h>
+#include <drake_robot_control/control_types.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * A joint trajectory q(t) and its derivative pre-sampled on a uniform time
+ * grid into one contiguous, cache line aligned table.
+ *
+ * Evaluate() finds the sample interval with a multiplication and blends the
+ * two neighbouring samples with a cubic Hermite polynomial. Its cost does not
+ * depend on the number of knots and it never allocates. Inside a segment of
+ * a cubic spline the blend reproduces the spline exactly, so errors are
+ * confined to the sample intervals that contain a knot.
+ */
+class BakedTrajectory {
+public:
+  // Joint values per table row, q and qdot rows are padded to this size so
+  // every sample is two cache lines and the blend runs on whole vectors.
+  static constexpr int kRowSize = 8;
+  static_assert(kRowSize >= kMaxNumJoints, "kRowSize too small");
+  // Upper bound on the table size, about 22 minutes at 200 Hz (32 MB).
+  static constexpr int kMaxNumSamples = 1 << 18;
+
+  /**
+   * Samples q_traj and qdot_traj over [start_time, end_time] of q_traj. The
+   * grid is stretched slightly so that both ends are sampled exactly, its
+   * spacing is at most sample_period.
+   * @return nullptr if q_traj has more than kRowSize rows or would need more
+   * than kMaxNumSamples samples
+   */
+  static std::unique_ptr<BakedTrajectory>
+  Make(const trajectories::PiecewisePolynomial<double> &q_traj,
+       const trajectories::PiecewisePolynomial<double> &qdot_traj,
+       double sample_period);
+
+  ~BakedTrajectory();
+
+  BakedTrajectory(const BakedTrajectory &) = delete;
+  BakedTrajectory &operator=(const BakedTrajectory &) = delete;
+
+  /**
+   * Writes q(t) and qdot(t) into q and v, which must already have
+   * num_joints() rows. t is clamped to the time span of the trajectory.
+   */
+  void Evaluate(double t, Eigen::VectorXd *const q,
+                Eigen::VectorXd *const v) const;
+
+  int num_joints() const { return num_joints_; }
+  int num_samples() const { return num_samples_; }
+  double sample_period() const { return sample_period_; }
+  size_t size_bytes() const { return num_samples_ * sizeof(Sample); }
+
+private:
+  typedef Eigen::Matrix<double, kRowSize, 1> Row;
+
+  struct alignas(64) Sample {
+    Row q;
+    Row v;
+  };
+
+  BakedTrajectory(int num_joints, int num_samples, double start_time,
+                  double end_time);
+
+  const int num_joints_;
+  const int num_samples_;
+  const double start_time_;
+  const double end_time_;
+  const double sample_period_;
+  const double inverse_sample_period_;
+  Sample *samples_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
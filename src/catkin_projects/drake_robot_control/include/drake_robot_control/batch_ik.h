@@ -0,0 +1,113 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <yaml-cpp/yaml.h>
+
+#include <drake/multibody/rigid_body_tree.h>
+
+#include <drake_robot_control/kinematics_cache_pool.h>
+#include <drake_robot_control/plan_construction_pool.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+struct BatchIkOptions {
+  // threads solving the poses of a batch
+  int num_threads = 4;
+  int max_iterations = 100;
+  double position_tolerance = 1e-4;                 // m
+  double orientation_tolerance = 0.1 * M_PI / 180.; // rad
+  // of the damped least squares step, in the units of the pose error
+  double damping = 1e-3;
+  // largest change of any joint in one iteration, rad
+  double max_step = 0.2;
+  // A pose that converges neither from its neighbour nor from the seed is
+  // solved again from up to this many random configurations within the
+  // joint limits, which depend only on its index in the batch.
+  int num_restarts = 3;
+
+  // Returns the defaults if node is not defined. Reads
+  // orientation_tolerance_deg and max_step_deg in degrees.
+  static BatchIkOptions FromYaml(const YAML::Node &node);
+};
+
+struct IkSolution {
+  // within both tolerances, q is within the joint limits either way
+  bool success = false;
+  Eigen::VectorXd q;
+  double position_residual = 0.;    // m
+  double orientation_residual = 0.; // rad
+  int num_iterations = 0;
+};
+
+/**
+ * Solves the inverse kinematics of one frame of a tree for batches of target
+ * poses, in parallel.
+ *
+ * Each pose is solved by damped least squares iterations on the geometric
+ * Jacobian, q += J^T (J J^T + damping^2 I)^-1 e with e the pose error in
+ * the end effector frame, clamped to the joint limits. The batch is split
+ * into contiguous chunks that worker threads of the solver's own pool solve
+ * one after another, each with a KinematicsCache leased from the tree's
+ * KinematicsCachePool for the whole chunk. With warm_start_from_neighbours,
+ * a pose starts from the solution of the pose before it in its chunk if that
+ * one converged. A pose that does not converge is solved again from the seed,
+ * then from up to num_restarts random configurations.
+ *
+ * Thread safe, batches from several callers share the threads.
+ */
+class BatchIkSolver {
+public:
+  // q_min, q_max joint limits of the positions of tree
+  BatchIkSolver(std::shared_ptr<const RigidBodyTreed> tree,
+                const BatchIkOptions &options, const Eigen::VectorXd &q_min,
+                const Eigen::VectorXd &q_max);
+
+  BatchIkSolver(const BatchIkSolver &) = delete;
+  BatchIkSolver &operator=(const BatchIkSolver &) = delete;
+
+  /**
+   * @param ee_index body or frame of the tree brought to the targets
+   * @param targets poses of ee_index in the world frame of the tree
+   * @param q_seed start of every pose that is not warm started
+   * @param position_tolerance, orientation_tolerance <= 0 uses the options
+   * @param solutions one per target
+   */
+  void Solve(int ee_index,
+             const std::vector<Eigen::Isometry3d,
+                               Eigen::aligned_allocator<Eigen::Isometry3d>>
+                 &targets,
+             const Eigen::VectorXd &q_seed, bool warm_start_from_neighbours,
+             double position_tolerance, double orientation_tolerance,
+             std::vector<IkSolution> *const solutions);
+
+  const BatchIkOptions &options() const { return options_; }
+
+private:
+  // Solves targets [begin, end) into solutions with cache.
+  void SolveChunk(KinematicsCache<double> *cache, int ee_index,
+                  const Eigen::Isometry3d *targets, int begin, int end,
+                  const Eigen::VectorXd &q_seed,
+                  bool warm_start_from_neighbours, double position_tolerance,
+                  double orientation_tolerance,
+                  std::vector<IkSolution> *const solutions) const;
+
+  void SolveOne(KinematicsCache<double> *cache, int ee_index,
+                const Eigen::Isometry3d &target, const Eigen::VectorXd &q_start,
+                double position_tolerance, double orientation_tolerance,
+                IkSolution *const solution) const;
+
+  const std::shared_ptr<const RigidBodyTreed> tree_;
+  const BatchIkOptions options_;
+  const Eigen::VectorXd q_min_;
+  const Eigen::VectorXd q_max_;
+  std::shared_ptr<KinematicsCachePool> cache_pool_;
+  PlanConstructionPool pool_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Fixed-size lock-free ring of T, the bounded MPMC queue after Dmitry
+ * Vyukov.
+ *
+ * Every slot carries a sequence number that tells producers and consumers
+ * whose turn it is. Both claim a slot with a CAS on their position, then
+ * fill or read it in place and hand it on by publishing the next sequence
+ * number. Neither side ever blocks, and nothing is allocated after
+ * construction. A push into a full ring fails rather than waiting.
+ *
+ * Capacity must be a power of two.
+ */
+template <typename T, size_t Capacity> class BoundedMpmcQueue {
+public:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "BoundedMpmcQueue capacity must be a power of two");
+  static constexpr size_t kCapacity = Capacity;
+
+  BoundedMpmcQueue()
+      : cells_(new Cell[Capacity]), enqueue_position_(0),
+        dequeue_position_(0) {
+    for (size_t i = 0; i < Capacity; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedMpmcQueue(const BoundedMpmcQueue &) = delete;
+  BoundedMpmcQueue &operator=(const BoundedMpmcQueue &) = delete;
+
+  // Claims a slot and calls fill(T *) on it, so large elements are written
+  // in place. Thread safe.
+  // @return false if the ring is full, fill is not called then
+  template <typename Fill> bool TryPush(const Fill &fill) {
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[position & kMask];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (diff == 0) {
+        if (enqueue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+    fill(&cell->value);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPush(const T &value) {
+    return TryPush([&value](T *slot) { *slot = value; });
+  }
+
+  // Takes the oldest element and calls consume(const T &) on it before the
+  // slot is reused. Thread safe.
+  // @return false if the queue is empty, consume is not called then
+  template <typename Consume> bool TryPop(const Consume &consume) {
+    size_t position = dequeue_position_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[position & kMask];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff = static_cast<intptr_t>(sequence) -
+                            static_cast<intptr_t>(position + 1);
+      if (diff == 0) {
+        if (dequeue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = dequeue_position_.load(std::memory_order_relaxed);
+      }
+    }
+    consume(static_cast<const T &>(cell->value));
+    cell->sequence.store(position + Capacity, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T *value) {
+    return TryPop([value](const T &slot) { *value = slot; });
+  }
+
+  // Slots claimed by producers so far, including those still being filled.
+  size_t num_pushed() const {
+    return enqueue_position_.load(std::memory_order_acquire);
+  }
+
+private:
+  static constexpr size_t kMask = Capacity - 1;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  alignas(64) std::atomic<size_t> enqueue_position_;
+  alignas(64) std::atomic<size_t> dequeue_position_;
+};
+
+template <typename T, size_t Capacity>
+constexpr size_t BoundedMpmcQueue<T, Capacity>::kCapacity;
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <yaml-cpp/yaml.h>
+
+#include "robot_msgs/ControlLoopStats.h"
+
+namespace drake {
+namespace robot_plan_runner {
+
+struct ControlDeadlineWatchdogOptions {
+  bool enabled = true;
+  // Budget of the plan Step in a tick, 0 means one control period.
+  double step_budget_s = 0.;
+  // The running plan is replaced by a hold plan after this many Steps over
+  // budget in a row.
+  int max_consecutive_misses = 3;
+  // The running plan is stopped when no status message arrived for this
+  // long, 0 means 20 control periods.
+  double status_timeout_s = 0.;
+
+  // Returns the defaults if node is not defined.
+  static ControlDeadlineWatchdogOptions FromYaml(const YAML::Node &node);
+};
+
+/**
+ * Deadline watchdog of the RobotPlanRunner control loop.
+ *
+ * Tracks the duration of the plan Step in every tick against a budget and
+ * the age of the latest status message against a timeout, and tells the
+ * runner when to degrade the running plan to a hold plan. The status age is
+ * checked whenever timer_fd(), a timerfd firing every half timeout, becomes
+ * readable, so a stalled status stream is noticed while the control loop
+ * would otherwise sleep in epoll_wait.
+ *
+ * RecordStep(), RecordStatus(), CheckStatusAge() and RecordDegradation() are
+ * for the control thread, Report() for the reporter thread. Neither side
+ * locks or allocates.
+ */
+class ControlDeadlineWatchdog {
+public:
+  ControlDeadlineWatchdog(const ControlDeadlineWatchdogOptions &options,
+                          double control_period);
+  ~ControlDeadlineWatchdog();
+
+  ControlDeadlineWatchdog(const ControlDeadlineWatchdog &) = delete;
+  ControlDeadlineWatchdog &operator=(const ControlDeadlineWatchdog &) = delete;
+
+  // @return true on the max_consecutive_misses-th Step over budget in a row,
+  // the running plan is to be degraded
+  bool RecordStep(int64_t step_ns);
+
+  void RecordStatus(int64_t receive_time_ns);
+
+  // Consumes the timer expirations.
+  // @return true when the status age first exceeds the timeout, not again
+  // until a status message arrived
+  bool CheckStatusAge(int64_t now_ns);
+
+  void RecordDegradation();
+
+  // -1 if the watchdog is disabled
+  int timer_fd() const { return timer_fd_; }
+  bool enabled() const { return options_.enabled; }
+  int64_t step_budget_ns() const { return step_budget_ns_; }
+  int max_consecutive_misses() const {
+    return options_.max_consecutive_misses;
+  }
+  int64_t status_timeout_ns() const { return status_timeout_ns_; }
+  // of the latest status message, -1 before the first one
+  int64_t status_age_ns(int64_t now_ns) const;
+
+  // Reporter thread only. Fills the watchdog fields of msg with the counts
+  // since the previous call.
+  void Report(int64_t now_ns, robot_msgs::ControlLoopStats *msg);
+
+private:
+  const ControlDeadlineWatchdogOptions options_;
+  const int64_t step_budget_ns_;
+  const int64_t status_timeout_ns_;
+  int timer_fd_;
+
+  // control thread state
+  int consecutive_misses_;
+  bool is_status_stale_;
+
+  // single writer, the control thread
+  std::atomic<int64_t> last_status_ns_;
+  std::atomic<uint64_t> num_step_misses_;
+  std::atomic<uint64_t> num_status_timeouts_;
+  std::atomic<uint64_t> num_degradations_;
+
+  // reporter thread state
+  uint64_t previous_num_step_misses_;
+  uint64_t previous_num_status_timeouts_;
+  uint64_t previous_num_degradations_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
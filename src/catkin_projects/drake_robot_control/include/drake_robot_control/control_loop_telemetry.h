@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <drake_robot_control/seqlock.h>
+
+#include "robot_msgs/ControlLoopStats.h"
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * HDR-style log-linear latency histogram in nanoseconds.
+ *
+ * Every power of two is split into 2^kSubBucketBits linear buckets, so a
+ * recorded value is reported with a relative error below 1/16 over the whole
+ * range [0, 2^kMaxValueBits) ns. Values above the range land in the last
+ * bucket.
+ *
+ * Record() may only be called from a single thread. It is a couple of
+ * instructions plus a relaxed atomic store, and never blocks or allocates.
+ * Counts only ever grow, so a reader can take Snapshot()s at any time and
+ * subtract the previous one to get the histogram of an interval.
+ */
+class LatencyHistogram {
+public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+  // 2^40 ns is about 18 minutes
+  static constexpr int kMaxValueBits = 40;
+  static constexpr int kNumBuckets =
+      (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+  typedef std::array<uint64_t, kNumBuckets> Counts;
+
+  LatencyHistogram() {
+    for (auto &count : counts_) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Writer side.
+  void Record(int64_t value_ns) {
+    std::atomic<uint64_t> &count = counts_[BucketIndex(value_ns)];
+    // single writer, so a plain load + store is enough and avoids a locked
+    // read-modify-write on the control thread.
+    count.store(count.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  }
+
+  // Reader side. Copies the cumulative counts.
+  void Snapshot(Counts *counts) const {
+    for (int i = 0; i < kNumBuckets; i++) {
+      (*counts)[i] = counts_[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  static int BucketIndex(int64_t value_ns);
+
+  // largest value that maps to bucket index
+  static int64_t BucketUpperBound(int index);
+
+  /**
+   * @param counts histogram of an interval, e.g. the difference of two
+   * snapshots
+   * @param quantile in [0, 1]
+   * @return upper bound of the bucket holding the given quantile, 0 if counts
+   * is empty
+   */
+  static int64_t ValueAtQuantile(const Counts &counts, double quantile);
+
+private:
+  std::array<std::atomic<uint64_t>, kNumBuckets> counts_;
+};
+
+/**
+ * Per-tick latency telemetry of the RobotPlanRunner control loop.
+ *
+ * The control thread calls RecordTick() once per tick with the duration of
+ * each stage. A low-rate reporter thread calls Report() to turn everything
+ * recorded since its previous call into a ControlLoopStats message. Nothing
+ * on the control thread side locks or allocates.
+ */
+class ControlLoopTelemetry {
+public:
+  enum Stage {
+    // control thread woken up by the status message -> status decoded
+    kDecode = 0,
+    // plan swap, hold plan construction and plan start bookkeeping
+    kPlanSwap,
+    // plan_local->Step
+    kStep,
+    // joint limits and safety checks
+    kSafetyCheck,
+    // encoding and publishing iiwa_command
+    kPublish,
+    // control thread woken up -> command published
+    kTotal,
+    kNumStages
+  };
+
+  static const char *StageName(int stage);
+
+  explicit ControlLoopTelemetry(int64_t tick_budget_ns);
+
+  /**
+   * Control thread only.
+   * @param stage_ns duration of each stage of the tick
+   * @param plan_type as returned by PlanBase::get_plan_type()
+   */
+  void RecordTick(const int64_t (&stage_ns)[kNumStages], int plan_number,
+                  const char *plan_type);
+
+  // Reporter thread only. Fills msg with the statistics of all ticks recorded
+  // since the previous call.
+  void Report(robot_msgs::ControlLoopStats *msg);
+
+private:
+  // Maxima of the current reporting interval, owned by the control thread
+  // and published through a SeqLock.
+  struct IntervalPeak {
+    // value of report_epoch_ the peak belongs to
+    uint64_t epoch;
+    int64_t max_ns[kNumStages];
+    int worst_tick_plan_number;
+    const char *worst_tick_plan_type;
+    int plan_number;
+    const char *plan_type;
+  };
+
+  const int64_t tick_budget_ns_;
+
+  LatencyHistogram histograms_[kNumStages];
+  std::atomic<uint64_t> num_overruns_;
+
+  // Report() bumps the epoch to start a new interval, RecordTick() resets
+  // its peak when it sees a new epoch.
+  std::atomic<uint64_t> report_epoch_;
+  IntervalPeak peak_;
+  SeqLock<IntervalPeak> published_peak_;
+
+  // reporter thread state
+  LatencyHistogram::Counts previous_counts_[kNumStages];
+  LatencyHistogram::Counts interval_counts_;
+  uint64_t previous_num_overruns_;
+  int64_t previous_report_time_ns_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
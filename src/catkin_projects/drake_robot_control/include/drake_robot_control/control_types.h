@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+namespace drake {
+namespace robot_plan_runner {
+
+// Upper bound on the number of joints of a controlled arm (iiwa: 7).
+// Sizes the inline storage of the types below and of the status snapshots.
+constexpr int kMaxNumJoints = 7;
+
+// Joint space vector that behaves like Eigen::VectorXd but keeps its
+// coefficients inline, so temporaries on the control path never touch the
+// heap. For the iiwa this is effectively Eigen::Matrix<double, 7, 1>.
+typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, kMaxNumJoints, 1>
+    JointVector;
+
+// num_joints x num_joints matrix with inline storage, e.g. the Hessian of a
+// joint space QP.
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, kMaxNumJoints,
+                      kMaxNumJoints>
+    JointMatrix;
+
+// 6 x num_velocities geometric Jacobian with inline storage.
+typedef Eigen::Matrix<double, 6, Eigen::Dynamic, 0, 6, kMaxNumJoints>
+    JacobianMatrix;
+
+} // namespace robot_plan_runner
+} // namespace drake
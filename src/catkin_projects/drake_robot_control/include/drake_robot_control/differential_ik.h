@@ -0,0 +1,77 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <yaml-cpp/yaml.h>
+
+#include <drake_robot_control/control_types.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Settings of the differential IK solve of the task space plans, loaded from
+ * the optional "ik_solver" block of "task_space_plan" in the plan runner
+ * config, e.g.
+ *
+ *   ik_solver:
+ *     method: damped_least_squares
+ *     damping_max: 0.15
+ *     manipulability_threshold: 0.04
+ */
+struct DifferentialIkOptions {
+  enum Method {
+    // pseudo-inverse by JacobiSVD, singular values below svd_threshold are
+    // dropped
+    kSvd,
+    // J^T (J J^T + lambda^2 I)^-1, lambda grows from 0 to damping_max as the
+    // manipulability sqrt(det(J J^T)) falls below manipulability_threshold
+    kDampedLeastSquares,
+    // W^-1 J^T (J W^-1 J^T)^-1 with W = diag(joint_weights), joints with
+    // larger weights move less
+    kWeightedPseudoInverse,
+    // J^T (J J^T)^-1 by a 6x6 Cholesky solve, no damping
+    kNormalEquations,
+  };
+
+  Method method = kSvd;
+  double svd_threshold = 0.01;
+  double damping_max = 0.15;
+  double manipulability_threshold = 0.04;
+  // one per joint, empty means all 1
+  std::vector<double> joint_weights;
+
+  // Returns the defaults if node is not defined.
+  static DifferentialIkOptions FromYaml(const YAML::Node &node);
+};
+
+/**
+ * Solves J q_dot = twist for the joint velocities of a task space plan.
+ * Implementations keep their workspaces inline and do not allocate, Solve
+ * runs on the control thread.
+ */
+class DifferentialIkSolver {
+public:
+  virtual ~DifferentialIkSolver() {}
+
+  /**
+   * @param J 6 x n geometric Jacobian, n <= kMaxNumJoints
+   * @param twist desired twist, expressed in the same frame as J
+   * @param q_dot resized to n
+   */
+  virtual void Solve(const JacobianMatrix &J,
+                     const Eigen::Matrix<double, 6, 1> &twist,
+                     JointVector *const q_dot) = 0;
+
+  // method name as used in the config, a string literal
+  virtual const char *name() const = 0;
+};
+
+std::unique_ptr<DifferentialIkSolver>
+MakeDifferentialIkSolver(const DifferentialIkOptions &options);
+
+} // namespace robot_plan_runner
+} // namespace drake
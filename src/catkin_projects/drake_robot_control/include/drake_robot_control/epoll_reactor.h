@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <drake_robot_control/event_notifier.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Minimal epoll based event loop.
+ *
+ * Handlers are registered for file descriptors before Run() and are called on
+ * the thread running Run() whenever their descriptor becomes readable (level
+ * triggered, so a handler that leaves data unread is called again). When
+ * several descriptors are ready in the same wakeup, handlers with a lower
+ * priority value run first.
+ *
+ * The thread sleeps in epoll_wait while nothing is ready, so an idle reactor
+ * costs no CPU and no periodic wakeups.
+ */
+class EpollReactor {
+public:
+  typedef std::function<void()> Handler;
+
+  EpollReactor();
+  ~EpollReactor();
+
+  EpollReactor(const EpollReactor &) = delete;
+  EpollReactor &operator=(const EpollReactor &) = delete;
+
+  // Must be called before Run().
+  void AddReadHandler(int fd, int priority, Handler handler);
+
+  // Dispatches handlers until Stop() is called.
+  void Run();
+
+  // Makes Run() return after the handlers of the current wakeup. Can be
+  // called from any thread.
+  void Stop();
+
+  // Monotonic time at which the current dispatch round woke up from
+  // epoll_wait. Only meaningful inside a handler.
+  int64_t wakeup_time_ns() const { return wakeup_time_ns_; }
+
+private:
+  struct Entry {
+    int fd;
+    int priority;
+    Handler handler;
+  };
+
+  static constexpr int kMaxEvents = 8;
+
+  const int epoll_fd_;
+  std::vector<Entry> entries_;
+  EventNotifier stop_notifier_;
+  std::atomic<bool> is_stopped_;
+  int64_t wakeup_time_ns_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Thin wrapper around a Linux eventfd.
+ *
+ * Notify() never blocks and is async-signal safe, so it can be called from
+ * the LCM receive thread without ever waiting on the consumer. Multiple
+ * notifications that arrive before the consumer wakes up are coalesced.
+ */
+class EventNotifier {
+public:
+  EventNotifier() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (fd_ < 0) {
+      throw std::runtime_error("EventNotifier: eventfd() failed");
+    }
+  }
+
+  ~EventNotifier() { close(fd_); }
+
+  EventNotifier(const EventNotifier &) = delete;
+  EventNotifier &operator=(const EventNotifier &) = delete;
+
+  void Notify() {
+    const uint64_t one = 1;
+    ssize_t ret;
+    do {
+      ret = write(fd_, &one, sizeof(one));
+    } while (ret < 0 && errno == EINTR);
+  }
+
+  /**
+   * Blocks until Notify() has been called at least once since the last
+   * Wait(), or until timeout_ms elapses (a negative timeout waits forever).
+   * @return number of coalesced notifications, 0 on timeout
+   */
+  uint64_t Wait(int timeout_ms = -1) {
+    uint64_t count = Consume();
+    if (count > 0) {
+      return count;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    int ret;
+    do {
+      ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret <= 0) {
+      return 0;
+    }
+    return Consume();
+  }
+
+  // Clears pending notifications without blocking.
+  uint64_t Consume() {
+    uint64_t count = 0;
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      return 0;
+    }
+    return count;
+  }
+
+  // For registering with poll/epoll based loops.
+  int fd() const { return fd_; }
+
+private:
+  const int fd_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
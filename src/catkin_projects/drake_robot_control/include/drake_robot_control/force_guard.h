@@ -2,20 +2,29 @@
 
 #include <Eigen/Dense>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 // drake
 #include <drake/multibody/rigid_body_tree.h>
 
+#include "drake_robot_control/control_types.h"
+#include "drake_robot_control/tick_kinematics.h"
+
 namespace spartan {
 namespace drake_robot_control {
 
+typedef drake::robot_plan_runner::TickKinematics TickKinematics;
+
 enum ForceGuardType {
   TOTAL_EXTERNAL_TORQUE,
   EXTERNAL_FORCE,
 };
 
+class ForceGuardContainer;
+
 /// Generic ForceGuard class.
 /// Contains a single method, EvaluateGuard, which checks to see if the guard
 /// has been triggered,
@@ -28,14 +37,12 @@ public:
   /**
    * Checks whether the guard has been triggered
    * Reports the fraction of the way it is to being triggered
-   * @param cache_
-   * @param q
+   * @param kinematics measured state of this control tick
    * @param tau_external
    * @return
    */
   virtual std::pair<bool, double>
-  EvaluateGuard(const KinematicsCache<double> &cache_,
-                const Eigen::Ref<const Eigen::VectorXd> &q,
+  EvaluateGuard(TickKinematics *const kinematics,
                 const Eigen::Ref<const Eigen::VectorXd> &tau_external) = 0;
 
   inline bool HasBeenTriggered() { return has_been_triggered_; }
@@ -43,6 +50,9 @@ public:
   inline ForceGuardType get_type() { return type_; }
 
 protected:
+  // ForceGuardContainer evaluates the guards it knows without EvaluateGuard
+  friend class ForceGuardContainer;
+
   ForceGuardType type_;
   bool has_been_triggered_;
 };
@@ -53,10 +63,11 @@ public:
   TotalExternalTorqueGuard(const double &external_torque_norm_threshold);
 
   std::pair<bool, double>
-  EvaluateGuard(const KinematicsCache<double> &cache_,
-                const Eigen::Ref<const Eigen::VectorXd> &q,
+  EvaluateGuard(TickKinematics *const kinematics,
                 const Eigen::Ref<const Eigen::VectorXd> &tau_external) override;
 
+  double get_threshold() const { return threshold_; }
+
 private:
   const double threshold_; // total external torque threshold
 };
@@ -74,10 +85,15 @@ public:
                      const Eigen::Ref<const Eigen::Vector3d> &force);
 
   std::pair<bool, double>
-  EvaluateGuard(const KinematicsCache<double> &cache_,
-                const Eigen::Ref<const Eigen::VectorXd> &q,
+  EvaluateGuard(TickKinematics *const kinematics,
                 const Eigen::Ref<const Eigen::VectorXd> &tau_external) override;
 
+  const RigidBodyTreed &get_tree() const { return tree_; }
+  int get_body_index() const { return idx_body_; }
+  int get_world_index() const { return idx_world_; }
+  int get_expressed_in_index() const { return idx_expressed_in_; }
+  const Eigen::Vector3d &get_force() const { return force_; }
+
 private:
   const RigidBodyTreed &tree_;
 
@@ -86,7 +102,8 @@ private:
   const int idx_expressed_in_;
   Eigen::Vector3d force_;
   Eigen::Matrix<double, 6, 1> twist_external_;
-  Eigen::Isometry3d H_body_expressed_in_;
+  // workspace reused on every call to EvaluateGuard
+  drake::robot_plan_runner::JointVector torque_external_threshold_;
 };
 
 // struct ForceGuardContainerResult{
@@ -94,19 +111,30 @@ private:
 //  double fraction
 //};
 
+/// Evaluates a set of guards every control tick.
+///
+/// Adding guards compiles them into flat arrays, so EvaluateGuards makes no
+/// virtual calls for the known guard types and does not allocate:
+///  - TotalExternalTorqueGuards reduce to one threshold each on
+///    tau_external.norm().
+///  - ExternalForceGuards are grouped by body and expressed-in frame. Each
+///    group costs one transform and one Jacobian per tick, both from the
+///    tick's TickKinematics. The threshold torques of all guards come out of
+///    a single product
+///      torque_thresholds = [J_v1^T R_1, J_v2^T R_2, ...] * forces
+///    where J_vg are the translational rows of group g's Jacobian, R_g
+///    rotates the group's expressed-in frame into its body frame, and
+///    forces holds each guard's force in the rows of its group.
+/// Guards of other types are evaluated through EvaluateGuard.
 class ForceGuardContainer {
 public:
-  ForceGuardContainer(){};
+  ForceGuardContainer() : has_been_triggered_(false){};
 
-  inline void AddGuard(std::shared_ptr<ForceGuard> guard) {
-    guards_.push_back(guard);
-  }
+  // Not while EvaluateGuards may run, compiling allocates.
+  void AddGuard(std::shared_ptr<ForceGuard> guard);
+  void AddGuards(const std::vector<std::shared_ptr<ForceGuard>> &guards);
 
-  inline void AddGuards(std::vector<std::shared_ptr<ForceGuard>> guards) {
-    for (int i = 0; i < guards.size(); i++) {
-      guards_.push_back(guards[i]);
-    }
-  }
+  int num_guards() const { return static_cast<int>(guards_.size()); }
 
   inline bool HasBeenTriggered() { return has_been_triggered_; }
 
@@ -114,15 +142,48 @@ public:
     return triggered_guard_;
   }
 
+  /**
+   * @return whether the guard closest to its threshold has triggered, its
+   * fraction of the threshold and the guard itself (null without guards)
+   */
   std::pair<bool, std::pair<double, std::shared_ptr<ForceGuard>>>
-  EvaluateGuards(const KinematicsCache<double> &cache_,
-                 const Eigen::Ref<const Eigen::VectorXd> &q,
+  EvaluateGuards(TickKinematics *const kinematics,
                  const Eigen::Ref<const Eigen::VectorXd> &tau_external);
 
 private:
+  // ExternalForceGuards sharing one transform and Jacobian
+  struct BodyGroup {
+    int idx_body;
+    int idx_world;
+    int idx_expressed_in;
+  };
+
+  // Rebuilds the arrays below from guards_.
+  void Compile();
+
   std::vector<std::shared_ptr<ForceGuard>> guards_;
   bool has_been_triggered_;
   std::shared_ptr<ForceGuard> triggered_guard_;
+
+  // TotalExternalTorqueGuards: index into guards_ and threshold
+  std::vector<int> torque_norm_guards_;
+  Eigen::VectorXd torque_norm_thresholds_;
+  // ExternalForceGuards: index into guards_, in the column order of
+  // force_columns_
+  std::vector<int> external_force_guards_;
+  std::vector<BodyGroup> body_groups_;
+  // 3 * num groups x num external force guards
+  Eigen::MatrixXd force_columns_;
+  // guards of any other type
+  std::vector<int> other_guards_;
+
+  // per tick workspace, sized by Compile
+  // num_velocities x 3 * num groups
+  Eigen::MatrixXd group_jacobians_;
+  // num_velocities x num external force guards
+  Eigen::MatrixXd torque_thresholds_;
+  // one per guard, in the order of guards_
+  Eigen::VectorXd fractions_;
 };
 
 } // spartan
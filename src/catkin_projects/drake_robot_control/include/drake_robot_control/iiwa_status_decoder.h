@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+
+#include <drake_robot_control/status_mailbox.h>
+
+#include <drake/lcmt_iiwa_status.hpp>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Decodes lcmt_iiwa_status from the LCM receive buffer straight into a
+ * RobotStatusSnapshot.
+ *
+ * A typed lcm::LCM subscription decodes every message into a new
+ * lcmt_iiwa_status, whose seven std::vector<double> are allocated and freed
+ * on the control thread at the status rate, and the handler then copies
+ * them into the snapshot. Decode reads the big endian fields the snapshot
+ * holds in place and skips the others.
+ *
+ * The offsets of the fields are learned from the generated encoder in the
+ * constructor. If its output does not decode the same way (a changed message
+ * type), Decode uses the generated decoder on a reused lcmt_iiwa_status
+ * instead, which allocates nothing once its vectors are sized.
+ */
+class IiwaStatusDecoder {
+public:
+  explicit IiwaStatusDecoder(int num_joints);
+
+  // Fills all fields of status but receive_time_ns.
+  // @return false if data is not an lcmt_iiwa_status with num_joints joints
+  bool Decode(const void *data, size_t size, RobotStatusSnapshot *status);
+
+  // false if Decode falls back to the generated decoder
+  bool is_direct() const { return is_direct_; }
+
+private:
+  // the arrays of RobotStatusSnapshot, in the order of field_offsets_
+  static constexpr int kNumFields = 5;
+
+  bool DecodeDirect(const char *data, size_t size,
+                    RobotStatusSnapshot *status) const;
+
+  const int num_joints_;
+  bool is_direct_;
+  size_t message_size_;
+  size_t field_offsets_[kNumFields];
+  lcmt_iiwa_status message_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
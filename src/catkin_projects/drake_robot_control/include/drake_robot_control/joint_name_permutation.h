@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <drake/multibody/rigid_body_tree.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Maps the joint name order of incoming trajectories and setpoints to
+ * position indices of a RigidBodyTree.
+ *
+ * Senders use the same one or two name orders for every message, so the
+ * permutation for an order is computed once and returned from the cache
+ * afterwards. Unpacking a message is then a gather through the index array
+ * instead of a std::map lookup per joint and knot.
+ */
+class JointNamePermutationCache {
+public:
+  // index of names that are not positions of the tree
+  static constexpr int kNotInTree = -1;
+  // Orders beyond this many are replaced least recently used first.
+  static constexpr int kMaxNumEntries = 8;
+
+  explicit JointNamePermutationCache(const RigidBodyTreed &tree);
+
+  JointNamePermutationCache(const JointNamePermutationCache &) = delete;
+  JointNamePermutationCache &
+  operator=(const JointNamePermutationCache &) = delete;
+
+  /**
+   * Thread safe.
+   * @return for every entry of names, its position index in the tree or
+   * kNotInTree. Stays valid after the entry is evicted.
+   */
+  std::shared_ptr<const std::vector<int>>
+  Lookup(const std::vector<std::string> &names);
+
+private:
+  struct Entry {
+    std::vector<std::string> names;
+    std::shared_ptr<const std::vector<int>> indices;
+    uint64_t last_used;
+  };
+
+  // the tree's positions, sorted by name
+  std::vector<std::pair<std::string, int>> position_names_;
+
+  std::mutex mutex_;
+  std::vector<Entry> entries_;
+  uint64_t num_lookups_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -1,53 +1,101 @@
 #pragma once
+#include <drake_robot_control/joint_name_permutation.h>
+#include <drake_robot_control/setpoint_jitter_buffer.h>
+#include <drake_robot_control/shared_setpoint_channel.h>
 #include <drake_robot_control/trajectory_plan_base.h>
 #include "ros/ros.h"
 #include "sensor_msgs/JointState.h"
+#include "trajectory_msgs/JointTrajectory.h"
 
 // ROS
 
 namespace drake {
 namespace robot_plan_runner {
 
+/**
+ * Streams joint setpoints from joint_space_streaming_setpoint (one point per
+ * sensor_msgs/JointState), joint_space_streaming_trajectory (several future
+ * points per trajectory_msgs/JointTrajectory) and optionally shared memory.
+ *
+ * Setpoints are timestamped by their header stamps, or when they are
+ * received if unstamped, and played out through a SetpointJitterBuffer, so
+ * clients can send batches of future points at a low rate.
+ */
 class JointSpaceStreamingPlan : public PlanBase {
 public:
-  JointSpaceStreamingPlan(std::shared_ptr<const RigidBodyTreed> tree,
-                          ros::NodeHandle &nh)
-      : PlanBase(std::move(tree)) {
+  // joint_names maps setpoint joint names to positions of tree
+  JointSpaceStreamingPlan(
+      std::shared_ptr<const RigidBodyTreed> tree, ros::NodeHandle &nh,
+      std::shared_ptr<JointNamePermutationCache> joint_names,
+      const SetpointJitterBufferOptions &buffer_options =
+          SetpointJitterBufferOptions())
+      : PlanBase(std::move(tree)), joint_names_(std::move(joint_names)),
+        setpoints_(get_num_positions(), buffer_options) {
+    DRAKE_DEMAND(get_num_positions() == get_num_velocities());
     setpoint_subscriber_ = std::make_shared<ros::Subscriber>(
       nh.subscribe(
-        "/plan_runner/joint_space_streaming_setpoint", 1,
+        "joint_space_streaming_setpoint", 1,
         &JointSpaceStreamingPlan::HandleSetpoint, this));
+    // several points per message, so more than one message may be pending
+    trajectory_subscriber_ = std::make_shared<ros::Subscriber>(
+      nh.subscribe(
+        "joint_space_streaming_trajectory", 4,
+        &JointSpaceStreamingPlan::HandleTrajectory, this));
   }
 
   // Current robot state x = [q,v]
   // Current time t
   void Step(const Eigen::Ref<const Eigen::VectorXd> &x,
             const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
+            TickKinematics *const kinematics,
             Eigen::VectorXd *const q_commanded,
             Eigen::VectorXd *const v_commanded,
             Eigen::VectorXd *const tau_commanded) override;
 
-  inline void SetGoal(const Eigen::VectorXd& q_commanded,
+  const char *get_plan_type() const override {
+    return "JointSpaceStreamingPlan";
+  }
+
+  // Adds a setpoint for MonotonicTimeNs() time_ns.
+  inline void SetGoal(int64_t time_ns,
+                      const Eigen::VectorXd& q_commanded,
                       const Eigen::VectorXd& v_commanded,
                       const Eigen::VectorXd& tau_commanded) {
     DRAKE_ASSERT(q_commanded.rows() == get_num_positions());
     DRAKE_ASSERT(v_commanded.rows() == get_num_velocities());
     DRAKE_ASSERT(tau_commanded.rows() == get_num_positions());
     std::lock_guard<std::mutex> lock(goal_mutex_);
-    q_commanded_ = q_commanded;
-    v_commanded_ = v_commanded;
-    tau_commanded_ = tau_commanded;
+    setpoints_.Insert(time_ns, q_commanded, v_commanded, tau_commanded);
   }
 
   void HandleSetpoint(const sensor_msgs::JointState::ConstPtr& msg);
+  void HandleTrajectory(const trajectory_msgs::JointTrajectory::ConstPtr& msg);
+
+  // Step also takes setpoints from channel, in addition to the ROS topic.
+  // Setpoints written before this call are ignored. Before the plan starts.
+  void set_shared_setpoints(
+      std::shared_ptr<const SharedSetpointChannel> channel) {
+    shared_setpoints_ = std::move(channel);
+    shared_setpoint_sequence_ =
+        shared_setpoints_ ? shared_setpoints_->joint_space_sequence() : 0;
+  }
 
  private:
-    Eigen::VectorXd q_commanded_;
-    Eigen::VectorXd v_commanded_;
-    Eigen::VectorXd tau_commanded_;
+    // Makes a new setpoint of shared_setpoints_ the goal. Needs goal_mutex_.
+    void ReadSharedSetpoint();
+
     std::mutex goal_mutex_;
+    std::shared_ptr<JointNamePermutationCache> joint_names_;
+    // guarded by goal_mutex_
+    SetpointJitterBuffer setpoints_;
 
     std::shared_ptr<ros::Subscriber> setpoint_subscriber_;
+    std::shared_ptr<ros::Subscriber> trajectory_subscriber_;
+
+    // control thread only
+    std::shared_ptr<const SharedSetpointChannel> shared_setpoints_;
+    uint64_t shared_setpoint_sequence_ = 0; // of the last one used
+    SharedJointSpaceSetpoint shared_setpoint_;
 };
 
 } // namespace robot_plan_runner
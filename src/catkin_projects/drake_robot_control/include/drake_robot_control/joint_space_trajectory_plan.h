@@ -1,4 +1,5 @@
 #pragma once
+#include <drake_robot_control/baked_trajectory.h>
 #include <drake_robot_control/trajectory_plan_base.h>
 
 // ROS
@@ -12,7 +13,7 @@ class JointSpaceTrajectoryPlan : public TrajectoryPlanBase {
 public:
   JointSpaceTrajectoryPlan(std::shared_ptr<const RigidBodyTreed> tree,
                            const PPType &q_traj)
-      : TrajectoryPlanBase(std::move(tree), q_traj) {
+      : TrajectoryPlanBase(std::move(tree), q_traj), is_hold_(false) {
     DRAKE_ASSERT(q_traj.rows() == get_num_positions());
   }
 
@@ -20,14 +21,38 @@ public:
   // Current time t
   void Step(const Eigen::Ref<const Eigen::VectorXd> &x,
             const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
+            TickKinematics *const kinematics,
             Eigen::VectorXd *const q_commanded,
             Eigen::VectorXd *const v_commanded,
             Eigen::VectorXd *const tau_commanded) override;
 
+  const char *get_plan_type() const override {
+    return "JointSpaceTrajectoryPlan";
+  }
+
+  bool GetFinalPosition(Eigen::VectorXd *const q_final) const override;
+
+  // Pre-samples the trajectory every sample_period so Step evaluates a
+  // BakedTrajectory instead of traj_ and traj_d_. Must be called before the
+  // plan is handed to the control thread.
+  // @return false if the trajectory is too long to bake, Step then keeps
+  // evaluating the polynomials
+  bool Bake(double sample_period);
+  bool is_baked() const { return baked_traj_ != nullptr; }
+  // 0 if the plan is not baked
+  double baked_sample_period() const {
+    return baked_traj_ ? baked_sample_period_ : 0.;
+  }
+
   static std::unique_ptr<JointSpaceTrajectoryPlan>
   MakeHoldCurrentPositionPlan(std::shared_ptr<const RigidBodyTreed> tree,
                               const Eigen::Ref<const Eigen::VectorXd> &q);
 
+  // Makes a plan from MakeHoldCurrentPositionPlan hold q and run again from
+  // NOT_STARTED, so the control thread can reuse one hold plan instead of
+  // allocating a new one. Not while another thread may wait on the plan.
+  void ResetHoldPosition(const Eigen::Ref<const Eigen::VectorXd> &q);
+
   inline void SetActionServer(
       std::shared_ptr<
           actionlib::SimpleActionServer<robot_msgs::JointTrajectoryAction>>
@@ -36,6 +61,12 @@ public:
   }
 
  private:
+  // made by MakeHoldCurrentPositionPlan, Step commands hold_position_
+  bool is_hold_;
+  Eigen::VectorXd hold_position_;
+  std::unique_ptr<BakedTrajectory> baked_traj_;
+  // period passed to Bake, the table spacing may be slightly smaller
+  double baked_sample_period_;
   std::shared_ptr<
       actionlib::SimpleActionServer<robot_msgs::JointTrajectoryAction>>
       joint_trajectory_action_;
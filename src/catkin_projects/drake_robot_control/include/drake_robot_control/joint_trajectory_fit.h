@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Dense>
+#include <yaml-cpp/yaml.h>
+
+#include <drake/common/trajectories/piecewise_polynomial.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+typedef trajectories::PiecewisePolynomial<double> PPType;
+
+struct JointTrajectoryFitOptions {
+  // Knots are dropped as long as the straight line in joint space between the
+  // kept neighbours passes within this distance (largest joint error, rad) of
+  // them at their times. 0 keeps every knot.
+  double decimation_tolerance = 0.;
+
+  // Returns the defaults if node is not defined. The tolerance is given in
+  // degrees, decimation_tolerance_deg.
+  static JointTrajectoryFitOptions FromYaml(const YAML::Node &node);
+};
+
+struct JointTrajectoryFitStats {
+  int num_input_knots = 0;
+  int num_knots = 0; // after decimation
+  double decimation_s = 0.;
+  double fit_s = 0.; // including refits after checking the dropped knots
+
+  double reduction_ratio() const {
+    return num_input_knots > 0
+               ? static_cast<double>(num_knots) / num_input_knots
+               : 1.;
+  }
+};
+
+// false if two times are equal, out of order or NaN. The fits below require
+// strictly increasing knot times.
+bool TimesStrictlyIncrease(const std::vector<double> &times);
+
+/**
+ * Douglas-Peucker over time-stamped joint space knots: keeps the first and
+ * last knot, then recursively the knot farthest (largest joint error) from
+ * the straight line between the kept ones, evaluated at its time, until all
+ * dropped knots are within tolerance.
+ *
+ * @param knots one column per knot
+ * @return indices of the kept knots, ascending
+ */
+std::vector<int> DecimateKnots(const std::vector<double> &times,
+                               const Eigen::Ref<const Eigen::MatrixXd> &knots,
+                               double tolerance);
+
+/**
+ * The C2 cubic spline through knots with velocity v_start at the first and
+ * v_end at the last knot, the spline PPType::Cubic(times, knots, v_start,
+ * v_end) fits. The velocities at the interior knots come from one
+ * tridiagonal solve shared by all joints, O(number of knots), and the spline
+ * is assembled from them as cubic Hermite segments.
+ *
+ * @param times strictly increasing
+ * @param knots one column per knot, at least two
+ */
+PPType FitCubicSpline(const std::vector<double> &times,
+                      const Eigen::Ref<const Eigen::MatrixXd> &knots,
+                      const Eigen::Ref<const Eigen::VectorXd> &v_start,
+                      const Eigen::Ref<const Eigen::VectorXd> &v_end);
+
+// Decimates knots by options, then fits a cubic spline with zero end
+// velocities, adding back dropped knots until the spline passes within the
+// tolerance of all of them. times must strictly increase. stats may be null.
+PPType FitJointTrajectory(const std::vector<double> &times,
+                          const Eigen::Ref<const Eigen::MatrixXd> &knots,
+                          const JointTrajectoryFitOptions &options,
+                          JointTrajectoryFitStats *const stats);
+
+} // namespace robot_plan_runner
+} // namespace drake
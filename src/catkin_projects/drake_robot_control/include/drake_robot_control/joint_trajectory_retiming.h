@@ -0,0 +1,79 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <yaml-cpp/yaml.h>
+
+#include <drake/common/trajectories/piecewise_polynomial.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+typedef trajectories::PiecewisePolynomial<double> PPType;
+
+struct JointTrajectoryRetimingOptions {
+  bool enabled = false;
+  // fraction of joint_speed_limit_degree_per_sec the retimed plan commands at
+  // most. Below 1 so the runner's per tick dq check never fires, the limits
+  // hold at the grid points and are slightly overshot between them.
+  double velocity_limit_fraction = 0.9;
+  double max_joint_acceleration_deg = 300.;
+  // per joint limits by joint name, deg/s and deg/s^2. Joints not listed use
+  // the limits above, velocities are capped at the runner's speed limit.
+  std::map<std::string, double> joint_velocity_limits_deg;
+  std::map<std::string, double> joint_acceleration_limits_deg;
+  // largest spacing of the grid the path is discretized on, in the original
+  // timing, and largest joint motion between grid points
+  double grid_step_s = 0.01;
+  double grid_step_deg = 0.2;
+
+  // Limits of the named joints in rad/s and rad/s^2. speed_limit_deg is the
+  // runner's joint_speed_limit_degree_per_sec.
+  void GetLimits(const std::vector<std::string> &joint_names,
+                 double speed_limit_deg, Eigen::VectorXd *const max_velocity,
+                 Eigen::VectorXd *const max_acceleration) const;
+
+  // Returns the defaults if node is not defined.
+  static JointTrajectoryRetimingOptions FromYaml(const YAML::Node &node);
+};
+
+struct JointTrajectoryRetimingStats {
+  double input_duration = 0.;
+  double duration = 0.;
+  int num_grid_points = 0;
+  double retiming_s = 0.;
+};
+
+/**
+ * Time-optimal parameterization of the geometric path traced by path, the
+ * fastest timing along it with |q_dot| <= max_velocity and
+ * |q_ddot| <= max_acceleration per joint, starting and ending at rest.
+ *
+ * Follows TOPP-RA (Pham and Pham, 2018): the path parameter s (the time of
+ * path) is discretized in steps of at most grid_step that move no joint more
+ * than about grid_step_distance (rad), x = s_dot^2 and u = s_ddot are
+ * constant between grid points. A backward pass computes the largest x at
+ * each grid point from which the end can still be reached at rest, a
+ * forward pass then takes the largest u that keeps x within them. Every
+ * stage is a one dimensional interval problem, the whole is
+ * O(grid points * joints).
+ *
+ * Dwells of path (stretches where it does not move) are removed.
+ *
+ * @param retimed cubic Hermite spline through the path at the grid points
+ * @param stats may be null
+ * @return false if the timing is not finite, as when the path has to come to
+ * rest on two grid points in a row. retimed is untouched then.
+ */
+bool RetimeJointTrajectory(const PPType &path,
+                           const Eigen::Ref<const Eigen::VectorXd> &max_velocity,
+                           const Eigen::Ref<const Eigen::VectorXd> &max_acceleration,
+                           double grid_step, double grid_step_distance,
+                           PPType *const retimed,
+                           JointTrajectoryRetimingStats *const stats);
+
+} // namespace robot_plan_runner
+} // namespace drake
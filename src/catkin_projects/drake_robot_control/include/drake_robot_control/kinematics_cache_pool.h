@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <drake/multibody/rigid_body_tree.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Preallocated KinematicsCache<double> objects of one RigidBodyTreed, handed
+ * out as RAII leases.
+ *
+ * Creating a KinematicsCache allocates one element per body. Plans that need
+ * kinematics of their own (the task space plans) and pose queries from ROS
+ * threads lease a cache instead, and return it when the plan or query is
+ * done. Acquire creates a new cache only when none is idle, which is counted
+ * as a miss.
+ *
+ * Everyone using the same tree shares one pool, see Get. Thread safe.
+ */
+class KinematicsCachePool
+    : public std::enable_shared_from_this<KinematicsCachePool> {
+public:
+  // Exclusive use of one cache of the pool until destroyed or reassigned.
+  class Lease {
+  public:
+    Lease() = default;
+    Lease(Lease &&other) = default;
+    Lease &operator=(Lease &&other) {
+      if (this != &other) {
+        Release();
+        pool_ = std::move(other.pool_);
+        cache_ = std::move(other.cache_);
+      }
+      return *this;
+    }
+    ~Lease() { Release(); }
+
+    KinematicsCache<double> &operator*() const { return *cache_; }
+    KinematicsCache<double> *operator->() const { return cache_.get(); }
+    explicit operator bool() const { return cache_ != nullptr; }
+
+  private:
+    friend class KinematicsCachePool;
+    Lease(std::shared_ptr<KinematicsCachePool> pool,
+          std::unique_ptr<KinematicsCache<double>> cache)
+        : pool_(std::move(pool)), cache_(std::move(cache)) {}
+
+    void Release();
+
+    std::shared_ptr<KinematicsCachePool> pool_;
+    std::unique_ptr<KinematicsCache<double>> cache_;
+  };
+
+  // The pool of tree, created empty the first time it is asked for. It
+  // lives as long as someone holds it or one of its leases.
+  static std::shared_ptr<KinematicsCachePool>
+  Get(const std::shared_ptr<const RigidBodyTreed> &tree);
+
+  KinematicsCachePool(const KinematicsCachePool &) = delete;
+  KinematicsCachePool &operator=(const KinematicsCachePool &) = delete;
+
+  // Creates caches until the pool has at least num_caches.
+  void Reserve(int num_caches);
+
+  Lease Acquire();
+
+  // Acquire calls that got an idle cache / had to create one
+  int64_t num_hits() const { return num_hits_.load(); }
+  int64_t num_misses() const { return num_misses_.load(); }
+  // caches created so far, leased or idle
+  int num_caches();
+
+private:
+  explicit KinematicsCachePool(std::shared_ptr<const RigidBodyTreed> tree)
+      : tree_(std::move(tree)), num_caches_(0), num_hits_(0),
+        num_misses_(0) {}
+
+  std::unique_ptr<KinematicsCache<double>> CreateCache() const;
+
+  // Never allocates, idle_ has room for every cache.
+  void Return(std::unique_ptr<KinematicsCache<double>> cache);
+
+  const std::shared_ptr<const RigidBodyTreed> tree_;
+
+  std::mutex mutex_;
+  // guarded by mutex_
+  std::vector<std::unique_ptr<KinematicsCache<double>>> idle_;
+  int num_caches_;
+
+  std::atomic<int64_t> num_hits_;
+  std::atomic<int64_t> num_misses_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
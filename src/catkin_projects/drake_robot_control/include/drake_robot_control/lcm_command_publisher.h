@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <Eigen/Dense>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Publishes lcmt_iiwa_command on one channel without going through lcm::LCM.
+ *
+ * lcm::LCM::publish allocates a buffer and encodes the whole message into it,
+ * then the udpm provider takes a lock and assembles the packet, on every
+ * call. Here the packet (LCM short message header, channel name and the
+ * encoded lcmt_iiwa_command) is built once by the generated encoder. Publish
+ * patches the sequence number, utime, joint positions and joint torques in
+ * place and sends it with one sendmsg on a UDP socket connected to the
+ * multicast group, so the route is resolved once as well. Stock LCM
+ * subscribers receive an ordinary short message.
+ *
+ * Not thread safe, it is meant for the control thread.
+ */
+class LcmCommandPublisher {
+public:
+  static constexpr const char *kDefaultUrl = "udpm://239.255.76.67:7667?ttl=0";
+
+  // @param url provider URL as for lcm::LCM, empty means LCM_DEFAULT_URL or
+  // the LCM default
+  // @return nullptr if url is not udpm, the channel name or message does not
+  // fit a short message, or the socket cannot be set up (errno tells why).
+  // Commands are then to be published with lcm::LCM.
+  static std::unique_ptr<LcmCommandPublisher>
+  Open(const std::string &url, const std::string &channel, int num_joints);
+
+  ~LcmCommandPublisher();
+
+  LcmCommandPublisher(const LcmCommandPublisher &) = delete;
+  LcmCommandPublisher &operator=(const LcmCommandPublisher &) = delete;
+
+  // position and torque have num_joints entries.
+  // @return false if the packet was not sent, errno tells why
+  bool Publish(int64_t utime, const Eigen::Ref<const Eigen::VectorXd> &position,
+               const Eigen::Ref<const Eigen::VectorXd> &torque);
+
+  int num_joints() const { return num_joints_; }
+  // header, channel and message
+  size_t packet_size() const { return packet_.size(); }
+
+private:
+  LcmCommandPublisher(int fd, int num_joints, std::vector<char> packet,
+                      size_t payload_offset);
+
+  // Writes the message fields into packet_ without sending it.
+  void Patch(int64_t utime, const Eigen::Ref<const Eigen::VectorXd> &position,
+             const Eigen::Ref<const Eigen::VectorXd> &torque);
+
+  const int fd_;
+  const int num_joints_;
+  std::vector<char> packet_;
+  // of the fields Publish patches, in packet_
+  const size_t utime_offset_;
+  const size_t position_offset_;
+  const size_t torque_offset_;
+  uint32_t sequence_number_;
+  struct iovec iov_;
+  struct msghdr msg_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
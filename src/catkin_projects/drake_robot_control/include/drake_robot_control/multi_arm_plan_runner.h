@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include <drake_robot_control/plan_runner.h>
+
+#include "robot_msgs/StartSynchronizedJointTrajectories.h"
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Runs the arms listed under "arms" in the plan runner config in one
+ * process, one RobotPlanRunner (with its own control thread, plan slot and
+ * queue) per arm. Each entry of "arms" has a name and overrides top level
+ * keys of the config for that arm, e.g.
+ *
+ *   arms:
+ *     - name: left
+ *       lcm_status_channel: "IIWA_STATUS_LEFT"
+ *       lcm_command_channel: "IIWA_COMMAND_LEFT"
+ *       base_frame_id: "left_base"
+ *       realtime: {enabled: true, threads: {control: {priority: 80,
+ *                                                     cpus: [2]}}}
+ *
+ * The arms share the kinematic tree of each distinct robot_urdf_path and one
+ * TF buffer. Each arm's ROS interface is advertised under <nh>/<name>.
+ * Without "arms" there is a single arm on nh itself, with the same ROS names
+ * as a standalone RobotPlanRunner.
+ *
+ * start_synchronized_joint_trajectories under nh starts plans on several arms
+ * at the same time, see PlanStartBarrier.
+ */
+class MultiArmPlanRunner {
+public:
+  static std::unique_ptr<MultiArmPlanRunner>
+  GetInstance(ros::NodeHandle &nh, const std::string &config_file_name);
+
+  MultiArmPlanRunner(const MultiArmPlanRunner &) = delete;
+  MultiArmPlanRunner &operator=(const MultiArmPlanRunner &) = delete;
+
+  void Start();
+
+  int num_arms() const { return static_cast<int>(arms_.size()); }
+
+  // null if there is no arm of that name
+  RobotPlanRunner *get_arm(const std::string &name);
+
+private:
+  MultiArmPlanRunner(ros::NodeHandle &nh, double synchronized_start_timeout_s);
+
+  bool HandleStartSynchronizedJointTrajectoriesServiceCall(
+      robot_msgs::StartSynchronizedJointTrajectories::Request &req,
+      robot_msgs::StartSynchronizedJointTrajectories::Response &res);
+
+  ros::NodeHandle nh_;
+  std::shared_ptr<tf2_ros::Buffer> tf_buffer_;
+  tf2_ros::TransformListener tf_listener_;
+  const double synchronized_start_timeout_s_;
+
+  std::vector<std::string> arm_names_;
+  // one per entry of arm_names_
+  std::vector<std::unique_ptr<RobotPlanRunner>> arms_;
+
+  ros::ServiceServer synchronized_start_server_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -8,11 +8,16 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "robot_msgs/PlanStatus.h"
 #include <drake/multibody/rigid_body_tree.h>
 
+#include "drake_robot_control/async_logger.h"
+#include "drake_robot_control/control_types.h"
 #include "drake_robot_control/force_guard.h"
+#include "drake_robot_control/plan_start_barrier.h"
+#include "drake_robot_control/tick_kinematics.h"
 
 namespace drake {
 namespace robot_plan_runner {
@@ -32,27 +37,41 @@ enum PlanStatus {
   STOPPED_BY_EXTERNAL_TRIGGER,
   STOPPED_BY_SAFETY_CHECK,
   STOPPED_BY_FORCE_GUARD,
+  STOPPED_BY_WATCHDOG,
 };
 
 class PlanBase {
 public:
+  typedef std::function<void(PlanBase &plan)> CompletionCallback;
+
   explicit PlanBase(std::shared_ptr<const RigidBodyTreed> tree)
-      : tree_(std::move(tree)), cache_(tree_->CreateKinematicsCache()),
-        cache_measured_state_(tree_->CreateKinematicsCache()),
-        is_finished_(false) {
+      : tree_(std::move(tree)), is_finished_(false) {
     num_positions = tree_->get_num_positions();
     num_velocities = tree_->get_num_velocities();
     plan_status_ = NOT_STARTED;
+    // sized once here so SetCurrentCommand never reallocates
+    q_commanded_prev_.setZero(num_positions);
+    tau_commanded_prev_.setZero(num_positions);
   }
 
   // x:=[q,v] robot state
   // t: plan time (relative to plan start time)
+  // kinematics: kinematics of x, shared by everything run in this tick. Use
+  // it instead of calling doKinematics on the measured state.
+  // Step is called on the control thread every tick. The output vectors are
+  // already sized by the caller, implementations should write into them in
+  // place and avoid heap allocating temporaries.
   virtual void Step(const Eigen::Ref<const Eigen::VectorXd> &x,
                     const Eigen::Ref<const Eigen::VectorXd> &tau_external,
-                    double t, Eigen::VectorXd *const q_commanded,
+                    double t, TickKinematics *const kinematics,
+                    Eigen::VectorXd *const q_commanded,
                     Eigen::VectorXd *const v_commanded,
                     Eigen::VectorXd *const tau_commanded) = 0;
 
+  // Name of the concrete plan type, used to tag control loop telemetry.
+  // Returns a string literal so it can be read on the control thread.
+  virtual const char *get_plan_type() const = 0;
+
   int get_num_positions() const { return num_positions; }
   int get_num_velocities() const { return num_velocities; }
 
@@ -70,7 +89,8 @@ public:
 
     if ((plan_status_ == PlanStatus::STOPPED_BY_EXTERNAL_TRIGGER) ||
         (plan_status == PlanStatus::STOPPED_BY_SAFETY_CHECK) ||
-        (plan_status == PlanStatus::STOPPED_BY_FORCE_GUARD)) {
+        (plan_status == PlanStatus::STOPPED_BY_FORCE_GUARD) ||
+        (plan_status == PlanStatus::STOPPED_BY_WATCHDOG)) {
       plan_halted = true;
     }
 
@@ -80,9 +100,30 @@ public:
   void Stop(){}; // currently does nothing
   PlanStatus WaitForPlanToFinish();
 
-  // sets the plan to be finished, notifies any waiting threads
+  // sets the plan to be finished, notifies any waiting threads and runs the
+  // completion callbacks. Only the first call has an effect.
   void SetPlanFinished();
 
+  // Sets plan_status and finishes the plan, unless it has already finished.
+  // @return false if the plan had already finished
+  bool FinishWithStatus(PlanStatus plan_status);
+
+  // Returns a finished plan to NOT_STARTED, for plans the runner reuses.
+  // Drops completion callbacks that have not run.
+  void Restart();
+
+  // callback is run once when the plan finishes, right away if it already
+  // has. It runs on the thread that finishes the plan, usually the control
+  // thread, so it must be short and must not block.
+  void AddCompletionCallback(CompletionCallback callback);
+
+  // Joint position the plan ends at, for plans where it is known up front.
+  // Plans queued behind this one start from there.
+  // @return false if the final position is not known
+  virtual bool GetFinalPosition(Eigen::VectorXd *const q_final) const {
+    return false;
+  }
+
   void GetPlanStatusMsg(robot_msgs::PlanStatus &plan_status_msg);
 
   // store the previously commanded q, tau
@@ -97,6 +138,14 @@ public:
   set_guard_container(std::shared_ptr<ForceGuardContainer> guard_container) {
     guard_container_ = guard_container;
   }
+  bool has_guard_container() const { return guard_container_ != nullptr; }
+
+  // Plans sharing a start barrier start together on several arms, see
+  // PlanStartBarrier. The runner holds position until then.
+  void set_start_barrier(std::shared_ptr<PlanStartBarrier> start_barrier) {
+    start_barrier_ = std::move(start_barrier);
+  }
+  PlanStartBarrier *get_start_barrier() const { return start_barrier_.get(); }
 
   // for multi-thread synchronization
   std::atomic<PlanStatus> plan_status_;
@@ -107,8 +156,6 @@ public:
 
 protected:
   std::shared_ptr<const RigidBodyTreed> tree_;
-  KinematicsCache<double> cache_;
-  KinematicsCache<double> cache_measured_state_;
 
   // records the last commands sent by this plan
   // or the last command sent by a previous plan if we have just swapped this
@@ -116,13 +163,21 @@ protected:
   Eigen::VectorXd q_commanded_prev_;
   Eigen::VectorXd tau_commanded_prev_;
   std::shared_ptr<ForceGuardContainer> guard_container_;
+  std::shared_ptr<PlanStartBarrier> start_barrier_;
 
 private:
   int num_positions;
   int num_velocities;
+  // guarded by mutex_
+  std::vector<CompletionCallback> completion_callbacks_;
 
   ;
 };
 
+// The message PlanBase::GetPlanStatusMsg gives for plan_status, for
+// completions published after the plan is gone.
+void FillPlanStatusMsg(PlanStatus plan_status,
+                       robot_msgs::PlanStatus &plan_status_msg);
+
 } // namespace robot_plan_runner
 } // namespace drake
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <drake_robot_control/bounded_mpmc_queue.h>
+#include <drake_robot_control/event_notifier.h>
+#include <drake_robot_control/plan_base.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+struct PlanCompletionEntry {
+  int plan_number;
+  PlanStatus status;
+};
+
+/**
+ * Plan completions on their way from the threads that finish plans, mostly
+ * the control thread, to the thread that publishes them on ROS.
+ *
+ * Push() takes a slot of a BoundedMpmcQueue and notifies the consumer. It
+ * never blocks and never allocates, where ros::Publisher::publish would
+ * serialize the message and take the publisher's locks. If the ring is full
+ * the completion is dropped and counted.
+ */
+class PlanCompletionQueue {
+public:
+  // Number of ring slots, must be a power of two.
+  static constexpr size_t kCapacity = 256;
+
+  PlanCompletionQueue();
+
+  PlanCompletionQueue(const PlanCompletionQueue &) = delete;
+  PlanCompletionQueue &operator=(const PlanCompletionQueue &) = delete;
+
+  // Thread safe. @return false if the ring was full
+  bool Push(int plan_number, PlanStatus status);
+
+  // Thread safe. @return false if the queue is empty
+  bool Pop(PlanCompletionEntry *completion) {
+    return completions_.TryPop(completion);
+  }
+
+  // Blocks until Push() was called or timeout_ms elapses, see
+  // EventNotifier::Wait.
+  void Wait(int timeout_ms) { notifier_.Wait(timeout_ms); }
+
+  // Completions dropped since the last call.
+  uint64_t TakeNumDropped() { return num_dropped_.exchange(0); }
+
+private:
+  BoundedMpmcQueue<PlanCompletionEntry, kCapacity> completions_;
+  std::atomic<uint64_t> num_dropped_;
+  EventNotifier notifier_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
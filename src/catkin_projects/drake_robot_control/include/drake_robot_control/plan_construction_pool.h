@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Worker threads that construct plans off the ROS callback threads.
+ *
+ * Building a plan waits on TF and fits splines and guards, independent
+ * stages a goal callback submits here to run them concurrently, then collects
+ * the results through the returned futures.
+ *
+ * Tasks must not wait on other tasks of the pool, with few threads that can
+ * deadlock. Thread safe.
+ */
+class PlanConstructionPool {
+public:
+  explicit PlanConstructionPool(int num_threads);
+
+  // Runs the tasks already submitted, then joins the threads.
+  ~PlanConstructionPool();
+
+  PlanConstructionPool(const PlanConstructionPool &) = delete;
+  PlanConstructionPool &operator=(const PlanConstructionPool &) = delete;
+
+  // Runs task() on a worker thread, its result or exception ends up in the
+  // future.
+  template <typename Task>
+  std::future<typename std::result_of<Task()>::type> Submit(Task task) {
+    typedef typename std::result_of<Task()>::type Result;
+    // std::function needs a copyable target
+    auto packaged =
+        std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    std::future<Result> result = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back([packaged]() { (*packaged)(); });
+    }
+    task_available_.notify_one();
+    return result;
+  }
+
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+private:
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable task_available_;
+  // guarded by mutex_
+  std::deque<std::function<void()>> tasks_;
+  bool is_stopping_;
+
+  std::vector<std::thread> threads_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <drake_robot_control/plan_base.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Bounded FIFO of plans waiting to run after the current one.
+ *
+ * A fixed ring of slots, so Push() and Pop() never allocate and Pop() can be
+ * called on the control thread. Not thread safe, RobotPlanRunner guards it
+ * with robot_plan_mutex_.
+ */
+class PlanQueue {
+public:
+  static constexpr int kDefaultCapacity = 16;
+
+  explicit PlanQueue(int capacity = kDefaultCapacity)
+      : slots_(capacity), head_(0), size_(0) {}
+
+  // Drops all queued plans.
+  void set_capacity(int capacity) {
+    slots_.assign(capacity, nullptr);
+    head_ = 0;
+    size_ = 0;
+  }
+  int capacity() const { return static_cast<int>(slots_.size()); }
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == capacity(); }
+
+  // @return false if the queue is full
+  bool Push(std::shared_ptr<PlanBase> plan) {
+    if (full()) {
+      return false;
+    }
+    slots_[(head_ + size_) % capacity()] = std::move(plan);
+    size_++;
+    return true;
+  }
+
+  // @return the oldest plan, nullptr if the queue is empty
+  std::shared_ptr<PlanBase> Pop() {
+    if (empty()) {
+      return nullptr;
+    }
+    std::shared_ptr<PlanBase> plan = std::move(slots_[head_]);
+    head_ = (head_ + 1) % capacity();
+    size_--;
+    return plan;
+  }
+
+  // most recently pushed plan, must not be called on an empty queue
+  const std::shared_ptr<PlanBase> &back() const {
+    return slots_[(head_ + size_ - 1) % capacity()];
+  }
+
+private:
+  std::vector<std::shared_ptr<PlanBase>> slots_;
+  int head_;
+  int size_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
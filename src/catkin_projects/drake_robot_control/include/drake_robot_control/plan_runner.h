@@ -4,6 +4,7 @@
 #include <condition_variable>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -11,9 +12,30 @@
 
 #include <yaml-cpp/yaml.h>
 
+#include <drake_robot_control/batch_ik.h>
+#include <drake_robot_control/control_deadline_watchdog.h>
+#include <drake_robot_control/control_loop_telemetry.h>
+#include <drake_robot_control/differential_ik.h>
+#include <drake_robot_control/epoll_reactor.h>
+#include <drake_robot_control/event_notifier.h>
+#include <drake_robot_control/iiwa_status_decoder.h>
+#include <drake_robot_control/joint_name_permutation.h>
+#include <drake_robot_control/joint_trajectory_fit.h>
+#include <drake_robot_control/joint_trajectory_retiming.h>
+#include <drake_robot_control/kinematics_cache_pool.h>
+#include <drake_robot_control/lcm_command_publisher.h>
 #include <drake_robot_control/joint_space_trajectory_plan.h>
 #include <drake_robot_control/joint_space_streaming_plan.h>
 #include <drake_robot_control/plan_base.h>
+#include <drake_robot_control/plan_completion_queue.h>
+#include <drake_robot_control/plan_construction_pool.h>
+#include <drake_robot_control/plan_queue.h>
+#include <drake_robot_control/plan_runner_log.h>
+#include <drake_robot_control/realtime_thread.h>
+#include <drake_robot_control/seqlock.h>
+#include <drake_robot_control/shared_setpoint_channel.h>
+#include <drake_robot_control/status_mailbox.h>
+#include <drake_robot_control/task_space_qp_trajectory_plan.h>
 #include <drake_robot_control/task_space_streaming_plan.h>
 #include <drake_robot_control/task_space_trajectory_plan.h>
 
@@ -35,9 +57,15 @@
 #include <tf2_ros/transform_listener.h>
 #include "std_srvs/Trigger.h"
 
+#include "geometry_msgs/TransformStamped.h"
 #include "robot_msgs/CartesianTrajectoryAction.h"
 #include "robot_msgs/JointTrajectoryAction.h"
 #include "robot_msgs/GetPlanNumberAction.h"
+#include "robot_msgs/PlanConstructionLatency.h"
+#include "robot_msgs/PlanCompletion.h"
+#include "robot_msgs/QueueJointTrajectory.h"
+#include "robot_msgs/RunBatchIK.h"
+#include "robot_msgs/RunIK.h"
 #include "robot_msgs/StartStreamingPlan.h"
 
 namespace drake {
@@ -77,6 +105,14 @@ public:
   static std::unique_ptr<RobotPlanRunner>
   GetInstance(ros::NodeHandle &nh, const std::string &config_file_name);
 
+  // Same from an already loaded config. Parses robot_urdf_path unless tree
+  // is given. Without tf_buffer the runner makes its own buffer and
+  // listener. ROS services and topics are advertised relative to nh.
+  static std::unique_ptr<RobotPlanRunner>
+  FromConfig(ros::NodeHandle &nh, YAML::Node config,
+             std::shared_ptr<const RigidBodyTreed> tree = nullptr,
+             std::shared_ptr<tf2_ros::Buffer> tf_buffer = nullptr);
+
   RobotPlanRunner(const std::string &lcm_status_channel,
                   const std::string &lcm_command_channel,
                   const std::string &lcm_plan_channel,
@@ -84,14 +120,15 @@ public:
                   const std::string &robot_ee_body_name, int num_joints,
                   double joint_speed_limit_deg_per_sec, double control_period,
                   YAML::Node config,
-                  std::unique_ptr<const RigidBodyTreed> tree,
-                  ros::NodeHandle &nh);
+                  std::shared_ptr<const RigidBodyTreed> tree,
+                  ros::NodeHandle &nh,
+                  std::shared_ptr<tf2_ros::Buffer> tf_buffer = nullptr);
   ~RobotPlanRunner();
 
   void Start();
 
-  // The following methods locks robot_status_mutex and returns current robot
-  // state/position/velocity.
+  // The following methods read the latest status from status_mailbox_ and
+  // return current robot state/position/velocity.
   Eigen::VectorXd get_current_robot_state();
   Eigen::VectorXd get_current_robot_position();
   Eigen::VectorXd get_current_robot_velocity();
@@ -103,11 +140,39 @@ public:
   // If new_plan_ is not a nullptr, it is moved to plan_local (which will be
   // executed
   // immediately), and becomes a nullptr again.
-  void QueueNewPlan(std::shared_ptr<PlanBase> new_plan) {
-    std::lock_guard<std::mutex> lock(robot_plan_mutex_);
-    new_plan_ = new_plan;
-    new_plan_->plan_number_ = plan_number_++; // sets the plan number
-  }
+  // new_plan preempts the current plan and cancels all queued plans.
+  void QueueNewPlan(std::shared_ptr<PlanBase> new_plan);
+
+  // Appends new_plan to plan_queue_. It is started on the control tick on
+  // which the plan ahead of it finishes normally, or on the next tick if the
+  // runner is only holding position.
+  // @param queue_epoch as returned by GetPlanQueueEnd, rejects the plan if
+  // the queue was cancelled or preempted since.
+  // @return false if the plan was rejected or the queue is full
+  bool AppendPlan(std::shared_ptr<PlanBase> new_plan, uint64_t queue_epoch);
+
+  // Position the last queued (or current) plan ends at, i.e. where a plan
+  // passed to AppendPlan starts.
+  // @return false if it is not known, e.g. behind a streaming plan
+  bool GetPlanQueueEnd(Eigen::VectorXd *const q_end,
+                       uint64_t *const queue_epoch);
+
+  // Cancels all queued plans and stops the current one.
+  void CancelAllPlans();
+
+  // Cubic joint space plan from trajectory that starts at the last command,
+  // for QueueNewPlan.
+  // @return null and sets error if the runner has no status yet or the
+  // trajectory has less than two knots or knot times that do not strictly
+  // increase
+  std::shared_ptr<JointSpaceTrajectoryPlan>
+  MakeJointTrajectoryPlanFromLastCommand(
+      const trajectory_msgs::JointTrajectory &trajectory,
+      std::string *const error);
+
+  // Publishes plan on plan_completion when it finishes, from the control
+  // loop stats thread.
+  void PublishCompletion(PlanBase *plan);
 
   std::shared_ptr<const RigidBodyTreed> get_rigid_body_tree() { return tree_; }
   double get_control_period() { return kControlPeriod_; }
@@ -129,30 +194,98 @@ private:
   // load joint limits
   void LoadJointLimits();
 
-  // applies the joint limits
-  Eigen::VectorXd ApplyJointLimits(const Eigen::VectorXd & q_commanded);
-
-  // worker method of lcm status receiver thread.
-  void ReceiveRobotStatus();
-
-  // worker method of lcm command publisher thread.
-  void PublishCommand();
-
-  // worker method of lcm construct new plan thread.
-  // This thread should subscribe to a channel with LCM type robot_plant_t and
-  // generate JointSpaceTrajectoryPlan.
-  void ConstructNewPlanFromLcm();
-
-  // This method is used by the condition_variable to prevent spurious wakeups.
-  bool has_received_new_status() { return has_received_new_status_; }
-
-  void HandleStatus(const lcm::ReceiveBuffer *, const std::string &,
-                    const lcmt_iiwa_status *status);
-
-  void
-  HandleJointSpaceTrajectoryPlan(const lcm::ReceiveBuffer *,
-                                 const std::string &,
-                                 const robotlocomotion::robot_plan_t *tape);
+  // clamps q_commanded to the joint limits in place
+  void ApplyJointLimits(Eigen::VectorXd *const q_commanded);
+
+  // worker method of the control thread.
+  // Runs reactor_, which waits on the status and plan LCM file descriptors
+  // and plan_events_. Every iiwa_status message runs ControlTick inline,
+  // messages on the plan channel are handed to lcm_plan_pool_, which
+  // builds and queues a JointSpaceTrajectoryPlan from them.
+  void RunControlLoop();
+
+  // Steps the current plan with the given status and publishes the command.
+  // Control thread only.
+  void ControlTick(const RobotStatusSnapshot &status);
+
+  // Runs when watchdog_'s timer fires, stops the running plan if the status
+  // messages stopped arriving. Control thread only.
+  void HandleWatchdogTimer();
+
+  // Stops the running plan with STOPPED_BY_WATCHDOG unless it already
+  // finished, cancels the queued plans, and has the next tick replace it by a
+  // hold plan at the last command. Control thread only.
+  void DegradeRunningPlan();
+
+  // For a plan about to start that has a PlanStartBarrier: arrives at the
+  // barrier and, once the common start time is reached, sets start_time_us
+  // so that the plan time is measured from it. Stops the plan if the barrier
+  // was cancelled.
+  // Control thread only.
+  // @return false if the plan must not start in this tick
+  bool PassStartBarrier(PlanBase *plan, int64_t utime,
+                        int64_t *const start_time_us);
+
+  // Swaps in new_plan_ or terminates the current plan if requested. Starts
+  // the next queued plan if the current one is done.
+  // Control thread only.
+  void ApplyPendingPlanChanges();
+
+  // Starts the next queued plan in the tick the current plan finished in.
+  // Control thread only.
+  // @return false if there is none, or a plan change is pending
+  bool StartNextQueuedPlan();
+
+  // Moves the head of plan_queue_ into control_state_.plan_local. Control
+  // thread only, robot_plan_mutex_ must be held.
+  // @param same_tick true if the previous plan finished earlier in this tick
+  // @return false if the queue is empty
+  bool PopQueuedPlanLocked(bool same_tick);
+
+  // Finishes all queued plans with STOPPED_BY_EXTERNAL_TRIGGER. Their
+  // completion callbacks run under robot_plan_mutex_.
+  // @return number of plans cancelled
+  int CancelQueuedPlans();
+  // same, robot_plan_mutex_ must be held
+  int CancelQueuedPlansLocked();
+
+  // QueueNewPlan, robot_plan_mutex_ must be held. plan_record is from
+  // EncodePlanRecord.
+  void QueueNewPlanLocked(std::shared_ptr<PlanBase> new_plan,
+                          std::vector<char> *plan_record);
+  // Payload of the plan record for recorder_, empty without one. Encoding
+  // copies the whole trajectory, so it is done before robot_plan_mutex_ is
+  // taken, the control thread needs that mutex to swap plans.
+  std::vector<char> EncodePlanRecord(const PlanBase &plan);
+
+  // worker method of the thread that publishes telemetry_ on
+  // control_loop_stats every control_loop_stats_period_s_, and the plan
+  // completions in plan_completions_ as they are pushed.
+  void PublishControlLoopStats();
+  // Publishes everything in plan_completions_ on plan_completion. Stats
+  // thread only.
+  void PublishQueuedCompletions();
+
+  // Returns the last position/torque command sent to the robot. Before the
+  // first command is published this is the command reported in the most
+  // recent iiwa_status message.
+  void GetLastCommand(Eigen::VectorXd *const q_commanded,
+                      Eigen::VectorXd *const tau_commanded);
+
+  // Decodes the status message with status_decoder_ and runs the control
+  // tick.
+  void HandleStatus(const lcm::ReceiveBuffer *rbuf, const std::string &);
+
+  // Copies the encoded robot_plan_t and hands it to lcm_plan_pool_, the
+  // control thread neither decodes nor fits it.
+  void HandleJointSpaceTrajectoryPlan(const lcm::ReceiveBuffer *rbuf,
+                                      const std::string &);
+
+  // Decodes a robot_plan_t and builds its plan, then queues it unless
+  // another plan or a stop request arrived on LCM since, i.e. sequence is no
+  // longer lcm_plan_sequence_. Runs on lcm_plan_pool_.
+  void ConstructPlanFromLcm(const std::vector<uint8_t> &data,
+                            uint64_t sequence);
 
   /**
    * Callback for the JointTrajectory action
@@ -170,13 +303,65 @@ private:
   void ExecuteCartesianTrajectoryAction(
       const robot_msgs::CartesianTrajectoryGoal::ConstPtr &goal);
 
-  void HandleStop(const lcm::ReceiveBuffer *, const std::string &,
-                  const robotlocomotion::robot_plan_t *) {
-    terminate_current_plan_flag_ = true;
-  }
+  struct TransformLookup {
+    geometry_msgs::TransformStamped transform;
+    std::string error; // empty if the lookup succeeded
+    int64_t done_ns;   // MonotonicTimeNs() when it finished
+  };
+
+  // Looks up frame_id in base_frame_id_ on construction_pool_, waiting up to
+  // tf_lookup_timeout_s_ for it to become available.
+  std::future<TransformLookup> LookupTransformAsync(const std::string &frame_id);
+
+  // Also discards the LCM plans still under construction.
+  void HandleStop(const lcm::ReceiveBuffer *, const std::string &);
+
+  // Builds a cubic joint space plan from a ROS trajectory. The first knot is
+  // replaced by q_start. stats may be null.
+  std::shared_ptr<JointSpaceTrajectoryPlan>
+  MakeJointTrajectoryPlan(const trajectory_msgs::JointTrajectory &trajectory,
+                          const Eigen::Ref<const Eigen::VectorXd> &q_start,
+                          bool retime,
+                          JointTrajectoryFitStats *const stats = nullptr);
+
+  // Decimates and fits knots (one column per knot) by
+  // joint_trajectory_fit_options_, retimes the spline if retime is set and
+  // retiming is enabled, and bakes the plan if enabled.
+  std::shared_ptr<JointSpaceTrajectoryPlan>
+  MakeJointTrajectoryPlanFromKnots(const std::vector<double> &times,
+                                   const Eigen::MatrixXd &knots, bool retime,
+                                   JointTrajectoryFitStats *const stats);
+
+  // Bakes plan at the control period if bake_joint_trajectories_ is set.
+  // Baking allocates and fills the sample table, so plans are built off the
+  // control thread (LCM plans on lcm_plan_pool_). Called on the control
+  // thread it leaves the plan unbaked and logs an error.
+  void BakeIfEnabled(JointSpaceTrajectoryPlan *plan);
 
   bool HandlePlanEndServiceCall(
     std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
+  bool HandleCancelAllPlansServiceCall(std_srvs::Trigger::Request &req,
+                                       std_srvs::Trigger::Response &res);
+  bool HandleQueueJointTrajectoryServiceCall(
+      robot_msgs::QueueJointTrajectory::Request &req,
+      robot_msgs::QueueJointTrajectory::Response &res);
+  bool HandleRunIKServiceCall(robot_msgs::RunIK::Request &req,
+                              robot_msgs::RunIK::Response &res);
+  bool HandleRunBatchIKServiceCall(robot_msgs::RunBatchIK::Request &req,
+                                   robot_msgs::RunBatchIK::Response &res);
+  // Solves the IK of ee_frame_id, a body or frame of the tree
+  // (robot_ee_body_name if empty), for poses on batch_ik_solver_, from
+  // seed_pose[0] or the current robot position. Poses with a zero
+  // quaternion are not solved, their residuals are infinite.
+  // @return why nothing was solved, empty if solutions has one per pose
+  std::string SolveIk(const std::vector<geometry_msgs::PoseStamped> &poses,
+                      const std::string &ee_frame_id,
+                      const std::vector<sensor_msgs::JointState> &seed_pose,
+                      bool warm_start_from_neighbours,
+                      double position_tolerance, double orientation_tolerance,
+                      std::vector<IkSolution> *const solutions);
+  void JointStateFromPositions(const Eigen::VectorXd &q,
+                               sensor_msgs::JointState *const joint_state);
   bool HandleInitJointSpaceStreamingServiceCall(
     robot_msgs::StartStreamingPlan::Request &req,
     robot_msgs::StartStreamingPlan::Response &res);
@@ -204,33 +389,127 @@ private:
   std::shared_ptr<const RigidBodyTreed> tree_;
 
   // mutexes
-  std::mutex robot_status_mutex_;
+  std::mutex print_mutex_;
   std::mutex robot_plan_mutex_;
 
-  // condition variables
-  std::condition_variable cv_;
+  // Latest iiwa_status, written by the control thread for other readers.
+  StatusMailbox status_mailbox_;
+  // last command actually sent, written by the control thread only
+  SeqLock<RobotCommandSnapshot> last_command_;
+
+  // stage latencies of every control tick
+  ControlLoopTelemetry telemetry_;
+  // created in the constructor, its counts are published with telemetry_
+  std::unique_ptr<ControlDeadlineWatchdog> watchdog_;
+  double control_loop_stats_period_s_;
+
+  // Event loop of the control thread and what it waits on. status_lcm_ also
+  // publishes the commands if command_publisher_ is null.
+  EpollReactor reactor_;
+  lcm::LCM status_lcm_;
+  lcm::LCM plan_lcm_;
+  // only with preencoded_lcm_commands set in the config
+  std::unique_ptr<LcmCommandPublisher> command_publisher_;
+  // created in the constructor, used by the control thread only
+  std::unique_ptr<IiwaStatusDecoder> status_decoder_;
+  // notified whenever terminate_current_plan_flag_ is set, so the current
+  // plan is stopped without waiting for the next status message.
+  EventNotifier plan_events_;
+  // finished plans PublishCompletion was asked to publish, drained by the
+  // control loop stats thread
+  PlanCompletionQueue plan_completions_;
+
+  // Plans run back to back after the current one, guarded by
+  // robot_plan_mutex_.
+  PlanQueue plan_queue_;
+  // Plan the control thread last swapped in, for GetPlanQueueEnd. Guarded by
+  // robot_plan_mutex_.
+  std::shared_ptr<PlanBase> active_plan_;
+  // Bumped whenever queued plans are cancelled or preempted, so a plan built
+  // against the old end of the queue is not appended. Guarded by
+  // robot_plan_mutex_.
+  uint64_t plan_queue_epoch_;
+  // Bumped by every plan and stop message on LCM. A plan built from an
+  // older message is discarded, checked under robot_plan_mutex_.
+  std::atomic<uint64_t> lcm_plan_sequence_;
+
+  // Everything the control tick keeps between status messages. Only touched
+  // by the control thread.
+  struct ControlLoopState {
+    std::shared_ptr<PlanBase> plan_local;
+    // plan_local is hold_plan, run when there was nothing else to run
+    bool is_holding;
+    // made once and reset to the last command whenever it takes over
+    std::shared_ptr<JointSpaceTrajectoryPlan> hold_plan;
+    double max_dq_per_step;
+    int64_t start_time_us;
+    bool has_published_command;
+    lcmt_iiwa_command iiwa_command;
+    Eigen::VectorXd q_commanded;
+    Eigen::VectorXd v_commanded;
+    Eigen::VectorXd tau_commanded;
+    Eigen::VectorXd prev_position_command;
+    Eigen::VectorXd prev_torque_command;
+    Eigen::VectorXd dq_cmd;
+    Eigen::VectorXd current_robot_state;
+    Eigen::VectorXd cur_tau_external;
+    // kinematics of current_robot_state, passed to Step
+    std::unique_ptr<TickKinematics> measured_kinematics;
+    // plan whose start barrier this arm has arrived at
+    int arrived_plan_number;
+    // plan the watchdog stopped, replaced by a hold plan at the start of the
+    // next tick, -1 if none
+    int degraded_plan_number;
+    RobotCommandSnapshot last_command;
+  };
+  ControlLoopState control_state_;
 
   // threads
-  std::thread publish_thread_;
-  std::thread subscriber_thread_;
-  std::thread plan_constructor_thread_;
+  std::thread control_thread_;
+  std::thread control_loop_stats_thread_;
 
   std::atomic<bool> is_waiting_for_first_robot_status_message_;
-  std::atomic<bool> has_received_new_status_;
   std::atomic<bool> terminate_current_plan_flag_;
+  std::atomic<bool> is_running_;
   std::atomic<int> plan_number_; // the current plan number
-  lcmt_iiwa_status iiwa_status_;
-  Eigen::VectorXd current_robot_state_;
-  Eigen::VectorXd iiwa_status_position_command_; // joint_position_commanded from
-                                               // iiwa_status msg
-
-  Eigen::VectorXd iiwa_status_torque_command_; // joint_torque_commanded from iiwa_status msg
-
-  Eigen::VectorXd last_position_command_; // last position command we actually sent
-  Eigen::VectorXd last_torque_command_; // last torque command we actually sent
 
   double joint_limit_tolerance_; // tolerance on joint limits
 
+  // pre-sample joint space trajectory plans, see JointSpaceTrajectoryPlan::Bake
+  bool bake_joint_trajectories_;
+  // knot decimation of incoming joint space trajectories
+  JointTrajectoryFitOptions joint_trajectory_fit_options_;
+  // time-optimal retiming of incoming joint space trajectories, with the
+  // per joint limits in rad/s and rad/s^2
+  JointTrajectoryRetimingOptions retiming_options_;
+  Eigen::VectorXd retiming_max_velocity_;
+  Eigen::VectorXd retiming_max_acceleration_;
+
+  // Records the control thread's inputs and outputs for offline replay if
+  // record_log_path is set, null otherwise.
+  std::unique_ptr<PlanRunnerRecorder> recorder_;
+
+  // joint name order of incoming plans -> position indices of tree_, shared
+  // with the streaming plans
+  std::shared_ptr<JointNamePermutationCache> joint_name_permutations_;
+
+  // Setpoint slots the streaming plans poll in addition to their ROS topics
+  // if shared_memory_setpoints is enabled, null otherwise.
+  std::shared_ptr<SharedSetpointChannel> shared_setpoints_;
+
+  // KinematicsCaches of tree_ for pose queries and the task space plans,
+  // shared with the other arms using the same tree
+  std::shared_ptr<KinematicsCachePool> kinematics_cache_pool_;
+
+  // differential IK of the task space plans
+  DifferentialIkOptions ik_options_;
+  // playout of joint space streaming setpoints
+  SetpointJitterBufferOptions streaming_buffer_options_;
+  // Cartesian trajectory goals run as EndEffectorOriginQpTrajectoryPlan if
+  // task_space_plan has a qp block.
+  bool use_task_space_qp_;
+  TaskSpaceQpOptions task_space_qp_options_;
+
   // These are the joint limits that will be applied before the command
   // is sent to the robot. These limits already include the joint_limit_tolerance_
   // as defined above
@@ -240,11 +519,26 @@ private:
 
 
   std::shared_ptr<PlanBase> new_plan_;
+  // set with new_plan_, lets the control tick skip robot_plan_mutex_ while a
+  // plan runs and nothing is pending
+  std::atomic<bool> has_new_plan_;
 
   // ROS
   ros::NodeHandle nh_;
-  tf2_ros::Buffer tf_buffer_;
-  tf2_ros::TransformListener tf_listener_;
+  // frame Cartesian goals are resolved in, base_frame_id in the config
+  std::string base_frame_id_;
+  // possibly shared with other arms of the process
+  std::shared_ptr<tf2_ros::Buffer> tf_buffer_;
+  // null if tf_buffer_ was passed in
+  std::unique_ptr<tf2_ros::TransformListener> tf_listener_;
+  double tf_lookup_timeout_s_;
+  // TF lookups and plan construction stages of the goal callbacks
+  std::unique_ptr<PlanConstructionPool> construction_pool_;
+  // plans received on LCM, kept apart from construction_pool_ so TF lookups
+  // waiting up to tf_lookup_timeout_s_ don't delay them
+  std::unique_ptr<PlanConstructionPool> lcm_plan_pool_;
+  // run_ik and run_batch_ik, with threads of its own
+  std::unique_ptr<BatchIkSolver> batch_ik_solver_;
   std::shared_ptr<
       actionlib::SimpleActionServer<robot_msgs::JointTrajectoryAction>>
       joint_trajectory_action_;
@@ -261,9 +555,16 @@ private:
     joint_space_streaming_plan_init_server_;
   std::shared_ptr<ros::ServiceServer>
     task_space_streaming_plan_init_server_;
+  std::shared_ptr<ros::ServiceServer> cancel_all_plans_server_;
+  std::shared_ptr<ros::ServiceServer> queue_joint_trajectory_server_;
+  std::shared_ptr<ros::ServiceServer> run_ik_server_;
+  std::shared_ptr<ros::ServiceServer> run_batch_ik_server_;
+  ros::Publisher control_loop_stats_publisher_;
+  ros::Publisher plan_completion_publisher_;
 
   // config
   YAML::Node config_;
+  RealtimeConfig realtime_config_;
 };
 
 } // namespace examples
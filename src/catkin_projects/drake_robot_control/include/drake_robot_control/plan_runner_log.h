@@ -0,0 +1,230 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <drake_robot_control/control_types.h>
+#include <drake_robot_control/joint_space_trajectory_plan.h>
+#include <drake_robot_control/status_mailbox.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Binary log of everything the RobotPlanRunner control thread consumes and
+ * produces, so a session can be replayed offline (see replay_plan_runner).
+ *
+ * The file starts with a LogHeader, followed by records. Each record is a
+ * RecordHeader and `size` bytes of payload. All integers and doubles are
+ * stored in host byte order.
+ *
+ * Per control tick the runner writes a StatusRecord, PlanSwapRecords and
+ * PlanTerminatedRecords for plan changes made in that tick, and finally the
+ * CommandRecord that was sent. Plan changes made between ticks appear
+ * between a CommandRecord and the next StatusRecord. A PlanRecord is written
+ * when a plan is handed to the runner, which is always before its swap.
+ */
+namespace plan_runner_log {
+
+constexpr char kMagic[8] = {'P', 'R', 'L', 'O', 'G', '0', '0', '1'};
+
+enum RecordType : uint32_t {
+  kStatus = 1,
+  kCommand = 2,
+  kPlan = 3,
+  kPlanSwap = 4,
+  kPlanTerminated = 5,
+  // records were dropped because the writer fell behind
+  kGap = 6,
+};
+
+struct LogHeader {
+  char magic[8];
+  int32_t num_joints;
+  int32_t reserved;
+  double control_period;
+  double max_dq_per_step;
+  double joint_limits_min[kMaxNumJoints];
+  double joint_limits_max[kMaxNumJoints];
+  // URDF the runner's tree was built from, with environment variables
+  // expanded
+  char urdf_path[256];
+};
+
+struct RecordHeader {
+  uint32_t type;
+  // payload size in bytes
+  uint32_t size;
+};
+
+struct StatusRecord {
+  int64_t utime;
+  double joint_position_measured[kMaxNumJoints];
+  double joint_velocity_estimated[kMaxNumJoints];
+  double joint_position_commanded[kMaxNumJoints];
+  double joint_torque_commanded[kMaxNumJoints];
+  double joint_torque_external[kMaxNumJoints];
+};
+
+struct CommandRecord {
+  int64_t utime;
+  int32_t plan_number;
+  int32_t reserved;
+  double joint_position[kMaxNumJoints];
+  double joint_torque[kMaxNumJoints];
+};
+
+enum PlanKind : int32_t {
+  // plan type the log cannot describe, e.g. streaming plans
+  kUnsupportedPlan = 0,
+  kJointSpaceTrajectoryPlan = 1,
+};
+
+// Fixed part of a kPlan record. For kJointSpaceTrajectoryPlan it is followed
+// by num_segments + 1 breaks and then num_segments * num_rows *
+// num_coefficients polynomial coefficients (segment major, ascending powers
+// of the time since the segment start).
+struct PlanRecord {
+  int32_t plan_number;
+  int32_t kind;
+  int32_t num_segments;
+  int32_t num_rows;
+  int32_t num_coefficients;
+  // force guards are not recorded, replay runs the plan without them
+  int32_t has_guards;
+  // JointSpaceTrajectoryPlan::Bake period, 0 if not baked
+  double baked_sample_period;
+  char plan_type[48];
+};
+
+struct PlanSwapRecord {
+  int32_t plan_number;
+  // 1 if the plan was started after the previous plan finished in the same
+  // tick, i.e. after the first Step of the tick
+  int32_t same_tick;
+};
+
+struct PlanTerminatedRecord {
+  // -1 if there was no plan to terminate
+  int32_t plan_number;
+  int32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable<LogHeader>::value &&
+                  std::is_trivially_copyable<StatusRecord>::value &&
+                  std::is_trivially_copyable<CommandRecord>::value &&
+                  std::is_trivially_copyable<PlanRecord>::value,
+              "log records are written with memcpy");
+
+// Serializes plan into the payload of a kPlan record.
+std::vector<char> EncodePlan(const PlanBase &plan);
+
+// Rebuilds the trajectory of a kJointSpaceTrajectoryPlan record.
+// @return false if payload is malformed
+bool DecodeJointTrajectory(const std::vector<char> &payload,
+                           PlanRecord *record, PPType *trajectory);
+
+} // namespace plan_runner_log
+
+/**
+ * Writes a plan_runner_log file in the background.
+ *
+ * Records are copied into a ring buffer under a mutex that is only held for
+ * the memcpy, a writer thread moves them to the file. The writer only takes
+ * the mutex to read and to advance the bounds of the ring, the file is written
+ * straight from the ring without it. The control thread therefore never
+ * waits on disk I/O or on the writer. If the ring is full the record is
+ * dropped and a kGap record marks the hole.
+ */
+class PlanRunnerRecorder {
+public:
+  static constexpr size_t kRingCapacity = 8 << 20;
+
+  // @return nullptr if the file cannot be opened
+  static std::unique_ptr<PlanRunnerRecorder>
+  Open(const std::string &path, const plan_runner_log::LogHeader &header);
+
+  // writes out everything recorded so far
+  ~PlanRunnerRecorder();
+
+  PlanRunnerRecorder(const PlanRunnerRecorder &) = delete;
+  PlanRunnerRecorder &operator=(const PlanRunnerRecorder &) = delete;
+
+  // control thread
+  void RecordStatus(const RobotStatusSnapshot &status);
+  void RecordCommand(const RobotCommandSnapshot &command, int plan_number);
+  void RecordPlanSwap(int plan_number, bool same_tick);
+  void RecordPlanTerminated(int plan_number);
+
+  // Any thread. payload is plan_runner_log::EncodePlan of the plan, which
+  // allocates, so it is made before taking any lock the control thread
+  // needs. plan_number is written into it, the plan may only get its number
+  // afterwards.
+  void RecordPlan(int plan_number, std::vector<char> *payload);
+
+  uint64_t num_dropped() const { return num_dropped_.load(); }
+
+private:
+  explicit PlanRunnerRecorder(FILE *file);
+
+  void Append(plan_runner_log::RecordType type, const void *payload,
+              uint32_t size);
+  // caller holds mutex_
+  bool AppendLocked(plan_runner_log::RecordType type, const void *payload,
+                    uint32_t size);
+  void CopyIntoRingLocked(const void *data, size_t size);
+  // worker method of writer_
+  void WriteLoop();
+  // Moves everything in the ring to the file. Writer thread only.
+  void WriteOut();
+
+  FILE *const file_;
+  std::mutex mutex_;
+  // Bytes [head_, head_ + size_) of the ring, wrapping around, are waiting to
+  // be written. Appends only write past them, only the writer advances
+  // head_. Both guarded by mutex_, the bytes are not.
+  std::unique_ptr<char[]> ring_;
+  size_t head_;
+  size_t size_;
+  bool has_gap_;
+  std::atomic<uint64_t> num_dropped_;
+  // writer thread only
+  std::mutex writer_mutex_;
+  std::condition_variable writer_cv_;
+  bool is_stopping_;
+  std::thread writer_;
+};
+
+/**
+ * Sequential reader of a plan_runner_log file.
+ */
+class PlanRunnerLogReader {
+public:
+  // @return nullptr if the file cannot be opened or has no valid header
+  static std::unique_ptr<PlanRunnerLogReader> Open(const std::string &path);
+  ~PlanRunnerLogReader();
+
+  const plan_runner_log::LogHeader &header() const { return header_; }
+
+  // Reads the next record. A truncated last record counts as end of file.
+  // @return false at the end of the file
+  bool Next(plan_runner_log::RecordHeader *record_header,
+            std::vector<char> *payload);
+
+private:
+  explicit PlanRunnerLogReader(FILE *file) : file_(file) {}
+
+  FILE *const file_;
+  plan_runner_log::LogHeader header_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
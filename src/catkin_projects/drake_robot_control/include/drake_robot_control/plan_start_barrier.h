@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Starts plans on several arms at the same time.
+ *
+ * Every arm's control thread calls Arrive once, on the first tick its plan
+ * would start in, and holds position until start_time_ns() is set and
+ * reached. The start time is start_delay_ns after the last arm arrived, on
+ * the MonotonicTimeNs clock shared by all control threads of the process.
+ * Since the arms tick out of phase, each one then starts its plan time at
+ * the common start time rather than at its own first tick.
+ *
+ * If one of the plans is stopped before the start, or an arm does not arrive
+ * within timeout_ns of the first one, the barrier is cancelled and the other
+ * plans are expected to stop too.
+ *
+ * Lock-free, every method may be called from any thread.
+ */
+class PlanStartBarrier {
+public:
+  PlanStartBarrier(int num_arms, int64_t start_delay_ns, int64_t timeout_ns)
+      : start_delay_ns_(start_delay_ns), timeout_ns_(timeout_ns),
+        num_remaining_(num_arms), first_arrival_ns_(-1),
+        last_arrival_ns_(-1), start_time_ns_(-1), is_cancelled_(false) {}
+
+  PlanStartBarrier(const PlanStartBarrier &) = delete;
+  PlanStartBarrier &operator=(const PlanStartBarrier &) = delete;
+
+  // Once per arm.
+  void Arrive(int64_t now_ns) {
+    int64_t expected = -1;
+    first_arrival_ns_.compare_exchange_strong(expected, now_ns);
+    int64_t last = last_arrival_ns_.load();
+    while (last < now_ns &&
+           !last_arrival_ns_.compare_exchange_weak(last, now_ns)) {
+    }
+    if (num_remaining_.fetch_sub(1) == 1) {
+      start_time_ns_.store(last_arrival_ns_.load() + start_delay_ns_);
+    }
+  }
+
+  // -1 until every arm has arrived
+  int64_t start_time_ns() const { return start_time_ns_.load(); }
+
+  void Cancel() { is_cancelled_.store(true); }
+
+  // Cancels the barrier if it has waited for the remaining arms for longer
+  // than timeout_ns.
+  bool is_cancelled(int64_t now_ns) {
+    const int64_t first_arrival = first_arrival_ns_.load();
+    if (start_time_ns() < 0 && first_arrival >= 0 &&
+        now_ns - first_arrival > timeout_ns_) {
+      Cancel();
+    }
+    return is_cancelled_.load();
+  }
+
+private:
+  const int64_t start_delay_ns_;
+  const int64_t timeout_ns_;
+  std::atomic<int> num_remaining_;
+  std::atomic<int64_t> first_arrival_ns_;
+  std::atomic<int64_t> last_arrival_ns_;
+  std::atomic<int64_t> start_time_ns_;
+  std::atomic<bool> is_cancelled_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
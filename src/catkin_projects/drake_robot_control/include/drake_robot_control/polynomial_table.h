@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include <drake/common/trajectories/piecewise_polynomial.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * The coefficients of a column vector PiecewisePolynomial copied into one
+ * table, so the trajectory and its first derivative can be evaluated on the
+ * control thread.
+ *
+ * PiecewisePolynomial::value returns a new matrix and evaluates every element
+ * through its monomial list, so each call allocates. Evaluate() finds the
+ * segment by binary search over the breaks and runs Horner's scheme on the
+ * table, writing into vectors the caller has already sized. It never
+ * allocates.
+ */
+class PolynomialTable {
+public:
+  PolynomialTable() : num_rows_(0), num_coefficients_(0) {}
+  explicit PolynomialTable(
+      const trajectories::PiecewisePolynomial<double> &traj);
+
+  /**
+   * Writes traj(t) into q and its time derivative into qdot. Both must have
+   * num_rows() rows. Like PiecewisePolynomial::value, t is clamped to the time
+   * span of the trajectory.
+   */
+  void Evaluate(double t, Eigen::Ref<Eigen::VectorXd> q,
+                Eigen::Ref<Eigen::VectorXd> qdot) const;
+
+  int num_rows() const { return num_rows_; }
+  int num_segments() const {
+    return breaks_.empty() ? 0 : static_cast<int>(breaks_.size()) - 1;
+  }
+
+private:
+  int num_rows_;
+  // highest degree of all segments + 1, lower degrees are zero padded
+  int num_coefficients_;
+  std::vector<double> breaks_;
+  // coefficient k of row r in segment s, of (t - breaks_[s])^k, at
+  // (s * num_rows_ + r) * num_coefficients_ + k
+  std::vector<double> coefficients_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+// Scheduling settings for a single plan runner thread.
+struct RealtimeThreadConfig {
+  // SCHED_FIFO priority in [1, 99], 0 keeps the default SCHED_OTHER policy.
+  int priority = 0;
+  // CPUs the thread is pinned to, empty leaves the affinity untouched.
+  std::vector<int> cpus;
+};
+
+/**
+ * Real-time mode of the plan runner, loaded from the optional "realtime"
+ * block of the plan runner config, e.g.
+ *
+ *   realtime:
+ *     enabled: true
+ *     lock_memory: true
+ *     prefault_stack_kb: 512
+ *     threads:
+ *       control: {priority: 80, cpus: [3]}
+ */
+struct RealtimeConfig {
+  bool enabled = false;
+  bool lock_memory = true;
+  size_t prefault_stack_bytes = 512 * 1024;
+  // the thread running the status/plan event loop and the control tick
+  RealtimeThreadConfig control_thread;
+
+  // Returns a disabled config if node is not defined.
+  static RealtimeConfig FromYaml(const YAML::Node &node);
+};
+
+/**
+ * Checks RLIMIT_MEMLOCK and locks all current and future pages of the
+ * process into RAM. Also stops glibc from trimming or mmap'ing the heap so
+ * that memory freed on the control path is not handed back to the kernel.
+ * @return false, after printing a warning, if the memory could not be locked
+ */
+bool LockProcessMemory();
+
+/**
+ * Applies config to the calling thread and prefaults prefault_stack_bytes of
+ * its stack. Failures to get RT privileges are reported as a warning and the
+ * thread keeps running with default scheduling.
+ * @return true if every requested setting was applied
+ */
+bool ConfigureCurrentThreadRealtime(const std::string &thread_name,
+                                    const RealtimeThreadConfig &config,
+                                    size_t prefault_stack_bytes);
+
+// Touches the next num_bytes of the calling thread's stack so that those
+// pages are resident before the thread enters its loop.
+void PrefaultStack(size_t num_bytes);
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Single-writer, multi-reader sequence lock around a trivially copyable value.
+ *
+ * The writer never blocks: Store() bumps the sequence number to an odd value,
+ * copies the payload and bumps it back to even. Readers copy the payload and
+ * retry only if a write overlapped the copy, so a reader can never stall the
+ * writer, and vice versa a slow reader never holds anything the writer needs.
+ *
+ * Only one thread may call Store(). Any number of threads may call Load().
+ */
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock payload must be trivially copyable");
+
+public:
+  SeqLock() : sequence_(0) { std::memset(&value_, 0, sizeof(T)); }
+
+  void Store(const T &value) {
+    const uint64_t seq = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&value_, &value, sizeof(T));
+    sequence_.store(seq + 2, std::memory_order_release);
+  }
+
+  /**
+   * Copies the most recently stored value into value.
+   * @return the number of Store() calls the copy reflects, 0 if nothing has
+   * been stored yet.
+   */
+  uint64_t Load(T *value) const {
+    while (true) {
+      const uint64_t seq_before = sequence_.load(std::memory_order_acquire);
+      if (seq_before & 1) {
+        continue; // write in progress
+      }
+      std::memcpy(value, &value_, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t seq_after = sequence_.load(std::memory_order_relaxed);
+      if (seq_before == seq_after) {
+        return seq_before / 2;
+      }
+    }
+  }
+
+  /**
+   * Like Load(), but gives up after max_attempts copies overlapped by a
+   * write, so a writer that died in the middle of Store() (e.g. another
+   * process writing to shared memory) cannot stall the reader.
+   * @return false if no consistent copy was made, value is unspecified then
+   */
+  bool TryLoad(T *value, uint64_t *sequence, int max_attempts) const {
+    for (int i = 0; i < max_attempts; i++) {
+      const uint64_t seq_before = sequence_.load(std::memory_order_acquire);
+      if (seq_before & 1) {
+        continue;
+      }
+      std::memcpy(value, &value_, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_before == sequence_.load(std::memory_order_relaxed)) {
+        *sequence = seq_before / 2;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // number of completed Store() calls
+  uint64_t sequence() const {
+    return sequence_.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  // keep the sequence counter and the payload on separate cache lines so
+  // polling the counter does not bounce the payload line between cores.
+  alignas(64) std::atomic<uint64_t> sequence_;
+  alignas(64) T value_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <yaml-cpp/yaml.h>
+
+#include <drake_robot_control/control_types.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+struct SetpointJitterBufferOptions {
+  // How far behind the newest setpoints the buffer plays out. Clients sending
+  // points that are already in the future by at least one message period can
+  // leave this at 0, clients sending points stamped "now" need about one
+  // message period plus the jitter of its delivery.
+  double playout_delay_s = 0.;
+  // points kept, enough for a few messages of future points
+  int capacity = 64;
+
+  // Returns the defaults if node is not defined.
+  static SetpointJitterBufferOptions FromYaml(const YAML::Node &node);
+};
+
+/**
+ * Short ring of timestamped joint setpoints, played out with a fixed delay.
+ *
+ * Sample(now) linearly interpolates position, velocity and torque between
+ * the two points around now - playout_delay, so the commanded setpoint moves
+ * smoothly even if setpoints arrive in bursts and irregularly. Before the
+ * first point Sample returns the first point, after the last point it holds
+ * the last one, it never extrapolates.
+ *
+ * A point inserted at time t replaces the points at t and later, so a client
+ * sending several future points per message revises its earlier ones.
+ *
+ * Preallocated at construction, Insert and Sample do not allocate. Not thread
+ * safe.
+ */
+class SetpointJitterBuffer {
+public:
+  SetpointJitterBuffer(int num_joints,
+                       const SetpointJitterBufferOptions &options);
+
+  void Insert(int64_t time_ns, const Eigen::Ref<const Eigen::VectorXd> &q,
+              const Eigen::Ref<const Eigen::VectorXd> &v,
+              const Eigen::Ref<const Eigen::VectorXd> &tau);
+
+  // Drops the points that are no longer needed for now_ns.
+  // @return false if the buffer is empty, the outputs are unchanged then
+  bool Sample(int64_t now_ns, Eigen::VectorXd *const q,
+              Eigen::VectorXd *const v, Eigen::VectorXd *const tau);
+
+  bool empty() const { return size_ == 0; }
+  int size() const { return size_; }
+  int64_t playout_delay_ns() const { return playout_delay_ns_; }
+
+private:
+  struct Point {
+    int64_t time_ns;
+    double q[kMaxNumJoints];
+    double v[kMaxNumJoints];
+    double tau[kMaxNumJoints];
+  };
+
+  // i-th oldest point
+  Point &at(int i) { return points_[(begin_ + i) % points_.size()]; }
+
+  const int num_joints_;
+  const int64_t playout_delay_ns_;
+  std::vector<Point> points_;
+  int begin_;
+  int size_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <drake_robot_control/control_types.h>
+#include <drake_robot_control/seqlock.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+// Joint space streaming setpoint, the shared memory counterpart of
+// sensor_msgs/JointState on joint_space_streaming_setpoint.
+struct SharedJointSpaceSetpoint {
+  // MonotonicTimeNs() time the setpoint is for, the clock is shared by all
+  // processes of the host. 0 means when it is read.
+  int64_t stamp_ns;
+  // must equal the number of positions of the tree
+  int num_joints;
+  // in the position order of the tree, there are no joint names
+  double position[kMaxNumJoints];
+  double velocity[kMaxNumJoints];
+  double effort[kMaxNumJoints];
+};
+
+// Task space streaming setpoint, the shared memory counterpart of
+// robot_msgs/CartesianGoalPoint on task_space_streaming_setpoint.
+struct SharedTaskSpaceSetpoint {
+  static constexpr int kMaxFrameNameLength = 64;
+
+  int64_t stamp_ns;
+  // null terminated names of tree frames
+  char frame_id[kMaxFrameNameLength];    // xyz, xyz_d and quaternion are in it
+  char ee_frame_id[kMaxFrameNameLength]; // frame aligned to the goal
+  double xyz[3];
+  double xyz_d[3];
+  double quaternion[4]; // w, x, y, z
+  double kp_rotation[3];
+  double kp_translation[3];
+};
+
+/**
+ * Streaming setpoints in POSIX shared memory, for clients on the same host
+ * that publish faster than ROS delivers (teleop, learned policies).
+ *
+ * The segment holds one SeqLock slot per setpoint type. A client overwrites
+ * the slot, and the streaming plan polls it in Step, so a setpoint costs a
+ * copy of a few hundred bytes instead of serialization, TCPROS and a spinner
+ * thread. Neither side ever blocks the other. Only the latest setpoint is
+ * kept, like the ROS topics with queue size 1, which remain available.
+ *
+ * The plan runner creates the segment, clients open it. Only one client may
+ * write each slot at a time.
+ */
+class SharedSetpointChannel {
+public:
+  // Plan runner side. Creates the segment, or resets it if it exists. It is
+  // only accessible to this user (0600), or also to group (0660) if given.
+  // @return nullptr if it cannot be created or exists but belongs to
+  // another user, errno tells why
+  static std::unique_ptr<SharedSetpointChannel>
+  Create(const std::string &name, const std::string &group = "");
+
+  // Client side. Opens a segment created by the plan runner.
+  // @return nullptr if there is none or it has a different layout
+  static std::unique_ptr<SharedSetpointChannel> Open(const std::string &name);
+
+  // Unmaps the segment, the creator also removes its name.
+  ~SharedSetpointChannel();
+
+  SharedSetpointChannel(const SharedSetpointChannel &) = delete;
+  SharedSetpointChannel &operator=(const SharedSetpointChannel &) = delete;
+
+  const std::string &name() const { return name_; }
+
+  // Client side.
+  void Write(const SharedJointSpaceSetpoint &setpoint) {
+    segment_->joint_space.Store(setpoint);
+  }
+  void Write(const SharedTaskSpaceSetpoint &setpoint) {
+    segment_->task_space.Store(setpoint);
+  }
+
+  // Plan side, never blocks and does not allocate. sequence is the number of
+  // setpoints written so far, it only grows while the segment exists.
+  // @return false if nothing has been written or a write kept overlapping
+  bool Read(SharedJointSpaceSetpoint *setpoint, uint64_t *sequence) const {
+    return segment_->joint_space.TryLoad(setpoint, sequence,
+                                         kMaxReadAttempts) &&
+           *sequence > 0;
+  }
+  bool Read(SharedTaskSpaceSetpoint *setpoint, uint64_t *sequence) const {
+    return segment_->task_space.TryLoad(setpoint, sequence,
+                                        kMaxReadAttempts) &&
+           *sequence > 0;
+  }
+
+  // setpoints written so far, plans ignore those before they started
+  uint64_t joint_space_sequence() const {
+    return segment_->joint_space.sequence();
+  }
+  uint64_t task_space_sequence() const {
+    return segment_->task_space.sequence();
+  }
+
+private:
+  static constexpr uint32_t kMagic = 0x53505431; // "SPT1"
+  static constexpr int kMaxReadAttempts = 4;
+
+  struct Segment {
+    // set last by Create, Open refuses segments without it
+    std::atomic<uint32_t> magic;
+    uint32_t size; // sizeof(Segment) of the creator
+    SeqLock<SharedJointSpaceSetpoint> joint_space;
+    SeqLock<SharedTaskSpaceSetpoint> task_space;
+  };
+
+  SharedSetpointChannel(std::string name, Segment *segment, bool is_owner)
+      : name_(std::move(name)), segment_(segment), is_owner_(is_owner) {}
+
+  const std::string name_;
+  Segment *const segment_;
+  const bool is_owner_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
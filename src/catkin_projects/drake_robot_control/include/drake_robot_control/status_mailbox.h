@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include <drake_robot_control/control_types.h>
+#include <drake_robot_control/seqlock.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+// Monotonic clock timestamp in nanoseconds.
+inline int64_t MonotonicTimeNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Fixed-size copy of the fields of lcmt_iiwa_status the plan runner uses,
+// decoded into it by IiwaStatusDecoder. Cache line aligned like the SeqLock
+// slot it is copied to, so a copy touches no more lines than it has to.
+struct alignas(64) RobotStatusSnapshot {
+  int64_t utime;
+  // monotonic time at which HandleStatus received the message
+  int64_t receive_time_ns;
+  int num_joints;
+  double joint_position_measured[kMaxNumJoints];
+  double joint_velocity_estimated[kMaxNumJoints];
+  double joint_position_commanded[kMaxNumJoints];
+  double joint_torque_commanded[kMaxNumJoints];
+  double joint_torque_external[kMaxNumJoints];
+};
+
+// Last command the control thread actually sent to the robot.
+struct RobotCommandSnapshot {
+  int64_t utime;
+  int num_joints;
+  double joint_position[kMaxNumJoints];
+  double joint_torque[kMaxNumJoints];
+};
+
+/**
+ * Latest robot status, written by the control thread for every status
+ * message and readable from any other thread (ROS callbacks) without a lock.
+ * Post() never blocks, so a slow reader cannot delay the control tick.
+ */
+class StatusMailbox {
+public:
+  // Writer side, called from the control thread only.
+  void Post(const RobotStatusSnapshot &status) { status_.Store(status); }
+
+  // @return false if no status has been posted yet
+  bool Latest(RobotStatusSnapshot *status) const {
+    return status_.Load(status) > 0;
+  }
+
+  bool has_status() const { return status_.sequence() > 0; }
+
+private:
+  SeqLock<RobotStatusSnapshot> status_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Dense>
+#include <yaml-cpp/yaml.h>
+
+#include <drake_robot_control/control_types.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * Solves the box constrained QP
+ *
+ *   min 1/2 x^T P x + c^T x   s.t.  lower <= x <= upper
+ *
+ * with P positive definite and at most kMaxNumJoints variables, by ADMM on
+ * the splitting x = z. The iterate z stays feasible, so a solve stopped at
+ * max_iterations still returns a point inside the box. z and the dual of the
+ * last solve are the warm start of the next one, which is what keeps the
+ * iteration count low when successive QPs are close, as from one control tick
+ * to the next.
+ *
+ * Does not allocate, fit for the control thread.
+ */
+class BoxQpSolver {
+public:
+  struct Options {
+    // worst case cost of a solve, one 7x7 back substitution per iteration
+    int max_iterations = 50;
+    // ADMM penalty relative to the mean diagonal of P
+    double rho_scale = 0.1;
+    // over-relaxation, in (0, 2)
+    double relaxation = 1.6;
+    // on the max norm of the primal and dual residuals
+    double tolerance = 1e-7;
+  };
+
+  BoxQpSolver() = default;
+  explicit BoxQpSolver(const Options &options) : options_(options) {}
+
+  // @return the number of ADMM iterations, 0 if the unconstrained minimum is
+  // inside the box
+  int Solve(const JointMatrix &P, const JointVector &c,
+            const JointVector &lower, const JointVector &upper,
+            JointVector *const x);
+
+  // Forgets the warm start.
+  void Reset() { z_.resize(0); }
+
+  // whether the last solve met the tolerance
+  bool converged() const { return converged_; }
+
+private:
+  Options options_;
+  bool converged_ = false;
+  JointMatrix M_;
+  Eigen::LLT<JointMatrix> llt_;
+  JointVector x_;
+  JointVector z_;
+  JointVector z_prev_;
+  // scaled dual
+  JointVector u_;
+};
+
+/**
+ * Settings of the QP task space controller, from the "qp" block of
+ * "task_space_plan" in the plan runner config. The joint position limits are
+ * the runner's joint_limits.
+ */
+struct TaskSpaceQpOptions {
+  // weight of the commanded twist, [rotation; translation]
+  Eigen::Matrix<double, 6, 1> twist_weights =
+      Eigen::Matrix<double, 6, 1>::Ones();
+  // weight of the secondary objective q_dot = kp_posture * (q_nominal - q)
+  double posture_weight = 1e-3;
+  double kp_posture = 1.;
+  // q_nominal in degrees, one per joint. Empty means the configuration the
+  // plan starts at.
+  std::vector<double> nominal_posture_deg;
+  // kept small, keeps P well conditioned at singularities
+  double velocity_regularization = 1e-4;
+  // fraction of joint_speed_limit_degree_per_sec the plan commands at most.
+  // Below 1 so the runner's per tick dq check never fires.
+  double velocity_limit_fraction = 0.9;
+  double max_joint_acceleration_deg = 600.;
+  BoxQpSolver::Options solver;
+
+  // Returns the defaults if node is not defined.
+  static TaskSpaceQpOptions FromYaml(const YAML::Node &node);
+};
+
+/**
+ * Joint velocity command of the task space plans as the QP
+ *
+ *   min |twist - J q_dot|^2_W + w_p |q_dot - kp_p (q_nominal - q)|^2
+ *       + eps |q_dot|^2
+ *   s.t. joint position limits reached in no less than one control period,
+ *        |q_dot| <= velocity limit,
+ *        |q_dot - q_dot_prev| <= acceleration limit * control period.
+ *
+ * When the bounds contradict each other, as when the arm moves fast towards a
+ * position limit, the acceleration bound gives way.
+ */
+class TaskSpaceQp {
+public:
+  TaskSpaceQp(const TaskSpaceQpOptions &options,
+              const Eigen::VectorXd &joint_limits_min,
+              const Eigen::VectorXd &joint_limits_max,
+              double joint_velocity_limit, double control_period);
+
+  void set_nominal_posture(const Eigen::Ref<const Eigen::VectorXd> &q) {
+    q_nominal_ = q;
+  }
+  bool has_nominal_posture() const { return q_nominal_.size() > 0; }
+
+  /**
+   * @param q current joint position (the last command)
+   * @param q_dot_prev joint velocity commanded in the previous tick
+   * @param J geometric Jacobian, expressed in the frame of twist
+   * @param q_dot resized to the number of joints
+   * @return ADMM iterations, see BoxQpSolver::Solve
+   */
+  int Solve(const Eigen::Ref<const Eigen::VectorXd> &q,
+            const JointVector &q_dot_prev, const JacobianMatrix &J,
+            const Eigen::Matrix<double, 6, 1> &twist, JointVector *const q_dot);
+
+  // Forgets the warm start, e.g. when a new plan starts.
+  void Reset() { solver_.Reset(); }
+
+  bool converged() const { return solver_.converged(); }
+
+private:
+  const TaskSpaceQpOptions options_;
+  const JointVector joint_limits_min_;
+  const JointVector joint_limits_max_;
+  const double max_velocity_;
+  const double max_velocity_change_;
+  const double control_period_;
+  JointVector q_nominal_;
+
+  BoxQpSolver solver_;
+  JointMatrix P_;
+  JointVector c_;
+  JointVector lower_;
+  JointVector upper_;
+  JacobianMatrix WJ_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <drake_robot_control/task_space_qp.h>
+#include <drake_robot_control/task_space_trajectory_plan.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+// EndEffectorOriginTrajectoryPlan that computes the joint velocity command
+// with TaskSpaceQp instead of a differential IK solve: joint position,
+// velocity and acceleration limits are constraints of the QP, and the
+// redundancy goes towards a nominal posture. The commands therefore stay
+// inside the runner's joint limits and per tick dq check, which the least
+// squares solvers can violate near singularities and joint limits.
+class EndEffectorOriginQpTrajectoryPlan
+    : public EndEffectorOriginTrajectoryPlan {
+public:
+  EndEffectorOriginQpTrajectoryPlan(
+      std::shared_ptr<const RigidBodyTreed> tree, const PPType &xyz_ee_traj,
+      const drake::math::RotationMatrixd &R_WE_initial,
+      const drake::math::RotationMatrixd &R_WE_final,
+      const Eigen::Vector3d &kp_rotation,
+      const Eigen::Vector3d &kp_translation, const std::string &ee_body_name,
+      const TaskSpaceQpOptions &qp_options,
+      const Eigen::VectorXd &joint_limits_min,
+      const Eigen::VectorXd &joint_limits_max, double joint_velocity_limit,
+      double control_period_s = 0.005, double force_threshold = 20);
+
+  const char *get_plan_type() const override {
+    return "EndEffectorOriginQpTrajectoryPlan";
+  }
+
+  // ticks in which the QP solve hit max_iterations
+  int num_unconverged_solves() const { return num_unconverged_solves_; }
+
+protected:
+  void ComputeJointVelocityCommand(
+      const Eigen::Ref<const Eigen::VectorXd> &q, const JacobianMatrix &J_ee_E,
+      const Eigen::Matrix<double, 6, 1> &T_WE_E_cmd,
+      JointVector *const q_dot) override;
+
+private:
+  TaskSpaceQp qp_;
+  // q_dot commanded in the previous tick, for the acceleration limit. The
+  // plan starts from rest.
+  JointVector q_dot_prev_;
+  int num_unconverged_solves_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
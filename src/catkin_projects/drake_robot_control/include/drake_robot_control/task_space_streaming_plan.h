@@ -5,6 +5,9 @@
 
 #include <drake/math/roll_pitch_yaw.h>
 #include <drake/math/rigid_transform.h>
+#include <drake_robot_control/differential_ik.h>
+#include <drake_robot_control/kinematics_cache_pool.h>
+#include <drake_robot_control/shared_setpoint_channel.h>
 #include <drake_robot_control/trajectory_plan_base.h>
 
 // ROS
@@ -17,10 +20,13 @@ public:
   TaskSpaceStreamingPlan(std::shared_ptr<const RigidBodyTreed> tree,
                          ros::NodeHandle &nh)
       : PlanBase(std::move(tree)),
-        have_goal_(false) {
+        have_goal_(false), has_measured_state_(false),
+        cache_(KinematicsCachePool::Get(tree_)->Acquire()),
+        cache_measured_state_(KinematicsCachePool::Get(tree_)->Acquire()),
+        ik_solver_(MakeDifferentialIkSolver(DifferentialIkOptions())) {
     setpoint_subscriber_ = std::make_shared<ros::Subscriber>(
       nh.subscribe(
-        "/plan_runner/task_space_streaming_setpoint", 1,
+        "task_space_streaming_setpoint", 1,
         &TaskSpaceStreamingPlan::HandleSetpoint, this));
   }
 
@@ -28,13 +34,46 @@ public:
   // Current time t
   void Step(const Eigen::Ref<const Eigen::VectorXd> &x,
             const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
+            TickKinematics *const kinematics,
             Eigen::VectorXd *const q_commanded,
             Eigen::VectorXd *const v_commanded,
             Eigen::VectorXd *const tau_commanded) override;
 
+  const char *get_plan_type() const override {
+    return "TaskSpaceStreamingPlan";
+  }
+
   void HandleSetpoint(const robot_msgs::CartesianGoalPoint::ConstPtr& msg);
 
+  // Replaces the default svd solver. Not while the plan is running.
+  void set_ik_solver(std::unique_ptr<DifferentialIkSolver> ik_solver) {
+    ik_solver_ = std::move(ik_solver);
+  }
+
+  // Step also takes setpoints from channel, in addition to the ROS topic.
+  // Setpoints written before this call are ignored. Before the plan starts.
+  void set_shared_setpoints(
+      std::shared_ptr<const SharedSetpointChannel> channel) {
+    shared_setpoints_ = std::move(channel);
+    shared_setpoint_sequence_ =
+        shared_setpoints_ ? shared_setpoints_->task_space_sequence() : 0;
+  }
+
  private:
+    // Sets the goal from a setpoint expressed in frame body_index_ee_goal,
+    // whose pose in world at the measured state is H_W_goal. Needs
+    // goal_mutex_.
+    void SetGoal(const Eigen::Isometry3d &H_W_goal, int body_index_ee_goal,
+                 int body_index_ee_frame, const Eigen::Vector3d &xyz_ee_goal,
+                 const Eigen::Vector3d &xyz_d_ee_goal,
+                 const Eigen::Quaterniond &quat_ee_goal,
+                 const Eigen::Vector3d &kp_rotation,
+                 const Eigen::Vector3d &kp_translation);
+
+    // Makes a new setpoint of shared_setpoints_ the goal, kinematics is at
+    // the measured state. Needs goal_mutex_.
+    void ReadSharedSetpoint(TickKinematics *const kinematics);
+
     std::mutex goal_mutex_;
     Eigen::Vector3d xyz_ee_goal_;
     Eigen::Vector3d xyz_d_ee_goal_;
@@ -45,11 +84,22 @@ public:
     // aligned to the above pose:
     int body_index_ee_frame_;
     bool have_goal_;
+    // measured state of the last Step, HandleSetpoint expresses goals in the
+    // world frame at this posture. Guarded by goal_mutex_.
+    Eigen::VectorXd q_measured_;
+    Eigen::VectorXd v_measured_;
+    bool has_measured_state_;
+    // kinematics of the commanded state, control thread only
+    KinematicsCachePool::Lease cache_;
+    // setpoint thread only
+    KinematicsCachePool::Lease cache_measured_state_;
 
     std::shared_ptr<ros::Subscriber> setpoint_subscriber_;
 
-    drake::TwistMatrix<double> J_ee_E_;
-    drake::TwistMatrix<double> J_ee_W_;
+    JacobianMatrix J_ee_E_;
+    // solves J_ee_E_ * q_dot_cmd_ = T_WE_E_cmd
+    std::unique_ptr<DifferentialIkSolver> ik_solver_;
+    JointVector q_dot_cmd_;
     Eigen::Isometry3d H_WE_; // ee to world, current homogeneous transform
     math::RigidTransform<double>
       H_WEr_; // end-effector to world, reference homogeneous transform
@@ -58,6 +108,18 @@ public:
     Eigen::Vector3d kp_translation_;
 
     double last_control_update_t_ = 0.;
+
+    // control thread only
+    std::shared_ptr<const SharedSetpointChannel> shared_setpoints_;
+    uint64_t shared_setpoint_sequence_ = 0; // of the last one used
+    SharedTaskSpaceSetpoint shared_setpoint_;
+    // frame names of the last shared setpoint and their indices, looking
+    // them up in the tree allocates
+    char shared_frame_id_[SharedTaskSpaceSetpoint::kMaxFrameNameLength] = {};
+    char shared_ee_frame_id_[SharedTaskSpaceSetpoint::kMaxFrameNameLength] =
+        {};
+    int shared_body_index_ee_goal_ = 0;
+    int shared_body_index_ee_frame_ = 0;
 };
 
 } // namespace robot_plan_runner
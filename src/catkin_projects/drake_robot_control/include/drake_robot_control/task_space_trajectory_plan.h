@@ -3,6 +3,8 @@
 
 #include <drake/math/roll_pitch_yaw.h>
 #include <drake/math/rigid_transform.h>
+#include <drake_robot_control/differential_ik.h>
+#include <drake_robot_control/kinematics_cache_pool.h>
 #include <drake_robot_control/trajectory_plan_base.h>
 
 namespace drake {
@@ -14,13 +16,14 @@ namespace robot_plan_runner {
  *    instead of a fixed reference rotation matrix.
  *
  *  2. The robot looks precarious when commanded to move near singularities.
+ *  The damped_least_squares ik_solver helps with that.
  *
  *  3. When multiple dq's exist, the robot should choose one that is close to a
  * nominal pose. For example, we prefer the robot to move its "elbow" away,
  * not towards the table when it moves its ee in Cartesian space.
  *
  * A reliable Cartesian space controller therefore could be solving QP's instead
- * of least squares.
+ * of least squares, see EndEffectorOriginQpTrajectoryPlan.
  */
 
 // xyz_ee_traj \in R^3 is the reference trajectory in world frame which the
@@ -61,10 +64,13 @@ public:
         ee_body_name_(ee_body_name), control_period_s_(control_period_s),
         force_threshold_(force_threshold),
         quat_WE_initial_(R_WE_initial.matrix()),
-        quat_WE_final_(R_WE_final.matrix()) {
+        quat_WE_final_(R_WE_final.matrix()),
+        cache_(KinematicsCachePool::Get(tree_)->Acquire()),
+        ik_solver_(MakeDifferentialIkSolver(DifferentialIkOptions())) {
     DRAKE_ASSERT(xyz_ee_traj.rows() == 3);
     idx_ee_ = tree_->FindBodyIndex(ee_body_name_);
     idx_world_ = tree_->FindBodyIndex("world");
+    q_command_final_.setZero(get_num_positions());
     this->ComputeOrientationTrajectory();
   }
 
@@ -80,10 +86,20 @@ public:
   // and a feedback term: (see Twan's paper).
   void Step(const Eigen::Ref<const Eigen::VectorXd> &x,
             const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
+            TickKinematics *const kinematics,
             Eigen::VectorXd *const q_commanded,
             Eigen::VectorXd *const v_commanded,
             Eigen::VectorXd *const tau_commanded) override;
 
+  const char *get_plan_type() const override {
+    return "EndEffectorOriginTrajectoryPlan";
+  }
+
+  // Replaces the default svd solver. Not while the plan is running.
+  void set_ik_solver(std::unique_ptr<DifferentialIkSolver> ik_solver) {
+    ik_solver_ = std::move(ik_solver);
+  }
+
   /**
    * Computes the orientation trajectory and associated angular velocity vector
    * Writes to the appropriate local variables
@@ -114,9 +130,20 @@ public:
     ang_velocity_WEr_W_ = R_WE_inital_ * ang_velocity_WEr_Einit;
   }
 
+protected:
+  // Joint velocities that realize the commanded twist T_WE_E_cmd at q, the
+  // last commanded position. Uses ik_solver_.
+  virtual void ComputeJointVelocityCommand(
+      const Eigen::Ref<const Eigen::VectorXd> &q, const JacobianMatrix &J_ee_E,
+      const Eigen::Matrix<double, 6, 1> &T_WE_E_cmd, JointVector *const q_dot);
+
 private:
-  drake::TwistMatrix<double> J_ee_E_;
-  drake::TwistMatrix<double> J_ee_W_;
+  // kinematics of the commanded state
+  KinematicsCachePool::Lease cache_;
+  JacobianMatrix J_ee_E_;
+  // solves J_ee_E_ * q_dot_cmd_ = T_WE_E_cmd
+  std::unique_ptr<DifferentialIkSolver> ik_solver_;
+  JointVector q_dot_cmd_;
   Eigen::Isometry3d H_WE_; // ee to world, current homogeneous transform
   drake::math::RigidTransform<double>
       H_WEr_; // end-effector to world, reference homogeneous transform
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include <Eigen/Dense>
+
+#include <drake/multibody/rigid_body_tree.h>
+#include <drake_robot_control/control_types.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+/**
+ * tree.geometricJacobian(cache, base_body_or_frame_ind,
+ * end_effector_body_or_frame_ind, expressed_in_body_or_frame_ind) written
+ * into J, which keeps its storage inline. RigidBodyTree::geometricJacobian
+ * returns a heap allocated matrix and builds the kinematic path in vectors,
+ * this walks the parent pointers and allocates nothing.
+ *
+ * J has a column per velocity of the tree, the ones of joints off the path
+ * between base and end effector are zero. For a serial arm like the iiwa
+ * that is exactly the compact Jacobian geometricJacobian returns. cache must
+ * be up to date (doKinematics).
+ */
+void CalcGeometricJacobian(const RigidBodyTreed &tree,
+                           const KinematicsCache<double> &cache,
+                           int base_body_or_frame_ind,
+                           int end_effector_body_or_frame_ind,
+                           int expressed_in_body_or_frame_ind,
+                           JacobianMatrix *const J);
+
+/**
+ * Kinematics of the measured robot state for one control tick.
+ *
+ * RobotPlanRunner resets it with the measured state at the start of every
+ * tick and passes it to the plan's Step, which hands it on to the force
+ * guards. doKinematics only runs when something asks for it, and transforms
+ * and Jacobians are memoized until the next Reset. A tick therefore computes
+ * each of them at most once, however many plans and guards use them.
+ *
+ * Control thread only.
+ */
+class TickKinematics {
+public:
+  // Distinct transforms and Jacobians memoized per tick. Further requests are
+  // computed every time.
+  static constexpr int kMaxNumMemoized = 8;
+
+  explicit TickKinematics(std::shared_ptr<const RigidBodyTreed> tree);
+
+  TickKinematics(const TickKinematics &) = delete;
+  TickKinematics &operator=(const TickKinematics &) = delete;
+
+  // Starts a new tick at the measured state q, v. Computes nothing.
+  void Reset(const Eigen::Ref<const Eigen::VectorXd> &q,
+             const Eigen::Ref<const Eigen::VectorXd> &v);
+
+  const RigidBodyTreed &tree() const { return *tree_; }
+  const Eigen::VectorXd &q() const { return q_; }
+  const Eigen::VectorXd &v() const { return v_; }
+
+  // KinematicsCache of the measured state, doKinematics runs on the first
+  // call in a tick.
+  const KinematicsCache<double> &cache();
+
+  // tree().relativeTransform(cache(), base_or_frame_ind, body_or_frame_ind)
+  const Eigen::Isometry3d &RelativeTransform(int base_or_frame_ind,
+                                             int body_or_frame_ind);
+
+  // tree().geometricJacobian(cache(), base_body_or_frame_ind,
+  // end_effector_body_or_frame_ind, expressed_in_body_or_frame_ind), see
+  // CalcGeometricJacobian
+  const JacobianMatrix &GeometricJacobian(int base_body_or_frame_ind,
+                                          int end_effector_body_or_frame_ind,
+                                          int expressed_in_body_or_frame_ind);
+
+  // number of doKinematics calls so far
+  int64_t num_kinematics_updates() const { return num_kinematics_updates_; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  struct TransformEntry {
+    int base;
+    int body;
+    Eigen::Isometry3d value;
+  };
+  struct JacobianEntry {
+    int base;
+    int end_effector;
+    int expressed_in;
+    JacobianMatrix value;
+  };
+
+  std::shared_ptr<const RigidBodyTreed> tree_;
+  KinematicsCache<double> cache_;
+  bool is_cache_valid_;
+  int64_t num_kinematics_updates_;
+  Eigen::VectorXd q_;
+  Eigen::VectorXd v_;
+
+  std::array<TransformEntry, kMaxNumMemoized> transforms_;
+  int num_transforms_;
+  std::array<JacobianEntry, kMaxNumMemoized> jacobians_;
+  int num_jacobians_;
+  // results that did not fit into the memo
+  Eigen::Isometry3d overflow_transform_;
+  JacobianMatrix overflow_jacobian_;
+};
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -1,6 +1,7 @@
 #pragma once
 #include <drake/common/trajectories/piecewise_polynomial.h>
 #include <drake_robot_control/plan_base.h>
+#include <drake_robot_control/polynomial_table.h>
 
 namespace drake {
 namespace robot_plan_runner {
@@ -13,11 +14,13 @@ class TrajectoryPlanBase : public PlanBase {
 public:
   TrajectoryPlanBase(std::shared_ptr<const RigidBodyTreed> tree,
                      const PPType &q_traj)
-      : PlanBase(std::move(tree)), traj_(q_traj) {
+      : PlanBase(std::move(tree)), traj_(q_traj), traj_table_(q_traj) {
     DRAKE_ASSERT(q_traj.cols() == 1);
     traj_d_ = traj_.derivative(1);
   }
 
+  const PPType &get_trajectory() const { return traj_; }
+
   double duration() const {
     if (traj_.get_number_of_segments() > 0) {
       return traj_.end_time() - traj_.start_time();
@@ -29,6 +32,8 @@ public:
 protected:
   PPType traj_;
   PPType traj_d_; // 1st order derivative of traj_
+  // traj_ and traj_d_ for Step, which must not call PPType::value
+  PolynomialTable traj_table_;
 };
 
 } // namespace robot_plan_runner
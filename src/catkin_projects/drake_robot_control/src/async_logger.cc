@@ -0,0 +1,169 @@
+#include <drake_robot_control/async_logger.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <thread>
+
+#include <drake_robot_control/status_mailbox.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+namespace {
+
+// drain interval for messages below kWarn, which do not wake the thread
+const int kDrainPeriodMs = 50;
+
+const char *LevelTag(LogLevel level) {
+  switch (level) {
+  case LogLevel::kDebug:
+    return "[DEBUG] ";
+  case LogLevel::kInfo:
+    return "[INFO] ";
+  case LogLevel::kWarn:
+    return "[WARN] ";
+  case LogLevel::kError:
+    return "[ERROR] ";
+  }
+  return "";
+}
+
+} // namespace
+
+LogLevel LogLevelFromString(const std::string &level) {
+  if (level == "debug") {
+    return LogLevel::kDebug;
+  }
+  if (level == "warn") {
+    return LogLevel::kWarn;
+  }
+  if (level == "error") {
+    return LogLevel::kError;
+  }
+  return LogLevel::kInfo;
+}
+
+AsyncLogger &AsyncLogger::Get() {
+  // Never destroyed, so threads that are still logging during shutdown do not
+  // touch a dead object. Whatever is left in the ring is written out at exit.
+  // Static storage rather than new so the alignas members are honored.
+  alignas(AsyncLogger) static char storage[sizeof(AsyncLogger)];
+  static AsyncLogger *logger = []() {
+    AsyncLogger *logger = new (storage) AsyncLogger();
+    std::atexit([]() { AsyncLogger::Get().Flush(); });
+    return logger;
+  }();
+  return *logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : num_written_(0), num_dropped_(0),
+      min_level_(static_cast<int>(LogLevel::kInfo)) {
+  std::thread(&AsyncLogger::Drain, this).detach();
+}
+
+void AsyncLogger::Log(LogLevel level, uint64_t num_suppressed,
+                      const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  const bool is_queued = records_.TryPush([&](Record *record) {
+    record->level = level;
+    record->num_suppressed = num_suppressed;
+    const int length =
+        std::vsnprintf(record->text, kMaxMessageLength, format, args);
+    record->length =
+        length < 0 ? 0 : std::min<uint32_t>(length, kMaxMessageLength - 1);
+  });
+  va_end(args);
+  if (!is_queued) {
+    // ring is full
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Warnings and errors are written out right away, everything else is
+  // picked up by the periodic drain.
+  if (level >= LogLevel::kWarn) {
+    notifier_.Notify();
+  }
+}
+
+void AsyncLogger::Flush() {
+  const size_t target = records_.num_pushed();
+  while (num_written_.load(std::memory_order_acquire) < target) {
+    notifier_.Notify();
+    std::this_thread::yield();
+  }
+}
+
+size_t AsyncLogger::DrainOnce() {
+  size_t num_written = 0;
+  while (records_.TryPop([](const Record &record) {
+    std::fputs(LevelTag(record.level), stdout);
+    std::fwrite(record.text, 1, record.length, stdout);
+    if (record.num_suppressed > 0) {
+      std::fprintf(stdout, " (%llu similar messages suppressed)",
+                   static_cast<unsigned long long>(record.num_suppressed));
+    }
+    std::fputc('\n', stdout);
+  })) {
+    num_written++;
+  }
+
+  const uint64_t num_dropped = num_dropped_.exchange(0);
+  if (num_dropped > 0) {
+    std::fprintf(stdout, "[WARN] log ring full, dropped %llu messages\n",
+                 static_cast<unsigned long long>(num_dropped));
+  }
+  if (num_written > 0 || num_dropped > 0) {
+    std::fflush(stdout);
+  }
+  num_written_.fetch_add(num_written, std::memory_order_release);
+  return num_written;
+}
+
+void AsyncLogger::Drain() {
+  while (true) {
+    notifier_.Wait(kDrainPeriodMs);
+    DrainOnce();
+  }
+}
+
+bool LogRateLimiter::Allow(uint64_t *num_suppressed) {
+  const int64_t now_ns = MonotonicTimeNs();
+  int64_t next_allowed_ns = next_allowed_ns_.load(std::memory_order_relaxed);
+  if (now_ns < next_allowed_ns ||
+      !next_allowed_ns_.compare_exchange_strong(next_allowed_ns,
+                                                now_ns + period_ns_,
+                                                std::memory_order_relaxed)) {
+    num_suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  *num_suppressed = num_suppressed_.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+MatrixString::MatrixString(const Eigen::Ref<const Eigen::MatrixXd> &m) {
+  size_t offset = 0;
+  buffer_[0] = '\0';
+  for (int i = 0; i < m.rows(); i++) {
+    for (int j = 0; j < m.cols() && offset < sizeof(buffer_); j++) {
+      const int n = std::snprintf(buffer_ + offset, sizeof(buffer_) - offset,
+                                  j == 0 ? "%g" : " %g", m(i, j));
+      if (n < 0) {
+        return;
+      }
+      offset += n;
+    }
+    if (i + 1 < m.rows() && offset + 1 < sizeof(buffer_)) {
+      buffer_[offset++] = '\n';
+      buffer_[offset] = '\0';
+    }
+  }
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,100 @@
+#include <drake_robot_control/baked_trajectory.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+namespace drake {
+namespace robot_plan_runner {
+
+std::unique_ptr<BakedTrajectory> BakedTrajectory::Make(
+    const trajectories::PiecewisePolynomial<double> &q_traj,
+    const trajectories::PiecewisePolynomial<double> &qdot_traj,
+    double sample_period) {
+  const int num_joints = q_traj.rows();
+  if (num_joints > kRowSize || q_traj.cols() != 1 || sample_period <= 0) {
+    return nullptr;
+  }
+
+  const double start_time = q_traj.start_time();
+  const double end_time = q_traj.end_time();
+  const double duration = end_time - start_time;
+  int num_intervals = 1;
+  if (duration > 0) {
+    // the tolerance keeps a duration that is a multiple of sample_period
+    // from getting an extra interval through rounding
+    const double n = std::ceil(duration / sample_period - 1e-9);
+    if (n + 1 > kMaxNumSamples) {
+      return nullptr;
+    }
+    num_intervals = std::max(1, static_cast<int>(n));
+  }
+
+  std::unique_ptr<BakedTrajectory> baked(new BakedTrajectory(
+      num_joints, num_intervals + 1, start_time, end_time));
+  for (int k = 0; k < baked->num_samples_; k++) {
+    const double t = k == num_intervals
+                         ? end_time
+                         : start_time + k * baked->sample_period_;
+    Sample &sample = baked->samples_[k];
+    sample.q.setZero();
+    sample.v.setZero();
+    sample.q.head(num_joints) = q_traj.value(t);
+    sample.v.head(num_joints) = qdot_traj.value(t);
+  }
+  return baked;
+}
+
+BakedTrajectory::BakedTrajectory(int num_joints, int num_samples,
+                                 double start_time, double end_time)
+    : num_joints_(num_joints), num_samples_(num_samples),
+      start_time_(start_time), end_time_(end_time),
+      sample_period_(end_time > start_time
+                         ? (end_time - start_time) / (num_samples - 1)
+                         : 1.),
+      inverse_sample_period_(1. / sample_period_), samples_(nullptr) {
+  void *memory = nullptr;
+  if (posix_memalign(&memory, alignof(Sample), num_samples_ * sizeof(Sample)) !=
+      0) {
+    throw std::bad_alloc();
+  }
+  samples_ = static_cast<Sample *>(memory);
+  for (int k = 0; k < num_samples_; k++) {
+    new (&samples_[k]) Sample();
+  }
+}
+
+BakedTrajectory::~BakedTrajectory() { std::free(samples_); }
+
+void BakedTrajectory::Evaluate(double t, Eigen::VectorXd *const q,
+                               Eigen::VectorXd *const v) const {
+  t = std::min(std::max(t, start_time_), end_time_);
+  const double s = (t - start_time_) * inverse_sample_period_;
+  const int k = std::min(static_cast<int>(s), num_samples_ - 2);
+  const double u = s - k;
+  const Sample &a = samples_[k];
+  const Sample &b = samples_[k + 1];
+
+  // cubic Hermite basis functions and their derivatives with respect to u
+  const double u2 = u * u;
+  const double u3 = u2 * u;
+  const double h00 = 2 * u3 - 3 * u2 + 1;
+  const double h10 = u3 - 2 * u2 + u;
+  const double h01 = 3 * u2 - 2 * u3;
+  const double h11 = u3 - u2;
+  const double dh00 = 6 * u2 - 6 * u;
+  const double dh10 = 3 * u2 - 4 * u + 1;
+  const double dh11 = 3 * u2 - 2 * u;
+
+  // the tangents are scaled by the interval length, since u is normalized
+  const double h = sample_period_;
+  const double inv_h = inverse_sample_period_;
+  const Row q_row = h00 * a.q + (h10 * h) * a.v + h01 * b.q + (h11 * h) * b.v;
+  const Row v_row = (dh00 * inv_h) * (a.q - b.q) + dh10 * a.v + dh11 * b.v;
+  q->head(num_joints_) = q_row.head(num_joints_);
+  v->head(num_joints_) = v_row.head(num_joints_);
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,210 @@
+#include <drake_robot_control/batch_ik.h>
+
+#include <algorithm>
+#include <future>
+#include <random>
+
+#include <drake/common/drake_assert.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// Chunks per thread. Unreachable poses run to max_iterations, more chunks
+// than threads keep the threads busy until the end of the batch, longer
+// chunks warm start more poses from a neighbour.
+const int kChunksPerThread = 4;
+// Iterations stop when no joint moves by more than this, rad.
+const double kMinStep = 1e-10;
+
+} // namespace
+
+BatchIkOptions BatchIkOptions::FromYaml(const YAML::Node &node) {
+  BatchIkOptions options;
+  if (!node) {
+    return options;
+  }
+  if (node["threads"]) {
+    options.num_threads = node["threads"].as<int>();
+  }
+  if (node["max_iterations"]) {
+    options.max_iterations = node["max_iterations"].as<int>();
+  }
+  if (node["position_tolerance"]) {
+    options.position_tolerance = node["position_tolerance"].as<double>();
+  }
+  if (node["orientation_tolerance_deg"]) {
+    options.orientation_tolerance =
+        node["orientation_tolerance_deg"].as<double>() * M_PI / 180.;
+  }
+  if (node["damping"]) {
+    options.damping = node["damping"].as<double>();
+  }
+  if (node["max_step_deg"]) {
+    options.max_step = node["max_step_deg"].as<double>() * M_PI / 180.;
+  }
+  if (node["restarts"]) {
+    options.num_restarts = node["restarts"].as<int>();
+  }
+  return options;
+}
+
+BatchIkSolver::BatchIkSolver(std::shared_ptr<const RigidBodyTreed> tree,
+                             const BatchIkOptions &options,
+                             const Eigen::VectorXd &q_min,
+                             const Eigen::VectorXd &q_max)
+    : tree_(std::move(tree)), options_(options), q_min_(q_min),
+      q_max_(q_max), cache_pool_(KinematicsCachePool::Get(tree_)),
+      pool_(std::max(options.num_threads, 1)) {
+  DRAKE_DEMAND(tree_->get_num_positions() == tree_->get_num_velocities());
+  DRAKE_DEMAND(q_min_.size() == tree_->get_num_positions() &&
+               q_max_.size() == tree_->get_num_positions());
+  // one cache per thread, on top of what the plans lease
+  cache_pool_->Reserve(cache_pool_->num_caches() + pool_.num_threads());
+}
+
+void BatchIkSolver::Solve(
+    int ee_index,
+    const std::vector<Eigen::Isometry3d,
+                      Eigen::aligned_allocator<Eigen::Isometry3d>> &targets,
+    const Eigen::VectorXd &q_seed, bool warm_start_from_neighbours,
+    double position_tolerance, double orientation_tolerance,
+    std::vector<IkSolution> *const solutions) {
+  DRAKE_DEMAND(q_seed.size() == tree_->get_num_positions());
+  if (position_tolerance <= 0) {
+    position_tolerance = options_.position_tolerance;
+  }
+  if (orientation_tolerance <= 0) {
+    orientation_tolerance = options_.orientation_tolerance;
+  }
+  const int num_targets = targets.size();
+  solutions->assign(num_targets, IkSolution());
+  if (num_targets == 0) {
+    return;
+  }
+
+  const int num_chunks =
+      std::min(num_targets, pool_.num_threads() * kChunksPerThread);
+  std::vector<std::future<void>> chunks;
+  chunks.reserve(num_chunks);
+  for (int i = 0; i < num_chunks; i++) {
+    const int begin = static_cast<int64_t>(num_targets) * i / num_chunks;
+    const int end = static_cast<int64_t>(num_targets) * (i + 1) / num_chunks;
+    chunks.push_back(pool_.Submit([=, &targets, &q_seed]() {
+      KinematicsCachePool::Lease cache = cache_pool_->Acquire();
+      SolveChunk(&*cache, ee_index, targets.data(), begin, end, q_seed,
+                 warm_start_from_neighbours, position_tolerance,
+                 orientation_tolerance, solutions);
+    }));
+  }
+  // all of them, targets and q_seed must outlive the tasks
+  std::exception_ptr error;
+  for (std::future<void> &chunk : chunks) {
+    try {
+      chunk.get();
+    } catch (...) {
+      error = std::current_exception();
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void BatchIkSolver::SolveChunk(KinematicsCache<double> *cache, int ee_index,
+                               const Eigen::Isometry3d *targets, int begin,
+                               int end, const Eigen::VectorXd &q_seed,
+                               bool warm_start_from_neighbours,
+                               double position_tolerance,
+                               double orientation_tolerance,
+                               std::vector<IkSolution> *const solutions) const {
+  Eigen::VectorXd q_start(q_seed.size());
+  for (int i = begin; i < end; i++) {
+    IkSolution &solution = (*solutions)[i];
+    const bool has_neighbour = warm_start_from_neighbours && i > begin &&
+                               (*solutions)[i - 1].success;
+    SolveOne(cache, ee_index, targets[i],
+             has_neighbour ? (*solutions)[i - 1].q : q_seed,
+             position_tolerance, orientation_tolerance, &solution);
+    int num_iterations = solution.num_iterations;
+    if (has_neighbour && !solution.success) {
+      // the neighbour may be on another branch of the solutions
+      SolveOne(cache, ee_index, targets[i], q_seed, position_tolerance,
+               orientation_tolerance, &solution);
+      num_iterations += solution.num_iterations;
+    }
+    // same restarts whichever thread solves the pose
+    std::mt19937 random(i);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    for (int restart = 0;
+         restart < options_.num_restarts && !solution.success; restart++) {
+      for (int j = 0; j < q_start.size(); j++) {
+        q_start[j] = q_min_[j] + uniform(random) * (q_max_[j] - q_min_[j]);
+      }
+      SolveOne(cache, ee_index, targets[i], q_start, position_tolerance,
+               orientation_tolerance, &solution);
+      num_iterations += solution.num_iterations;
+    }
+    solution.num_iterations = num_iterations;
+  }
+}
+
+void BatchIkSolver::SolveOne(KinematicsCache<double> *cache, int ee_index,
+                             const Eigen::Isometry3d &target,
+                             const Eigen::VectorXd &q_start,
+                             double position_tolerance,
+                             double orientation_tolerance,
+                             IkSolution *const solution) const {
+  const double damping_squared = options_.damping * options_.damping;
+  Eigen::VectorXd &q = solution->q;
+  q = q_start.cwiseMax(q_min_).cwiseMin(q_max_);
+  solution->success = false;
+  solution->num_iterations = 0;
+
+  Eigen::Matrix<double, 6, 1> error;
+  Eigen::VectorXd dq(q.size());
+  Eigen::VectorXd q_previous(q.size());
+  while (true) {
+    cache->initialize(q);
+    tree_->doKinematics(*cache);
+    const Eigen::Isometry3d H_WE = tree_->relativeTransform(
+        *cache, RigidBodyTreeConstants::kWorldBodyIndex, ee_index);
+
+    // pose error in the end effector frame, rotation first as in the twists
+    const Eigen::Matrix3d R_EW = H_WE.linear().transpose();
+    const Eigen::AngleAxisd rotation_error(R_EW * target.linear());
+    error.head<3>() = rotation_error.angle() * rotation_error.axis();
+    error.tail<3>() = R_EW * (target.translation() - H_WE.translation());
+    solution->orientation_residual = std::abs(rotation_error.angle());
+    solution->position_residual = error.tail<3>().norm();
+    if (solution->position_residual <= position_tolerance &&
+        solution->orientation_residual <= orientation_tolerance) {
+      solution->success = true;
+      return;
+    }
+    if (solution->num_iterations == options_.max_iterations) {
+      return;
+    }
+    solution->num_iterations++;
+
+    const Eigen::Matrix<double, 6, Eigen::Dynamic> J_E =
+        tree_->geometricJacobian(*cache,
+                                 RigidBodyTreeConstants::kWorldBodyIndex,
+                                 ee_index, ee_index);
+    Eigen::Matrix<double, 6, 6> JJt = J_E * J_E.transpose();
+    JJt.diagonal().array() += damping_squared;
+    dq = J_E.transpose() * JJt.ldlt().solve(error);
+    const double largest_step = dq.cwiseAbs().maxCoeff();
+    if (largest_step > options_.max_step) {
+      dq *= options_.max_step / largest_step;
+    }
+    q_previous = q;
+    q = (q + dq).cwiseMax(q_min_).cwiseMin(q_max_);
+    if ((q - q_previous).cwiseAbs().maxCoeff() < kMinStep) {
+      return; // stuck at a joint limit or singularity
+    }
+  }
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,131 @@
+// Compares evaluating a 7-DoF cubic PiecewisePolynomial and its derivative
+// (what JointSpaceTrajectoryPlan::Step does every tick) against a
+// BakedTrajectory sampled at the control period.
+//
+// Usage: benchmark_baked_trajectory [control_period_s]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <drake_robot_control/baked_trajectory.h>
+
+using drake::robot_plan_runner::BakedTrajectory;
+typedef drake::trajectories::PiecewisePolynomial<double> PPType;
+
+namespace {
+
+const int kNumJoints = 7;
+// Knots are spaced uniformly at random in [0.5, 1.5] * kMeanKnotSpacing,
+// so they do not line up with the sample grid.
+const double kMeanKnotSpacing = 0.1;
+
+double NowNs() {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+PPType MakeTrajectory(int num_knots, std::mt19937 *rng) {
+  std::uniform_real_distribution<double> step(-0.05, 0.05);
+  std::uniform_real_distribution<double> spacing(0.5 * kMeanKnotSpacing,
+                                                 1.5 * kMeanKnotSpacing);
+  std::vector<double> times(num_knots);
+  std::vector<Eigen::MatrixXd> knots(num_knots,
+                                     Eigen::MatrixXd::Zero(kNumJoints, 1));
+  for (int i = 0; i < num_knots; i++) {
+    times[i] = i == 0 ? 0 : times[i - 1] + spacing(*rng);
+    if (i > 0) {
+      for (int j = 0; j < kNumJoints; j++) {
+        knots[i](j, 0) = knots[i - 1](j, 0) + step(*rng);
+      }
+    }
+  }
+  const Eigen::MatrixXd knot_dot = Eigen::MatrixXd::Zero(kNumJoints, 1);
+  return PPType::Cubic(times, knots, knot_dot, knot_dot);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const double control_period = argc > 1 ? std::atof(argv[1]) : 0.005;
+  std::mt19937 rng(1);
+
+  std::printf("control period %g s, %d joints, knots every %g s on average\n",
+              control_period, kNumJoints, kMeanKnotSpacing);
+  std::printf("%8s %10s %10s %12s %12s %12s %12s %10s %10s\n", "knots",
+              "bake_ms", "table_kB", "pp_seq_ns", "baked_seq_ns", "pp_rand_ns",
+              "baked_rand_ns", "max_dq", "max_dv");
+
+  for (int num_knots : {10, 100, 1000, 10000}) {
+    const PPType traj = MakeTrajectory(num_knots, &rng);
+    const PPType traj_d = traj.derivative(1);
+    const double duration = traj.end_time() - traj.start_time();
+
+    double t0 = NowNs();
+    std::unique_ptr<BakedTrajectory> baked =
+        BakedTrajectory::Make(traj, traj_d, control_period);
+    const double bake_ms = (NowNs() - t0) / 1e6;
+    if (!baked) {
+      std::printf("%8d too long to bake\n", num_knots);
+      continue;
+    }
+
+    // Control loop access pattern: ticks at the control period with a bit
+    // of jitter, as plan time is derived from the robot status timestamps.
+    std::uniform_real_distribution<double> jitter(-0.1, 0.1);
+    std::vector<double> sequential_times;
+    for (double t = 0; t <= duration; t += control_period) {
+      sequential_times.push_back(
+          std::max(0., t + jitter(rng) * control_period));
+    }
+    std::uniform_real_distribution<double> uniform_time(0, duration);
+    std::vector<double> random_times(sequential_times.size());
+    for (double &t : random_times) {
+      t = uniform_time(rng);
+    }
+
+    Eigen::VectorXd q(kNumJoints), v(kNumJoints);
+    Eigen::VectorXd q_baked(kNumJoints), v_baked(kNumJoints);
+    double sink = 0;
+    double ns[4];
+    for (int pattern = 0; pattern < 2; pattern++) {
+      const std::vector<double> &times =
+          pattern == 0 ? sequential_times : random_times;
+      t0 = NowNs();
+      for (double t : times) {
+        q = traj.value(t);
+        v = traj_d.value(t);
+        sink += q[0] + v[0];
+      }
+      ns[2 * pattern] = (NowNs() - t0) / times.size();
+      t0 = NowNs();
+      for (double t : times) {
+        baked->Evaluate(t, &q_baked, &v_baked);
+        sink += q_baked[0] + v_baked[0];
+      }
+      ns[2 * pattern + 1] = (NowNs() - t0) / times.size();
+    }
+
+    double max_dq = 0, max_dv = 0;
+    for (double t : random_times) {
+      q = traj.value(t);
+      v = traj_d.value(t);
+      baked->Evaluate(t, &q_baked, &v_baked);
+      max_dq = std::max(max_dq, (q - q_baked).cwiseAbs().maxCoeff());
+      max_dv = std::max(max_dv, (v - v_baked).cwiseAbs().maxCoeff());
+    }
+
+    std::printf("%8d %10.2f %10zu %12.1f %12.1f %12.1f %12.1f %10.2e %10.2e\n",
+                num_knots, bake_ms, baked->size_bytes() / 1024, ns[0], ns[1],
+                ns[2], ns[3], max_dq, max_dv);
+    if (sink == 42) {
+      std::printf(" ");
+    }
+  }
+  return 0;
+}
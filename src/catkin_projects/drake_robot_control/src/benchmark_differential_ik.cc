@@ -0,0 +1,297 @@
+// Compares the DifferentialIkSolver implementations on the iiwa: cost per
+// solve on random configurations, and tracking accuracy of the task space
+// control law (kinematic simulation at the control period) on
+//  - a 10 cm circle in the middle of the workspace, and
+//  - a push out along the shoulder-to-hand direction and back, amplitude
+//    given in m, which gets close to or beyond full reach, and
+//  - a pull in towards the shoulder that runs joint 4 into its limit.
+// The QP of EndEffectorOriginQpTrajectoryPlan is tracked alongside the
+// solvers.
+//
+// Usage: benchmark_differential_ik [stretch_amplitude ...]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <drake/common/find_resource.h>
+#include <drake/multibody/joints/floating_base_types.h>
+#include <drake/multibody/parsers/urdf_parser.h>
+#include <drake/multibody/rigid_body_tree.h>
+
+#include <drake_robot_control/differential_ik.h>
+#include <drake_robot_control/task_space_qp.h>
+#include <drake_robot_control/utils.h>
+
+using drake::robot_plan_runner::DifferentialIkOptions;
+using drake::robot_plan_runner::DifferentialIkSolver;
+using drake::robot_plan_runner::JacobianMatrix;
+using drake::robot_plan_runner::JointVector;
+using drake::robot_plan_runner::MakeDifferentialIkSolver;
+using drake::robot_plan_runner::TaskSpaceQp;
+using drake::robot_plan_runner::TaskSpaceQpOptions;
+using spartan::drake_robot_control::utils::LogSO3;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+namespace {
+
+const double kControlPeriod = 0.005;
+// defaults of task_space_plan in iiwa_plan_runner_config.yaml
+const double kKpRotation = 50;
+const double kKpTranslation = 100;
+// joint_speed_limit_degree_per_sec, the runner's per tick safety check
+const double kJointSpeedLimit = 300. / 180 * M_PI;
+const double kMaxDqPerStep = kJointSpeedLimit * kControlPeriod;
+// joint_limits minus joint_limit_tolerance, in degrees
+const double kJointLimits[] = {165, 115, 165, 115, 165, 115, 170};
+
+double NowNs() {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct Kinematics {
+  Kinematics(const RigidBodyTreed &tree, int ee)
+      : tree(tree), ee(ee), cache(tree.CreateKinematicsCache()) {}
+
+  void Update(const Eigen::VectorXd &q) {
+    cache.initialize(q);
+    tree.doKinematics(cache);
+    H_WE = tree.CalcBodyPoseInWorldFrame(cache, tree.get_body(ee));
+    J_ee_E = tree.geometricJacobian(cache, 0, ee, ee);
+  }
+
+  const RigidBodyTreed &tree;
+  const int ee;
+  KinematicsCache<double> cache;
+  Eigen::Isometry3d H_WE;
+  JacobianMatrix J_ee_E;
+};
+
+struct TrackingResult {
+  double rms_position_error = 0;
+  double max_position_error = 0;
+  double max_rotation_error = 0;
+  // largest change of a joint velocity between two ticks
+  double max_q_dot_change = 0;
+  // ticks the runner's dq safety check would have stopped the plan at
+  int num_dq_violations = 0;
+};
+
+// Reference pose and twist (in W) at time t.
+typedef std::function<void(double t, Eigen::Isometry3d *H_WEr,
+                           Vector6d *T_WEr_W)>
+    Reference;
+
+// q_dot for the twist at q
+typedef std::function<void(const Eigen::VectorXd &q, const JacobianMatrix &J,
+                           const Vector6d &twist, JointVector *q_dot)>
+    Controller;
+
+TrackingResult Track(const Controller &controller, Kinematics *kin,
+                     Eigen::VectorXd q, const Eigen::VectorXd &q_min,
+                     const Eigen::VectorXd &q_max, const Reference &reference,
+                     double duration) {
+  TrackingResult result;
+  JointVector q_dot, q_dot_prev = JointVector::Zero(q.size());
+  double sum_squared_error = 0;
+  int num_ticks = 0;
+  for (double t = 0; t < duration; t += kControlPeriod) {
+    Eigen::Isometry3d H_WEr;
+    Vector6d T_WEr_W;
+    reference(t, &H_WEr, &T_WEr_W);
+    kin->Update(q);
+    const Eigen::Isometry3d H_EEr = kin->H_WE.inverse() * H_WEr;
+    const Eigen::Matrix3d R_EW = kin->H_WE.linear().transpose();
+
+    Vector6d twist;
+    twist.head(3) = kKpRotation * LogSO3(H_EEr.linear()) +
+                    R_EW * T_WEr_W.head(3);
+    twist.tail(3) =
+        kKpTranslation * H_EEr.translation() + R_EW * T_WEr_W.tail(3);
+    controller(q, kin->J_ee_E, twist, &q_dot);
+
+    const double error = H_EEr.translation().norm();
+    sum_squared_error += error * error;
+    num_ticks++;
+    result.max_position_error = std::max(result.max_position_error, error);
+    result.max_rotation_error =
+        std::max(result.max_rotation_error, LogSO3(H_EEr.linear()).norm());
+    result.max_q_dot_change = std::max(
+        result.max_q_dot_change, (q_dot - q_dot_prev).cwiseAbs().maxCoeff());
+    // ApplyJointLimits, then the dq check
+    const Eigen::VectorXd q_next =
+        (q + q_dot * kControlPeriod).cwiseMax(q_min).cwiseMin(q_max);
+    if ((q_next - q).cwiseAbs().maxCoeff() > kMaxDqPerStep) {
+      result.num_dq_violations++;
+    }
+    q_dot_prev = q_dot;
+    q = q_next;
+  }
+  result.rms_position_error = std::sqrt(sum_squared_error / num_ticks);
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  RigidBodyTreed tree;
+  drake::parsers::urdf::AddModelInstanceFromUrdfFileToWorld(
+      drake::FindResourceOrThrow("drake/manipulation/models/iiwa_description/"
+                                 "urdf/iiwa14_no_collision.urdf"),
+      drake::multibody::joints::kFixed, &tree);
+  const int ee = tree.FindBodyIndex("iiwa_link_ee");
+  const int nq = tree.get_num_positions();
+  Kinematics kin(tree, ee);
+  Eigen::VectorXd q_min(nq), q_max(nq);
+  for (int i = 0; i < nq; i++) {
+    q_max[i] = kJointLimits[i] / 180 * M_PI;
+    q_min[i] = -q_max[i];
+  }
+
+  std::vector<DifferentialIkOptions> options(4);
+  options[0].method = DifferentialIkOptions::kSvd;
+  options[1].method = DifferentialIkOptions::kDampedLeastSquares;
+  options[2].method = DifferentialIkOptions::kWeightedPseudoInverse;
+  options[2].joint_weights = {2, 2, 1, 1, 1, 1, 1};
+  options[3].method = DifferentialIkOptions::kNormalEquations;
+
+  // cost per solve
+  const int kNumSamples = 1000;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-2, 2);
+  std::vector<JacobianMatrix> jacobians(kNumSamples);
+  std::vector<Vector6d> twists(kNumSamples);
+  for (int k = 0; k < kNumSamples; k++) {
+    Eigen::VectorXd q(nq);
+    for (int i = 0; i < nq; i++) {
+      q[i] = uniform(rng);
+    }
+    kin.Update(q);
+    jacobians[k] = kin.J_ee_E;
+    for (int i = 0; i < 6; i++) {
+      twists[k][i] = uniform(rng);
+    }
+  }
+  std::printf("%-24s %10s\n", "solver", "ns/solve");
+  for (const DifferentialIkOptions &option : options) {
+    std::unique_ptr<DifferentialIkSolver> solver =
+        MakeDifferentialIkSolver(option);
+    JointVector q_dot;
+    double sink = 0;
+    const int kNumRepetitions = 200;
+    const double t0 = NowNs();
+    for (int r = 0; r < kNumRepetitions; r++) {
+      for (int k = 0; k < kNumSamples; k++) {
+        solver->Solve(jacobians[k], twists[k], &q_dot);
+        sink += q_dot[0];
+      }
+    }
+    std::printf("%-24s %10.0f%s\n", solver->name(),
+                (NowNs() - t0) / (kNumRepetitions * kNumSamples),
+                sink == 42 ? " " : "");
+  }
+
+  // tracking
+  Eigen::VectorXd q0(nq);
+  q0 << 0, 0.6, 0, -1.3, 0, 0.9, 0;
+  kin.Update(q0);
+  const Eigen::Isometry3d H_WE0 = kin.H_WE;
+  const Eigen::Vector3d p0 = H_WE0.translation();
+  const Eigen::Vector3d shoulder =
+      tree.CalcBodyPoseInWorldFrame(kin.cache,
+                                    tree.get_body(tree.FindBodyIndex(
+                                        "iiwa_link_2")))
+          .translation();
+  const Eigen::Vector3d outward = (p0 - shoulder).normalized();
+
+  std::vector<std::pair<std::string, Reference>> references;
+  const double kCircleRadius = 0.1, kCirclePeriod = 5;
+  references.emplace_back(
+      "circle", [&](double t, Eigen::Isometry3d *H, Vector6d *T) {
+        const double w = 2 * M_PI / kCirclePeriod;
+        *H = H_WE0;
+        H->translation() =
+            p0 + kCircleRadius *
+                     Eigen::Vector3d(std::cos(w * t) - 1, std::sin(w * t), 0);
+        T->setZero();
+        T->tail(3) = kCircleRadius * w *
+                     Eigen::Vector3d(-std::sin(w * t), std::cos(w * t), 0);
+      });
+  std::vector<double> amplitudes;
+  for (int i = 1; i < argc; i++) {
+    amplitudes.push_back(std::atof(argv[i]));
+  }
+  if (amplitudes.empty()) {
+    amplitudes = {0.2, 0.6};
+  }
+  const double kStretchPeriod = 6;
+  for (double amplitude : amplitudes) {
+    references.emplace_back(
+        "stretch " + std::to_string(amplitude).substr(0, 4) + " m",
+        [=](double t, Eigen::Isometry3d *H, Vector6d *T) {
+          const double w = 2 * M_PI / kStretchPeriod;
+          *H = H_WE0;
+          H->translation() =
+              p0 + amplitude * 0.5 * (1 - std::cos(w * t)) * outward;
+          T->setZero();
+          T->tail(3) = amplitude * 0.5 * w * std::sin(w * t) * outward;
+        });
+  }
+  const double kPullAmplitude = 0.5;
+  references.emplace_back(
+      "pull 0.5 m", [=](double t, Eigen::Isometry3d *H, Vector6d *T) {
+        const double w = 2 * M_PI / kStretchPeriod;
+        *H = H_WE0;
+        H->translation() =
+            p0 - kPullAmplitude * 0.5 * (1 - std::cos(w * t)) * outward;
+        T->setZero();
+        T->tail(3) = -kPullAmplitude * 0.5 * w * std::sin(w * t) * outward;
+      });
+
+  const auto print_result = [](const char *name,
+                                const TrackingResult &result) {
+    std::printf("%-24s %10.3f %10.3f %10.3f %14.3f %12d\n", name,
+                1e3 * result.rms_position_error,
+                1e3 * result.max_position_error, result.max_rotation_error,
+                result.max_q_dot_change, result.num_dq_violations);
+  };
+  for (const auto &reference : references) {
+    const double duration =
+        reference.first == "circle" ? kCirclePeriod : kStretchPeriod;
+    std::printf("\n%s\n%-24s %10s %10s %10s %14s %12s\n",
+                reference.first.c_str(), "solver", "rms_mm", "max_mm",
+                "max_rot", "max_dq_dot", "dq_violations");
+    for (const DifferentialIkOptions &option : options) {
+      std::unique_ptr<DifferentialIkSolver> solver =
+          MakeDifferentialIkSolver(option);
+      const TrackingResult result = Track(
+          [&solver](const Eigen::VectorXd &, const JacobianMatrix &J,
+                    const Vector6d &twist, JointVector *q_dot) {
+            solver->Solve(J, twist, q_dot);
+          },
+          &kin, q0, q_min, q_max, reference.second, duration);
+      print_result(solver->name(), result);
+    }
+    TaskSpaceQp qp(TaskSpaceQpOptions(), q_min, q_max, kJointSpeedLimit,
+                   kControlPeriod);
+    JointVector q_dot_prev = JointVector::Zero(nq);
+    const TrackingResult result = Track(
+        [&](const Eigen::VectorXd &q, const JacobianMatrix &J,
+            const Vector6d &twist, JointVector *q_dot) {
+          qp.Solve(q, q_dot_prev, J, twist, q_dot);
+          q_dot_prev = *q_dot;
+        },
+        &kin, q0, q_min, q_max, reference.second, duration);
+    print_result("qp", result);
+  }
+  return 0;
+}
@@ -0,0 +1,164 @@
+// Compares building a 7-DoF joint space trajectory with PPType::Cubic (what
+// the plan runner did for every incoming trajectory) against
+// FitJointTrajectory, without and with knot decimation, on dense smooth
+// trajectories like planners emit.
+//
+// Usage: benchmark_joint_trajectory_fit [max_knots_for_pp_cubic]
+//
+// PPType::Cubic is skipped above max_knots_for_pp_cubic (default 10000).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <drake_robot_control/joint_trajectory_fit.h>
+
+using drake::robot_plan_runner::FitCubicSpline;
+using drake::robot_plan_runner::FitJointTrajectory;
+using drake::robot_plan_runner::JointTrajectoryFitOptions;
+using drake::robot_plan_runner::JointTrajectoryFitStats;
+using drake::robot_plan_runner::PPType;
+
+namespace {
+
+const int kNumJoints = 7;
+// planner output spacing
+const double kKnotSpacing = 0.01;
+
+double NowMs() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// A few random sinusoids per joint, up to 1 rad and 0.5 Hz.
+void MakeTrajectory(int num_knots, std::mt19937 *rng,
+                    std::vector<double> *times, Eigen::MatrixXd *knots) {
+  std::uniform_real_distribution<double> amplitude(0.05, 0.3);
+  std::uniform_real_distribution<double> frequency(0.05, 0.5);
+  std::uniform_real_distribution<double> phase(0, 2 * M_PI);
+  Eigen::MatrixXd a(kNumJoints, 3), f(kNumJoints, 3), p(kNumJoints, 3);
+  for (int i = 0; i < a.size(); i++) {
+    a(i) = amplitude(*rng);
+    f(i) = frequency(*rng);
+    p(i) = phase(*rng);
+  }
+  times->resize(num_knots);
+  knots->resize(kNumJoints, num_knots);
+  for (int k = 0; k < num_knots; k++) {
+    const double t = k * kKnotSpacing;
+    (*times)[k] = t;
+    for (int j = 0; j < kNumJoints; j++) {
+      double q = 0;
+      for (int m = 0; m < 3; m++) {
+        q += a(j, m) * std::sin(2 * M_PI * f(j, m) * t + p(j, m));
+      }
+      (*knots)(j, k) = q;
+    }
+  }
+}
+
+// largest joint error of spline at the input knots
+double MaxKnotError(const PPType &spline, const std::vector<double> &times,
+                    const Eigen::MatrixXd &knots) {
+  double max_error = 0;
+  for (int k = 0; k < knots.cols(); k++) {
+    max_error = std::max(
+        max_error,
+        (spline.value(times[k]) - knots.col(k)).cwiseAbs().maxCoeff());
+  }
+  return max_error;
+}
+
+// mean ns of value(t) and derivative value(t) at the control period
+double TickNs(const PPType &spline, const PPType &spline_d) {
+  double sink = 0;
+  int num_ticks = 0;
+  const double t0 = NowMs();
+  for (double t = spline.start_time(); t <= spline.end_time(); t += 0.005) {
+    sink += spline.value(t)(0, 0) + spline_d.value(t)(0, 0);
+    num_ticks++;
+  }
+  const double ns = (NowMs() - t0) * 1e6 / num_ticks;
+  if (sink == 42) {
+    std::printf(" ");
+  }
+  return ns;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int max_knots_for_pp_cubic = argc > 1 ? std::atoi(argv[1]) : 10000;
+  std::mt19937 rng(1);
+
+  std::printf("%d joints, knots every %g s\n", kNumJoints, kKnotSpacing);
+  std::printf("%8s %-22s %10s %10s %8s %12s %10s\n", "knots", "method",
+              "build_ms", "knots_out", "ratio", "max_err_deg", "tick_ns");
+
+  for (int num_knots : {1000, 10000, 100000}) {
+    std::vector<double> times;
+    Eigen::MatrixXd knots;
+    MakeTrajectory(num_knots, &rng, &times, &knots);
+    const Eigen::VectorXd zero = Eigen::VectorXd::Zero(kNumJoints);
+
+    PPType reference;
+    if (num_knots <= max_knots_for_pp_cubic) {
+      std::vector<Eigen::MatrixXd> knot_matrices(num_knots);
+      for (int k = 0; k < num_knots; k++) {
+        knot_matrices[k] = knots.col(k);
+      }
+      const Eigen::MatrixXd knot_dot = zero;
+      const double t0 = NowMs();
+      reference = PPType::Cubic(times, knot_matrices, knot_dot, knot_dot);
+      const double build_ms = NowMs() - t0;
+      std::printf("%8d %-22s %10.2f %10d %8.3f %12.2e %10.1f\n", num_knots,
+                  "PPType::Cubic", build_ms, num_knots, 1.,
+                  MaxKnotError(reference, times, knots) * 180 / M_PI,
+                  TickNs(reference, reference.derivative(1)));
+    } else {
+      std::printf("%8d %-22s %10s\n", num_knots, "PPType::Cubic", "skipped");
+    }
+
+    double t0 = NowMs();
+    const PPType direct = FitCubicSpline(times, knots, zero, zero);
+    const double direct_ms = NowMs() - t0;
+    std::printf("%8d %-22s %10.2f %10d %8.3f %12.2e %10.1f\n", num_knots,
+                "tridiagonal", direct_ms, num_knots, 1.,
+                MaxKnotError(direct, times, knots) * 180 / M_PI,
+                TickNs(direct, direct.derivative(1)));
+    if (num_knots <= max_knots_for_pp_cubic) {
+      // the same spline
+      double max_difference = 0;
+      for (double t = 0; t <= times.back(); t += 0.0037) {
+        max_difference = std::max(
+            max_difference,
+            (direct.value(t) - reference.value(t)).cwiseAbs().maxCoeff());
+      }
+      std::printf("%8s %-22s %10.2e rad\n", "", "  vs PPType::Cubic",
+                  max_difference);
+    }
+
+    for (double tolerance_deg : {0.01, 0.1}) {
+      JointTrajectoryFitOptions options;
+      options.decimation_tolerance = tolerance_deg * M_PI / 180;
+      JointTrajectoryFitStats stats;
+      t0 = NowMs();
+      const PPType decimated =
+          FitJointTrajectory(times, knots, options, &stats);
+      const double build_ms = NowMs() - t0;
+      char method[32];
+      std::snprintf(method, sizeof(method), "decimated %.2f deg",
+                    tolerance_deg);
+      std::printf("%8d %-22s %10.2f %10d %8.3f %12.2e %10.1f\n", num_knots,
+                  method, build_ms, stats.num_knots, stats.reduction_ratio(),
+                  MaxKnotError(decimated, times, knots) * 180 / M_PI,
+                  TickNs(decimated, decimated.derivative(1)));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,149 @@
+// Compares publishing a 7-DoF lcmt_iiwa_command with lcm::LCM::publish (what
+// the control tick did every status message) against LcmCommandPublisher,
+// and checks that an lcm::LCM subscriber decodes the preencoded packets.
+//
+// Usage: benchmark_lcm_command_publish [num_publishes]
+//
+// Publishes on IIWA_COMMAND_BENCHMARK with LCM_DEFAULT_URL, nothing
+// subscribes to it but the check.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <drake_robot_control/lcm_command_publisher.h>
+
+#include <drake/lcmt_iiwa_command.hpp>
+#include <lcm/lcm-cpp.hpp>
+
+using drake::lcmt_iiwa_command;
+using drake::robot_plan_runner::LcmCommandPublisher;
+
+namespace {
+
+const int kNumJoints = 7;
+const char *const kChannel = "IIWA_COMMAND_BENCHMARK";
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// q and tau of the command published at tick i
+void MakeCommand(int i, Eigen::VectorXd *q, Eigen::VectorXd *tau) {
+  for (int j = 0; j < kNumJoints; j++) {
+    (*q)[j] = 0.001 * i + 0.1 * j;
+    (*tau)[j] = -0.01 * j;
+  }
+}
+
+void PrintLatencies(const char *method, std::vector<int64_t> *latencies_ns) {
+  std::sort(latencies_ns->begin(), latencies_ns->end());
+  double sum = 0;
+  for (int64_t latency : *latencies_ns) {
+    sum += latency;
+  }
+  const size_t n = latencies_ns->size();
+  std::printf("%-24s %10.0f %10lld %10lld %10lld\n", method, sum / n,
+              static_cast<long long>((*latencies_ns)[n / 2]),
+              static_cast<long long>((*latencies_ns)[n * 99 / 100]),
+              static_cast<long long>(latencies_ns->back()));
+}
+
+class CommandReceiver {
+public:
+  void Handle(const lcm::ReceiveBuffer *, const std::string &,
+              const lcmt_iiwa_command *msg) {
+    received.push_back(*msg);
+  }
+  std::vector<lcmt_iiwa_command> received;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int num_publishes = argc > 1 ? std::atoi(argv[1]) : 100000;
+
+  lcm::LCM lcm;
+  if (!lcm.good()) {
+    std::fprintf(stderr, "lcm::LCM failed to initialize\n");
+    return 1;
+  }
+  std::unique_ptr<LcmCommandPublisher> publisher =
+      LcmCommandPublisher::Open("", kChannel, kNumJoints);
+  if (!publisher) {
+    std::fprintf(stderr, "LcmCommandPublisher::Open failed: %s\n",
+                 std::strerror(errno));
+    return 1;
+  }
+
+  // what an unmodified LCM subscriber makes of the preencoded packets
+  Eigen::VectorXd q(kNumJoints), tau(kNumJoints);
+  const int num_checked = 10;
+  CommandReceiver receiver;
+  int num_mismatches = 0;
+  {
+    lcm::LCM subscriber_lcm;
+    subscriber_lcm.subscribe(kChannel, &CommandReceiver::Handle, &receiver);
+    for (int i = 0; i < num_checked; i++) {
+      MakeCommand(i, &q, &tau);
+      publisher->Publish(i, q, tau);
+    }
+    while (static_cast<int>(receiver.received.size()) < num_checked &&
+           subscriber_lcm.handleTimeout(1000) > 0) {
+    }
+  }
+  for (const lcmt_iiwa_command &msg : receiver.received) {
+    MakeCommand(msg.utime, &q, &tau);
+    bool match = msg.num_joints == kNumJoints && msg.num_torques == kNumJoints;
+    for (int j = 0; match && j < kNumJoints; j++) {
+      match = msg.joint_position[j] == q[j] && msg.joint_torque[j] == tau[j];
+    }
+    num_mismatches += !match;
+  }
+  std::printf("lcm::LCM subscriber received %zu of %d preencoded commands, "
+              "%d differ\n",
+              receiver.received.size(), num_checked, num_mismatches);
+
+  std::printf("%d publishes of %zu byte packets\n", num_publishes,
+              publisher->packet_size());
+  std::printf("%-24s %10s %10s %10s %10s\n", "method", "mean_ns", "p50_ns",
+              "p99_ns", "max_ns");
+  std::vector<int64_t> latencies_ns(num_publishes);
+
+  lcmt_iiwa_command command;
+  command.num_joints = kNumJoints;
+  command.joint_position.resize(kNumJoints);
+  command.num_torques = kNumJoints;
+  command.joint_torque.resize(kNumJoints);
+  for (int i = 0; i < num_publishes; i++) {
+    MakeCommand(i, &q, &tau);
+    const int64_t start_ns = NowNs();
+    command.utime = i;
+    for (int j = 0; j < kNumJoints; j++) {
+      command.joint_position[j] = q[j];
+      command.joint_torque[j] = tau[j];
+    }
+    lcm.publish(kChannel, &command);
+    latencies_ns[i] = NowNs() - start_ns;
+  }
+  PrintLatencies("lcm::LCM::publish", &latencies_ns);
+
+  for (int i = 0; i < num_publishes; i++) {
+    MakeCommand(i, &q, &tau);
+    const int64_t start_ns = NowNs();
+    publisher->Publish(i, q, tau);
+    latencies_ns[i] = NowNs() - start_ns;
+  }
+  PrintLatencies("LcmCommandPublisher", &latencies_ns);
+  return num_mismatches == 0 &&
+                 static_cast<int>(receiver.received.size()) == num_checked
+             ? 0
+             : 1;
+}
@@ -0,0 +1,153 @@
+#include <drake_robot_control/control_deadline_watchdog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// single writer, so a plain load + store is enough
+void Increment(std::atomic<uint64_t> *count) {
+  count->store(count->load(std::memory_order_relaxed) + 1,
+               std::memory_order_relaxed);
+}
+
+} // namespace
+
+ControlDeadlineWatchdogOptions
+ControlDeadlineWatchdogOptions::FromYaml(const YAML::Node &node) {
+  ControlDeadlineWatchdogOptions options;
+  if (!node) {
+    return options;
+  }
+  if (node["enabled"]) {
+    options.enabled = node["enabled"].as<bool>();
+  }
+  if (node["step_budget_s"]) {
+    options.step_budget_s = node["step_budget_s"].as<double>();
+  }
+  if (node["max_consecutive_misses"]) {
+    options.max_consecutive_misses = node["max_consecutive_misses"].as<int>();
+  }
+  if (node["status_timeout_s"]) {
+    options.status_timeout_s = node["status_timeout_s"].as<double>();
+  }
+  return options;
+}
+
+ControlDeadlineWatchdog::ControlDeadlineWatchdog(
+    const ControlDeadlineWatchdogOptions &options, double control_period)
+    : options_(options),
+      step_budget_ns_(static_cast<int64_t>(
+          (options.step_budget_s > 0 ? options.step_budget_s
+                                     : control_period) *
+          1e9)),
+      status_timeout_ns_(static_cast<int64_t>(
+          (options.status_timeout_s > 0 ? options.status_timeout_s
+                                        : 20 * control_period) *
+          1e9)),
+      timer_fd_(-1), consecutive_misses_(0), is_status_stale_(false),
+      last_status_ns_(-1), num_step_misses_(0), num_status_timeouts_(0),
+      num_degradations_(0), previous_num_step_misses_(0),
+      previous_num_status_timeouts_(0), previous_num_degradations_(0) {
+  if (!options_.enabled) {
+    return;
+  }
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd_ < 0) {
+    throw std::runtime_error(
+        std::string("ControlDeadlineWatchdog: timerfd_create() failed: ") +
+        std::strerror(errno));
+  }
+  // a stale status is noticed at most half a timeout late
+  const int64_t period_ns = std::max<int64_t>(status_timeout_ns_ / 2, 1000000);
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = period_ns / 1000000000;
+  spec.it_interval.tv_nsec = period_ns % 1000000000;
+  spec.it_value = spec.it_interval;
+  if (timerfd_settime(timer_fd_, 0, &spec, nullptr) != 0) {
+    close(timer_fd_);
+    throw std::runtime_error(
+        std::string("ControlDeadlineWatchdog: timerfd_settime() failed: ") +
+        std::strerror(errno));
+  }
+}
+
+ControlDeadlineWatchdog::~ControlDeadlineWatchdog() {
+  if (timer_fd_ >= 0) {
+    close(timer_fd_);
+  }
+}
+
+bool ControlDeadlineWatchdog::RecordStep(int64_t step_ns) {
+  if (step_ns <= step_budget_ns_) {
+    consecutive_misses_ = 0;
+    return false;
+  }
+  Increment(&num_step_misses_);
+  consecutive_misses_++;
+  return options_.enabled &&
+         consecutive_misses_ == options_.max_consecutive_misses;
+}
+
+void ControlDeadlineWatchdog::RecordStatus(int64_t receive_time_ns) {
+  last_status_ns_.store(receive_time_ns, std::memory_order_relaxed);
+  is_status_stale_ = false;
+}
+
+bool ControlDeadlineWatchdog::CheckStatusAge(int64_t now_ns) {
+  uint64_t expirations;
+  while (read(timer_fd_, &expirations, sizeof(expirations)) ==
+         sizeof(expirations)) {
+  }
+  // nothing times out before the first status message, age_ns is -1 then
+  const int64_t age_ns = status_age_ns(now_ns);
+  if (is_status_stale_ || age_ns < status_timeout_ns_) {
+    return false;
+  }
+  is_status_stale_ = true;
+  Increment(&num_status_timeouts_);
+  return true;
+}
+
+void ControlDeadlineWatchdog::RecordDegradation() {
+  Increment(&num_degradations_);
+}
+
+int64_t ControlDeadlineWatchdog::status_age_ns(int64_t now_ns) const {
+  const int64_t last_status_ns =
+      last_status_ns_.load(std::memory_order_relaxed);
+  return last_status_ns < 0 ? -1 : now_ns - last_status_ns;
+}
+
+void ControlDeadlineWatchdog::Report(int64_t now_ns,
+                                     robot_msgs::ControlLoopStats *msg) {
+  msg->step_budget_us = step_budget_ns_ / 1e3;
+  msg->status_timeout_us = status_timeout_ns_ / 1e3;
+  const int64_t age_ns = status_age_ns(now_ns);
+  msg->status_age_us = age_ns < 0 ? -1. : age_ns / 1e3;
+
+  const uint64_t num_step_misses =
+      num_step_misses_.load(std::memory_order_relaxed);
+  msg->num_step_deadline_misses = num_step_misses - previous_num_step_misses_;
+  previous_num_step_misses_ = num_step_misses;
+  const uint64_t num_status_timeouts =
+      num_status_timeouts_.load(std::memory_order_relaxed);
+  msg->num_status_timeouts =
+      num_status_timeouts - previous_num_status_timeouts_;
+  previous_num_status_timeouts_ = num_status_timeouts;
+  const uint64_t num_degradations =
+      num_degradations_.load(std::memory_order_relaxed);
+  msg->num_degradations = num_degradations - previous_num_degradations_;
+  previous_num_degradations_ = num_degradations;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
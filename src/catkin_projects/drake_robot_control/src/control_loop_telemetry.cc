@@ -0,0 +1,174 @@
+#include <drake_robot_control/control_loop_telemetry.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <drake_robot_control/status_mailbox.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+int LatencyHistogram::BucketIndex(int64_t value_ns) {
+  if (value_ns < 2 * kSubBucketCount) {
+    return std::max<int64_t>(value_ns, 0);
+  }
+  if (value_ns >= (int64_t(1) << kMaxValueBits)) {
+    return kNumBuckets - 1;
+  }
+  const int msb = 63 - __builtin_clzll(static_cast<uint64_t>(value_ns));
+  const int shift = msb - kSubBucketBits;
+  return shift * kSubBucketCount + static_cast<int>(value_ns >> shift);
+}
+
+int64_t LatencyHistogram::BucketUpperBound(int index) {
+  if (index < 2 * kSubBucketCount) {
+    return index;
+  }
+  const int shift = index / kSubBucketCount - 1;
+  const int64_t sub_bucket = index - shift * kSubBucketCount;
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+int64_t LatencyHistogram::ValueAtQuantile(const Counts &counts,
+                                          double quantile) {
+  uint64_t total = 0;
+  for (uint64_t count : counts) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  // smallest bucket whose cumulative count reaches ceil(quantile * total)
+  uint64_t rank = static_cast<uint64_t>(quantile * total + 0.999999);
+  rank = std::min(std::max<uint64_t>(rank, 1), total);
+  uint64_t cumulative = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    cumulative += counts[i];
+    if (cumulative >= rank) {
+      return BucketUpperBound(i);
+    }
+  }
+  return BucketUpperBound(kNumBuckets - 1);
+}
+
+const char *ControlLoopTelemetry::StageName(int stage) {
+  switch (stage) {
+  case kDecode:
+    return "decode";
+  case kPlanSwap:
+    return "plan_swap";
+  case kStep:
+    return "step";
+  case kSafetyCheck:
+    return "safety_check";
+  case kPublish:
+    return "publish";
+  case kTotal:
+    return "total";
+  default:
+    return "unknown";
+  }
+}
+
+ControlLoopTelemetry::ControlLoopTelemetry(int64_t tick_budget_ns)
+    : tick_budget_ns_(tick_budget_ns), num_overruns_(0), report_epoch_(0),
+      previous_num_overruns_(0),
+      previous_report_time_ns_(MonotonicTimeNs()) {
+  std::memset(&peak_, 0, sizeof(peak_));
+  peak_.plan_number = -1;
+  peak_.worst_tick_plan_number = -1;
+  for (int i = 0; i < kNumStages; i++) {
+    previous_counts_[i].fill(0);
+  }
+}
+
+void ControlLoopTelemetry::RecordTick(const int64_t (&stage_ns)[kNumStages],
+                                      int plan_number, const char *plan_type) {
+  for (int i = 0; i < kNumStages; i++) {
+    histograms_[i].Record(stage_ns[i]);
+  }
+  if (stage_ns[kTotal] > tick_budget_ns_) {
+    num_overruns_.store(num_overruns_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+  }
+
+  const uint64_t epoch = report_epoch_.load(std::memory_order_acquire);
+  if (epoch != peak_.epoch) {
+    // first tick of a new reporting interval
+    peak_.epoch = epoch;
+    std::fill(peak_.max_ns, peak_.max_ns + kNumStages, 0);
+  }
+  for (int i = 0; i < kNumStages; i++) {
+    peak_.max_ns[i] = std::max(peak_.max_ns[i], stage_ns[i]);
+  }
+  if (stage_ns[kTotal] == peak_.max_ns[kTotal]) {
+    peak_.worst_tick_plan_number = plan_number;
+    peak_.worst_tick_plan_type = plan_type;
+  }
+  peak_.plan_number = plan_number;
+  peak_.plan_type = plan_type;
+  published_peak_.Store(peak_);
+}
+
+void ControlLoopTelemetry::Report(robot_msgs::ControlLoopStats *msg) {
+  // Take the peak before starting the next interval. Ticks recorded between
+  // these two lines still show up in the histograms of the next report, only
+  // their contribution to the maxima is lost.
+  IntervalPeak peak;
+  const bool has_peak = published_peak_.Load(&peak) > 0;
+  const uint64_t epoch = report_epoch_.fetch_add(1, std::memory_order_acq_rel);
+  const bool peak_is_current = has_peak && peak.epoch == epoch;
+
+  const int64_t now_ns = MonotonicTimeNs();
+  msg->header.stamp = ros::Time::now();
+  msg->interval_s = (now_ns - previous_report_time_ns_) / 1e9;
+  previous_report_time_ns_ = now_ns;
+  msg->tick_budget_us = tick_budget_ns_ / 1e3;
+
+  const uint64_t num_overruns = num_overruns_.load(std::memory_order_relaxed);
+  msg->num_overruns = num_overruns - previous_num_overruns_;
+  previous_num_overruns_ = num_overruns;
+
+  msg->stage_names.resize(kNumStages);
+  msg->p50_us.resize(kNumStages);
+  msg->p99_us.resize(kNumStages);
+  msg->p999_us.resize(kNumStages);
+  msg->max_us.resize(kNumStages);
+  msg->num_ticks = 0;
+
+  LatencyHistogram::Counts counts;
+  for (int i = 0; i < kNumStages; i++) {
+    histograms_[i].Snapshot(&counts);
+    uint64_t num_ticks = 0;
+    for (int j = 0; j < LatencyHistogram::kNumBuckets; j++) {
+      interval_counts_[j] = counts[j] - previous_counts_[i][j];
+      num_ticks += interval_counts_[j];
+    }
+    previous_counts_[i] = counts;
+
+    msg->stage_names[i] = StageName(i);
+    msg->p50_us[i] =
+        LatencyHistogram::ValueAtQuantile(interval_counts_, 0.5) / 1e3;
+    msg->p99_us[i] =
+        LatencyHistogram::ValueAtQuantile(interval_counts_, 0.99) / 1e3;
+    msg->p999_us[i] =
+        LatencyHistogram::ValueAtQuantile(interval_counts_, 0.999) / 1e3;
+    msg->max_us[i] = peak_is_current ? peak.max_ns[i] / 1e3 : 0;
+    if (i == kTotal) {
+      msg->num_ticks = num_ticks;
+    }
+  }
+
+  msg->plan_number = has_peak ? peak.plan_number : -1;
+  msg->plan_type = (has_peak && peak.plan_type) ? peak.plan_type : "";
+  msg->worst_tick_plan_number =
+      peak_is_current ? peak.worst_tick_plan_number : -1;
+  msg->worst_tick_plan_type =
+      (peak_is_current && peak.worst_tick_plan_type)
+          ? peak.worst_tick_plan_type
+          : "";
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,178 @@
+#include <drake_robot_control/differential_ik.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+// Keeps the Cholesky factorization defined at exact singularities, far below
+// anything that changes the solution elsewhere.
+const double kRegularization = 1e-9;
+
+class SvdIkSolver : public DifferentialIkSolver {
+public:
+  explicit SvdIkSolver(double threshold)
+      : threshold_(threshold),
+        svd_(6, kMaxNumJoints, Eigen::ComputeThinU | Eigen::ComputeThinV) {}
+
+  void Solve(const JacobianMatrix &J, const Vector6d &twist,
+             JointVector *const q_dot) override {
+    svd_.compute(J);
+    // When computing the pseudoinverse, this ignores all singular
+    // values smaller than this threshold. This is raised
+    // from the Eigen default to create less jerky movements near
+    // singularities.
+    svd_.setThreshold(threshold_);
+    *q_dot = svd_.solve(twist);
+  }
+
+  const char *name() const override { return "svd"; }
+
+private:
+  const double threshold_;
+  Eigen::JacobiSVD<JacobianMatrix> svd_;
+};
+
+class DampedLeastSquaresIkSolver : public DifferentialIkSolver {
+public:
+  DampedLeastSquaresIkSolver(double damping_max,
+                             double manipulability_threshold)
+      : damping_max_(damping_max),
+        manipulability_threshold_(manipulability_threshold) {}
+
+  void Solve(const JacobianMatrix &J, const Vector6d &twist,
+             JointVector *const q_dot) override {
+    JJt_.noalias() = J * J.transpose();
+    ldlt_.compute(JJt_);
+    // det(J J^T) from the LDLT factors, which the damped solve below
+    // cannot reuse because it factors J J^T + lambda^2 I
+    double det = 1;
+    for (int i = 0; i < 6; i++) {
+      det *= std::max(ldlt_.vectorD()[i], 0.);
+    }
+    const double manipulability = std::sqrt(det);
+    double damping_squared = 0;
+    if (manipulability < manipulability_threshold_) {
+      const double ratio = manipulability / manipulability_threshold_;
+      damping_squared = damping_max_ * damping_max_ * (1 - ratio * ratio);
+    }
+    JJt_.diagonal().array() += damping_squared + kRegularization;
+    llt_.compute(JJt_);
+    y_ = llt_.solve(twist);
+    q_dot->noalias() = J.transpose() * y_;
+  }
+
+  const char *name() const override { return "damped_least_squares"; }
+
+private:
+  const double damping_max_;
+  const double manipulability_threshold_;
+  Matrix6d JJt_;
+  Eigen::LDLT<Matrix6d> ldlt_;
+  Eigen::LLT<Matrix6d> llt_;
+  Vector6d y_;
+};
+
+// W^-1 J^T (J W^-1 J^T)^-1 twist. With unit weights these are the normal
+// equations of the minimum norm solution.
+class WeightedPseudoInverseIkSolver : public DifferentialIkSolver {
+public:
+  WeightedPseudoInverseIkSolver(const std::vector<double> &joint_weights,
+                                const char *name)
+      : name_(name) {
+    inverse_weights_.setOnes(kMaxNumJoints);
+    for (size_t i = 0;
+         i < joint_weights.size() && i < static_cast<size_t>(kMaxNumJoints);
+         i++) {
+      inverse_weights_[i] = 1. / joint_weights[i];
+    }
+  }
+
+  void Solve(const JacobianMatrix &J, const Vector6d &twist,
+             JointVector *const q_dot) override {
+    const int n = J.cols();
+    JWinv_ = J * inverse_weights_.head(n).asDiagonal();
+    JWJt_.noalias() = JWinv_ * J.transpose();
+    JWJt_.diagonal().array() += kRegularization;
+    llt_.compute(JWJt_);
+    y_ = llt_.solve(twist);
+    q_dot->noalias() = JWinv_.transpose() * y_;
+  }
+
+  const char *name() const override { return name_; }
+
+private:
+  const char *const name_;
+  JointVector inverse_weights_;
+  JacobianMatrix JWinv_;
+  Matrix6d JWJt_;
+  Eigen::LLT<Matrix6d> llt_;
+  Vector6d y_;
+};
+
+} // namespace
+
+DifferentialIkOptions DifferentialIkOptions::FromYaml(const YAML::Node &node) {
+  DifferentialIkOptions options;
+  if (!node) {
+    return options;
+  }
+  if (node["method"]) {
+    const std::string method = node["method"].as<std::string>();
+    if (method == "svd") {
+      options.method = kSvd;
+    } else if (method == "damped_least_squares") {
+      options.method = kDampedLeastSquares;
+    } else if (method == "weighted_pseudo_inverse") {
+      options.method = kWeightedPseudoInverse;
+    } else if (method == "normal_equations") {
+      options.method = kNormalEquations;
+    } else {
+      std::cerr << "Unknown ik_solver method " << method << ", using svd"
+                << std::endl;
+    }
+  }
+  if (node["svd_threshold"]) {
+    options.svd_threshold = node["svd_threshold"].as<double>();
+  }
+  if (node["damping_max"]) {
+    options.damping_max = node["damping_max"].as<double>();
+  }
+  if (node["manipulability_threshold"]) {
+    options.manipulability_threshold =
+        node["manipulability_threshold"].as<double>();
+  }
+  if (node["joint_weights"]) {
+    options.joint_weights = node["joint_weights"].as<std::vector<double>>();
+  }
+  return options;
+}
+
+std::unique_ptr<DifferentialIkSolver>
+MakeDifferentialIkSolver(const DifferentialIkOptions &options) {
+  switch (options.method) {
+  case DifferentialIkOptions::kDampedLeastSquares:
+    return std::unique_ptr<DifferentialIkSolver>(new DampedLeastSquaresIkSolver(
+        options.damping_max, options.manipulability_threshold));
+  case DifferentialIkOptions::kWeightedPseudoInverse:
+    return std::unique_ptr<DifferentialIkSolver>(
+        new WeightedPseudoInverseIkSolver(options.joint_weights,
+                                          "weighted_pseudo_inverse"));
+  case DifferentialIkOptions::kNormalEquations:
+    return std::unique_ptr<DifferentialIkSolver>(
+        new WeightedPseudoInverseIkSolver({}, "normal_equations"));
+  case DifferentialIkOptions::kSvd:
+  default:
+    return std::unique_ptr<DifferentialIkSolver>(
+        new SvdIkSolver(options.svd_threshold));
+  }
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,84 @@
+#include <drake_robot_control/epoll_reactor.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <drake_robot_control/status_mailbox.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+EpollReactor::EpollReactor()
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), is_stopped_(false),
+      wakeup_time_ns_(0) {
+  if (epoll_fd_ < 0) {
+    throw std::runtime_error("EpollReactor: epoll_create1() failed");
+  }
+  AddReadHandler(stop_notifier_.fd(), -1,
+                 [this]() { stop_notifier_.Consume(); });
+}
+
+EpollReactor::~EpollReactor() { close(epoll_fd_); }
+
+void EpollReactor::AddReadHandler(int fd, int priority, Handler handler) {
+  struct epoll_event event;
+  std::memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  // index into entries_, so dispatch does not need a lookup
+  event.data.u32 = static_cast<uint32_t>(entries_.size());
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    throw std::runtime_error(std::string("EpollReactor: epoll_ctl() failed: ") +
+                             std::strerror(errno));
+  }
+  entries_.push_back(Entry{fd, priority, std::move(handler)});
+}
+
+void EpollReactor::Run() {
+  struct epoll_event events[kMaxEvents];
+  Entry *ready[kMaxEvents];
+
+  while (!is_stopped_.load()) {
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cout << "EpollReactor: epoll_wait failed (" << std::strerror(errno)
+                << "), stopping" << std::endl;
+      return;
+    }
+    wakeup_time_ns_ = MonotonicTimeNs();
+
+    for (int i = 0; i < num_events; i++) {
+      ready[i] = &entries_[events[i].data.u32];
+    }
+    // num_events is tiny, insertion sort keeps this allocation free
+    for (int i = 1; i < num_events; i++) {
+      Entry *entry = ready[i];
+      int j = i - 1;
+      for (; j >= 0 && ready[j]->priority > entry->priority; j--) {
+        ready[j + 1] = ready[j];
+      }
+      ready[j + 1] = entry;
+    }
+
+    for (int i = 0; i < num_events; i++) {
+      ready[i]->handler();
+    }
+  }
+}
+
+void EpollReactor::Stop() {
+  is_stopped_.store(true);
+  stop_notifier_.Notify();
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -13,8 +13,7 @@ TotalExternalTorqueGuard::TotalExternalTorqueGuard(
       threshold_(external_torque_norm_threshold){};
 
 std::pair<bool, double> TotalExternalTorqueGuard::EvaluateGuard(
-    const KinematicsCache<double> &cache_,
-    const Eigen::Ref<const Eigen::VectorXd> &q,
+    TickKinematics *const kinematics,
     const Eigen::Ref<const Eigen::VectorXd> &tau_external) {
 
   double fraction = tau_external.norm() / threshold_;
@@ -39,24 +38,23 @@ ExternalForceGuard::ExternalForceGuard(
 }
 
 std::pair<bool, double> ExternalForceGuard::EvaluateGuard(
-    const KinematicsCache<double> &cache_,
-    const Eigen::Ref<const Eigen::VectorXd> &q,
+    TickKinematics *const kinematics,
     const Eigen::Ref<const Eigen::VectorXd> &tau_external) {
 
   // compute expressed_in to body  transform
-  H_body_expressed_in_ =
-      tree_.relativeTransform(cache_, idx_body_, idx_expressed_in_);
+  const Eigen::Isometry3d &H_body_expressed_in =
+      kinematics->RelativeTransform(idx_body_, idx_expressed_in_);
 
   // rotate force to be in body frame
-  twist_external_.tail(3) = H_body_expressed_in_.linear() * force_;
+  twist_external_.tail(3) = H_body_expressed_in.linear() * force_;
 
-  Eigen::MatrixXd J =
-      tree_.geometricJacobian(cache_, idx_world_, idx_body_, idx_body_);
-  Eigen::VectorXd torque_external_threshold = J.transpose() * twist_external_;
+  const drake::robot_plan_runner::JacobianMatrix &J =
+      kinematics->GeometricJacobian(idx_world_, idx_body_, idx_body_);
+  torque_external_threshold_.noalias() = J.transpose() * twist_external_;
 
   // hack to avoid division by zero
   double fraction =
-      tau_external.norm() / (torque_external_threshold.norm() + 1e-5);
+      tau_external.norm() / (torque_external_threshold_.norm() + 1e-5);
   bool guard_triggered = fraction > 1.0;
 
   if (guard_triggered) {
@@ -74,38 +72,141 @@ std::pair<bool, double> ExternalForceGuard::EvaluateGuard(
   return std::make_pair(guard_triggered, fraction);
 }
 
+void ForceGuardContainer::AddGuard(std::shared_ptr<ForceGuard> guard) {
+  guards_.push_back(guard);
+  Compile();
+}
+
+void ForceGuardContainer::AddGuards(
+    const std::vector<std::shared_ptr<ForceGuard>> &guards) {
+  guards_.insert(guards_.end(), guards.begin(), guards.end());
+  Compile();
+}
+
+void ForceGuardContainer::Compile() {
+  torque_norm_guards_.clear();
+  external_force_guards_.clear();
+  body_groups_.clear();
+  other_guards_.clear();
+
+  std::vector<double> torque_norm_thresholds;
+  // group of each entry of external_force_guards_
+  std::vector<int> guard_groups;
+  int num_velocities = 0;
+
+  for (int i = 0; i < guards_.size(); i++) {
+    ForceGuard *guard = guards_[i].get();
+    if (guard->get_type() == ForceGuardType::TOTAL_EXTERNAL_TORQUE) {
+      auto torque_guard = dynamic_cast<TotalExternalTorqueGuard *>(guard);
+      if (torque_guard) {
+        torque_norm_guards_.push_back(i);
+        torque_norm_thresholds.push_back(torque_guard->get_threshold());
+        continue;
+      }
+    } else if (guard->get_type() == ForceGuardType::EXTERNAL_FORCE) {
+      auto force_guard = dynamic_cast<ExternalForceGuard *>(guard);
+      if (force_guard) {
+        int group = 0;
+        while (group < body_groups_.size() &&
+               !(body_groups_[group].idx_body ==
+                     force_guard->get_body_index() &&
+                 body_groups_[group].idx_world ==
+                     force_guard->get_world_index() &&
+                 body_groups_[group].idx_expressed_in ==
+                     force_guard->get_expressed_in_index())) {
+          group++;
+        }
+        if (group == body_groups_.size()) {
+          body_groups_.push_back({force_guard->get_body_index(),
+                                  force_guard->get_world_index(),
+                                  force_guard->get_expressed_in_index()});
+        }
+        external_force_guards_.push_back(i);
+        guard_groups.push_back(group);
+        num_velocities = force_guard->get_tree().get_num_velocities();
+        continue;
+      }
+    }
+    other_guards_.push_back(i);
+  }
+
+  torque_norm_thresholds_ = Eigen::Map<Eigen::VectorXd>(
+      torque_norm_thresholds.data(), torque_norm_thresholds.size());
+
+  const int num_force_guards = external_force_guards_.size();
+  force_columns_.setZero(3 * body_groups_.size(), num_force_guards);
+  for (int k = 0; k < num_force_guards; k++) {
+    auto force_guard = static_cast<ExternalForceGuard *>(
+        guards_[external_force_guards_[k]].get());
+    force_columns_.block<3, 1>(3 * guard_groups[k], k) =
+        force_guard->get_force();
+  }
+
+  group_jacobians_.setZero(num_velocities, 3 * body_groups_.size());
+  torque_thresholds_.setZero(num_velocities, num_force_guards);
+  fractions_.setZero(guards_.size());
+}
+
 std::pair<bool, std::pair<double, std::shared_ptr<ForceGuard>>>
 ForceGuardContainer::EvaluateGuards(
-    const KinematicsCache<double> &cache_,
-    const Eigen::Ref<const Eigen::VectorXd> &q,
+    TickKinematics *const kinematics,
     const Eigen::Ref<const Eigen::VectorXd> &tau_external) {
 
-  double largest_fraction;
-  bool guard_triggered = false;
-  std::shared_ptr<ForceGuard> guard;
-  std::pair<bool, double> result;
+  if (guards_.empty()) {
+    return std::make_pair(false,
+                          std::make_pair(0.0, std::shared_ptr<ForceGuard>()));
+  }
+
+  const double tau_external_norm = tau_external.norm();
+
+  for (int i = 0; i < torque_norm_guards_.size(); i++) {
+    fractions_(torque_norm_guards_[i]) =
+        tau_external_norm / torque_norm_thresholds_(i);
+  }
+
+  if (!external_force_guards_.empty()) {
+    for (int g = 0; g < body_groups_.size(); g++) {
+      const BodyGroup &group = body_groups_[g];
+      // rotates forces from the expressed_in frame into the body frame
+      const Eigen::Isometry3d &H_body_expressed_in =
+          kinematics->RelativeTransform(group.idx_body, group.idx_expressed_in);
+      const drake::robot_plan_runner::JacobianMatrix &J =
+          kinematics->GeometricJacobian(group.idx_world, group.idx_body,
+                                        group.idx_body);
+      // a force only enters the twist through its linear (bottom) part
+      group_jacobians_.middleCols<3>(3 * g).noalias() =
+          J.bottomRows<3>().transpose() * H_body_expressed_in.linear();
+    }
+    torque_thresholds_.noalias() = group_jacobians_ * force_columns_;
+
+    for (int k = 0; k < external_force_guards_.size(); k++) {
+      // hack to avoid division by zero
+      fractions_(external_force_guards_[k]) =
+          tau_external_norm / (torque_thresholds_.col(k).norm() + 1e-5);
+    }
+  }
+
+  for (int i : other_guards_) {
+    fractions_(i) = guards_[i]->EvaluateGuard(kinematics, tau_external).second;
+  }
+
+  int idx_largest;
+  const double largest_fraction = fractions_.maxCoeff(&idx_largest);
+  const bool guard_triggered = largest_fraction > 1.0;
 
   for (int i = 0; i < guards_.size(); i++) {
-    result = guards_[i]->EvaluateGuard(cache_, q, tau_external);
-
-    if (i == 0) {
-      guard_triggered = result.first;
-      largest_fraction = result.second;
-      guard = guards_[i];
-    } else if (result.second > largest_fraction) {
-      guard_triggered = result.first;
-      largest_fraction = result.second;
-      guard = guards_[i];
+    if (fractions_(i) > 1.0) {
+      guards_[i]->has_been_triggered_ = true;
     }
   }
 
   if (guard_triggered) {
     has_been_triggered_ = true;
-    triggered_guard_ = guard;
+    triggered_guard_ = guards_[idx_largest];
   }
 
   return std::make_pair(guard_triggered,
-                        std::make_pair(guard_triggered, guard));
+                        std::make_pair(largest_fraction, guards_[idx_largest]));
 }
 
 } // spartan
@@ -0,0 +1,173 @@
+#include <drake_robot_control/iiwa_status_decoder.h>
+
+#include <endian.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <drake/common/drake_assert.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// fingerprint, utime and num_joints precede the arrays
+const size_t kHeaderSize = 20;
+const double kMarkerStride = 1000.;
+
+uint64_t GetBigEndian64(const char *source) {
+  uint64_t value;
+  std::memcpy(&value, source, sizeof(value));
+  return be64toh(value);
+}
+
+uint32_t GetBigEndian32(const char *source) {
+  uint32_t value;
+  std::memcpy(&value, source, sizeof(value));
+  return be32toh(value);
+}
+
+double GetBigEndianDouble(const char *source) {
+  const uint64_t bits = GetBigEndian64(source);
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+double *SnapshotField(RobotStatusSnapshot *status, int field) {
+  switch (field) {
+  case 0:
+    return status->joint_position_measured;
+  case 1:
+    return status->joint_velocity_estimated;
+  case 2:
+    return status->joint_position_commanded;
+  case 3:
+    return status->joint_torque_commanded;
+  default:
+    return status->joint_torque_external;
+  }
+}
+
+std::vector<double> *MessageField(lcmt_iiwa_status *message, int field) {
+  switch (field) {
+  case 0:
+    return &message->joint_position_measured;
+  case 1:
+    return &message->joint_velocity_estimated;
+  case 2:
+    return &message->joint_position_commanded;
+  case 3:
+    return &message->joint_torque_commanded;
+  default:
+    return &message->joint_torque_external;
+  }
+}
+
+} // namespace
+
+constexpr int IiwaStatusDecoder::kNumFields;
+
+IiwaStatusDecoder::IiwaStatusDecoder(int num_joints)
+    : num_joints_(num_joints), is_direct_(false), message_size_(0) {
+  DRAKE_DEMAND(num_joints > 0 && num_joints <= kMaxNumJoints);
+  message_.num_joints = num_joints;
+  message_.joint_position_ipo.assign(num_joints, 0.);
+  message_.joint_torque_measured.assign(num_joints, 0.);
+  for (int field = 0; field < kNumFields; field++) {
+    MessageField(&message_, field)->assign(num_joints, 0.);
+  }
+
+  // Encode a probe in which every array the snapshot keeps starts with its
+  // own marker, and find the markers in the encoded message.
+  lcmt_iiwa_status probe = message_;
+  probe.utime = 0x0102030405060708;
+  for (int field = 0; field < kNumFields; field++) {
+    for (int i = 0; i < num_joints; i++) {
+      (*MessageField(&probe, field))[i] = kMarkerStride * (field + 1) + i;
+    }
+  }
+  probe.joint_position_ipo.assign(num_joints, -1.);
+  probe.joint_torque_measured.assign(num_joints, -1.);
+  std::vector<char> buffer(probe.getEncodedSize());
+  if (probe.encode(buffer.data(), 0, buffer.size()) !=
+      static_cast<int>(buffer.size())) {
+    return;
+  }
+  message_size_ = buffer.size();
+  const size_t array_size = sizeof(double) * num_joints;
+  int num_found = 0;
+  for (size_t offset = kHeaderSize; offset + array_size <= buffer.size();
+       offset += array_size) {
+    const double marker = GetBigEndianDouble(buffer.data() + offset);
+    const int field = static_cast<int>(std::lround(marker / kMarkerStride)) - 1;
+    if (field >= 0 && field < kNumFields &&
+        marker == kMarkerStride * (field + 1)) {
+      field_offsets_[field] = offset;
+      num_found++;
+    }
+  }
+  if (num_found != kNumFields) {
+    return;
+  }
+
+  // the whole probe has to come back
+  RobotStatusSnapshot decoded;
+  if (!DecodeDirect(buffer.data(), buffer.size(), &decoded) ||
+      decoded.utime != probe.utime) {
+    return;
+  }
+  for (int field = 0; field < kNumFields; field++) {
+    for (int i = 0; i < num_joints; i++) {
+      if (SnapshotField(&decoded, field)[i] !=
+          (*MessageField(&probe, field))[i]) {
+        return;
+      }
+    }
+  }
+  is_direct_ = true;
+}
+
+bool IiwaStatusDecoder::Decode(const void *data, size_t size,
+                               RobotStatusSnapshot *status) {
+  if (is_direct_) {
+    return DecodeDirect(static_cast<const char *>(data), size, status);
+  }
+  if (message_.decode(data, 0, size) < 0 ||
+      message_.num_joints != num_joints_) {
+    return false;
+  }
+  status->utime = message_.utime;
+  status->num_joints = num_joints_;
+  for (int field = 0; field < kNumFields; field++) {
+    std::memcpy(SnapshotField(status, field),
+                MessageField(&message_, field)->data(),
+                sizeof(double) * num_joints_);
+  }
+  return true;
+}
+
+bool IiwaStatusDecoder::DecodeDirect(const char *data, size_t size,
+                                     RobotStatusSnapshot *status) const {
+  if (size != message_size_ ||
+      GetBigEndian64(data) !=
+          static_cast<uint64_t>(lcmt_iiwa_status::getHash()) ||
+      static_cast<int32_t>(GetBigEndian32(data + 16)) != num_joints_) {
+    return false;
+  }
+  status->utime = static_cast<int64_t>(GetBigEndian64(data + 8));
+  status->num_joints = num_joints_;
+  for (int field = 0; field < kNumFields; field++) {
+    double *destination = SnapshotField(status, field);
+    const char *source = data + field_offsets_[field];
+    for (int i = 0; i < num_joints_; i++) {
+      destination[i] = GetBigEndianDouble(source + sizeof(double) * i);
+    }
+  }
+  return true;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
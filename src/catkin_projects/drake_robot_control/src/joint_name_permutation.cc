@@ -0,0 +1,50 @@
+#include <drake_robot_control/joint_name_permutation.h>
+
+#include <algorithm>
+
+namespace drake {
+namespace robot_plan_runner {
+
+JointNamePermutationCache::JointNamePermutationCache(
+    const RigidBodyTreed &tree)
+    : num_lookups_(0) {
+  const std::map<std::string, int> name_to_idx =
+      tree.computePositionNameToIndexMap();
+  position_names_.assign(name_to_idx.begin(), name_to_idx.end());
+  entries_.reserve(kMaxNumEntries);
+}
+
+std::shared_ptr<const std::vector<int>>
+JointNamePermutationCache::Lookup(const std::vector<std::string> &names) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  num_lookups_++;
+  for (Entry &entry : entries_) {
+    if (entry.names == names) {
+      entry.last_used = num_lookups_;
+      return entry.indices;
+    }
+  }
+
+  auto indices = std::make_shared<std::vector<int>>(names.size(), kNotInTree);
+  for (size_t i = 0; i < names.size(); i++) {
+    const auto it = std::lower_bound(
+        position_names_.begin(), position_names_.end(), names[i],
+        [](const std::pair<std::string, int> &position,
+           const std::string &name) { return position.first < name; });
+    if (it != position_names_.end() && it->first == names[i]) {
+      (*indices)[i] = it->second;
+    }
+  }
+
+  if (static_cast<int>(entries_.size()) == kMaxNumEntries) {
+    entries_.erase(std::min_element(
+        entries_.begin(), entries_.end(), [](const Entry &a, const Entry &b) {
+          return a.last_used < b.last_used;
+        }));
+  }
+  entries_.push_back(Entry{names, indices, num_lookups_});
+  return indices;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -1,14 +1,28 @@
 #include <drake_robot_control/joint_space_streaming_plan.h>
+#include <drake_robot_control/status_mailbox.h>
 
 namespace drake {
 namespace robot_plan_runner {
+namespace {
+
+// MonotonicTimeNs() time of a ROS stamp, now if it is unset.
+int64_t StampToMonotonicNs(const ros::Time &stamp) {
+  const int64_t now_ns = MonotonicTimeNs();
+  if (stamp.isZero()) {
+    return now_ns;
+  }
+  return now_ns + (stamp - ros::Time::now()).toNSec();
+}
+
+} // namespace
 
 // Current robot state x = [q,v]
 // Current time t
 void JointSpaceStreamingPlan::Step(
     const Eigen::Ref<const Eigen::VectorXd> &x,
     const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
-    Eigen::VectorXd *const q_commanded, Eigen::VectorXd *const v_commanded,
+    TickKinematics *const kinematics, Eigen::VectorXd *const q_commanded,
+    Eigen::VectorXd *const v_commanded,
     Eigen::VectorXd *const tau_commanded) {
 
   PlanStatus not_started_status = PlanStatus::NOT_STARTED;
@@ -20,54 +34,71 @@ void JointSpaceStreamingPlan::Step(
   // if so just echo the last command
   if (this->is_stopped()) {
     *q_commanded = q_commanded_prev_;
-    *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+    tau_commanded->setZero();
     return;
   }
 
-  // do kinematics so we can check the force guards
-  Eigen::VectorXd q = x.head(this->get_num_positions());
-  Eigen::VectorXd v = x.tail(this->get_num_positions());
-  cache_measured_state_.initialize(q, v);
-  tree_->doKinematics(cache_measured_state_);
-
   // Check the external force guards
   if (guard_container_) {
     std::pair<bool, std::pair<double, std::shared_ptr<ForceGuard>>> result =
-                                          guard_container_->EvaluateGuards(cache_measured_state_, q,
-                                                                           tau_external);
+        guard_container_->EvaluateGuards(kinematics, tau_external);
 
     bool guard_triggered = result.first;
 
     if (guard_triggered) {
-      std::cout << "Force Guard Triggered, stopping plan" << std::endl;
-      std::cout << "ForceGuardType: " << result.second.second->get_type()
-                << std::endl;
+      PLAN_RUNNER_LOG(kWarn,
+                      "Force Guard Triggered, stopping plan\n"
+                      "ForceGuardType: %d",
+                      result.second.second->get_type());
       plan_status_ = PlanStatus::STOPPED_BY_FORCE_GUARD;
       this->SetPlanFinished();
 
       *q_commanded = q_commanded_prev_;
-      *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+      tau_commanded->setZero();
       return;
     }
   }
 
   // 
   std::lock_guard<std::mutex> lock(goal_mutex_);
-  if (q_commanded_.rows() == q_commanded->rows() &&
-      v_commanded_.rows() == v_commanded->rows() &&
-      tau_commanded_.rows() == tau_commanded->rows()){
-    *q_commanded = q_commanded_;
-    *v_commanded = v_commanded_;
-    *tau_commanded = tau_commanded_;
-  } else {
+  if (shared_setpoints_) {
+    ReadSharedSetpoint();
+  }
+  if (!setpoints_.Sample(MonotonicTimeNs(), q_commanded, v_commanded,
+                         tau_commanded)) {
    *q_commanded = q_commanded_prev_;
    *tau_commanded =  tau_commanded_prev_;
   }
 }
 
+void JointSpaceStreamingPlan::ReadSharedSetpoint() {
+  uint64_t sequence;
+  if (!shared_setpoints_->Read(&shared_setpoint_, &sequence) ||
+      sequence <= shared_setpoint_sequence_) {
+    return;
+  }
+  shared_setpoint_sequence_ = sequence;
+
+  if (shared_setpoint_.num_joints != this->get_num_positions()) {
+    PLAN_RUNNER_LOG_THROTTLE(kWarn, 1.0,
+                             "Discarding shared memory setpoint with %d "
+                             "joints, the robot has %d",
+                             shared_setpoint_.num_joints,
+                             this->get_num_positions());
+    return;
+  }
+  typedef Eigen::Map<const Eigen::VectorXd> ConstMap;
+  const int n = this->get_num_positions();
+  setpoints_.Insert(shared_setpoint_.stamp_ns > 0 ? shared_setpoint_.stamp_ns
+                                                  : MonotonicTimeNs(),
+                    ConstMap(shared_setpoint_.position, n),
+                    ConstMap(shared_setpoint_.velocity, n),
+                    ConstMap(shared_setpoint_.effort, n));
+}
+
 void JointSpaceStreamingPlan::HandleSetpoint(const sensor_msgs::JointState::ConstPtr& msg) {
-  std::map<std::string, int> name_to_idx =
-    tree_->computePositionNameToIndexMap();
+  const std::shared_ptr<const std::vector<int>> name_to_idx =
+      joint_names_->Lookup(msg->name);
 
   DRAKE_ASSERT(msg->position.size() == msg->name.size());
   DRAKE_ASSERT(msg->velocity.size() == msg->name.size());
@@ -79,17 +110,52 @@ void JointSpaceStreamingPlan::HandleSetpoint(const sensor_msgs::JointState::Cons
   Eigen::VectorXd tau = Eigen::VectorXd::Zero(this->get_num_positions());
 
   for (int i = 0; i < msg->name.size(); i++) {
-    if (name_to_idx.count(msg->name[i]) == 0) {
+    const int ind = (*name_to_idx)[i];
+    if (ind == JointNamePermutationCache::kNotInTree) {
       continue;
     }
-    int ind = name_to_idx[msg->name[i]];
     DRAKE_ASSERT(ind < this->get_num_positions());
     DRAKE_ASSERT(ind < this->get_num_velocities());
     q[ind] = msg->position[i];
     v[ind] = msg->velocity[i];
     tau[ind] = msg->effort[i];
   }
-  SetGoal(q, v, tau);
+  SetGoal(StampToMonotonicNs(msg->header.stamp), q, v, tau);
+}
+
+void JointSpaceStreamingPlan::HandleTrajectory(
+    const trajectory_msgs::JointTrajectory::ConstPtr& msg) {
+  const std::shared_ptr<const std::vector<int>> name_to_idx =
+      joint_names_->Lookup(msg->joint_names);
+  const int64_t start_time_ns = StampToMonotonicNs(msg->header.stamp);
+
+  Eigen::VectorXd q = Eigen::VectorXd::Zero(this->get_num_positions());
+  Eigen::VectorXd v = Eigen::VectorXd::Zero(this->get_num_velocities());
+  Eigen::VectorXd tau = Eigen::VectorXd::Zero(this->get_num_positions());
+
+  std::lock_guard<std::mutex> lock(goal_mutex_);
+  for (const trajectory_msgs::JointTrajectoryPoint &point : msg->points) {
+    if (point.positions.size() != msg->joint_names.size()) {
+      ROS_WARN("Discarding streaming trajectory point with %zu positions for "
+               "%zu joints", point.positions.size(), msg->joint_names.size());
+      continue;
+    }
+    // velocities and efforts are optional
+    const bool has_velocities =
+        point.velocities.size() == point.positions.size();
+    const bool has_efforts = point.effort.size() == point.positions.size();
+    for (int i = 0; i < msg->joint_names.size(); i++) {
+      const int ind = (*name_to_idx)[i];
+      if (ind == JointNamePermutationCache::kNotInTree) {
+        continue;
+      }
+      q[ind] = point.positions[i];
+      v[ind] = has_velocities ? point.velocities[i] : 0.;
+      tau[ind] = has_efforts ? point.effort[i] : 0.;
+    }
+    setpoints_.Insert(start_time_ns + point.time_from_start.toNSec(), q, v,
+                      tau);
+  }
 }
 
 } // namespace robot_plan_runner
@@ -8,7 +8,8 @@ namespace robot_plan_runner {
 void JointSpaceTrajectoryPlan::Step(
     const Eigen::Ref<const Eigen::VectorXd> &x,
     const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
-    Eigen::VectorXd *const q_commanded, Eigen::VectorXd *const v_commanded,
+    TickKinematics *const kinematics, Eigen::VectorXd *const q_commanded,
+    Eigen::VectorXd *const v_commanded,
     Eigen::VectorXd *const tau_commanded) {
 
   PlanStatus not_started_status = PlanStatus::NOT_STARTED;
@@ -20,48 +21,48 @@ void JointSpaceTrajectoryPlan::Step(
   // if so just echo the last command
   if (this->is_stopped()) {
     *q_commanded = q_commanded_prev_;
-    *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+    tau_commanded->setZero();
     return;
   }
 
 
-  // do kinematics so we can check the force guards
-  Eigen::VectorXd q = x.head(this->get_num_positions());
-  Eigen::VectorXd v = x.tail(this->get_num_positions());
-  cache_measured_state_.initialize(q, v);
-  tree_->doKinematics(cache_measured_state_);
-
   // Check the external force guards
   if (guard_container_) {
     std::pair<bool, std::pair<double, std::shared_ptr<ForceGuard>>> result =
-                                          guard_container_->EvaluateGuards(cache_measured_state_, q,
-                                                                           tau_external);
+        guard_container_->EvaluateGuards(kinematics, tau_external);
 
     bool guard_triggered = result.first;
 
     if (guard_triggered) {
-      std::cout << "Force Guard Triggered, stopping plan" << std::endl;
-      std::cout << "ForceGuardType: " << result.second.second->get_type()
-                << std::endl;
+      PLAN_RUNNER_LOG(kWarn,
+                      "Force Guard Triggered, stopping plan\n"
+                      "ForceGuardType: %d",
+                      result.second.second->get_type());
       plan_status_ = PlanStatus::STOPPED_BY_FORCE_GUARD;
       this->SetPlanFinished();
 
       *q_commanded = q_commanded_prev_;
-      *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+      tau_commanded->setZero();
       return;
     }
   }
 
   DRAKE_ASSERT(t >= 0);
-  *q_commanded = traj_.value(t);
-  *v_commanded = traj_d_.value(t);
-  *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+  if (is_hold_) {
+    *q_commanded = hold_position_;
+    v_commanded->setZero();
+  } else if (baked_traj_) {
+    baked_traj_->Evaluate(t, q_commanded, v_commanded);
+  } else {
+    traj_table_.Evaluate(t, *q_commanded, *v_commanded);
+  }
+  tau_commanded->setZero();
 
   if (t > this->duration()) {
 
     if (plan_status_.compare_exchange_strong(running_status,
                                              PlanStatus::FINISHED_NORMALLY)) {
-      ROS_INFO("plan finished normally");
+      PLAN_RUNNER_LOG(kInfo, "plan finished normally");
 
       // notify the condition variable
       this->SetPlanFinished();
@@ -69,6 +70,29 @@ void JointSpaceTrajectoryPlan::Step(
   }
 }
 
+bool JointSpaceTrajectoryPlan::Bake(double sample_period) {
+  baked_traj_ = BakedTrajectory::Make(traj_, traj_d_, sample_period);
+  baked_sample_period_ = sample_period;
+  return baked_traj_ != nullptr;
+}
+
+bool JointSpaceTrajectoryPlan::GetFinalPosition(
+    Eigen::VectorXd *const q_final) const {
+  if (is_hold_) {
+    *q_final = hold_position_;
+  } else {
+    *q_final = traj_.value(traj_.end_time());
+  }
+  return true;
+}
+
+void JointSpaceTrajectoryPlan::ResetHoldPosition(
+    const Eigen::Ref<const Eigen::VectorXd> &q) {
+  DRAKE_ASSERT(is_hold_);
+  hold_position_ = q;
+  Restart();
+}
+
 std::unique_ptr<JointSpaceTrajectoryPlan>
 JointSpaceTrajectoryPlan::MakeHoldCurrentPositionPlan(std::shared_ptr<const RigidBodyTreed> tree,
                             const Eigen::Ref<const Eigen::VectorXd> &q) {
@@ -83,6 +107,8 @@ JointSpaceTrajectoryPlan::MakeHoldCurrentPositionPlan(std::shared_ptr<const Rigi
   }
   auto ptr = std::make_unique<JointSpaceTrajectoryPlan>(
       tree, PPType::ZeroOrderHold(times, knots));
+  ptr->is_hold_ = true;
+  ptr->hold_position_ = q;
   return std::move(ptr);
 }
 
@@ -0,0 +1,219 @@
+#include <drake_robot_control/joint_trajectory_fit.h>
+
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+#include <drake/common/drake_assert.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+double NowS() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+JointTrajectoryFitOptions
+JointTrajectoryFitOptions::FromYaml(const YAML::Node &node) {
+  JointTrajectoryFitOptions options;
+  if (!node) {
+    return options;
+  }
+  if (node["decimation_tolerance_deg"]) {
+    options.decimation_tolerance =
+        node["decimation_tolerance_deg"].as<double>() * M_PI / 180.;
+  }
+  return options;
+}
+
+bool TimesStrictlyIncrease(const std::vector<double> &times) {
+  for (size_t i = 1; i < times.size(); i++) {
+    if (!(times[i] > times[i - 1])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<int> DecimateKnots(const std::vector<double> &times,
+                               const Eigen::Ref<const Eigen::MatrixXd> &knots,
+                               double tolerance) {
+  const int num_knots = knots.cols();
+  DRAKE_DEMAND(static_cast<int>(times.size()) == num_knots);
+  std::vector<int> kept;
+  if (num_knots <= 2 || tolerance <= 0) {
+    for (int i = 0; i < num_knots; i++) {
+      kept.push_back(i);
+    }
+    return kept;
+  }
+
+  std::vector<char> keep(num_knots, 0);
+  keep[0] = keep[num_knots - 1] = 1;
+  // spans between kept knots still to be checked, an explicit stack so
+  // 100k knot inputs do not recurse that deep
+  std::vector<std::pair<int, int>> spans;
+  spans.emplace_back(0, num_knots - 1);
+  while (!spans.empty()) {
+    const int first = spans.back().first;
+    const int last = spans.back().second;
+    spans.pop_back();
+    if (last - first < 2) {
+      continue;
+    }
+    const double t0 = times[first];
+    const double dt = times[last] - t0;
+    int farthest = -1;
+    double max_error = tolerance;
+    for (int i = first + 1; i < last; i++) {
+      const double s = dt > 0 ? (times[i] - t0) / dt : 0.;
+      const double error =
+          (knots.col(i) - (1 - s) * knots.col(first) - s * knots.col(last))
+              .cwiseAbs()
+              .maxCoeff();
+      if (error > max_error) {
+        max_error = error;
+        farthest = i;
+      }
+    }
+    if (farthest >= 0) {
+      keep[farthest] = 1;
+      spans.emplace_back(first, farthest);
+      spans.emplace_back(farthest, last);
+    }
+  }
+
+  for (int i = 0; i < num_knots; i++) {
+    if (keep[i]) {
+      kept.push_back(i);
+    }
+  }
+  return kept;
+}
+
+PPType FitCubicSpline(const std::vector<double> &times,
+                      const Eigen::Ref<const Eigen::MatrixXd> &knots,
+                      const Eigen::Ref<const Eigen::VectorXd> &v_start,
+                      const Eigen::Ref<const Eigen::VectorXd> &v_end) {
+  const int num_knots = knots.cols();
+  const int n = knots.rows();
+  DRAKE_DEMAND(num_knots >= 2);
+  DRAKE_DEMAND(static_cast<int>(times.size()) == num_knots);
+
+  // Knot velocities v. Continuity of the acceleration at interior knot i
+  // gives
+  //   h_i v_{i-1} + 2 (h_{i-1} + h_i) v_i + h_{i-1} v_{i+1}
+  //     = 3 (h_i / h_{i-1} (q_i - q_{i-1}) + h_{i-1} / h_i (q_{i+1} - q_i))
+  // with h_i = t_{i+1} - t_i. The system is strictly diagonally dominant, so
+  // the Thomas algorithm needs no pivoting.
+  Eigen::MatrixXd v(n, num_knots);
+  v.col(0) = v_start;
+  v.col(num_knots - 1) = v_end;
+  if (num_knots > 2) {
+    const int num_interior = num_knots - 2;
+    // forward sweep: the upper diagonal scaled by the pivots, and the rhs
+    std::vector<double> upper(num_interior);
+    Eigen::MatrixXd rhs(n, num_interior);
+    for (int k = 0; k < num_interior; k++) {
+      const int i = k + 1;
+      const double h_prev = times[i] - times[i - 1];
+      const double h = times[i + 1] - times[i];
+      DRAKE_DEMAND(h_prev > 0 && h > 0);
+      const double lower = h;
+      double diagonal = 2 * (h_prev + h);
+      rhs.col(k) = 3 * (h / h_prev * (knots.col(i) - knots.col(i - 1)) +
+                        h_prev / h * (knots.col(i + 1) - knots.col(i)));
+      if (k == 0) {
+        rhs.col(k) -= lower * v.col(0);
+      } else {
+        diagonal -= lower * upper[k - 1];
+        rhs.col(k) -= lower * rhs.col(k - 1);
+      }
+      if (k == num_interior - 1) {
+        rhs.col(k) -= h_prev * v.col(num_knots - 1);
+      }
+      upper[k] = h_prev / diagonal;
+      rhs.col(k) /= diagonal;
+    }
+    // back substitution
+    v.col(num_interior) = rhs.col(num_interior - 1);
+    for (int k = num_interior - 2; k >= 0; k--) {
+      v.col(k + 1) = rhs.col(k) - upper[k] * v.col(k + 2);
+    }
+  }
+
+  std::vector<Eigen::MatrixXd> knot_matrices(num_knots);
+  std::vector<Eigen::MatrixXd> knot_dot_matrices(num_knots);
+  for (int i = 0; i < num_knots; i++) {
+    knot_matrices[i] = knots.col(i);
+    knot_dot_matrices[i] = v.col(i);
+  }
+  return PPType::Cubic(times, knot_matrices, knot_dot_matrices);
+}
+
+PPType FitJointTrajectory(const std::vector<double> &times,
+                          const Eigen::Ref<const Eigen::MatrixXd> &knots,
+                          const JointTrajectoryFitOptions &options,
+                          JointTrajectoryFitStats *const stats) {
+  const double start_s = NowS();
+  std::vector<int> kept =
+      DecimateKnots(times, knots, options.decimation_tolerance);
+  const double decimated_s = NowS();
+
+  const Eigen::VectorXd zero = Eigen::VectorXd::Zero(knots.rows());
+  PPType spline;
+  while (true) {
+    std::vector<double> kept_times(kept.size());
+    Eigen::MatrixXd kept_knots(knots.rows(), kept.size());
+    for (int i = 0; i < static_cast<int>(kept.size()); i++) {
+      kept_times[i] = times[kept[i]];
+      kept_knots.col(i) = knots.col(kept[i]);
+    }
+    spline = FitCubicSpline(kept_times, kept_knots, zero, zero);
+    if (static_cast<int>(kept.size()) == knots.cols()) {
+      break;
+    }
+
+    // The spline bulges away from the chords DecimateKnots measured against,
+    // so check it at the dropped knots and keep the worst one of each span
+    // that is out of tolerance. Terminates, at the latest with every knot.
+    std::vector<int> refined;
+    for (int k = 0; k + 1 < static_cast<int>(kept.size()); k++) {
+      refined.push_back(kept[k]);
+      int worst = -1;
+      double max_error = options.decimation_tolerance;
+      for (int i = kept[k] + 1; i < kept[k + 1]; i++) {
+        const double error =
+            (spline.value(times[i]) - knots.col(i)).cwiseAbs().maxCoeff();
+        if (error > max_error) {
+          max_error = error;
+          worst = i;
+        }
+      }
+      if (worst >= 0) {
+        refined.push_back(worst);
+      }
+    }
+    refined.push_back(kept.back());
+    if (refined.size() == kept.size()) {
+      break;
+    }
+    kept = std::move(refined);
+  }
+
+  if (stats) {
+    stats->num_input_knots = knots.cols();
+    stats->num_knots = kept.size();
+    stats->decimation_s = decimated_s - start_s;
+    stats->fit_s = NowS() - decimated_s;
+  }
+  return spline;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
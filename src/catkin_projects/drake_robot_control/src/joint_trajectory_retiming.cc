@@ -0,0 +1,281 @@
+#include <drake_robot_control/joint_trajectory_retiming.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <drake/common/drake_assert.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// x = s_dot^2 bound where the path does not move and nothing limits it
+const double kMaxPathSpeedSquared = 1e4;
+const int kBisectionIterations = 60;
+const double kInfinity = std::numeric_limits<double>::infinity();
+
+double NowS() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Narrows [*u_min, *u_max] to the s_ddot u for which the joint accelerations
+// u_coefficient u + x_coefficient x stay within max_acceleration at path
+// speed x. Called with (q', q'') this is the acceleration at a grid point.
+// @return false if the range is empty
+bool IntersectAccelerationRange(const Eigen::VectorXd &u_coefficient,
+                                const Eigen::VectorXd &x_coefficient,
+                                const Eigen::VectorXd &max_acceleration,
+                                double x, double *const u_min,
+                                double *const u_max) {
+  for (int j = 0; j < u_coefficient.size(); j++) {
+    const double a = max_acceleration[j];
+    if (std::abs(u_coefficient[j]) < 1e-12) {
+      // whatever u
+      if (std::abs(x_coefficient[j]) * x > a) {
+        return false;
+      }
+      continue;
+    }
+    double lower = (-a - x_coefficient[j] * x) / u_coefficient[j];
+    double upper = (a - x_coefficient[j] * x) / u_coefficient[j];
+    if (u_coefficient[j] < 0) {
+      std::swap(lower, upper);
+    }
+    *u_min = std::max(*u_min, lower);
+    *u_max = std::min(*u_max, upper);
+  }
+  return *u_min <= *u_max;
+}
+
+// Largest x in [0, x_max] satisfying is_feasible, which holds on an interval
+// containing 0.
+template <typename Feasible>
+double LargestFeasible(double x_max, const Feasible &is_feasible) {
+  if (is_feasible(x_max)) {
+    return x_max;
+  }
+  double lower = 0., upper = x_max;
+  for (int i = 0; i < kBisectionIterations; i++) {
+    const double x = 0.5 * (lower + upper);
+    if (is_feasible(x)) {
+      lower = x;
+    } else {
+      upper = x;
+    }
+  }
+  return lower;
+}
+
+double ReadLimit(const std::map<std::string, double> &limits,
+                 const std::string &name, double default_limit) {
+  auto it = limits.find(name);
+  return it == limits.end() ? default_limit : it->second;
+}
+
+} // namespace
+
+JointTrajectoryRetimingOptions
+JointTrajectoryRetimingOptions::FromYaml(const YAML::Node &node) {
+  JointTrajectoryRetimingOptions options;
+  if (!node) {
+    return options;
+  }
+  if (node["enabled"]) {
+    options.enabled = node["enabled"].as<bool>();
+  }
+  if (node["velocity_limit_fraction"]) {
+    options.velocity_limit_fraction =
+        node["velocity_limit_fraction"].as<double>();
+  }
+  if (node["max_joint_acceleration_deg"]) {
+    options.max_joint_acceleration_deg =
+        node["max_joint_acceleration_deg"].as<double>();
+  }
+  if (node["joint_velocity_limits_deg"]) {
+    options.joint_velocity_limits_deg =
+        node["joint_velocity_limits_deg"].as<std::map<std::string, double>>();
+  }
+  if (node["joint_acceleration_limits_deg"]) {
+    options.joint_acceleration_limits_deg =
+        node["joint_acceleration_limits_deg"]
+            .as<std::map<std::string, double>>();
+  }
+  if (node["grid_step_s"]) {
+    options.grid_step_s = node["grid_step_s"].as<double>();
+  }
+  if (node["grid_step_deg"]) {
+    options.grid_step_deg = node["grid_step_deg"].as<double>();
+  }
+  return options;
+}
+
+void JointTrajectoryRetimingOptions::GetLimits(
+    const std::vector<std::string> &joint_names, double speed_limit_deg,
+    Eigen::VectorXd *const max_velocity,
+    Eigen::VectorXd *const max_acceleration) const {
+  const int n = joint_names.size();
+  max_velocity->resize(n);
+  max_acceleration->resize(n);
+  for (int i = 0; i < n; i++) {
+    const double velocity_deg = std::min(
+        speed_limit_deg,
+        ReadLimit(joint_velocity_limits_deg, joint_names[i], speed_limit_deg));
+    (*max_velocity)[i] = velocity_limit_fraction * velocity_deg * M_PI / 180.;
+    (*max_acceleration)[i] = ReadLimit(joint_acceleration_limits_deg,
+                                       joint_names[i],
+                                       max_joint_acceleration_deg) *
+                             M_PI / 180.;
+  }
+}
+
+bool RetimeJointTrajectory(
+    const PPType &path, const Eigen::Ref<const Eigen::VectorXd> &max_velocity,
+    const Eigen::Ref<const Eigen::VectorXd> &max_acceleration,
+    double grid_step, double grid_step_distance, PPType *const retimed,
+    JointTrajectoryRetimingStats *const stats) {
+  const double start_s = NowS();
+  const int n = path.rows();
+  DRAKE_DEMAND(max_velocity.size() == n && max_acceleration.size() == n);
+  DRAKE_DEMAND(grid_step > 0 && grid_step_distance > 0);
+  DRAKE_DEMAND(retimed != nullptr);
+
+  const double s_start = path.start_time();
+  const double s_end = path.end_time();
+  const double length = s_end - s_start;
+  DRAKE_DEMAND(length > 0);
+  const Eigen::VectorXd a_max = max_acceleration;
+
+  // Grid on the path and the path derivatives there. Steps are at most
+  // grid_step and move no joint more than about grid_step_distance, the
+  // retimed spline interpolates between grid points and strays from the
+  // limits on long ones.
+  const PPType path_s = path.derivative(1);
+  const PPType path_ss = path_s.derivative(1);
+  const double min_step = std::min(grid_step, length * 1e-6);
+  std::vector<double> s_grid;
+  std::vector<Eigen::VectorXd> q, q_s, q_ss;
+  double s = s_start;
+  while (true) {
+    s_grid.push_back(s);
+    q.push_back(path.value(s));
+    q_s.push_back(path_s.value(s));
+    q_ss.push_back(path_ss.value(s));
+    if (s >= s_end) {
+      break;
+    }
+    // q' dominates where the path moves, q'' where it starts from rest
+    const double speed = q_s.back().cwiseAbs().maxCoeff();
+    const double curvature = q_ss.back().cwiseAbs().maxCoeff();
+    double step = grid_step;
+    if (speed * step + 0.5 * curvature * step * step > grid_step_distance) {
+      step = std::max(min_step,
+                      std::min(grid_step_distance / speed,
+                               std::sqrt(2 * grid_step_distance / curvature)));
+    }
+    if (s_end - s <= step) {
+      s = s_end;
+    } else if (s_end - s < 1.5 * step) {
+      s = 0.5 * (s + s_end); // no sliver at the end
+    } else {
+      s += step;
+    }
+  }
+  const int num_points = s_grid.size();
+  std::vector<double> ds(num_points - 1);
+  for (int i = 0; i < num_points - 1; i++) {
+    ds[i] = s_grid[i + 1] - s_grid[i];
+  }
+
+  // maximum velocity curve, the largest x each point allows on its own
+  std::vector<double> x_limit(num_points);
+  for (int i = 0; i < num_points; i++) {
+    double x_velocity = kMaxPathSpeedSquared;
+    for (int j = 0; j < n; j++) {
+      const double speed = std::abs(q_s[i][j]);
+      if (speed * std::sqrt(kMaxPathSpeedSquared) > max_velocity[j]) {
+        x_velocity =
+            std::min(x_velocity, std::pow(max_velocity[j] / speed, 2));
+      }
+    }
+    x_limit[i] = LargestFeasible(x_velocity, [&](double x) {
+      double u_min = -kInfinity, u_max = kInfinity;
+      return IntersectAccelerationRange(q_s[i], q_ss[i], a_max, x, &u_min,
+                                        &u_max);
+    });
+  }
+
+  // Range of u on segment i starting at x. Following the first order
+  // interpolation of TOPP-RA the accelerations are bounded at both ends, the
+  // path speed at the end being x + 2 ds u. Bounding them at the start only
+  // lets u grow without limit where the path barely moves, as at its ends.
+  auto segment_range = [&](int i, double x, double *const u_min,
+                           double *const u_max) {
+    *u_min = -kInfinity;
+    *u_max = kInfinity;
+    return IntersectAccelerationRange(q_s[i], q_ss[i], a_max, x, u_min,
+                                      u_max) &&
+           IntersectAccelerationRange(q_s[i + 1] + 2 * ds[i] * q_ss[i + 1],
+                                      q_ss[i + 1], a_max, x, u_min, u_max);
+  };
+
+  // backward pass: controllable sets [0, x_reachable[i]], from which the
+  // end is reached at rest
+  std::vector<double> x_reachable(num_points);
+  x_reachable[num_points - 1] = 0.;
+  for (int i = num_points - 2; i >= 0; i--) {
+    const double x_next = x_reachable[i + 1];
+    x_reachable[i] = LargestFeasible(x_limit[i], [&](double x) {
+      double u_min, u_max;
+      return segment_range(i, x, &u_min, &u_max) &&
+             u_min <= (x_next - x) / (2 * ds[i]) &&
+             u_max >= -x / (2 * ds[i]);
+    });
+  }
+
+  // forward pass: greedily the largest s_ddot
+  std::vector<double> x(num_points);
+  x[0] = 0.;
+  for (int i = 0; i < num_points - 1; i++) {
+    double u_min, u_max;
+    segment_range(i, x[i], &u_min, &u_max);
+    const double u =
+        std::min(u_max, (x_reachable[i + 1] - x[i]) / (2 * ds[i]));
+    x[i + 1] =
+        std::min(std::max(0., x[i] + 2 * ds[i] * u), x_reachable[i + 1]);
+  }
+
+  // s_ddot constant between grid points, the retimed plan starts when path
+  // does
+  std::vector<double> times(num_points);
+  std::vector<Eigen::MatrixXd> knots(num_points);
+  std::vector<Eigen::MatrixXd> knots_dot(num_points);
+  times[0] = s_start;
+  for (int i = 0; i < num_points; i++) {
+    if (i > 0) {
+      const double speed_sum = std::sqrt(x[i - 1]) + std::sqrt(x[i]);
+      if (!(speed_sum > 0)) {
+        return false;
+      }
+      times[i] = times[i - 1] + 2 * ds[i - 1] / speed_sum;
+    }
+    knots[i] = q[i];
+    knots_dot[i] = q_s[i] * std::sqrt(x[i]);
+  }
+  *retimed = PPType::Cubic(times, knots, knots_dot);
+
+  if (stats) {
+    stats->input_duration = length;
+    stats->duration = times.back() - times.front();
+    stats->num_grid_points = num_points;
+    stats->retiming_s = NowS() - start_s;
+  }
+  return true;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,88 @@
+#include <drake_robot_control/kinematics_cache_pool.h>
+
+#include <map>
+
+namespace drake {
+namespace robot_plan_runner {
+
+void KinematicsCachePool::Lease::Release() {
+  if (cache_) {
+    pool_->Return(std::move(cache_));
+  }
+  pool_.reset();
+}
+
+std::shared_ptr<KinematicsCachePool>
+KinematicsCachePool::Get(const std::shared_ptr<const RigidBodyTreed> &tree) {
+  static std::mutex registry_mutex;
+  // A pool holds its tree, so an entry that has not expired cannot refer to a
+  // tree that was freed and its address reused.
+  static std::map<const RigidBodyTreed *, std::weak_ptr<KinematicsCachePool>>
+      registry;
+
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::weak_ptr<KinematicsCachePool> &entry = registry[tree.get()];
+  std::shared_ptr<KinematicsCachePool> pool = entry.lock();
+  if (!pool) {
+    pool.reset(new KinematicsCachePool(tree));
+    entry = pool;
+  }
+  return pool;
+}
+
+std::unique_ptr<KinematicsCache<double>>
+KinematicsCachePool::CreateCache() const {
+  return std::unique_ptr<KinematicsCache<double>>(
+      new KinematicsCache<double>(tree_->CreateKinematicsCache()));
+}
+
+void KinematicsCachePool::Reserve(int num_caches) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (num_caches_ >= num_caches) {
+        return;
+      }
+    }
+    // created outside the lock, Acquire does not wait for it
+    std::unique_ptr<KinematicsCache<double>> cache = CreateCache();
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_caches_++;
+    idle_.reserve(num_caches_);
+    idle_.push_back(std::move(cache));
+  }
+}
+
+KinematicsCachePool::Lease KinematicsCachePool::Acquire() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_.empty()) {
+      std::unique_ptr<KinematicsCache<double>> cache = std::move(idle_.back());
+      idle_.pop_back();
+      num_hits_++;
+      return Lease(shared_from_this(), std::move(cache));
+    }
+  }
+  std::unique_ptr<KinematicsCache<double>> cache = CreateCache();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_caches_++;
+    idle_.reserve(num_caches_);
+  }
+  num_misses_++;
+  return Lease(shared_from_this(), std::move(cache));
+}
+
+int KinematicsCachePool::num_caches() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_caches_;
+}
+
+void KinematicsCachePool::Return(
+    std::unique_ptr<KinematicsCache<double>> cache) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  idle_.push_back(std::move(cache));
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
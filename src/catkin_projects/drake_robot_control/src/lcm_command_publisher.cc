@@ -0,0 +1,215 @@
+#include <drake_robot_control/lcm_command_publisher.h>
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <drake/lcmt_iiwa_command.hpp>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// lcm_udpm.c: magic of a message sent in a single datagram, and the largest
+// such message including header and channel
+const uint32_t kShortHeaderMagic = 0x4c433032; // "LC02"
+const size_t kShortHeaderSize = 8;
+const size_t kShortMessageMaxSize = 65499;
+const size_t kMaxChannelNameLength = 63;
+const uint16_t kDefaultPort = 7667;
+const char *const kDefaultAddress = "239.255.76.67";
+
+// fields of the udpm URL this publisher needs
+struct UdpmUrl {
+  std::string address;
+  uint16_t port;
+  int ttl;
+};
+
+// udpm://[address[:port]][?ttl=N&...], the other options only concern
+// receiving
+bool ParseUdpmUrl(const std::string &url, UdpmUrl *const parsed) {
+  const std::string scheme = "udpm://";
+  if (url.compare(0, scheme.size(), scheme) != 0) {
+    return false;
+  }
+  const size_t query = url.find('?', scheme.size());
+  const std::string network =
+      url.substr(scheme.size(), query == std::string::npos
+                                    ? std::string::npos
+                                    : query - scheme.size());
+  const size_t colon = network.find(':');
+  parsed->address = network.substr(0, colon);
+  if (parsed->address.empty()) {
+    parsed->address = kDefaultAddress;
+  }
+  parsed->port = kDefaultPort;
+  if (colon != std::string::npos) {
+    const int port = std::atoi(network.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) {
+      return false;
+    }
+    parsed->port = port;
+  }
+  parsed->ttl = 0;
+  size_t option = query;
+  while (option != std::string::npos) {
+    const size_t end = url.find('&', option + 1);
+    const std::string key_value = url.substr(
+        option + 1, end == std::string::npos ? end : end - option - 1);
+    if (key_value.compare(0, 4, "ttl=") == 0) {
+      parsed->ttl = std::atoi(key_value.c_str() + 4);
+    }
+    option = end;
+  }
+  return true;
+}
+
+void PutBigEndian32(uint32_t value, char *const destination) {
+  value = htobe32(value);
+  std::memcpy(destination, &value, sizeof(value));
+}
+
+void PutBigEndian64(uint64_t value, char *const destination) {
+  value = htobe64(value);
+  std::memcpy(destination, &value, sizeof(value));
+}
+
+void PutBigEndianDouble(double value, char *const destination) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  PutBigEndian64(bits, destination);
+}
+
+} // namespace
+
+constexpr const char *LcmCommandPublisher::kDefaultUrl;
+
+std::unique_ptr<LcmCommandPublisher>
+LcmCommandPublisher::Open(const std::string &url, const std::string &channel,
+                          int num_joints) {
+  std::string provider_url = url;
+  if (provider_url.empty()) {
+    const char *default_url = std::getenv("LCM_DEFAULT_URL");
+    provider_url = default_url && default_url[0] ? default_url : kDefaultUrl;
+  }
+  UdpmUrl udpm;
+  struct sockaddr_in destination;
+  std::memset(&destination, 0, sizeof(destination));
+  destination.sin_family = AF_INET;
+  if (!ParseUdpmUrl(provider_url, &udpm) ||
+      inet_pton(AF_INET, udpm.address.c_str(), &destination.sin_addr) != 1 ||
+      channel.empty() || channel.size() > kMaxChannelNameLength ||
+      num_joints <= 0) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  destination.sin_port = htons(udpm.port);
+
+  // Packet template: header, channel and the message as the generated
+  // encoder writes it with all joints at 0.
+  lcmt_iiwa_command command;
+  command.utime = 0;
+  command.num_joints = num_joints;
+  command.joint_position.assign(num_joints, 0.);
+  command.num_torques = num_joints;
+  command.joint_torque.assign(num_joints, 0.);
+  const size_t payload_offset = kShortHeaderSize + channel.size() + 1;
+  const int payload_size = command.getEncodedSize();
+  if (payload_offset + payload_size >= kShortMessageMaxSize) {
+    errno = EMSGSIZE;
+    return nullptr;
+  }
+  std::vector<char> packet(payload_offset + payload_size, 0);
+  PutBigEndian32(kShortHeaderMagic, packet.data());
+  std::memcpy(packet.data() + kShortHeaderSize, channel.c_str(),
+              channel.size() + 1);
+  if (command.encode(packet.data(), payload_offset, payload_size) !=
+      payload_size) {
+    errno = EPROTO;
+    return nullptr;
+  }
+
+  const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  // as lcm_udpm sets up its send socket, TTL 0 keeps packets on the host
+  const unsigned char ttl = udpm.ttl;
+  const unsigned char loop = 1;
+  if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) !=
+          0 ||
+      connect(fd, reinterpret_cast<struct sockaddr *>(&destination),
+              sizeof(destination)) != 0) {
+    const int error = errno;
+    close(fd);
+    errno = error;
+    return nullptr;
+  }
+
+  std::unique_ptr<LcmCommandPublisher> publisher(new LcmCommandPublisher(
+      fd, num_joints, std::move(packet), payload_offset));
+
+  // The offsets follow from the lcmt_iiwa_command layout. Check them against
+  // the generated encoder, so a changed message type falls back to lcm::LCM
+  // instead of publishing garbage.
+  command.utime = 0x0102030405060708;
+  Eigen::VectorXd position(num_joints), torque(num_joints);
+  for (int i = 0; i < num_joints; i++) {
+    command.joint_position[i] = position[i] = 0.5 + i;
+    command.joint_torque[i] = torque[i] = -0.25 - i;
+  }
+  std::vector<char> expected(payload_size);
+  command.encode(expected.data(), 0, payload_size);
+  publisher->Patch(command.utime, position, torque);
+  if (std::memcmp(publisher->packet_.data() + payload_offset, expected.data(),
+                  payload_size) != 0) {
+    errno = EPROTO;
+    return nullptr;
+  }
+  return publisher;
+}
+
+LcmCommandPublisher::LcmCommandPublisher(int fd, int num_joints,
+                                         std::vector<char> packet,
+                                         size_t payload_offset)
+    : fd_(fd), num_joints_(num_joints), packet_(std::move(packet)),
+      // fingerprint, utime, num_joints, joint_position, num_torques
+      utime_offset_(payload_offset + 8), position_offset_(utime_offset_ + 12),
+      torque_offset_(position_offset_ + 8 * num_joints + 4),
+      sequence_number_(0) {
+  iov_.iov_base = packet_.data();
+  iov_.iov_len = packet_.size();
+  std::memset(&msg_, 0, sizeof(msg_));
+  msg_.msg_iov = &iov_;
+  msg_.msg_iovlen = 1;
+}
+
+LcmCommandPublisher::~LcmCommandPublisher() { close(fd_); }
+
+bool LcmCommandPublisher::Publish(
+    int64_t utime, const Eigen::Ref<const Eigen::VectorXd> &position,
+    const Eigen::Ref<const Eigen::VectorXd> &torque) {
+  PutBigEndian32(sequence_number_++, packet_.data() + 4);
+  Patch(utime, position, torque);
+  return sendmsg(fd_, &msg_, 0) == static_cast<ssize_t>(packet_.size());
+}
+
+void LcmCommandPublisher::Patch(
+    int64_t utime, const Eigen::Ref<const Eigen::VectorXd> &position,
+    const Eigen::Ref<const Eigen::VectorXd> &torque) {
+  char *const packet = packet_.data();
+  PutBigEndian64(utime, packet + utime_offset_);
+  for (int i = 0; i < num_joints_; i++) {
+    PutBigEndianDouble(position[i], packet + position_offset_ + 8 * i);
+    PutBigEndianDouble(torque[i], packet + torque_offset_ + 8 * i);
+  }
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,179 @@
+#include <drake_robot_control/multi_arm_plan_runner.h>
+
+#include <algorithm>
+#include <map>
+
+#include <drake/multibody/joints/floating_base_types.h>
+#include <drake/multibody/parsers/urdf_parser.h>
+
+#include "common_utils/system_utils.h"
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// Top level config with the keys of arm replacing those of config.
+YAML::Node MergeArmConfig(const YAML::Node &config, const YAML::Node &arm) {
+  YAML::Node merged = YAML::Clone(config);
+  merged.remove("arms");
+  for (YAML::const_iterator it = arm.begin(); it != arm.end(); ++it) {
+    const std::string key = it->first.as<std::string>();
+    if (key != "name") {
+      merged[key] = YAML::Clone(it->second);
+    }
+  }
+  // arms recording to the same file would overwrite each other
+  if (!arm["record_log_path"] && merged["record_log_path"] &&
+      !merged["record_log_path"].as<std::string>().empty()) {
+    merged["record_log_path"] = merged["record_log_path"].as<std::string>() +
+                                "." + arm["name"].as<std::string>();
+  }
+  // and so would arms writing to the same setpoint slots
+  const YAML::Node shared_setpoints = merged["shared_memory_setpoints"];
+  if (!(arm["shared_memory_setpoints"] &&
+        arm["shared_memory_setpoints"]["name"]) &&
+      shared_setpoints && shared_setpoints["enabled"] &&
+      shared_setpoints["enabled"].as<bool>()) {
+    const std::string name = shared_setpoints["name"]
+                                 ? shared_setpoints["name"].as<std::string>()
+                                 : "/plan_runner_setpoints";
+    merged["shared_memory_setpoints"]["name"] =
+        name + "_" + arm["name"].as<std::string>();
+  }
+  return merged;
+}
+
+} // namespace
+
+MultiArmPlanRunner::MultiArmPlanRunner(ros::NodeHandle &nh,
+                                       double synchronized_start_timeout_s)
+    : nh_(nh), tf_buffer_(std::make_shared<tf2_ros::Buffer>()),
+      tf_listener_(*tf_buffer_),
+      synchronized_start_timeout_s_(synchronized_start_timeout_s) {}
+
+std::unique_ptr<MultiArmPlanRunner>
+MultiArmPlanRunner::GetInstance(ros::NodeHandle &nh,
+                                const std::string &config_file_name) {
+  YAML::Node config = YAML::LoadFile(config_file_name);
+  double timeout_s = 1.;
+  if (config["synchronized_start_timeout_s"]) {
+    timeout_s = config["synchronized_start_timeout_s"].as<double>();
+  }
+  std::unique_ptr<MultiArmPlanRunner> runner(
+      new MultiArmPlanRunner(nh, timeout_s));
+
+  if (!config["arms"]) {
+    runner->arm_names_.push_back("");
+    runner->arms_.push_back(
+        RobotPlanRunner::FromConfig(nh, config, nullptr, runner->tf_buffer_));
+  } else {
+    // arms with the same URDF share its tree, which is immutable once parsed
+    std::map<std::string, std::shared_ptr<const RigidBodyTreed>> trees;
+    for (const YAML::Node &arm : config["arms"]) {
+      if (!arm["name"]) {
+        std::cerr << "Config file has an arm without a name." << std::endl;
+        std::exit(1);
+      }
+      const std::string name = arm["name"].as<std::string>();
+      YAML::Node arm_config = MergeArmConfig(config, arm);
+
+      std::shared_ptr<const RigidBodyTreed> &tree =
+          trees[arm_config["robot_urdf_path"].as<std::string>()];
+      if (!tree) {
+        auto parsed_tree = std::make_shared<RigidBodyTreed>();
+        std::string urdf_filename =
+            arm_config["robot_urdf_path"].as<std::string>();
+        autoExpandEnvironmentVariables(urdf_filename);
+        parsers::urdf::AddModelInstanceFromUrdfFileToWorld(
+            urdf_filename, multibody::joints::kFixed, parsed_tree.get());
+        tree = std::move(parsed_tree);
+      }
+
+      ros::NodeHandle arm_nh(nh, name);
+      runner->arm_names_.push_back(name);
+      runner->arms_.push_back(RobotPlanRunner::FromConfig(
+          arm_nh, arm_config, tree, runner->tf_buffer_));
+    }
+  }
+
+  runner->synchronized_start_server_ = runner->nh_.advertiseService(
+      "start_synchronized_joint_trajectories",
+      &MultiArmPlanRunner::HandleStartSynchronizedJointTrajectoriesServiceCall,
+      runner.get());
+  return runner;
+}
+
+void MultiArmPlanRunner::Start() {
+  for (auto &arm : arms_) {
+    arm->Start();
+  }
+}
+
+RobotPlanRunner *MultiArmPlanRunner::get_arm(const std::string &name) {
+  for (size_t i = 0; i < arms_.size(); i++) {
+    if (arm_names_[i] == name) {
+      return arms_[i].get();
+    }
+  }
+  return nullptr;
+}
+
+bool MultiArmPlanRunner::HandleStartSynchronizedJointTrajectoriesServiceCall(
+    robot_msgs::StartSynchronizedJointTrajectories::Request &req,
+    robot_msgs::StartSynchronizedJointTrajectories::Response &res) {
+  res.success = false;
+  const int num_plans = req.arm_names.size();
+  if (num_plans == 0 || req.trajectories.size() != req.arm_names.size()) {
+    res.message = "need one trajectory per arm";
+    return true;
+  }
+
+  // build all plans before touching any arm, so a bad request leaves them
+  // alone
+  std::vector<RobotPlanRunner *> arms(num_plans);
+  std::vector<std::shared_ptr<JointSpaceTrajectoryPlan>> plans(num_plans);
+  double max_control_period = 0;
+  for (int i = 0; i < num_plans; i++) {
+    arms[i] = get_arm(req.arm_names[i]);
+    if (!arms[i]) {
+      res.message = "unknown arm " + req.arm_names[i];
+      return true;
+    }
+    for (int j = 0; j < i; j++) {
+      if (arms[j] == arms[i]) {
+        res.message = "arm " + req.arm_names[i] + " given twice";
+        return true;
+      }
+    }
+    std::string error;
+    plans[i] = arms[i]->MakeJointTrajectoryPlanFromLastCommand(
+        req.trajectories[i], &error);
+    if (!plans[i]) {
+      res.message = req.arm_names[i] + ": " + error;
+      return true;
+    }
+    max_control_period =
+        std::max(max_control_period, arms[i]->get_control_period());
+  }
+
+  // one control period of slack, so every arm sees the start time ahead
+  auto barrier = std::make_shared<PlanStartBarrier>(
+      num_plans, static_cast<int64_t>(max_control_period * 1e9),
+      static_cast<int64_t>(synchronized_start_timeout_s_ * 1e9));
+  res.plan_numbers.resize(num_plans);
+  for (int i = 0; i < num_plans; i++) {
+    plans[i]->set_start_barrier(barrier);
+    // a plan preempted or stopped before the start takes the others with it
+    PlanStartBarrier *barrier_ptr = barrier.get();
+    plans[i]->AddCompletionCallback(
+        [barrier_ptr](PlanBase &) { barrier_ptr->Cancel(); });
+    arms[i]->PublishCompletion(plans[i].get());
+    arms[i]->QueueNewPlan(plans[i]);
+    res.plan_numbers[i] = plans[i]->plan_number_;
+  }
+  res.success = true;
+  return true;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
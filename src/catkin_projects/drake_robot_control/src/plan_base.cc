@@ -22,14 +22,54 @@ PlanStatus PlanBase::WaitForPlanToFinish() {
 
 void PlanBase::SetPlanFinished() {
   std::unique_lock<std::mutex> lock(mutex_);
+  if (is_finished_) {
+    return;
+  }
   is_finished_ = true;
+  std::vector<CompletionCallback> callbacks;
+  callbacks.swap(completion_callbacks_);
   lock.unlock();
   cv_.notify_all();
+  for (CompletionCallback &callback : callbacks) {
+    callback(*this);
+  }
+}
+
+bool PlanBase::FinishWithStatus(PlanStatus plan_status) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_finished_) {
+      return false;
+    }
+    plan_status_ = plan_status;
+  }
+  SetPlanFinished();
+  return true;
+}
+
+void PlanBase::Restart() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  is_finished_ = false;
+  plan_status_ = NOT_STARTED;
+  completion_callbacks_.clear();
+}
+
+void PlanBase::AddCompletionCallback(CompletionCallback callback) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!is_finished_) {
+    completion_callbacks_.push_back(std::move(callback));
+    return;
+  }
+  lock.unlock();
+  callback(*this);
 }
 
 void PlanBase::GetPlanStatusMsg(robot_msgs::PlanStatus &plan_status_msg) {
-  PlanStatus plan_status = this->get_plan_status();
+  FillPlanStatusMsg(this->get_plan_status(), plan_status_msg);
+}
 
+void FillPlanStatusMsg(PlanStatus plan_status,
+                       robot_msgs::PlanStatus &plan_status_msg) {
   switch (plan_status) {
     case PlanStatus::NOT_STARTED:{
       plan_status_msg.status = plan_status_msg.NOT_STARTED;
@@ -51,6 +91,11 @@ void PlanBase::GetPlanStatusMsg(robot_msgs::PlanStatus &plan_status_msg) {
       plan_status_msg.status = plan_status_msg.STOPPED_BY_FORCE_GUARD;
       break;
     }
+    case PlanStatus::STOPPED_BY_WATCHDOG: {
+      plan_status_msg.status = plan_status_msg.STOPPED_BY_WATCHDOG;
+      plan_status_msg.msg = "control loop deadline missed";
+      break;
+    }
     default: {
       plan_status_msg.status = plan_status_msg.ERROR;
       break;
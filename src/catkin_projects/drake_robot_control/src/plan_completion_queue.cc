@@ -0,0 +1,21 @@
+#include <drake_robot_control/plan_completion_queue.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+constexpr size_t PlanCompletionQueue::kCapacity;
+
+PlanCompletionQueue::PlanCompletionQueue() : num_dropped_(0) {}
+
+bool PlanCompletionQueue::Push(int plan_number, PlanStatus status) {
+  if (!completions_.TryPush(PlanCompletionEntry{plan_number, status})) {
+    // ring is full
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  notifier_.Notify();
+  return true;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,44 @@
+#include <drake_robot_control/plan_construction_pool.h>
+
+#include <algorithm>
+
+namespace drake {
+namespace robot_plan_runner {
+
+PlanConstructionPool::PlanConstructionPool(int num_threads)
+    : is_stopping_(false) {
+  for (int i = 0; i < std::max(1, num_threads); i++) {
+    threads_.emplace_back(&PlanConstructionPool::Run, this);
+  }
+}
+
+PlanConstructionPool::~PlanConstructionPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_stopping_ = true;
+  }
+  task_available_.notify_all();
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+}
+
+void PlanConstructionPool::Run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_available_.wait(lock,
+                           [this]() { return is_stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return; // stopping
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -1,4 +1,7 @@
 #include <boost/format.hpp>
+#include <cerrno>
+#include <cstring>
+#include <limits>
 #include <math.h>
 
 #include <drake/math/roll_pitch_yaw.h>
@@ -23,6 +26,15 @@ double ToRadians(double degrees) {
   return degrees * M_PI / 180.;
 }
 
+// TimesStrictlyIncrease of the time_from_start of the points
+bool TimesStrictlyIncrease(const trajectory_msgs::JointTrajectory &trajectory) {
+  std::vector<double> times(trajectory.points.size());
+  for (size_t i = 0; i < times.size(); i++) {
+    times[i] = trajectory.points[i].time_from_start.toSec();
+  }
+  return TimesStrictlyIncrease(times);
+}
+
 typedef spartan::drake_robot_control::ForceGuard ForceGuard;
 typedef spartan::drake_robot_control::TotalExternalTorqueGuard
     TotalExternalTorqueGuard;
@@ -87,7 +99,13 @@ ExternalForceGuardFromRosMsg(const robot_msgs::ExternalForceGuard &msg,
 std::unique_ptr<RobotPlanRunner>
 RobotPlanRunner::GetInstance(ros::NodeHandle &nh,
                              const std::string &config_file_name) {
-  YAML::Node config = YAML::LoadFile(config_file_name);
+  return FromConfig(nh, YAML::LoadFile(config_file_name));
+}
+
+std::unique_ptr<RobotPlanRunner>
+RobotPlanRunner::FromConfig(ros::NodeHandle &nh, YAML::Node config,
+                            std::shared_ptr<const RigidBodyTreed> tree,
+                            std::shared_ptr<tf2_ros::Buffer> tf_buffer) {
   if (!config["lcm_status_channel"] || !config["lcm_command_channel"] ||
       !config["lcm_plan_channel"] || !config["lcm_stop_channel"] ||
       !config["num_joints"] || !config["robot_ee_body_name"] ||
@@ -100,11 +118,14 @@ RobotPlanRunner::GetInstance(ros::NodeHandle &nh,
     std::exit(1);
   }
 
-  auto tree = std::make_unique<RigidBodyTreed>();
-  std::string urdf_filename = config["robot_urdf_path"].as<std::string>();
-  autoExpandEnvironmentVariables(urdf_filename);
-  parsers::urdf::AddModelInstanceFromUrdfFileToWorld(
-      urdf_filename, multibody::joints::kFixed, tree.get());
+  if (!tree) {
+    auto parsed_tree = std::make_shared<RigidBodyTreed>();
+    std::string urdf_filename = config["robot_urdf_path"].as<std::string>();
+    autoExpandEnvironmentVariables(urdf_filename);
+    parsers::urdf::AddModelInstanceFromUrdfFileToWorld(
+        urdf_filename, multibody::joints::kFixed, parsed_tree.get());
+    tree = std::move(parsed_tree);
+  }
 
   auto ptr = std::make_unique<RobotPlanRunner>(
       config["lcm_status_channel"].as<std::string>(),
@@ -114,7 +135,8 @@ RobotPlanRunner::GetInstance(ros::NodeHandle &nh,
       config["robot_ee_body_name"].as<std::string>(),
       config["num_joints"].as<int>(),
       config["joint_speed_limit_degree_per_sec"].as<double>(),
-      config["control_period_s"].as<double>(), config, std::move(tree), nh);
+      config["control_period_s"].as<double>(), config, std::move(tree), nh,
+      std::move(tf_buffer));
 
   return std::move(ptr);
 }
@@ -125,27 +147,169 @@ RobotPlanRunner::RobotPlanRunner(
     const std::string &lcm_stop_channel, const std::string &robot_ee_body_name,
     int num_joints, double joint_speed_limit_deg_per_sec, double control_period,
     YAML::Node config,
-    std::unique_ptr<const RigidBodyTreed> tree, ros::NodeHandle &nh)
+    std::shared_ptr<const RigidBodyTreed> tree, ros::NodeHandle &nh,
+    std::shared_ptr<tf2_ros::Buffer> tf_buffer)
     : kLcmStatusChannel_(lcm_status_channel),
       kLcmCommandChannel_(lcm_command_channel),
       kLcmPlanChannel_(lcm_plan_channel), kLcmStopChannel_(lcm_stop_channel),
       kRobotEeBodyName_(robot_ee_body_name), kNumJoints_(num_joints),
       kJointSpeedLimitDegPerSec_(joint_speed_limit_deg_per_sec),
       kControlPeriod_(control_period), config_(config), tree_(std::move(tree)), nh_(nh),
-      plan_number_(0), tf_listener_(tf_buffer_),
-      terminate_current_plan_flag_(false) {
+      plan_number_(0), base_frame_id_("base"),
+      tf_buffer_(std::move(tf_buffer)),
+      terminate_current_plan_flag_(false), is_running_(false),
+      telemetry_(static_cast<int64_t>(control_period * 1e9)) {
 
   DRAKE_DEMAND(kNumJoints_ == tree_->get_num_positions());
   DRAKE_DEMAND(kNumJoints_ == tree_->get_num_actuators());
+  DRAKE_DEMAND(kNumJoints_ <= kMaxNumJoints);
   this->LoadJointLimits();
+  joint_name_permutations_ =
+      std::make_shared<JointNamePermutationCache>(*tree_);
+  kinematics_cache_pool_ = KinematicsCachePool::Get(tree_);
+  // enough for a task space plan and a pose query at the same time
+  int kinematics_cache_pool_size = 4;
+  if (config_["kinematics_cache_pool_size"]) {
+    kinematics_cache_pool_size =
+        config_["kinematics_cache_pool_size"].as<int>();
+  }
+  kinematics_cache_pool_->Reserve(kinematics_cache_pool_size);
+  realtime_config_ = RealtimeConfig::FromYaml(config_["realtime"]);
+  status_decoder_.reset(new IiwaStatusDecoder(kNumJoints_));
+  if (!status_decoder_->is_direct()) {
+    std::cerr << "lcmt_iiwa_status layout not recognized, decoding "
+              << kLcmStatusChannel_ << " with the generated decoder"
+              << std::endl;
+  }
+  watchdog_.reset(new ControlDeadlineWatchdog(
+      ControlDeadlineWatchdogOptions::FromYaml(
+          config_["control_deadline_watchdog"]),
+      kControlPeriod_));
+  if (!tf_buffer_) {
+    tf_buffer_ = std::make_shared<tf2_ros::Buffer>();
+    tf_listener_.reset(new tf2_ros::TransformListener(*tf_buffer_));
+  }
+  if (config_["base_frame_id"]) {
+    base_frame_id_ = config_["base_frame_id"].as<std::string>();
+  }
+  streaming_buffer_options_ = SetpointJitterBufferOptions::FromYaml(
+      config_["joint_space_streaming_plan"]);
+  int plan_construction_threads = 2;
+  if (config_["plan_construction_threads"]) {
+    plan_construction_threads =
+        config_["plan_construction_threads"].as<int>();
+  }
+  construction_pool_.reset(new PlanConstructionPool(plan_construction_threads));
+  // one worker builds the LCM plans in the order they arrive, never behind a
+  // TF lookup of a goal callback
+  lcm_plan_pool_.reset(new PlanConstructionPool(1));
+  batch_ik_solver_.reset(
+      new BatchIkSolver(tree_, BatchIkOptions::FromYaml(config_["batch_ik"]),
+                        joint_limits_min_, joint_limits_max_));
+  tf_lookup_timeout_s_ = 1.0;
+  if (config_["tf_lookup_timeout_s"]) {
+    tf_lookup_timeout_s_ = config_["tf_lookup_timeout_s"].as<double>();
+  }
+  joint_trajectory_fit_options_ = JointTrajectoryFitOptions::FromYaml(
+      config_["joint_trajectory_fit"]);
+  retiming_options_ = JointTrajectoryRetimingOptions::FromYaml(
+      config_["joint_trajectory_retiming"]);
+  std::vector<std::string> joint_names(kNumJoints_);
+  for (int i = 0; i < kNumJoints_; i++) {
+    joint_names[i] = tree_->get_position_name(i);
+  }
+  retiming_options_.GetLimits(joint_names, kJointSpeedLimitDegPerSec_,
+                              &retiming_max_velocity_,
+                              &retiming_max_acceleration_);
+  use_task_space_qp_ = false;
+  if (config_["task_space_plan"]) {
+    ik_options_ = DifferentialIkOptions::FromYaml(
+        config_["task_space_plan"]["ik_solver"]);
+    if (config_["task_space_plan"]["qp"]) {
+      use_task_space_qp_ = true;
+      task_space_qp_options_ =
+          TaskSpaceQpOptions::FromYaml(config_["task_space_plan"]["qp"]);
+    }
+  }
+  // creates the log ring and its drain thread before any thread logs
+  if (config_["log_level"]) {
+    AsyncLogger::Get().set_min_level(
+        LogLevelFromString(config_["log_level"].as<std::string>()));
+  } else {
+    AsyncLogger::Get();
+  }
+  control_loop_stats_period_s_ = 1.0;
+  if (config_["control_loop_stats_period_s"]) {
+    control_loop_stats_period_s_ =
+        config_["control_loop_stats_period_s"].as<double>();
+  }
+  if (config_["record_log_path"] &&
+      !config_["record_log_path"].as<std::string>().empty()) {
+    plan_runner_log::LogHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.num_joints = kNumJoints_;
+    header.control_period = kControlPeriod_;
+    header.max_dq_per_step =
+        kJointSpeedLimitDegPerSec_ / 180 * M_PI * kControlPeriod_;
+    for (int i = 0; i < kNumJoints_; i++) {
+      header.joint_limits_min[i] = joint_limits_min_[i];
+      header.joint_limits_max[i] = joint_limits_max_[i];
+    }
+    std::string urdf_path = config_["robot_urdf_path"].as<std::string>();
+    autoExpandEnvironmentVariables(urdf_path);
+    std::strncpy(header.urdf_path, urdf_path.c_str(),
+                 sizeof(header.urdf_path) - 1);
+
+    const std::string log_path = config_["record_log_path"].as<std::string>();
+    recorder_ = PlanRunnerRecorder::Open(log_path, header);
+    if (recorder_) {
+      std::cout << "Recording plan runner log to " << log_path << std::endl;
+    } else {
+      std::cerr << "Could not open " << log_path << " for recording"
+                << std::endl;
+    }
+  }
+  const YAML::Node shared_setpoints_config = config_["shared_memory_setpoints"];
+  if (shared_setpoints_config && shared_setpoints_config["enabled"] &&
+      shared_setpoints_config["enabled"].as<bool>()) {
+    std::string name = "/plan_runner_setpoints";
+    if (shared_setpoints_config["name"]) {
+      name = shared_setpoints_config["name"].as<std::string>();
+    }
+    std::string group;
+    if (shared_setpoints_config["group"]) {
+      group = shared_setpoints_config["group"].as<std::string>();
+    }
+    shared_setpoints_ = SharedSetpointChannel::Create(name, group);
+    if (shared_setpoints_) {
+      std::cout << "Streaming plans also read setpoints from shared memory "
+                << name << std::endl;
+    } else {
+      std::cerr << "Could not create shared memory " << name << ": "
+                << std::strerror(errno) << std::endl;
+    }
+  }
+  bake_joint_trajectories_ = config_["bake_joint_trajectories"] &&
+                             config_["bake_joint_trajectories"].as<bool>();
+  if (config_["preencoded_lcm_commands"] &&
+      config_["preencoded_lcm_commands"].as<bool>()) {
+    // same provider as status_lcm_, which is created with the default URL
+    command_publisher_ =
+        LcmCommandPublisher::Open("", kLcmCommandChannel_, kNumJoints_);
+    if (!command_publisher_) {
+      std::cerr << "Publishing " << kLcmCommandChannel_
+                << " with lcm::LCM, no preencoded publisher: "
+                << std::strerror(errno) << std::endl;
+    }
+  }
+  if (config_["plan_queue_capacity"]) {
+    plan_queue_.set_capacity(config_["plan_queue_capacity"].as<int>());
+  }
+  plan_queue_epoch_ = 0;
+  lcm_plan_sequence_ = 0;
   plan_number_ = 0;
   new_plan_ = nullptr;
-  current_robot_state_.resize(kNumJoints_ * 2, 1);
-  iiwa_status_position_command_.resize(kNumJoints_, 1);
-  iiwa_status_torque_command_.resize(kNumJoints_, 1);
-  last_position_command_.resize(kNumJoints_, 1);
-  last_torque_command_.resize(kNumJoints_, 1);
-  has_received_new_status_ = false;
+  has_new_plan_ = false;
   is_waiting_for_first_robot_status_message_ = true;
 
   // setup the ROS actions
@@ -174,18 +338,41 @@ RobotPlanRunner::RobotPlanRunner(
   // Set up the streaming plan management services and channels
   plan_end_server_ = std::make_shared<ros::ServiceServer>(
       nh_.advertiseService(
-        "/plan_runner/stop_plan",
+        "stop_plan",
         &RobotPlanRunner::HandlePlanEndServiceCall, this));
   joint_space_streaming_plan_init_server_ = 
     std::make_shared<ros::ServiceServer>(
       nh_.advertiseService(
-        "/plan_runner/init_joint_space_streaming",
+        "init_joint_space_streaming",
         &RobotPlanRunner::HandleInitJointSpaceStreamingServiceCall, this));
   task_space_streaming_plan_init_server_ = 
     std::make_shared<ros::ServiceServer>(
       nh_.advertiseService(
-        "/plan_runner/init_task_space_streaming",
+        "init_task_space_streaming",
         &RobotPlanRunner::HandleInitTaskSpaceStreamingServiceCall, this));
+
+  // plan queue
+  cancel_all_plans_server_ =
+      std::make_shared<ros::ServiceServer>(nh_.advertiseService(
+          "cancel_all_plans",
+          &RobotPlanRunner::HandleCancelAllPlansServiceCall, this));
+  queue_joint_trajectory_server_ =
+      std::make_shared<ros::ServiceServer>(nh_.advertiseService(
+          "queue_joint_trajectory",
+          &RobotPlanRunner::HandleQueueJointTrajectoryServiceCall, this));
+
+  // inverse kinematics
+  run_ik_server_ = std::make_shared<ros::ServiceServer>(nh_.advertiseService(
+      "run_ik", &RobotPlanRunner::HandleRunIKServiceCall, this));
+  run_batch_ik_server_ =
+      std::make_shared<ros::ServiceServer>(nh_.advertiseService(
+          "run_batch_ik", &RobotPlanRunner::HandleRunBatchIKServiceCall,
+          this));
+
+  control_loop_stats_publisher_ = nh_.advertise<robot_msgs::ControlLoopStats>(
+      "control_loop_stats", 10);
+  plan_completion_publisher_ = nh_.advertise<robot_msgs::PlanCompletion>(
+      "plan_completion", 10);
 }
 
 bool RobotPlanRunner::HandleInitJointSpaceStreamingServiceCall(
@@ -200,7 +387,9 @@ bool RobotPlanRunner::HandleInitJointSpaceStreamingServiceCall(
     return false;
   }
 
-  auto plan_local = std::make_shared<JointSpaceStreamingPlan>(tree_, nh_);
+  auto plan_local = std::make_shared<JointSpaceStreamingPlan>(
+      tree_, nh_, joint_name_permutations_, streaming_buffer_options_);
+  plan_local->set_shared_setpoints(shared_setpoints_);
 
   std::cout << "started joint space streaming plan" << std::endl;
 
@@ -247,6 +436,8 @@ bool RobotPlanRunner::HandleInitTaskSpaceStreamingServiceCall(
   }
 
   auto plan_local = std::make_shared<TaskSpaceStreamingPlan>(tree_, nh_);
+  plan_local->set_ik_solver(MakeDifferentialIkSolver(ik_options_));
+  plan_local->set_shared_setpoints(shared_setpoints_);
 
   std::cout << "started task space streaming plan" << std::endl;
 
@@ -275,43 +466,453 @@ bool RobotPlanRunner::HandleInitTaskSpaceStreamingServiceCall(
 
 bool RobotPlanRunner::HandlePlanEndServiceCall(
   std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res) {
-  terminate_current_plan_flag_ = true;
+  CancelAllPlans();
   res.success = true;
   return true;
 }
 
-RobotPlanRunner::~RobotPlanRunner() {
-  if (publish_thread_.joinable()) {
-    publish_thread_.join();
+bool RobotPlanRunner::HandleCancelAllPlansServiceCall(
+    std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res) {
+  CancelAllPlans();
+  res.success = true;
+  return true;
+}
+
+bool RobotPlanRunner::HandleQueueJointTrajectoryServiceCall(
+    robot_msgs::QueueJointTrajectory::Request &req,
+    robot_msgs::QueueJointTrajectory::Response &res) {
+  res.success = false;
+  res.plan_number = -1;
+  if (is_waiting_for_first_robot_status_message_) {
+    res.message = "no status message received yet";
+    return true;
+  } else if (req.trajectory.points.size() < 2) {
+    res.message = "not enough knot points";
+    return true;
+  } else if (!TimesStrictlyIncrease(req.trajectory)) {
+    res.message = "knot times do not strictly increase";
+    return true;
   }
-  if (subscriber_thread_.joinable()) {
-    subscriber_thread_.join();
+
+  Eigen::VectorXd q_start;
+  uint64_t queue_epoch;
+  if (!GetPlanQueueEnd(&q_start, &queue_epoch)) {
+    res.message = "the last queued plan has no known final position, "
+                  "stop it first";
+    return true;
   }
-  if (plan_constructor_thread_.joinable()) {
-    plan_constructor_thread_.join();
+
+  auto plan_local = MakeJointTrajectoryPlan(req.trajectory, q_start, true);
+
+  // Add ForceGuards if specified
+  if (req.force_guard.size() > 0) {
+    std::shared_ptr<ForceGuardContainer> guard_container =
+        ForceGuardContainerFromRosMsg(req.force_guard[0], *tree_);
+    if (guard_container) {
+      plan_local->set_guard_container(guard_container);
+    }
+  }
+
+  PublishCompletion(plan_local.get());
+
+  if (!AppendPlan(plan_local, queue_epoch)) {
+    res.message = "plan queue is full or was cancelled, plan discarded";
+    return true;
+  }
+
+  res.success = true;
+  res.plan_number = plan_local->plan_number_;
+  return true;
+}
+
+bool RobotPlanRunner::HandleRunIKServiceCall(robot_msgs::RunIK::Request &req,
+                                             robot_msgs::RunIK::Response &res) {
+  // nominal_pose is not used, the iterations end at a solution near the seed
+  std::vector<IkSolution> solutions;
+  const std::string error =
+      SolveIk(std::vector<geometry_msgs::PoseStamped>(1, req.pose_stamped), "",
+              req.seed_pose, false, 0., 0., &solutions);
+  if (!error.empty()) {
+    ROS_WARN("run_ik: %s", error.c_str());
+    res.success = false;
+    return true;
+  }
+  res.success = solutions[0].success;
+  JointStateFromPositions(solutions[0].q, &res.joint_state);
+  return true;
+}
+
+bool RobotPlanRunner::HandleRunBatchIKServiceCall(
+    robot_msgs::RunBatchIK::Request &req,
+    robot_msgs::RunBatchIK::Response &res) {
+  const int64_t start_ns = MonotonicTimeNs();
+  std::vector<IkSolution> solutions;
+  res.message = SolveIk(req.poses, req.ee_frame_id, req.seed_pose,
+                        req.warm_start_from_neighbours, req.position_tolerance,
+                        req.orientation_tolerance, &solutions);
+  const int num_solutions = solutions.size();
+  res.joint_states.resize(num_solutions);
+  res.success.resize(num_solutions);
+  res.position_residual.resize(num_solutions);
+  res.orientation_residual.resize(num_solutions);
+  res.num_iterations.resize(num_solutions);
+  int num_solved = 0;
+  for (int i = 0; i < num_solutions; i++) {
+    const IkSolution &solution = solutions[i];
+    JointStateFromPositions(solution.q, &res.joint_states[i]);
+    res.success[i] = solution.success;
+    res.position_residual[i] = solution.position_residual;
+    res.orientation_residual[i] = solution.orientation_residual;
+    res.num_iterations[i] = solution.num_iterations;
+    num_solved += solution.success;
+  }
+  res.solve_time = (MonotonicTimeNs() - start_ns) * 1e-9;
+  if (res.message.empty()) {
+    ROS_INFO("run_batch_ik: %d of %d poses solved in %.1f ms", num_solved,
+             num_solutions, res.solve_time * 1e3);
+  } else {
+    ROS_WARN("run_batch_ik: %s", res.message.c_str());
+  }
+  return true;
+}
+
+std::string RobotPlanRunner::SolveIk(
+    const std::vector<geometry_msgs::PoseStamped> &poses,
+    const std::string &ee_frame_id,
+    const std::vector<sensor_msgs::JointState> &seed_pose,
+    bool warm_start_from_neighbours, double position_tolerance,
+    double orientation_tolerance, std::vector<IkSolution> *const solutions) {
+  solutions->clear();
+  if (poses.empty()) {
+    return "no poses";
+  }
+  // Normalizing a zero (or NaN) quaternion gives NaN, which the solver
+  // would iterate on until max_iterations. Such poses are reported as not
+  // solved, the rest of the batch is solved.
+  std::vector<int> valid_poses;
+  valid_poses.reserve(poses.size());
+  for (size_t i = 0; i < poses.size(); i++) {
+    const geometry_msgs::Quaternion &orientation = poses[i].pose.orientation;
+    const double norm =
+        Eigen::Quaterniond(orientation.w, orientation.x, orientation.y,
+                           orientation.z)
+            .norm();
+    if (norm > 1e-6) {
+      valid_poses.push_back(i);
+    } else {
+      ROS_WARN("IK pose %zu has a zero quaternion, its orientation is "
+               "undefined, not solved", i);
+    }
+  }
+  // frames of the poses, looked up while the rest is prepared, an empty
+  // frame_id is the base frame
+  std::map<std::string, std::future<TransformLookup>> frame_lookups;
+  for (int i : valid_poses) {
+    const std::string &frame_id = poses[i].header.frame_id;
+    if (!frame_id.empty() && frame_lookups.count(frame_id) == 0) {
+      frame_lookups.emplace(frame_id, LookupTransformAsync(frame_id));
+    }
+  }
+
+  // a body of the tree, or else a frame attached to one
+  const std::string &ee_name =
+      ee_frame_id.empty() ? kRobotEeBodyName_ : ee_frame_id;
+  int ee_index;
+  try {
+    ee_index = tree_->FindBodyIndex(ee_name);
+  } catch (const std::exception &) {
+    try {
+      ee_index = tree_->findFrame(ee_name)->get_frame_index();
+    } catch (const std::exception &ex) {
+      return ex.what();
+    }
+  }
+
+  Eigen::VectorXd q_seed = Eigen::VectorXd::Zero(kNumJoints_);
+  if (!is_waiting_for_first_robot_status_message_) {
+    q_seed = get_current_robot_position();
+  } else if (seed_pose.empty()) {
+    return "no seed_pose and no status message received yet";
+  }
+  if (!seed_pose.empty()) {
+    const sensor_msgs::JointState &seed = seed_pose[0];
+    if (seed.position.size() != seed.name.size()) {
+      return "seed_pose needs a position for every name";
+    }
+    std::shared_ptr<const std::vector<int>> name_to_idx =
+        joint_name_permutations_->Lookup(seed.name);
+    for (size_t i = 0; i < seed.name.size(); i++) {
+      const int joint_idx = (*name_to_idx)[i];
+      if (joint_idx == JointNamePermutationCache::kNotInTree) {
+        return "seed_pose joint " + seed.name[i] + " is not in the tree";
+      }
+      q_seed[joint_idx] = seed.position[i];
+    }
+  }
+
+  std::map<std::string, Eigen::Affine3d> frames;
+  frames[""] = Eigen::Affine3d::Identity();
+  for (auto &lookup : frame_lookups) {
+    const TransformLookup frame_tf = lookup.second.get();
+    if (!frame_tf.error.empty()) {
+      return frame_tf.error;
+    }
+    frames[lookup.first] =
+        spartan::drake_robot_control::utils::transformToEigen(
+            frame_tf.transform);
+  }
+  std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
+      targets(valid_poses.size());
+  for (size_t i = 0; i < valid_poses.size(); i++) {
+    const geometry_msgs::PoseStamped &pose_stamped = poses[valid_poses[i]];
+    const geometry_msgs::Pose &pose = pose_stamped.pose;
+    Eigen::Isometry3d pose_local = Eigen::Isometry3d::Identity();
+    pose_local.translate(
+        Eigen::Vector3d(pose.position.x, pose.position.y, pose.position.z));
+    pose_local.rotate(Eigen::Quaterniond(pose.orientation.w,
+                                         pose.orientation.x,
+                                         pose.orientation.y,
+                                         pose.orientation.z)
+                          .normalized());
+    targets[i] = Eigen::Isometry3d(
+        (frames[pose_stamped.header.frame_id] * pose_local).matrix());
+  }
+
+  std::vector<IkSolution> valid_solutions;
+  if (!targets.empty()) {
+    try {
+      batch_ik_solver_->Solve(ee_index, targets, q_seed,
+                              warm_start_from_neighbours, position_tolerance,
+                              orientation_tolerance, &valid_solutions);
+    } catch (const std::exception &ex) {
+      return ex.what();
+    }
+  }
+  // the poses that were not solved keep the seed and infinite residuals
+  IkSolution not_solved;
+  not_solved.q = q_seed;
+  not_solved.position_residual = std::numeric_limits<double>::infinity();
+  not_solved.orientation_residual = std::numeric_limits<double>::infinity();
+  solutions->assign(poses.size(), not_solved);
+  for (size_t i = 0; i < valid_poses.size(); i++) {
+    (*solutions)[valid_poses[i]] = std::move(valid_solutions[i]);
+  }
+  return "";
+}
+
+void RobotPlanRunner::JointStateFromPositions(
+    const Eigen::VectorXd &q, sensor_msgs::JointState *const joint_state) {
+  joint_state->header.stamp = ros::Time::now();
+  joint_state->name.resize(kNumJoints_);
+  joint_state->position.resize(kNumJoints_);
+  for (int i = 0; i < kNumJoints_; i++) {
+    joint_state->name[i] = tree_->get_position_name(i);
+    joint_state->position[i] = q[i];
+  }
+}
+
+std::shared_ptr<JointSpaceTrajectoryPlan>
+RobotPlanRunner::MakeJointTrajectoryPlanFromLastCommand(
+    const trajectory_msgs::JointTrajectory &trajectory,
+    std::string *const error) {
+  if (is_waiting_for_first_robot_status_message_) {
+    *error = "no status message received yet";
+    return nullptr;
+  } else if (trajectory.points.size() < 2) {
+    *error = "not enough knot points";
+    return nullptr;
+  } else if (!TimesStrictlyIncrease(trajectory)) {
+    *error = "knot times do not strictly increase";
+    return nullptr;
+  }
+  Eigen::VectorXd q_start, tau_start;
+  GetLastCommand(&q_start, &tau_start);
+  // not retimed, the arms of a synchronized start keep the timing their
+  // trajectories were planned with together
+  return MakeJointTrajectoryPlan(trajectory, q_start, false);
+}
+
+void RobotPlanRunner::PublishCompletion(PlanBase *plan) {
+  // Runs on the control thread, so it only queues the completion, the stats
+  // thread publishes it.
+  plan->AddCompletionCallback([this](PlanBase &plan) {
+    plan_completions_.Push(plan.plan_number_, plan.get_plan_status());
+  });
+}
+
+void RobotPlanRunner::PublishQueuedCompletions() {
+  PlanCompletionEntry completion;
+  while (plan_completions_.Pop(&completion)) {
+    robot_msgs::PlanCompletion msg;
+    msg.plan_number = completion.plan_number;
+    FillPlanStatusMsg(completion.status, msg.status);
+    plan_completion_publisher_.publish(msg);
+  }
+  const uint64_t num_dropped = plan_completions_.TakeNumDropped();
+  if (num_dropped > 0) {
+    PLAN_RUNNER_LOG(kWarn,
+                    "plan completion queue full, %llu completions were "
+                    "not published",
+                    static_cast<unsigned long long>(num_dropped));
+  }
+}
+
+std::vector<char> RobotPlanRunner::EncodePlanRecord(const PlanBase &plan) {
+  if (!recorder_) {
+    return std::vector<char>();
+  }
+  return plan_runner_log::EncodePlan(plan);
+}
+
+void RobotPlanRunner::QueueNewPlan(std::shared_ptr<PlanBase> new_plan) {
+  std::vector<char> plan_record = EncodePlanRecord(*new_plan);
+  std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+  QueueNewPlanLocked(std::move(new_plan), &plan_record);
+}
+
+void RobotPlanRunner::QueueNewPlanLocked(std::shared_ptr<PlanBase> new_plan,
+                                         std::vector<char> *plan_record) {
+  const int num_cancelled = CancelQueuedPlansLocked();
+  if (num_cancelled > 0) {
+    PLAN_RUNNER_LOG(kInfo, "New plan cancelled %d queued plans",
+                    num_cancelled);
+  }
+  new_plan_ = std::move(new_plan);
+  has_new_plan_ = true;
+  new_plan_->plan_number_ = plan_number_++; // sets the plan number
+  if (recorder_) {
+    recorder_->RecordPlan(new_plan_->plan_number_, plan_record);
+  }
+}
+
+bool RobotPlanRunner::AppendPlan(std::shared_ptr<PlanBase> new_plan,
+                                 uint64_t queue_epoch) {
+  std::vector<char> plan_record = EncodePlanRecord(*new_plan);
+  std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+  if (queue_epoch != plan_queue_epoch_ || plan_queue_.full()) {
+    return false;
+  }
+  new_plan->plan_number_ = plan_number_++;
+  if (recorder_) {
+    recorder_->RecordPlan(new_plan->plan_number_, &plan_record);
+  }
+  plan_queue_.Push(std::move(new_plan));
+  return true;
+}
+
+bool RobotPlanRunner::GetPlanQueueEnd(Eigen::VectorXd *const q_end,
+                                      uint64_t *const queue_epoch) {
+  std::shared_ptr<PlanBase> last_plan;
+  {
+    std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+    *queue_epoch = plan_queue_epoch_;
+    if (!plan_queue_.empty()) {
+      last_plan = plan_queue_.back();
+    } else if (new_plan_) {
+      last_plan = new_plan_;
+    } else {
+      last_plan = active_plan_;
+    }
+  }
+
+  // A plan that is over leaves the robot at the last command, so does the
+  // hold plan the runner falls back to.
+  if (!last_plan || last_plan->is_stopped() ||
+      last_plan->get_plan_status() == PlanStatus::FINISHED_NORMALLY) {
+    Eigen::VectorXd tau_end;
+    GetLastCommand(q_end, &tau_end);
+    return true;
+  }
+  return last_plan->GetFinalPosition(q_end);
+}
+
+void RobotPlanRunner::CancelAllPlans() {
+  const int num_cancelled = CancelQueuedPlans();
+  if (num_cancelled > 0) {
+    PLAN_RUNNER_LOG(kInfo, "Cancelled %d queued plans", num_cancelled);
+  }
+  terminate_current_plan_flag_ = true;
+  plan_events_.Notify();
+}
+
+int RobotPlanRunner::CancelQueuedPlans() {
+  std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+  return CancelQueuedPlansLocked();
+}
+
+int RobotPlanRunner::CancelQueuedPlansLocked() {
+  int num_cancelled = 0;
+  while (!plan_queue_.empty()) {
+    std::shared_ptr<PlanBase> plan = plan_queue_.Pop();
+    plan->FinishWithStatus(PlanStatus::STOPPED_BY_EXTERNAL_TRIGGER);
+    num_cancelled++;
+  }
+  plan_queue_epoch_++;
+  return num_cancelled;
+}
+
+RobotPlanRunner::~RobotPlanRunner() {
+  is_running_ = false;
+  reactor_.Stop();
+  if (control_thread_.joinable()) {
+    control_thread_.join();
+  }
+  if (control_loop_stats_thread_.joinable()) {
+    control_loop_stats_thread_.join();
   }
 }
 
 void RobotPlanRunner::Start() {
-  publish_thread_ = std::thread(&RobotPlanRunner::PublishCommand, this);
-  subscriber_thread_ = std::thread(&RobotPlanRunner::ReceiveRobotStatus, this);
-  plan_constructor_thread_ =
-      std::thread(&RobotPlanRunner::ConstructNewPlanFromLcm, this);
+  if (realtime_config_.enabled && realtime_config_.lock_memory) {
+    LockProcessMemory();
+  }
+
+  is_running_ = true;
+  control_thread_ = std::thread(&RobotPlanRunner::RunControlLoop, this);
+  control_loop_stats_thread_ =
+      std::thread(&RobotPlanRunner::PublishControlLoopStats, this);
 }
 
 Eigen::VectorXd RobotPlanRunner::get_current_robot_state() {
-  std::lock_guard<std::mutex> lock(robot_status_mutex_);
-  return current_robot_state_;
+  RobotStatusSnapshot status;
+  status_mailbox_.Latest(&status);
+  Eigen::VectorXd x(kNumJoints_ * 2);
+  for (int i = 0; i < kNumJoints_; i++) {
+    x[i] = status.joint_position_measured[i];
+    x[i + kNumJoints_] = status.joint_velocity_estimated[i];
+  }
+  return x;
 }
 
 Eigen::VectorXd RobotPlanRunner::get_current_robot_position() {
-  std::lock_guard<std::mutex> lock(robot_status_mutex_);
-  return current_robot_state_.head(kNumJoints_);
+  return get_current_robot_state().head(kNumJoints_);
 }
 
 Eigen::VectorXd RobotPlanRunner::get_current_robot_velocity() {
-  std::lock_guard<std::mutex> lock(robot_status_mutex_);
-  return current_robot_state_.tail(kNumJoints_);
+  return get_current_robot_state().tail(kNumJoints_);
+}
+
+void RobotPlanRunner::GetLastCommand(Eigen::VectorXd *const q_commanded,
+                                     Eigen::VectorXd *const tau_commanded) {
+  q_commanded->resize(kNumJoints_);
+  tau_commanded->resize(kNumJoints_);
+
+  RobotCommandSnapshot command;
+  if (last_command_.Load(&command) > 0) {
+    for (int i = 0; i < kNumJoints_; i++) {
+      (*q_commanded)[i] = command.joint_position[i];
+      (*tau_commanded)[i] = command.joint_torque[i];
+    }
+    return;
+  }
+
+  // nothing published yet, fall back to what the robot reports as commanded
+  RobotStatusSnapshot status;
+  status_mailbox_.Latest(&status);
+  for (int i = 0; i < kNumJoints_; i++) {
+    (*q_commanded)[i] = status.joint_position_commanded[i];
+    (*tau_commanded)[i] = status.joint_torque_commanded[i];
+  }
 }
 
 void RobotPlanRunner::LoadJointLimits(){
@@ -334,244 +935,493 @@ void RobotPlanRunner::LoadJointLimits(){
 
 }
 
-Eigen::VectorXd RobotPlanRunner::ApplyJointLimits(const Eigen::VectorXd & q_commanded){
-  Eigen::VectorXd q_clamp = q_commanded.cwiseMax(joint_limits_min_);
-  q_clamp = q_clamp.cwiseMin(joint_limits_max_);
-  return q_clamp;
+void RobotPlanRunner::ApplyJointLimits(Eigen::VectorXd *const q_commanded) {
+  *q_commanded =
+      q_commanded->cwiseMax(joint_limits_min_).cwiseMin(joint_limits_max_);
 }
 
 
 
-void RobotPlanRunner::ReceiveRobotStatus() {
-  // lock mutex when printing so that the text is not mangled (by printing in
-  // another thread).
-  robot_status_mutex_.lock();
-  std::cout << "Robot status receiver thread starting on thread "
+void RobotPlanRunner::RunControlLoop() {
+  print_mutex_.lock();
+  std::cout << "Control thread starting on thread "
             << std::this_thread::get_id() << std::endl;
-  robot_status_mutex_.unlock();
-
-  lcm::LCM receiver_lcm;
-  receiver_lcm.subscribe(kLcmStatusChannel_, &RobotPlanRunner::HandleStatus,
-                         this);
+  print_mutex_.unlock();
 
-  while (true) {
-    // Call lcm handle until at least one status message is
-    // processed.
-    while (0 == receiver_lcm.handleTimeout(10) ||
-           is_waiting_for_first_robot_status_message_) {
-      // TODO: Print something here so users know no LCM message has been
-      // received.
-    }
+  if (realtime_config_.enabled) {
+    ConfigureCurrentThreadRealtime("plan_runner_ctl",
+                                   realtime_config_.control_thread,
+                                   realtime_config_.prefault_stack_bytes);
   }
-}
 
-void RobotPlanRunner::ConstructNewPlanFromLcm() {
-  // lock mutex when printing so that the text is not mangled (by printing in
-  // another thread).
-  robot_status_mutex_.lock();
-  std::cout << "New Plan constructor thread starting on thread "
-            << std::this_thread::get_id() << std::endl;
-  robot_status_mutex_.unlock();
+  // Allocate and initialize stuff used in the control tick.
+  ControlLoopState &state = control_state_;
+  state.max_dq_per_step =
+      kJointSpeedLimitDegPerSec_ / 180 * M_PI * kControlPeriod_;
+  state.is_holding = false;
+  state.start_time_us = -1;
+  state.has_published_command = false;
+  state.iiwa_command.num_joints = kNumJoints_;
+  state.iiwa_command.joint_position.resize(kNumJoints_, 0.);
+  state.iiwa_command.num_torques = kNumJoints_;
+  state.iiwa_command.joint_torque.resize(kNumJoints_, 0.);
+  state.q_commanded.resize(kNumJoints_);
+  state.v_commanded.resize(kNumJoints_);
+  state.tau_commanded.resize(kNumJoints_);
+  state.prev_position_command.resize(kNumJoints_);
+  state.prev_torque_command.resize(kNumJoints_);
+  state.dq_cmd.resize(kNumJoints_);
+  state.current_robot_state.resize(kNumJoints_ * 2);
+  state.cur_tau_external.resize(kNumJoints_);
+  state.measured_kinematics.reset(new TickKinematics(tree_));
+  state.hold_plan = JointSpaceTrajectoryPlan::MakeHoldCurrentPositionPlan(
+      tree_, Eigen::VectorXd::Zero(kNumJoints_));
+  state.arrived_plan_number = -1;
+  state.degraded_plan_number = -1;
+  state.last_command.num_joints = kNumJoints_;
+
+  // HandleStatus runs the control tick inline, so the status channel gets
+  // its own LCM instance and is dispatched before plans and stop requests
+  // that arrive in the same wakeup.
+  status_lcm_.subscribe(kLcmStatusChannel_, &RobotPlanRunner::HandleStatus,
+                        this);
+  plan_lcm_.subscribe(kLcmPlanChannel_,
+                      &RobotPlanRunner::HandleJointSpaceTrajectoryPlan, this);
+  plan_lcm_.subscribe(kLcmStopChannel_, &RobotPlanRunner::HandleStop, this);
+
+  reactor_.AddReadHandler(status_lcm_.getFileno(), 0,
+                          [this]() { status_lcm_.handleTimeout(0); });
+  reactor_.AddReadHandler(plan_events_.fd(), 1, [this]() {
+    plan_events_.Consume();
+    ApplyPendingPlanChanges();
+  });
+  reactor_.AddReadHandler(plan_lcm_.getFileno(), 2,
+                          [this]() { plan_lcm_.handleTimeout(0); });
+  if (watchdog_->enabled()) {
+    reactor_.AddReadHandler(watchdog_->timer_fd(), 3,
+                            [this]() { HandleWatchdogTimer(); });
+  }
 
-  lcm::LCM constructor_lcm;
-  constructor_lcm.subscribe(
-      kLcmPlanChannel_, &RobotPlanRunner::HandleJointSpaceTrajectoryPlan, this);
-  constructor_lcm.subscribe(kLcmStopChannel_, &RobotPlanRunner::HandleStop,
-                            this);
+  reactor_.Run();
+  std::cout << "Control thread stopped" << std::endl;
+}
 
-  while (true) {
-    // Call lcm handle until at least one status message is
-    // processed.
-    while (0 == constructor_lcm.handleTimeout(10)) {
-      // TODO: Print something here so users know no LCM message has been
-      // received.
+void RobotPlanRunner::ApplyPendingPlanChanges() {
+  std::shared_ptr<PlanBase> &plan_local = control_state_.plan_local;
+  // Nothing can change while a plan runs unless a plan or stop request came
+  // in. Queued plans only start once the current one is over.
+  if (!has_new_plan_.load() && !terminate_current_plan_flag_.load() &&
+      plan_local && !control_state_.is_holding && !plan_local->is_stopped() &&
+      plan_local->get_plan_status() != PlanStatus::FINISHED_NORMALLY) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+  if (terminate_current_plan_flag_.load() == true) {
+    PLAN_RUNNER_LOG(kInfo, "Terminating current plan");
+    if (recorder_) {
+      recorder_->RecordPlanTerminated(plan_local ? plan_local->plan_number_
+                                                 : -1);
+    }
+    if (plan_local) {
+      plan_local->FinishWithStatus(PlanStatus::STOPPED_BY_EXTERNAL_TRIGGER);
+      plan_local.reset();
     }
+    // plans appended since the stop request were planned to start where the
+    // stopped plan would have ended
+    CancelQueuedPlansLocked();
+    active_plan_.reset();
+    terminate_current_plan_flag_.store(false);
+  } else if (new_plan_) {
+    PLAN_RUNNER_LOG(kInfo, "New plan swapped into control thread");
+    if (plan_local) {
+      // preempted, lets anyone waiting on it return
+      plan_local->FinishWithStatus(PlanStatus::STOPPED_BY_EXTERNAL_TRIGGER);
+    }
+    plan_local = new_plan_;
+    new_plan_.reset();
+    has_new_plan_ = false;
+    control_state_.is_holding = false;
+    active_plan_ = plan_local;
+    if (recorder_) {
+      recorder_->RecordPlanSwap(plan_local->plan_number_, false);
+    }
+  } else if (!plan_queue_.empty() &&
+             (!plan_local || control_state_.is_holding ||
+              plan_local->is_stopped() ||
+              plan_local->get_plan_status() == PlanStatus::FINISHED_NORMALLY)) {
+    PopQueuedPlanLocked(false);
   }
 }
 
-void RobotPlanRunner::PublishCommand() {
-  robot_status_mutex_.lock();
-  std::cout << "Command publisher thread starting on thread "
-            << std::this_thread::get_id() << std::endl;
-  robot_status_mutex_.unlock();
+bool RobotPlanRunner::StartNextQueuedPlan() {
+  std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+  // a preempting plan or stop request wins, it is handled on the next tick
+  if (new_plan_ || terminate_current_plan_flag_.load()) {
+    return false;
+  }
+  return PopQueuedPlanLocked(true);
+}
 
-  // Allocate and initialize stuff used in the loop.
-  lcm::LCM publisher_lcm;
-  std::shared_ptr<PlanBase> plan_local;
+bool RobotPlanRunner::PopQueuedPlanLocked(bool same_tick) {
+  std::shared_ptr<PlanBase> next_plan = plan_queue_.Pop();
+  if (!next_plan) {
+    return false;
+  }
+  PLAN_RUNNER_LOG(kInfo, "Queued plan No. %d swapped into control thread, "
+                         "%d more queued",
+                  next_plan->plan_number_, plan_queue_.size());
+  control_state_.plan_local = std::move(next_plan);
+  control_state_.is_holding = false;
+  active_plan_ = control_state_.plan_local;
+  if (recorder_) {
+    recorder_->RecordPlanSwap(control_state_.plan_local->plan_number_,
+                              same_tick);
+  }
+  return true;
+}
 
-  const double max_dq_per_step =
-      kJointSpeedLimitDegPerSec_ / 180 * M_PI * kControlPeriod_;
+bool RobotPlanRunner::PassStartBarrier(PlanBase *plan, int64_t utime,
+                                       int64_t *const start_time_us) {
+  PlanStartBarrier *barrier = plan->get_start_barrier();
+  const int64_t now_ns = MonotonicTimeNs();
+  if (control_state_.arrived_plan_number != plan->plan_number_) {
+    PLAN_RUNNER_LOG(kInfo, "Plan No. %d waiting for the other arms",
+                    plan->plan_number_);
+    barrier->Arrive(now_ns);
+    control_state_.arrived_plan_number = plan->plan_number_;
+  }
+  if (barrier->is_cancelled(now_ns)) {
+    PLAN_RUNNER_LOG(kWarn, "Synchronized start of plan No. %d cancelled",
+                    plan->plan_number_);
+    plan->FinishWithStatus(PlanStatus::STOPPED_BY_EXTERNAL_TRIGGER);
+    return false;
+  }
+  const int64_t start_time_ns = barrier->start_time_ns();
+  if (start_time_ns < 0 || now_ns < start_time_ns) {
+    return false;
+  }
+  // the plan time of this tick is the time since the common start
+  *start_time_us = utime - (now_ns - start_time_ns) / 1000;
+  return true;
+}
 
-  lcmt_iiwa_status iiwa_status_local;
-  iiwa_status_local.utime = -1;
-  int64_t start_time_us = -1;
-  int64_t cur_time_us = -1;
-  double cur_plan_time_s = -1;
-  bool has_published_command = false;
-  // bool terminate_current_plan = false; // whether or not to
+void RobotPlanRunner::ControlTick(const RobotStatusSnapshot &status) {
+  const int64_t t_tick_start_ns = MonotonicTimeNs();
+
+  ControlLoopState &state = control_state_;
+  std::shared_ptr<PlanBase> &plan_local = state.plan_local;
+  const double max_dq_per_step = state.max_dq_per_step;
+  int64_t &start_time_us = state.start_time_us;
+  bool &has_published_command = state.has_published_command;
+  lcmt_iiwa_command &iiwa_command = state.iiwa_command;
+  Eigen::VectorXd &q_commanded = state.q_commanded;
+  Eigen::VectorXd &v_commanded = state.v_commanded;
+  Eigen::VectorXd &tau_commanded = state.tau_commanded;
+  Eigen::VectorXd &prev_position_command = state.prev_position_command;
+  Eigen::VectorXd &prev_torque_command = state.prev_torque_command;
+  Eigen::VectorXd &dq_cmd = state.dq_cmd;
+  Eigen::VectorXd &current_robot_state = state.current_robot_state;
+  Eigen::VectorXd &cur_tau_external = state.cur_tau_external;
+  RobotCommandSnapshot &last_command = state.last_command;
+
+  // per-tick stage durations for telemetry_
+  int64_t stage_ns[ControlLoopTelemetry::kNumStages];
+  int64_t t_step_start_ns, t_step_end_ns, t_publish_start_ns, t_published_ns;
+  int tick_plan_number;
+  const char *tick_plan_type;
+  double cur_plan_time_s;
+
+  if (recorder_) {
+    recorder_->RecordStatus(status);
+  }
 
-  lcmt_iiwa_command iiwa_command;
-  iiwa_command.num_joints = kNumJoints_;
-  iiwa_command.joint_position.resize(kNumJoints_, 0.);
-  iiwa_command.num_torques = kNumJoints_;
-  iiwa_command.joint_torque.resize(kNumJoints_, 0.);
-  Eigen::VectorXd q_commanded(kNumJoints_), v_commanded(kNumJoints_),
-      tau_commanded(kNumJoints_);
+  for (int i = 0; i < kNumJoints_; i++) {
+    current_robot_state[i] = status.joint_position_measured[i];
+    current_robot_state[i + kNumJoints_] = status.joint_velocity_estimated[i];
+  }
+  state.measured_kinematics->Reset(current_robot_state.head(kNumJoints_),
+                                   current_robot_state.tail(kNumJoints_));
 
-  Eigen::VectorXd prev_position_command(kNumJoints_);
-  Eigen::VectorXd prev_torque_command(kNumJoints_);
+  if (!has_published_command) {
+    for (int i = 0; i < kNumJoints_; i++) {
+      prev_position_command[i] = status.joint_position_commanded[i];
+      prev_torque_command[i] = status.joint_torque_commanded[i];
+    }
+  }
 
-  Eigen::VectorXd current_robot_state, cur_tau_external(kNumJoints_);
+  // see if there are any new plans
+  ApplyPendingPlanChanges();
 
-  while (true) {
-    // Put the thread to sleep until a new iiwa_status message is received by
-    // the subscriber thread.
-    std::unique_lock<std::mutex> status_lock(robot_status_mutex_);
-    cv_.wait(status_lock,
-             std::bind(&RobotPlanRunner::has_received_new_status, this));
-    has_received_new_status_ = false;
-
-    // we should have the lock at this point
-
-    // these should all be copies
-    current_robot_state = current_robot_state_;
-    iiwa_status_local = iiwa_status_; // this is a copy
-
-    // Calling unlock is necessary because when cv_.wait() returns, this
-    // thread acquires the mutex, preventing the receiver thread from
-    // executing
-    if (!has_published_command) {      
-      prev_position_command = iiwa_status_position_command_;
-      prev_torque_command = iiwa_status_torque_command_;
-    }
-
-    // update what you commanded
-    last_position_command_ = prev_position_command;
-    last_torque_command_ = prev_torque_command;
-
-    status_lock.unlock();
-
-    // see if there are any new plans
-    robot_plan_mutex_.lock();
-    if (terminate_current_plan_flag_.load() == true) {
-      std::cout << "Terminating current plan" << std::endl;
-      plan_local->set_plan_status(PlanStatus::STOPPED_BY_EXTERNAL_TRIGGER);
-      plan_local->SetPlanFinished();
-      terminate_current_plan_flag_.store(false);
+  if (state.degraded_plan_number >= 0) {
+    // unless a new plan took over already
+    if (plan_local && plan_local->plan_number_ == state.degraded_plan_number) {
+      if (recorder_) {
+        recorder_->RecordPlanTerminated(state.degraded_plan_number);
+      }
       plan_local.reset();
-    } else if (new_plan_) {
-      std::cout << "New plan swapped into publisher thread" << std::endl;
-      plan_local = new_plan_;
-      new_plan_.reset();
     }
-    robot_plan_mutex_.unlock();
+    state.degraded_plan_number = -1;
+  }
 
-    cur_time_us = iiwa_status_local.utime;
-    for (int i = 0; i < kNumJoints_; i++) {
-      cur_tau_external[i] = iiwa_status_local.joint_torque_external[i];
-    }
+  for (int i = 0; i < kNumJoints_; i++) {
+    cur_tau_external[i] = status.joint_torque_external[i];
+  }
 
-    if (!plan_local) {
-      std::cout << "plan_local == nullptr, holding current position..."
-                << std::endl;
+  if (!plan_local) {
+    PLAN_RUNNER_LOG(kInfo,
+                    "plan_local == nullptr, holding current position...");
 
-      // use the last commanded robot position
-      plan_local = JointSpaceTrajectoryPlan::MakeHoldCurrentPositionPlan(
-          tree_, prev_position_command);
+    // use the last commanded robot position
+    state.hold_plan->ResetHoldPosition(prev_position_command);
+    plan_local = state.hold_plan;
 
-      // update the plan number manually since we aren't using the
-      // QueueNewPlan function
-      plan_local->plan_number_ = plan_number_++;
-    }
+    // update the plan number manually since we aren't using the
+    // QueueNewPlan function
+    plan_local->plan_number_ = plan_number_++;
+    state.is_holding = true;
+  }
+
+  t_step_start_ns = MonotonicTimeNs();
+  // If the plan finishes normally in this tick and another one is queued,
+  // the queued plan is started and stepped right away, continuing from the
+  // command the finished plan just produced. Back-to-back plans therefore
+  // have no idle tick in between.
+  bool started_from_queue = false;
+  while (true) {
+    const PlanStatus status_before_step = plan_local->get_plan_status();
 
     // special logic if the plan is new, i.e. not yet in state RUNNING
-    if (plan_local->get_plan_status() == PlanStatus::NOT_STARTED) {
-      std::cout << "\nStarting plan No. " << plan_number_ << std::endl;
+    if (status_before_step == PlanStatus::NOT_STARTED) {
+      if (plan_local->get_start_barrier() &&
+          !PassStartBarrier(plan_local.get(), status.utime, &start_time_us)) {
+        // hold the last command until the other arms are ready
+        if (!started_from_queue) {
+          q_commanded = prev_position_command;
+        }
+        v_commanded.setZero();
+        tau_commanded.setZero();
+        break;
+      }
+      PLAN_RUNNER_LOG(kInfo, "Starting plan No. %d", plan_local->plan_number_);
 
-      plan_local->SetCurrentCommand(prev_position_command, prev_torque_command);
-      start_time_us = iiwa_status_local.utime;
+      if (started_from_queue) {
+        plan_local->SetCurrentCommand(q_commanded, tau_commanded);
+      } else {
+        plan_local->SetCurrentCommand(prev_position_command,
+                                      prev_torque_command);
+      }
+      if (!plan_local->get_start_barrier()) {
+        start_time_us = status.utime;
+      }
     }
 
-    cur_plan_time_s = static_cast<double>(cur_time_us - start_time_us) / 1e6;
+    cur_plan_time_s = static_cast<double>(status.utime - start_time_us) / 1e6;
     plan_local->Step(current_robot_state, cur_tau_external, cur_plan_time_s,
-                     &q_commanded, &v_commanded, &tau_commanded);
+                     state.measured_kinematics.get(), &q_commanded,
+                     &v_commanded, &tau_commanded);
+
+    const PlanStatus status_after_step = plan_local->get_plan_status();
+    if (status_after_step != status_before_step && plan_local->is_stopped()) {
+      // e.g. a force guard fired, the queued plans were meant to start where
+      // this one would have ended
+      const int num_cancelled = CancelQueuedPlans();
+      if (num_cancelled > 0) {
+        PLAN_RUNNER_LOG(kWarn, "Plan No. %d stopped, cancelled %d queued plans",
+                        plan_local->plan_number_, num_cancelled);
+      }
+      break;
+    }
+    if (started_from_queue ||
+        status_before_step == PlanStatus::FINISHED_NORMALLY ||
+        status_after_step != PlanStatus::FINISHED_NORMALLY ||
+        !StartNextQueuedPlan()) {
+      break;
+    }
+    started_from_queue = true;
+  }
+  t_step_end_ns = MonotonicTimeNs();
+  if (watchdog_->RecordStep(t_step_end_ns - t_step_start_ns) &&
+      !state.is_holding) {
+    // this tick's command is late but sound, it is still published
+    PLAN_RUNNER_LOG(kError,
+                    "Plan No. %d (%s) Step over its %.2f ms budget %d ticks "
+                    "in a row, last %.2f ms, holding position",
+                    plan_local->plan_number_, plan_local->get_plan_type(),
+                    watchdog_->step_budget_ns() / 1e6,
+                    watchdog_->max_consecutive_misses(),
+                    (t_step_end_ns - t_step_start_ns) / 1e6);
+    DegradeRunningPlan();
+  }
+  // the safety checks below may reset plan_local
+  tick_plan_number = plan_local->plan_number_;
+  tick_plan_type = plan_local->get_plan_type();
 
-    // apply joint limits
-    q_commanded = this->ApplyJointLimits(q_commanded);
+  // apply joint limits
+  this->ApplyJointLimits(&q_commanded);
 
-    plan_local->SetCurrentCommand(q_commanded, tau_commanded);
+  plan_local->SetCurrentCommand(q_commanded, tau_commanded);
 
-    // Discard current plan if commanded position is "too far away" from
-    // the previous commanded position, i.e. the commanded joint trajectory is
-    // not sufficiently smooth.
-    Eigen::VectorXd dq_cmd = q_commanded - prev_position_command;
-    bool unsafe_command = false;
-    for (int i = 0; i < kNumJoints_; i++) {
+  // Discard current plan if commanded position is "too far away" from
+  // the previous commanded position, i.e. the commanded joint trajectory is
+  // not sufficiently smooth.
+  dq_cmd = q_commanded - prev_position_command;
+  bool unsafe_command = false;
+  for (int i = 0; i < kNumJoints_; i++) {
 
-      if ((std::abs(dq_cmd[i]) > max_dq_per_step)) {
-        std::cout << "Commanded joint position is too jerky, discarding plan..."
-                  << std::endl;
-        std::cout << "dq_cmd limit: " << max_dq_per_step << std::endl;
-        std::cout << "Commanded dq_cmd[" << i << "]: " << dq_cmd[i]
-                  << std::endl;
-        unsafe_command = true;
-      }
+    if ((std::abs(dq_cmd[i]) > max_dq_per_step)) {
+      PLAN_RUNNER_LOG(kError,
+                      "Commanded joint position is too jerky, discarding "
+                      "plan...\ndq_cmd limit: %f\nCommanded dq_cmd[%d]: %f",
+                      max_dq_per_step, i, dq_cmd[i]);
+      unsafe_command = true;
+    }
 
-      if (std::abs(tau_commanded[i]) > 1.0) {
-        std::cout << "Non-zero torque command detected, stopping" << std::endl;
-        unsafe_command = true;
-      }
+    if (std::abs(tau_commanded[i]) > 1.0) {
+      PLAN_RUNNER_LOG(kError, "Non-zero torque command detected, stopping");
+      unsafe_command = true;
+    }
 
-      if (std::isnan(q_commanded[i])) {
-        std::cout << "\nCommand is nan, discarding" << std::endl;
-        std::cout << "\nposition_command:\n" << q_commanded << std::endl;
-        std::cout << "\nvelocity_command:\n" << v_commanded << std::endl;
-        std::cout << "\ntorque_command:\n" << tau_commanded << std::endl;
-        std::cout << "Current_robot_state:\n"
-                  << current_robot_state << std::endl;
-        std::cout << "\ncur_plan_time: " << cur_plan_time_s << std::endl;
-        unsafe_command = true;
-
-        std::cout << "plan_local->get_plan_status():"
-                  << plan_local->get_plan_status() << std::endl;
-        std::cout << "plan_local->is_finished_:" << plan_local->is_finished_
-                  << std::endl;
-      }
+    if (std::isnan(q_commanded[i])) {
+      PLAN_RUNNER_LOG(
+          kError,
+          "Command is nan, discarding\nposition_command: %s\n"
+          "velocity_command: %s\ntorque_command: %s\n"
+          "Current_robot_state: %s\ncur_plan_time: %f\n"
+          "plan_local->get_plan_status(): %d\nplan_local->is_finished_: %d",
+          MatrixString(q_commanded.transpose()).c_str(),
+          MatrixString(v_commanded.transpose()).c_str(),
+          MatrixString(tau_commanded.transpose()).c_str(),
+          MatrixString(current_robot_state.transpose()).c_str(),
+          cur_plan_time_s, plan_local->get_plan_status(),
+          plan_local->is_finished_);
+      unsafe_command = true;
+    }
 
-      if (unsafe_command) {
-        std::cout << "detected unsafe command\n";
-        std::cout << "\nposition_command:\n" << q_commanded << std::endl;
-        std::cout << "\ntorque_command:\n" << tau_commanded << std::endl;
-
-        std::cout << "sending previous position command instead" << std::endl;
-        std::cout << "setting torque command to zero" << std::endl;
-        q_commanded = prev_position_command;
-        tau_commanded = Eigen::VectorXd::Zero(kNumJoints_);
-
-        std::cout << "safe commands" << std::endl;
-        std::cout << "\nposition_command:\n" << q_commanded << std::endl;
-        std::cout << "\ntorque_command:\n" << tau_commanded << std::endl;
-
-        plan_local->set_plan_status(PlanStatus::STOPPED_BY_SAFETY_CHECK);
-        plan_local->SetPlanFinished();
-        std::cout << "set current plan to finished\n";
-        plan_local.reset();
-        std::cout << "reset plan_local pointer\n";
-        break;
+    if (unsafe_command) {
+      PLAN_RUNNER_LOG(kError,
+                      "detected unsafe command\nposition_command: %s\n"
+                      "torque_command: %s\nsending previous position "
+                      "command instead, setting torque command to zero",
+                      MatrixString(q_commanded.transpose()).c_str(),
+                      MatrixString(tau_commanded.transpose()).c_str());
+      q_commanded = prev_position_command;
+      tau_commanded.setZero();
+
+      PLAN_RUNNER_LOG(kError, "safe commands\nposition_command: %s",
+                      MatrixString(q_commanded.transpose()).c_str());
+
+      plan_local->set_plan_status(PlanStatus::STOPPED_BY_SAFETY_CHECK);
+      plan_local->SetPlanFinished();
+      plan_local.reset();
+      PLAN_RUNNER_LOG(kInfo, "set current plan to finished");
+      const int num_cancelled = CancelQueuedPlans();
+      if (num_cancelled > 0) {
+        PLAN_RUNNER_LOG(kWarn, "cancelled %d queued plans", num_cancelled);
       }
+      break;
     }
+  }
 
-    // construct and publish iiwa_command
-    iiwa_command.utime = iiwa_status_local.utime;
+  // construct and publish iiwa_command
+  t_publish_start_ns = MonotonicTimeNs();
+  iiwa_command.utime = status.utime;
+  if (command_publisher_) {
+    if (!command_publisher_->Publish(status.utime, q_commanded,
+                                     tau_commanded)) {
+      PLAN_RUNNER_LOG(kError, "Could not send %s: %s",
+                      kLcmCommandChannel_.c_str(), std::strerror(errno));
+    }
+  } else {
     for (int i = 0; i < kNumJoints_; i++) {
       iiwa_command.joint_position[i] = q_commanded(i);
       iiwa_command.joint_torque[i] = tau_commanded(i);
     }
-    publisher_lcm.publish(kLcmCommandChannel_, &iiwa_command);
-    has_published_command = true;
-    prev_position_command = q_commanded;
-    prev_torque_command = tau_commanded;
+    status_lcm_.publish(kLcmCommandChannel_, &iiwa_command);
+  }
+  t_published_ns = MonotonicTimeNs();
+  has_published_command = true;
+  prev_position_command = q_commanded;
+  prev_torque_command = tau_commanded;
+
+  // update what you commanded
+  last_command.utime = iiwa_command.utime;
+  for (int i = 0; i < kNumJoints_; i++) {
+    last_command.joint_position[i] = q_commanded(i);
+    last_command.joint_torque[i] = tau_commanded(i);
+  }
+  last_command_.Store(last_command);
+  if (recorder_) {
+    recorder_->RecordCommand(last_command, tick_plan_number);
+  }
+
+  stage_ns[ControlLoopTelemetry::kDecode] =
+      t_tick_start_ns - status.receive_time_ns;
+  stage_ns[ControlLoopTelemetry::kPlanSwap] =
+      t_step_start_ns - t_tick_start_ns;
+  stage_ns[ControlLoopTelemetry::kStep] = t_step_end_ns - t_step_start_ns;
+  stage_ns[ControlLoopTelemetry::kSafetyCheck] =
+      t_publish_start_ns - t_step_end_ns;
+  stage_ns[ControlLoopTelemetry::kPublish] = t_published_ns - t_publish_start_ns;
+  stage_ns[ControlLoopTelemetry::kTotal] =
+      t_published_ns - status.receive_time_ns;
+  telemetry_.RecordTick(stage_ns, tick_plan_number, tick_plan_type);
+}
+
+void RobotPlanRunner::HandleWatchdogTimer() {
+  const int64_t now_ns = reactor_.wakeup_time_ns();
+  if (!watchdog_->CheckStatusAge(now_ns)) {
+    return;
+  }
+  PLAN_RUNNER_LOG(kError, "No %s message for %.0f ms, holding position",
+                  kLcmStatusChannel_.c_str(),
+                  watchdog_->status_age_ns(now_ns) / 1e6);
+  DegradeRunningPlan();
+}
+
+void RobotPlanRunner::DegradeRunningPlan() {
+  ControlLoopState &state = control_state_;
+  if (!state.plan_local || state.is_holding) {
+    return;
+  }
+  state.plan_local->FinishWithStatus(PlanStatus::STOPPED_BY_WATCHDOG);
+  state.degraded_plan_number = state.plan_local->plan_number_;
+  watchdog_->RecordDegradation();
+  const int num_cancelled = CancelQueuedPlans();
+  if (num_cancelled > 0) {
+    PLAN_RUNNER_LOG(kWarn, "Plan No. %d stopped by the watchdog, cancelled %d "
+                           "queued plans",
+                    state.degraded_plan_number, num_cancelled);
+  }
+}
+
+void RobotPlanRunner::PublishControlLoopStats() {
+  print_mutex_.lock();
+  std::cout << "Control loop stats thread starting on thread "
+            << std::this_thread::get_id() << std::endl;
+  print_mutex_.unlock();
+
+  robot_msgs::ControlLoopStats msg;
+  const int64_t period_ns =
+      static_cast<int64_t>(control_loop_stats_period_s_ * 1e9);
+  int64_t next_stats_ns = MonotonicTimeNs() + period_ns;
+  while (is_running_) {
+    // completions are published as they come in, the stats once a period
+    const int64_t now_ns = MonotonicTimeNs();
+    if (now_ns < next_stats_ns) {
+      plan_completions_.Wait(
+          static_cast<int>((next_stats_ns - now_ns + 999999) / 1000000));
+      PublishQueuedCompletions();
+      continue;
+    }
+    next_stats_ns = std::max(next_stats_ns + period_ns, now_ns);
+    telemetry_.Report(&msg);
+    watchdog_->Report(now_ns, &msg);
+    msg.kinematics_cache_pool_hits = kinematics_cache_pool_->num_hits();
+    msg.kinematics_cache_pool_misses = kinematics_cache_pool_->num_misses();
+    msg.kinematics_cache_pool_size = kinematics_cache_pool_->num_caches();
+    control_loop_stats_publisher_.publish(msg);
   }
+  PublishQueuedCompletions();
 }
 
 void RobotPlanRunner::MoveToJointPosition(
@@ -582,8 +1432,9 @@ void RobotPlanRunner::MoveToJointPosition(
   knots.push_back(q0);
   knots.push_back(q_final);
 
-  std::shared_ptr<PlanBase> plan = std::make_shared<JointSpaceTrajectoryPlan>(
+  auto plan = std::make_shared<JointSpaceTrajectoryPlan>(
       tree_, PPType::FirstOrderHold(times, knots));
+  BakeIfEnabled(plan.get());
   QueueNewPlan(plan);
 }
 
@@ -622,69 +1473,97 @@ void RobotPlanRunner::MoveToJointPosition(
 //  QueueNewPlan(plan);
 //}
 
-void RobotPlanRunner::HandleStatus(const lcm::ReceiveBuffer *,
-                                   const std::string &,
-                                   const lcmt_iiwa_status *status) {
-  std::unique_lock<std::mutex> lock(robot_status_mutex_);
-  iiwa_status_ = *status;
-  has_received_new_status_ = true;
-
-  for (int i = 0; i < kNumJoints_; i++) {
-    current_robot_state_[i] = iiwa_status_.joint_position_measured[i];
-    current_robot_state_[i + kNumJoints_] =
-        iiwa_status_.joint_velocity_estimated[i];
-    iiwa_status_position_command_[i] = iiwa_status_.joint_position_commanded[i];
-    iiwa_status_torque_command_[i] = iiwa_status_.joint_torque_commanded[i];
+void RobotPlanRunner::HandleStatus(const lcm::ReceiveBuffer *rbuf,
+                                   const std::string &) {
+  RobotStatusSnapshot snapshot;
+  if (!status_decoder_->Decode(rbuf->data, rbuf->data_size, &snapshot)) {
+    PLAN_RUNNER_LOG(kError,
+                    "Dropping %s message, not an lcmt_iiwa_status with %d "
+                    "joints",
+                    kLcmStatusChannel_.c_str(), kNumJoints_);
+    return;
   }
-  lock.unlock();
-
+  // HandleStatus is only called from the reactor on the control thread
+  snapshot.receive_time_ns = reactor_.wakeup_time_ns();
 
-  if (is_waiting_for_first_robot_status_message_){
-    last_position_command_ = iiwa_status_position_command_;
-    last_torque_command_ = iiwa_status_torque_command_;
-  }
+  // Never blocks, lets other threads read the latest status.
+  status_mailbox_.Post(snapshot);
   is_waiting_for_first_robot_status_message_ = false;
-  cv_.notify_all();
+  watchdog_->RecordStatus(snapshot.receive_time_ns);
+
+  ControlTick(snapshot);
 }
 
 void RobotPlanRunner::HandleJointSpaceTrajectoryPlan(
-    const lcm::ReceiveBuffer *, const std::string &,
-    const robotlocomotion::robot_plan_t *tape) {
+    const lcm::ReceiveBuffer *rbuf, const std::string &) {
+  PLAN_RUNNER_LOG(kInfo, "New joint space trajectory plan received.");
+  const uint64_t sequence = ++lcm_plan_sequence_;
+  // rbuf is only valid during the callback
+  const uint8_t *const bytes = static_cast<const uint8_t *>(rbuf->data);
+  auto data =
+      std::make_shared<std::vector<uint8_t>>(bytes, bytes + rbuf->data_size);
+  lcm_plan_pool_->Submit([this, data, sequence]() {
+    try {
+      ConstructPlanFromLcm(*data, sequence);
+    } catch (const std::exception &e) {
+      PLAN_RUNNER_LOG(kError, "Discarding plan: %s", e.what());
+    }
+  });
+}
+
+void RobotPlanRunner::HandleStop(const lcm::ReceiveBuffer *,
+                                 const std::string &) {
+  {
+    std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+    ++lcm_plan_sequence_;
+  }
+  CancelAllPlans();
+}
+
+void RobotPlanRunner::ConstructPlanFromLcm(const std::vector<uint8_t> &data,
+                                           uint64_t sequence) {
   // Most of the code in this function is copied from
   // drake/examples/kuka_iiwa_arm/kuka_plan_runner.cc
-  std::cout << "New joint space trajectory plan received." << std::endl;
+  robotlocomotion::robot_plan_t plan_msg;
+  if (plan_msg.decode(data.data(), 0, data.size()) < 0) {
+    PLAN_RUNNER_LOG(kWarn, "Discarding plan, could not decode it.");
+    return;
+  }
+  const robotlocomotion::robot_plan_t *const tape = &plan_msg;
   if (is_waiting_for_first_robot_status_message_) {
-    std::cout << "Discarding plan, no status message received yet" << std::endl;
+    PLAN_RUNNER_LOG(kWarn, "Discarding plan, no status message received yet");
     return;
   } else if (tape->num_states < 2) {
-    std::cout << "Discarding plan, Not enough knot points." << std::endl;
+    PLAN_RUNNER_LOG(kWarn, "Discarding plan, Not enough knot points.");
     return;
   }
 
-  robot_status_mutex_.lock();
-  auto iiwa_status_local = iiwa_status_;
-  auto last_position_command_local = this->last_position_command_;
-  auto last_torque_command_local = this->last_torque_command_;
-  robot_status_mutex_.unlock();
+  Eigen::VectorXd last_position_command_local, last_torque_command_local;
+  GetLastCommand(&last_position_command_local, &last_torque_command_local);
 
-  std::vector<Eigen::MatrixXd> knots(tape->num_states,
-                                     Eigen::MatrixXd::Zero(kNumJoints_, 1));
-  std::map<std::string, int> name_to_idx =
-      tree_->computePositionNameToIndexMap();
+  // one column per knot
+  Eigen::MatrixXd knots = Eigen::MatrixXd::Zero(kNumJoints_, tape->num_states);
+  // every knot carries its own joint names, but they are almost always the
+  // same as in the previous knot
+  std::shared_ptr<const std::vector<int>> name_to_idx;
+  const std::vector<std::string> *idx_names = nullptr;
   for (int i = 0; i < tape->num_states; ++i) {
     const auto &state = tape->plan[i];
+    if (!idx_names || state.joint_name != *idx_names) {
+      name_to_idx = joint_name_permutations_->Lookup(state.joint_name);
+      idx_names = &state.joint_name;
+    }
     for (int j = 0; j < state.num_joints; ++j) {
-      if (name_to_idx.count(state.joint_name[j]) == 0) {
+      const int joint_idx = (*name_to_idx)[j];
+      if (joint_idx == JointNamePermutationCache::kNotInTree) {
         continue;
       }
-      // Treat the matrix at knots[i] as a column vector.
       if (i == 0) {
         // Always start moving from the position which we're
         // currently commanding.
-        knots[0](name_to_idx[state.joint_name[j]], 0) =
-            last_position_command_local[j];
+        knots(joint_idx, 0) = last_position_command_local[j];
       } else {
-        knots[i](name_to_idx[state.joint_name[j]], 0) = state.joint_position[j];
+        knots(joint_idx, i) = state.joint_position[j];
       }
     }
   }
@@ -693,61 +1572,50 @@ void RobotPlanRunner::HandleJointSpaceTrajectoryPlan(
   for (int k = 0; k < static_cast<int>(tape->plan.size()); ++k) {
     input_time.push_back(tape->plan[k].utime / 1e6);
   }
+  if (!TimesStrictlyIncrease(input_time)) {
+    PLAN_RUNNER_LOG(kWarn,
+                    "Discarding plan, knot times do not strictly increase.");
+    return;
+  }
 
-  const Eigen::MatrixXd knot_dot = Eigen::MatrixXd::Zero(kNumJoints_, 1);
-  auto plan_new_local = std::make_shared<JointSpaceTrajectoryPlan>(
-      tree_, PPType::Cubic(input_time, knots, knot_dot, knot_dot));
-
-  QueueNewPlan(plan_new_local);
-}
-
-void RobotPlanRunner::ExecuteJointTrajectoryAction(
-    const robot_msgs::JointTrajectoryGoal::ConstPtr &goal) {
-
-  ROS_INFO("\n\n----JointTrajectoryAction Start------\n\n");
-  ROS_INFO("Received Joint Space Trajectory Plan");
-  // robot_msgs::JointTrajectoryResult result;
-
-  int num_knot_points = goal->trajectory.points.size();
-  const trajectory_msgs::JointTrajectory &trajectory = goal->trajectory;
+  auto plan_new_local =
+      MakeJointTrajectoryPlanFromKnots(input_time, knots, true, nullptr);
+  std::vector<char> plan_record = EncodePlanRecord(*plan_new_local);
 
-  if (is_waiting_for_first_robot_status_message_) {
-    std::cout << "Discarding plan, no status message received yet" << std::endl;
-    return;
-  } else if (num_knot_points < 2) {
-    std::cout << "Discarding plan, Not enough knot points." << std::endl;
+  std::lock_guard<std::mutex> lock(robot_plan_mutex_);
+  if (sequence != lcm_plan_sequence_) {
+    PLAN_RUNNER_LOG(kInfo, "Discarding plan, superseded while it was built.");
     return;
   }
+  QueueNewPlanLocked(std::move(plan_new_local), &plan_record);
+}
 
-  robot_status_mutex_.lock();
-  auto iiwa_status_local = iiwa_status_;
-  auto last_position_command_local = this->last_position_command_;
-  auto last_torque_command_local = this->last_torque_command_;
-  robot_status_mutex_.unlock();
-
-  std::vector<Eigen::MatrixXd> knots(num_knot_points,
-                                     Eigen::MatrixXd::Zero(kNumJoints_, 1));
-  std::map<std::string, int> name_to_idx =
-      tree_->computePositionNameToIndexMap();
+std::shared_ptr<JointSpaceTrajectoryPlan>
+RobotPlanRunner::MakeJointTrajectoryPlan(
+    const trajectory_msgs::JointTrajectory &trajectory,
+    const Eigen::Ref<const Eigen::VectorXd> &q_start, bool retime,
+    JointTrajectoryFitStats *const stats) {
+  const int num_knot_points = trajectory.points.size();
+  // one column per knot
+  Eigen::MatrixXd knots = Eigen::MatrixXd::Zero(kNumJoints_, num_knot_points);
+  const std::shared_ptr<const std::vector<int>> name_to_idx =
+      joint_name_permutations_->Lookup(trajectory.joint_names);
 
   std::vector<double> input_time;
   for (int i = 0; i < num_knot_points; ++i) {
     const trajectory_msgs::JointTrajectoryPoint &traj_point =
         trajectory.points[i];
     for (int j = 0; j < trajectory.joint_names.size(); ++j) {
-      std::string joint_name = trajectory.joint_names[j];
-      if (name_to_idx.count(joint_name) == 0) {
+      const int joint_idx = (*name_to_idx)[j];
+      if (joint_idx == JointNamePermutationCache::kNotInTree) {
         continue;
       }
-
-      int joint_idx = name_to_idx[joint_name];
-      // Treat the matrix at knots[i] as a column vector.
       if (i == 0) {
-        // Always start moving from the position which we're
-        // currently commanding.
-        knots[0](joint_idx, 0) = last_position_command_local[j];
+        // Always start moving from q_start, i.e. the position which we're
+        // currently commanding or the end of the plan queue.
+        knots(joint_idx, 0) = q_start[joint_idx];
       } else {
-        knots[i](joint_idx, 0) = traj_point.positions[j];
+        knots(joint_idx, i) = traj_point.positions[j];
       }
     }
 
@@ -756,9 +1624,103 @@ void RobotPlanRunner::ExecuteJointTrajectoryAction(
 
   std::cout << "plan duration in seconds: " << input_time.back() << std::endl;
 
-  const Eigen::MatrixXd knot_dot = Eigen::MatrixXd::Zero(kNumJoints_, 1);
-  auto plan_local = std::make_shared<JointSpaceTrajectoryPlan>(
-      tree_, PPType::Cubic(input_time, knots, knot_dot, knot_dot));
+  return MakeJointTrajectoryPlanFromKnots(input_time, knots, retime, stats);
+}
+
+std::shared_ptr<JointSpaceTrajectoryPlan>
+RobotPlanRunner::MakeJointTrajectoryPlanFromKnots(
+    const std::vector<double> &times, const Eigen::MatrixXd &knots,
+    bool retime, JointTrajectoryFitStats *const stats) {
+  JointTrajectoryFitStats fit_stats;
+  PPType spline = FitJointTrajectory(
+      times, knots, joint_trajectory_fit_options_, &fit_stats);
+  PLAN_RUNNER_LOG(kInfo,
+                  "Fitted %d of %d knots (%.1f%%), decimation %.2f ms, "
+                  "spline fit %.2f ms",
+                  fit_stats.num_knots, fit_stats.num_input_knots,
+                  fit_stats.reduction_ratio() * 100,
+                  fit_stats.decimation_s * 1e3, fit_stats.fit_s * 1e3);
+  if (stats) {
+    *stats = fit_stats;
+  }
+
+  if (retime && retiming_options_.enabled) {
+    PPType retimed;
+    JointTrajectoryRetimingStats retiming_stats;
+    if (RetimeJointTrajectory(spline, retiming_max_velocity_,
+                              retiming_max_acceleration_,
+                              retiming_options_.grid_step_s,
+                              ToRadians(retiming_options_.grid_step_deg),
+                              &retimed, &retiming_stats)) {
+      PLAN_RUNNER_LOG(kInfo,
+                      "Retimed plan from %.3f s to %.3f s on %d grid points "
+                      "in %.2f ms",
+                      retiming_stats.input_duration, retiming_stats.duration,
+                      retiming_stats.num_grid_points,
+                      retiming_stats.retiming_s * 1e3);
+      spline = std::move(retimed);
+    } else {
+      PLAN_RUNNER_LOG(kWarn, "Could not retime plan, keeping its timing");
+    }
+  }
+
+  auto plan = std::make_shared<JointSpaceTrajectoryPlan>(tree_, spline);
+  BakeIfEnabled(plan.get());
+  return plan;
+}
+
+void RobotPlanRunner::BakeIfEnabled(JointSpaceTrajectoryPlan *plan) {
+  if (!bake_joint_trajectories_) {
+    return;
+  }
+  if (std::this_thread::get_id() == control_thread_.get_id()) {
+    // would stall the control tick for the size of the trajectory
+    PLAN_RUNNER_LOG(kError, "Not baking on the control thread, evaluating "
+                            "the polynomials instead");
+    return;
+  }
+  if (!plan->Bake(kControlPeriod_)) {
+    PLAN_RUNNER_LOG(kWarn, "%f s trajectory is too long to bake, evaluating "
+                           "the polynomials instead",
+                    plan->duration());
+  }
+}
+
+void RobotPlanRunner::ExecuteJointTrajectoryAction(
+    const robot_msgs::JointTrajectoryGoal::ConstPtr &goal) {
+  const int64_t receive_ns = MonotonicTimeNs();
+  robot_msgs::PlanConstructionLatency latency;
+
+  ROS_INFO("\n\n----JointTrajectoryAction Start------\n\n");
+  ROS_INFO("Received Joint Space Trajectory Plan");
+  // robot_msgs::JointTrajectoryResult result;
+
+  int num_knot_points = goal->trajectory.points.size();
+  const trajectory_msgs::JointTrajectory &trajectory = goal->trajectory;
+
+  if (is_waiting_for_first_robot_status_message_) {
+    std::cout << "Discarding plan, no status message received yet" << std::endl;
+    return;
+  } else if (num_knot_points < 2) {
+    std::cout << "Discarding plan, Not enough knot points." << std::endl;
+    return;
+  } else if (!TimesStrictlyIncrease(trajectory)) {
+    std::cout << "Discarding plan, knot times do not strictly increase."
+              << std::endl;
+    return;
+  }
+
+  Eigen::VectorXd last_position_command_local, last_torque_command_local;
+  GetLastCommand(&last_position_command_local, &last_torque_command_local);
+
+  JointTrajectoryFitStats fit_stats;
+  int64_t stage_start_ns = MonotonicTimeNs();
+  auto plan_local = MakeJointTrajectoryPlan(
+      trajectory, last_position_command_local, true, &fit_stats);
+  latency.spline_fit = (MonotonicTimeNs() - stage_start_ns) * 1e-9;
+  latency.num_input_knots = fit_stats.num_input_knots;
+  latency.num_knots = fit_stats.num_knots;
+  stage_start_ns = MonotonicTimeNs();
 
   // Add ForceGuards if specified
   if (goal->force_guard.size() > 0) {
@@ -774,8 +1736,13 @@ void RobotPlanRunner::ExecuteJointTrajectoryAction(
       plan_local->set_guard_container(guard_container);
     }
   }
+  latency.guard_build = (MonotonicTimeNs() - stage_start_ns) * 1e-9;
 
+  stage_start_ns = MonotonicTimeNs();
   QueueNewPlan(plan_local);
+  const int64_t queued_ns = MonotonicTimeNs();
+  latency.queue = (queued_ns - stage_start_ns) * 1e-9;
+  latency.total = (queued_ns - receive_ns) * 1e-9;
 
   // // now wait for the plan to finish
   ROS_INFO("Waiting for plan to finish");
@@ -785,6 +1752,7 @@ void RobotPlanRunner::ExecuteJointTrajectoryAction(
   // ROS_INFO("setting ROS action to succeeded state");
   robot_msgs::JointTrajectoryResult result;
   plan_local->GetPlanStatusMsg(result.status);
+  result.construction_latency = latency;
 
   ROS_INFO("setting action result");
   joint_trajectory_action_->setSucceeded(result);
@@ -792,13 +1760,37 @@ void RobotPlanRunner::ExecuteJointTrajectoryAction(
   ROS_INFO("\n\n------JointTrajectoryAction Finished------\n\n");
 }
 
+std::future<RobotPlanRunner::TransformLookup>
+RobotPlanRunner::LookupTransformAsync(const std::string &frame_id) {
+  const std::string base_frame_id = base_frame_id_;
+  return construction_pool_->Submit([this, base_frame_id, frame_id]() {
+    TransformLookup lookup;
+    try {
+      // returns as soon as the transform is available
+      lookup.transform = tf_buffer_->lookupTransform(
+          base_frame_id, frame_id, ros::Time(0),
+          ros::Duration(tf_lookup_timeout_s_));
+    } catch (const tf2::TransformException &ex) {
+      lookup.error = ex.what();
+    }
+    lookup.done_ns = MonotonicTimeNs();
+    return lookup;
+  });
+}
+
 void RobotPlanRunner::ExecuteCartesianTrajectoryAction(
     const robot_msgs::CartesianTrajectoryGoal::ConstPtr &goal) {
+  const int64_t receive_ns = MonotonicTimeNs();
+  robot_msgs::PlanConstructionLatency latency;
 
   ROS_INFO("\n\n-------CartesianTrajectoryAction Start--------\n\n");
   const robot_msgs::CartesianTrajectory &traj = goal->trajectory;
 
   int num_knot_points = traj.xyz_points.size();
+  std::vector<double> knot_times(traj.time_from_start.size());
+  for (size_t i = 0; i < knot_times.size(); i++) {
+    knot_times[i] = traj.time_from_start[i].toSec();
+  }
 
   if (is_waiting_for_first_robot_status_message_) {
     std::cout << "Discarding plan, no status message received yet" << std::endl;
@@ -806,86 +1798,59 @@ void RobotPlanRunner::ExecuteCartesianTrajectoryAction(
   } else if (num_knot_points < 2) {
     std::cout << "Discarding plan, Not enough knot points." << std::endl;
     return;
+  } else if (knot_times.size() != traj.xyz_points.size()) {
+    std::cout << "Discarding plan, need one time_from_start per knot point."
+              << std::endl;
+    return;
+  } else if (!TimesStrictlyIncrease(knot_times)) {
+    std::cout << "Discarding plan, knot times do not strictly increase."
+              << std::endl;
+    return;
   }
 
-  robot_status_mutex_.lock();
-  auto iiwa_status_local = iiwa_status_;
-  auto last_position_command_local = this->last_position_command_;
-  auto last_torque_command_local = this->last_torque_command_;
-  robot_status_mutex_.unlock();
-
-  // extract the xyz trajectory
-
+  // The transforms and the force guards do not depend on the rest of the
+  // goal, they are prepared on the construction pool while it is decoded.
+  //
   // frame in which xyz_traj is expressed.
   // It can either be world (denoted by base)
   // or it can be a local frame on the robot
-  std::string xyz_traj_frame_id = traj.xyz_points[0].header.frame_id;
-  std::string base_frame_id = "base";
-  //  std::cout << "xyz_traj_frame_id: " << xyz_traj_frame_id << std::endl;
-  geometry_msgs::TransformStamped transform_tf;
-
-  try {
-    transform_tf = tf_buffer_.lookupTransform(base_frame_id, xyz_traj_frame_id,
-                                              ros::Time(0));
-  } catch (tf2::TransformException ex) {
-    ROS_ERROR("%s", ex.what());
-    ros::Duration(1.0).sleep();
-  }
-  // convert to Eigen transform
-  Eigen::Affine3d T_local_to_world =
-      spartan::drake_robot_control::utils::transformToEigen(transform_tf);
-
-  //
-  // lookup current position of ee_frame_id
-  geometry_msgs::TransformStamped ee_frame_tf;
-  try {
-    ee_frame_tf = tf_buffer_.lookupTransform(base_frame_id, traj.ee_frame_id,
-                                             ros::Time(0));
-  } catch (tf2::TransformException ex) {
-    ROS_ERROR("%s", ex.what());
-    ros::Duration(1.0).sleep();
+  std::future<TransformLookup> traj_frame_lookup =
+      LookupTransformAsync(traj.xyz_points[0].header.frame_id);
+  // current position of ee_frame_id
+  std::future<TransformLookup> ee_frame_lookup =
+      LookupTransformAsync(traj.ee_frame_id);
+  // guard container (null without guards) and the time it took
+  std::future<std::pair<std::shared_ptr<ForceGuardContainer>, int64_t>>
+      guards;
+  if (goal->force_guard.size() > 0) {
+    guards = construction_pool_->Submit([this, goal]() {
+      const int64_t start_ns = MonotonicTimeNs();
+      std::shared_ptr<ForceGuardContainer> guard_container =
+          ForceGuardContainerFromRosMsg(goal->force_guard[0], *tree_);
+      return std::make_pair(guard_container, MonotonicTimeNs() - start_ns);
+    });
   }
 
-  Eigen::Affine3d T_ee_to_world =
-      spartan::drake_robot_control::utils::transformToEigen(ee_frame_tf);
-
-  std::vector<Eigen::MatrixXd> knots(num_knot_points,
-                                     Eigen::MatrixXd::Zero(3, 1));
-  std::vector<double> input_time;
-
-  // Local to world transformation
-
-  // figure out what frame the points are expressed in
+  // decode
+  int64_t stage_start_ns = MonotonicTimeNs();
+  std::vector<Eigen::Vector3d> xyz_local(num_knot_points);
+  std::vector<double> input_time(num_knot_points);
   for (int i = 0; i < num_knot_points; i++) {
-
-    // replace first knot point by current position of ee_frame
-    Eigen::Vector3d xyz_pos_in_world;
-    if (i == 0) {
-      xyz_pos_in_world = T_ee_to_world.translation();
-    } else {
-
-      const geometry_msgs::PointStamped &xyz_point = traj.xyz_points[i];
-      Eigen::Vector3d xyz_pos_local(xyz_point.point.x, xyz_point.point.y,
-                                    xyz_point.point.z);
-      xyz_pos_in_world = T_local_to_world * xyz_pos_local;
-    }
-
-    knots[i] = xyz_pos_in_world;
-    input_time.push_back(traj.time_from_start[i].toSec());
+    const geometry_msgs::PointStamped &xyz_point = traj.xyz_points[i];
+    xyz_local[i] = Eigen::Vector3d(xyz_point.point.x, xyz_point.point.y,
+                                   xyz_point.point.z);
+    input_time[i] = traj.time_from_start[i].toSec();
   }
 
-  drake::math::RotationMatrixd R_ee_to_world_initial(T_ee_to_world.linear());
-  drake::math::RotationMatrixd R_ee_to_world_final;
-
-  if (traj.quaternions.size() > 0) {
+  const bool has_final_orientation = traj.quaternions.size() > 0;
+  Eigen::Quaterniond quat_WE_final;
+  if (has_final_orientation) {
     ROS_INFO("Orientation passed in, interpolating with slerp");
     const geometry_msgs::Quaternion &quat_msg = traj.quaternions[0];
-    Eigen::Quaterniond quat_WE_final(quat_msg.w, quat_msg.x, quat_msg.y,
-                                     quat_msg.z);
-    R_ee_to_world_final = drake::math::RotationMatrixd(quat_WE_final);
+    quat_WE_final =
+        Eigen::Quaterniond(quat_msg.w, quat_msg.x, quat_msg.y, quat_msg.z);
   } else {
     ROS_INFO("No orientation passed in, using current");
-    R_ee_to_world_final = R_ee_to_world_initial;
   }
 
   // figure out the gains
@@ -910,35 +1875,96 @@ void RobotPlanRunner::ExecuteCartesianTrajectoryAction(
                             .as<std::vector<double>>()
                             .data());
   }
+  latency.decode = (MonotonicTimeNs() - stage_start_ns) * 1e-9;
+
+  // tf
+  const TransformLookup traj_frame_tf = traj_frame_lookup.get();
+  const TransformLookup ee_frame_tf = ee_frame_lookup.get();
+  latency.tf =
+      (std::max(traj_frame_tf.done_ns, ee_frame_tf.done_ns) - receive_ns) *
+      1e-9;
+  if (!traj_frame_tf.error.empty() || !ee_frame_tf.error.empty()) {
+    robot_msgs::CartesianTrajectoryResult result;
+    result.status.status = result.status.ERROR;
+    result.status.msg = traj_frame_tf.error.empty() ? ee_frame_tf.error
+                                                    : traj_frame_tf.error;
+    ROS_ERROR("Discarding plan: %s", result.status.msg.c_str());
+    latency.total = (MonotonicTimeNs() - receive_ns) * 1e-9;
+    result.construction_latency = latency;
+    cartesian_trajectory_action_->setAborted(result, result.status.msg);
+    return;
+  }
+  // convert to Eigen transform
+  const Eigen::Affine3d T_local_to_world =
+      spartan::drake_robot_control::utils::transformToEigen(
+          traj_frame_tf.transform);
+  const Eigen::Affine3d T_ee_to_world =
+      spartan::drake_robot_control::utils::transformToEigen(
+          ee_frame_tf.transform);
+
+  // spline fit
+  stage_start_ns = MonotonicTimeNs();
+  std::vector<Eigen::MatrixXd> knots(num_knot_points);
+  // replace first knot point by current position of ee_frame
+  knots[0] = T_ee_to_world.translation();
+  for (int i = 1; i < num_knot_points; i++) {
+    knots[i] = T_local_to_world * xyz_local[i];
+  }
+
+  drake::math::RotationMatrixd R_ee_to_world_initial(T_ee_to_world.linear());
+  drake::math::RotationMatrixd R_ee_to_world_final =
+      has_final_orientation ? drake::math::RotationMatrixd(quat_WE_final)
+                            : R_ee_to_world_initial;
 
   const Eigen::MatrixXd knot_dot = Eigen::MatrixXd::Zero(3, 1);
-  auto plan_local = std::make_shared<EndEffectorOriginTrajectoryPlan>(
-      tree_, PPType::Cubic(input_time, knots, knot_dot, knot_dot),
-      R_ee_to_world_initial, R_ee_to_world_final, kp_rotation, kp_translation,
-      traj.ee_frame_id);
+  std::shared_ptr<EndEffectorOriginTrajectoryPlan> plan_local;
+  if (use_task_space_qp_) {
+    plan_local = std::make_shared<EndEffectorOriginQpTrajectoryPlan>(
+        tree_, PPType::Cubic(input_time, knots, knot_dot, knot_dot),
+        R_ee_to_world_initial, R_ee_to_world_final, kp_rotation,
+        kp_translation, traj.ee_frame_id, task_space_qp_options_,
+        joint_limits_min_, joint_limits_max_,
+        ToRadians(kJointSpeedLimitDegPerSec_), kControlPeriod_);
+  } else {
+    plan_local = std::make_shared<EndEffectorOriginTrajectoryPlan>(
+        tree_, PPType::Cubic(input_time, knots, knot_dot, knot_dot),
+        R_ee_to_world_initial, R_ee_to_world_final, kp_rotation,
+        kp_translation, traj.ee_frame_id);
+    plan_local->set_ik_solver(MakeDifferentialIkSolver(ik_options_));
+  }
+  latency.spline_fit = (MonotonicTimeNs() - stage_start_ns) * 1e-9;
 
   // Add ForceGuards if specified
-  if (goal->force_guard.size() > 0) {
-
-    const robot_msgs::ForceGuard force_guard_msg = goal->force_guard[0];
-    std::shared_ptr<ForceGuardContainer> guard_container =
-        ForceGuardContainerFromRosMsg(force_guard_msg, *tree_);
+  if (guards.valid()) {
+    const std::pair<std::shared_ptr<ForceGuardContainer>, int64_t>
+        guard_result = guards.get();
+    latency.guard_build = guard_result.second * 1e-9;
 
     // if the shared_ptr is not null, it means there is at least one guard in
     // the guard container
-    if (guard_container) {
+    if (guard_result.first) {
       ROS_INFO("Adding ForceGuardContainer to plan");
-      plan_local->set_guard_container(guard_container);
+      plan_local->set_guard_container(guard_result.first);
     }
   }
 
+  stage_start_ns = MonotonicTimeNs();
   QueueNewPlan(plan_local);
+  const int64_t queued_ns = MonotonicTimeNs();
+  latency.queue = (queued_ns - stage_start_ns) * 1e-9;
+  latency.total = (queued_ns - receive_ns) * 1e-9;
+  ROS_INFO("Plan constructed in %.1f ms (decode %.1f, tf %.1f, spline fit "
+           "%.1f, guard build %.1f, queue %.1f)",
+           latency.total * 1e3, latency.decode * 1e3, latency.tf * 1e3,
+           latency.spline_fit * 1e3, latency.guard_build * 1e3,
+           latency.queue * 1e3);
   ROS_INFO("Waiting for plan to finish");
 
   PlanStatus plan_status = plan_local->WaitForPlanToFinish();
 
   robot_msgs::CartesianTrajectoryResult result;
   plan_local->GetPlanStatusMsg(result.status);
+  result.construction_latency = latency;
   ROS_INFO("setting action result");
   cartesian_trajectory_action_->setSucceeded(result);
   ROS_INFO("\n\n------CartesianTrajectoryAction Finished------\n\n");
@@ -948,12 +1974,12 @@ void RobotPlanRunner::GetBodyPoseInWorldFrame(const RigidBody<double> &body,
                                               Eigen::Isometry3d *const T,
                                               Eigen::Vector3d *const rpy) {
   Eigen::VectorXd q = get_current_robot_position();
-  KinematicsCache<double> cache = tree_->CreateKinematicsCache();
-  cache.initialize(q);
-  tree_->doKinematics(cache);
+  KinematicsCachePool::Lease cache = kinematics_cache_pool_->Acquire();
+  cache->initialize(q);
+  tree_->doKinematics(*cache);
 
-  *T = tree_->CalcBodyPoseInWorldFrame(cache, body);
-  *rpy = tree_->relativeRollPitchYaw(cache, body.get_body_index(), 0);
+  *T = tree_->CalcBodyPoseInWorldFrame(*cache, body);
+  *rpy = tree_->relativeRollPitchYaw(*cache, body.get_body_index(), 0);
 }
 
 } // namespace robot_plan_runner
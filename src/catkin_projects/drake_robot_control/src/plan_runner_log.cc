@@ -0,0 +1,291 @@
+#include <drake_robot_control/plan_runner_log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+namespace drake {
+namespace robot_plan_runner {
+
+namespace plan_runner_log {
+
+std::vector<char> EncodePlan(const PlanBase &plan) {
+  PlanRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.plan_number = plan.plan_number_;
+  record.kind = kUnsupportedPlan;
+  record.has_guards = plan.has_guard_container();
+  std::strncpy(record.plan_type, plan.get_plan_type(),
+               sizeof(record.plan_type) - 1);
+
+  std::vector<double> data;
+  const auto *joint_plan = dynamic_cast<const JointSpaceTrajectoryPlan *>(&plan);
+  if (joint_plan) {
+    const PPType &traj = joint_plan->get_trajectory();
+    record.kind = kJointSpaceTrajectoryPlan;
+    record.num_segments = traj.get_number_of_segments();
+    record.num_rows = traj.rows();
+    record.baked_sample_period = joint_plan->baked_sample_period();
+    for (int i = 0; i < record.num_segments; i++) {
+      for (int row = 0; row < record.num_rows; row++) {
+        record.num_coefficients =
+            std::max<int32_t>(record.num_coefficients,
+                              traj.getPolynomial(i, row).GetDegree() + 1);
+      }
+    }
+
+    data = traj.get_segment_times();
+    for (int i = 0; i < record.num_segments; i++) {
+      for (int row = 0; row < record.num_rows; row++) {
+        const Eigen::VectorXd coefficients =
+            traj.getPolynomial(i, row).GetCoefficients();
+        for (int k = 0; k < record.num_coefficients; k++) {
+          data.push_back(k < coefficients.size() ? coefficients[k] : 0.);
+        }
+      }
+    }
+  }
+
+  std::vector<char> payload(sizeof(record) + data.size() * sizeof(double));
+  std::memcpy(payload.data(), &record, sizeof(record));
+  if (!data.empty()) {
+    std::memcpy(payload.data() + sizeof(record), data.data(),
+                data.size() * sizeof(double));
+  }
+  return payload;
+}
+
+bool DecodeJointTrajectory(const std::vector<char> &payload,
+                           PlanRecord *record, PPType *trajectory) {
+  if (payload.size() < sizeof(PlanRecord)) {
+    return false;
+  }
+  std::memcpy(record, payload.data(), sizeof(PlanRecord));
+  if (record->kind != kJointSpaceTrajectoryPlan || record->num_segments < 1 ||
+      record->num_rows < 1 || record->num_coefficients < 1) {
+    return false;
+  }
+  const size_t num_breaks = record->num_segments + 1;
+  const size_t num_coefficients = static_cast<size_t>(record->num_segments) *
+                                  record->num_rows * record->num_coefficients;
+  if (payload.size() !=
+      sizeof(PlanRecord) + (num_breaks + num_coefficients) * sizeof(double)) {
+    return false;
+  }
+
+  std::vector<double> data(num_breaks + num_coefficients);
+  std::memcpy(data.data(), payload.data() + sizeof(PlanRecord),
+              data.size() * sizeof(double));
+  const std::vector<double> breaks(data.begin(), data.begin() + num_breaks);
+  std::vector<PPType::PolynomialMatrix> polynomials;
+  size_t offset = num_breaks;
+  for (int i = 0; i < record->num_segments; i++) {
+    PPType::PolynomialMatrix segment(record->num_rows, 1);
+    for (int row = 0; row < record->num_rows; row++) {
+      segment(row, 0) =
+          PPType::PolynomialType(Eigen::Map<const Eigen::VectorXd>(
+              data.data() + offset, record->num_coefficients));
+      offset += record->num_coefficients;
+    }
+    polynomials.push_back(segment);
+  }
+  *trajectory = PPType(polynomials, breaks);
+  return true;
+}
+
+} // namespace plan_runner_log
+
+using plan_runner_log::RecordHeader;
+using plan_runner_log::RecordType;
+
+std::unique_ptr<PlanRunnerRecorder>
+PlanRunnerRecorder::Open(const std::string &path,
+                         const plan_runner_log::LogHeader &header) {
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    return nullptr;
+  }
+  plan_runner_log::LogHeader file_header = header;
+  std::memcpy(file_header.magic, plan_runner_log::kMagic,
+              sizeof(file_header.magic));
+  if (std::fwrite(&file_header, sizeof(file_header), 1, file) != 1) {
+    std::fclose(file);
+    return nullptr;
+  }
+  return std::unique_ptr<PlanRunnerRecorder>(new PlanRunnerRecorder(file));
+}
+
+PlanRunnerRecorder::PlanRunnerRecorder(FILE *file)
+    : file_(file), ring_(new char[kRingCapacity]), head_(0), size_(0),
+      has_gap_(false), num_dropped_(0),
+      is_stopping_(false) {
+  writer_ = std::thread(&PlanRunnerRecorder::WriteLoop, this);
+}
+
+PlanRunnerRecorder::~PlanRunnerRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    is_stopping_ = true;
+  }
+  writer_cv_.notify_all();
+  writer_.join();
+  std::fclose(file_);
+}
+
+void PlanRunnerRecorder::RecordStatus(const RobotStatusSnapshot &status) {
+  plan_runner_log::StatusRecord record;
+  record.utime = status.utime;
+  for (int i = 0; i < kMaxNumJoints; i++) {
+    const bool valid = i < status.num_joints;
+    record.joint_position_measured[i] =
+        valid ? status.joint_position_measured[i] : 0.;
+    record.joint_velocity_estimated[i] =
+        valid ? status.joint_velocity_estimated[i] : 0.;
+    record.joint_position_commanded[i] =
+        valid ? status.joint_position_commanded[i] : 0.;
+    record.joint_torque_commanded[i] =
+        valid ? status.joint_torque_commanded[i] : 0.;
+    record.joint_torque_external[i] =
+        valid ? status.joint_torque_external[i] : 0.;
+  }
+  Append(plan_runner_log::kStatus, &record, sizeof(record));
+}
+
+void PlanRunnerRecorder::RecordCommand(const RobotCommandSnapshot &command,
+                                       int plan_number) {
+  plan_runner_log::CommandRecord record;
+  record.utime = command.utime;
+  record.plan_number = plan_number;
+  record.reserved = 0;
+  for (int i = 0; i < kMaxNumJoints; i++) {
+    const bool valid = i < command.num_joints;
+    record.joint_position[i] = valid ? command.joint_position[i] : 0.;
+    record.joint_torque[i] = valid ? command.joint_torque[i] : 0.;
+  }
+  Append(plan_runner_log::kCommand, &record, sizeof(record));
+}
+
+void PlanRunnerRecorder::RecordPlanSwap(int plan_number, bool same_tick) {
+  const plan_runner_log::PlanSwapRecord record{plan_number, same_tick};
+  Append(plan_runner_log::kPlanSwap, &record, sizeof(record));
+}
+
+void PlanRunnerRecorder::RecordPlanTerminated(int plan_number) {
+  const plan_runner_log::PlanTerminatedRecord record{plan_number, 0};
+  Append(plan_runner_log::kPlanTerminated, &record, sizeof(record));
+}
+
+void PlanRunnerRecorder::RecordPlan(int plan_number,
+                                    std::vector<char> *payload) {
+  const int32_t number = plan_number;
+  std::memcpy(payload->data() + offsetof(plan_runner_log::PlanRecord,
+                                         plan_number),
+              &number, sizeof(number));
+  Append(plan_runner_log::kPlan, payload->data(), payload->size());
+}
+
+void PlanRunnerRecorder::Append(RecordType type, const void *payload,
+                                uint32_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (has_gap_) {
+    if (!AppendLocked(plan_runner_log::kGap, nullptr, 0)) {
+      num_dropped_++;
+      return;
+    }
+    has_gap_ = false;
+  }
+  if (!AppendLocked(type, payload, size)) {
+    has_gap_ = true;
+    num_dropped_++;
+  }
+}
+
+bool PlanRunnerRecorder::AppendLocked(RecordType type, const void *payload,
+                                      uint32_t size) {
+  if (kRingCapacity - size_ < sizeof(RecordHeader) + size) {
+    return false;
+  }
+  const RecordHeader header{type, size};
+  CopyIntoRingLocked(&header, sizeof(header));
+  CopyIntoRingLocked(payload, size);
+  return true;
+}
+
+void PlanRunnerRecorder::CopyIntoRingLocked(const void *data, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  const char *bytes = static_cast<const char *>(data);
+  const size_t tail = (head_ + size_) % kRingCapacity;
+  const size_t first = std::min(size, kRingCapacity - tail);
+  std::memcpy(ring_.get() + tail, bytes, first);
+  std::memcpy(ring_.get(), bytes + first, size - first);
+  size_ += size;
+}
+
+void PlanRunnerRecorder::WriteLoop() {
+  std::unique_lock<std::mutex> lock(writer_mutex_);
+  while (!is_stopping_) {
+    writer_cv_.wait_for(lock, std::chrono::milliseconds(20));
+    lock.unlock();
+    WriteOut();
+    lock.lock();
+  }
+  lock.unlock();
+  WriteOut();
+}
+
+void PlanRunnerRecorder::WriteOut() {
+  size_t head, size;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    head = head_;
+    size = size_;
+  }
+  if (size == 0) {
+    return;
+  }
+  // Appends do not touch these bytes until head_ moves past them.
+  const size_t first = std::min(size, kRingCapacity - head);
+  std::fwrite(ring_.get() + head, 1, first, file_);
+  std::fwrite(ring_.get(), 1, size - first, file_);
+  std::fflush(file_);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  head_ = (head + size) % kRingCapacity;
+  size_ -= size;
+}
+
+std::unique_ptr<PlanRunnerLogReader>
+PlanRunnerLogReader::Open(const std::string &path) {
+  FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    return nullptr;
+  }
+  std::unique_ptr<PlanRunnerLogReader> reader(new PlanRunnerLogReader(file));
+  if (std::fread(&reader->header_, sizeof(reader->header_), 1, file) != 1 ||
+      std::memcmp(reader->header_.magic, plan_runner_log::kMagic,
+                  sizeof(plan_runner_log::kMagic)) != 0 ||
+      reader->header_.num_joints < 1 ||
+      reader->header_.num_joints > kMaxNumJoints) {
+    return nullptr;
+  }
+  reader->header_.urdf_path[sizeof(reader->header_.urdf_path) - 1] = '\0';
+  return reader;
+}
+
+PlanRunnerLogReader::~PlanRunnerLogReader() { std::fclose(file_); }
+
+bool PlanRunnerLogReader::Next(RecordHeader *record_header,
+                               std::vector<char> *payload) {
+  if (std::fread(record_header, sizeof(*record_header), 1, file_) != 1) {
+    return false;
+  }
+  payload->resize(record_header->size);
+  return record_header->size == 0 ||
+         std::fread(payload->data(), record_header->size, 1, file_) == 1;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
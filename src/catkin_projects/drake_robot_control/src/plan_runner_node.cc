@@ -1,5 +1,5 @@
 #include <common_utils/system_utils.h>
-#include <drake_robot_control/plan_runner.h>
+#include <drake_robot_control/multi_arm_plan_runner.h>
 #include <gflags/gflags.h>
 
 // ROS
@@ -11,7 +11,7 @@ int main(int argc, char **argv) {
   ros::NodeHandle nh("plan_runner"); // sets the node's namespace
   std::string config_filename;
   nh.getParam("param_filename", config_filename);
-  auto runner = drake::robot_plan_runner::RobotPlanRunner::GetInstance(
+  auto runner = drake::robot_plan_runner::MultiArmPlanRunner::GetInstance(
       nh, config_filename);
   runner->Start();
 
@@ -0,0 +1,67 @@
+#include <drake_robot_control/polynomial_table.h>
+
+#include <algorithm>
+
+#include <drake/common/drake_assert.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+PolynomialTable::PolynomialTable(
+    const trajectories::PiecewisePolynomial<double> &traj)
+    : num_rows_(traj.rows()), num_coefficients_(1) {
+  DRAKE_DEMAND(traj.cols() == 1);
+  const int num_segments = traj.get_number_of_segments();
+  if (num_segments == 0) {
+    num_rows_ = 0;
+    return;
+  }
+  for (int s = 0; s < num_segments; s++) {
+    for (int r = 0; r < num_rows_; r++) {
+      num_coefficients_ = std::max(num_coefficients_,
+                                   traj.getSegmentPolynomialDegree(s, r) + 1);
+    }
+  }
+
+  breaks_ = traj.get_segment_times();
+  coefficients_.assign(num_segments * num_rows_ * num_coefficients_, 0.);
+  for (int s = 0; s < num_segments; s++) {
+    for (int r = 0; r < num_rows_; r++) {
+      const Eigen::VectorXd c = traj.getPolynomial(s, r).GetCoefficients();
+      double *row = &coefficients_[(s * num_rows_ + r) * num_coefficients_];
+      for (int k = 0; k < c.size(); k++) {
+        row[k] = c[k];
+      }
+    }
+  }
+}
+
+void PolynomialTable::Evaluate(double t, Eigen::Ref<Eigen::VectorXd> q,
+                               Eigen::Ref<Eigen::VectorXd> qdot) const {
+  DRAKE_ASSERT(q.size() == num_rows_ && qdot.size() == num_rows_);
+  if (breaks_.empty()) {
+    return;
+  }
+  t = std::min(std::max(t, breaks_.front()), breaks_.back());
+  // the segment that starts at or before t, the last one includes its end
+  const int num_segments = breaks_.size() - 1;
+  int s = std::upper_bound(breaks_.begin(), breaks_.end(), t) -
+          breaks_.begin() - 1;
+  s = std::min(std::max(s, 0), num_segments - 1);
+  const double tau = t - breaks_[s];
+
+  const double *row = &coefficients_[s * num_rows_ * num_coefficients_];
+  for (int r = 0; r < num_rows_; r++, row += num_coefficients_) {
+    double value = row[num_coefficients_ - 1];
+    double derivative = 0.;
+    for (int k = num_coefficients_ - 2; k >= 0; k--) {
+      derivative = derivative * tau + value;
+      value = value * tau + row[k];
+    }
+    q[r] = value;
+    qdot[r] = derivative;
+  }
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
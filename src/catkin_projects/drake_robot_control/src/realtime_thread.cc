@@ -0,0 +1,158 @@
+#include <drake_robot_control/realtime_thread.h>
+
+#include <alloca.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+namespace {
+
+RealtimeThreadConfig ThreadConfigFromYaml(const YAML::Node &node) {
+  RealtimeThreadConfig config;
+  if (!node) {
+    return config;
+  }
+  if (node["priority"]) {
+    config.priority = node["priority"].as<int>();
+  }
+  if (node["cpus"]) {
+    config.cpus = node["cpus"].as<std::vector<int>>();
+  }
+  return config;
+}
+
+} // namespace
+
+RealtimeConfig RealtimeConfig::FromYaml(const YAML::Node &node) {
+  RealtimeConfig config;
+  if (!node) {
+    return config;
+  }
+  if (node["enabled"]) {
+    config.enabled = node["enabled"].as<bool>();
+  }
+  if (node["lock_memory"]) {
+    config.lock_memory = node["lock_memory"].as<bool>();
+  }
+  if (node["prefault_stack_kb"]) {
+    config.prefault_stack_bytes = node["prefault_stack_kb"].as<size_t>() * 1024;
+  }
+  const YAML::Node &threads = node["threads"];
+  if (threads) {
+    // "publish" is the name used before the status receiver and the command
+    // publisher were merged into one control thread.
+    config.control_thread = ThreadConfigFromYaml(
+        threads["control"] ? threads["control"] : threads["publish"]);
+  }
+  return config;
+}
+
+bool LockProcessMemory() {
+  struct rlimit memlock_limit;
+  if (getrlimit(RLIMIT_MEMLOCK, &memlock_limit) == 0 &&
+      memlock_limit.rlim_cur != RLIM_INFINITY) {
+    std::cout << "WARNING: RLIMIT_MEMLOCK is " << memlock_limit.rlim_cur
+              << " bytes, locking memory fails without CAP_IPC_LOCK. Raise "
+                 "memlock in /etc/security/limits.conf"
+              << std::endl;
+  }
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    std::cout << "WARNING: mlockall failed (" << std::strerror(errno)
+              << "), continuing without locked memory" << std::endl;
+    return false;
+  }
+
+  // keep freed heap memory mapped and locked instead of returning it
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  // check that the kernel actually reports the pages as locked
+  std::ifstream proc_status("/proc/self/status");
+  std::string line;
+  while (std::getline(proc_status, line)) {
+    if (line.compare(0, 6, "VmLck:") == 0) {
+      std::cout << "Locked process memory, " << line << std::endl;
+      return true;
+    }
+  }
+  std::cout << "Locked process memory" << std::endl;
+  return true;
+}
+
+void PrefaultStack(size_t num_bytes) {
+  if (num_bytes == 0) {
+    return;
+  }
+  volatile char *stack = static_cast<volatile char *>(alloca(num_bytes));
+  for (size_t i = 0; i < num_bytes; i += 4096) {
+    stack[i] = 0;
+  }
+}
+
+bool ConfigureCurrentThreadRealtime(const std::string &thread_name,
+                                    const RealtimeThreadConfig &config,
+                                    size_t prefault_stack_bytes) {
+  bool success = true;
+  pthread_t self = pthread_self();
+  pthread_setname_np(self, thread_name.substr(0, 15).c_str());
+
+  if (!config.cpus.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : config.cpus) {
+      CPU_SET(cpu, &cpu_set);
+    }
+    int ret = pthread_setaffinity_np(self, sizeof(cpu_set), &cpu_set);
+    if (ret != 0) {
+      std::cout << "WARNING: could not set CPU affinity of " << thread_name
+                << " (" << std::strerror(ret) << ")" << std::endl;
+      success = false;
+    }
+  }
+
+  if (config.priority > 0) {
+    struct rlimit rtprio_limit;
+    if (getrlimit(RLIMIT_RTPRIO, &rtprio_limit) == 0 &&
+        rtprio_limit.rlim_cur != RLIM_INFINITY &&
+        rtprio_limit.rlim_cur < static_cast<rlim_t>(config.priority)) {
+      std::cout << "WARNING: RLIMIT_RTPRIO is " << rtprio_limit.rlim_cur
+                << ", below the requested priority " << config.priority
+                << " of " << thread_name << ", this fails without CAP_SYS_NICE"
+                << std::endl;
+    }
+
+    struct sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = config.priority;
+    int ret = pthread_setschedparam(self, SCHED_FIFO, &param);
+    if (ret != 0) {
+      std::cout << "WARNING: could not switch " << thread_name
+                << " to SCHED_FIFO priority " << config.priority << " ("
+                << std::strerror(ret)
+                << "), falling back to default scheduling" << std::endl;
+      success = false;
+    }
+  }
+
+  PrefaultStack(prefault_stack_bytes);
+
+  if (success && config.priority > 0) {
+    std::cout << thread_name << " running with SCHED_FIFO priority "
+              << config.priority << std::endl;
+  }
+  return success;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,419 @@
+// Replays a log written by RobotPlanRunner (record_log_path in the config)
+// through the plans' Step functions, as fast as possible and without LCM or
+// ROS. Reports the Step cost per plan type and compares every command against
+// the one the live runner sent.
+//
+// Usage: replay_plan_runner --log=<file> [--urdf=<file>] [--tolerance=1e-9]
+//
+// Exits with 1 if any command differs from the recorded one by more than
+// --tolerance, so it can gate controller changes.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <drake/multibody/joints/floating_base_types.h>
+#include <drake/multibody/parsers/urdf_parser.h>
+
+#include <drake_robot_control/joint_space_trajectory_plan.h>
+#include <drake_robot_control/plan_runner_log.h>
+
+DEFINE_string(log, "", "plan runner log to replay");
+DEFINE_string(urdf, "", "robot URDF, defaults to the one named in the log");
+DEFINE_double(tolerance, 1e-9,
+              "maximum allowed difference to the recorded commands");
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+using namespace plan_runner_log;
+
+/**
+ * Re-runs the plan handling of RobotPlanRunner::ControlTick on the recorded
+ * status messages. Plan swaps and terminations are taken from the log
+ * instead of being re-derived, everything else (hold plan, plan start, Step,
+ * joint limits, safety checks) is recomputed and must stay in sync with
+ * ControlTick.
+ */
+class PlanRunnerReplay {
+public:
+  PlanRunnerReplay(const LogHeader &header,
+                   std::shared_ptr<const RigidBodyTreed> tree)
+      : header_(header), tree_(std::move(tree)),
+        num_joints_(header.num_joints), has_published_command_(false),
+        is_unsupported_plan_(false), start_time_us_(0),
+        measured_kinematics_(tree_), in_tick_(false),
+        num_ticks_(0), num_skipped_ticks_(0), num_mismatches_(0),
+        num_gaps_(0), max_q_error_(0), max_tau_error_(0),
+        first_mismatch_utime_(-1), first_utime_(-1), last_utime_(-1) {
+    q_commanded_.setZero(num_joints_);
+    v_commanded_.setZero(num_joints_);
+    tau_commanded_.setZero(num_joints_);
+    prev_position_command_.setZero(num_joints_);
+    prev_torque_command_.setZero(num_joints_);
+    current_robot_state_.setZero(2 * num_joints_);
+    cur_tau_external_.setZero(num_joints_);
+    joint_limits_min_ = Eigen::Map<const Eigen::VectorXd>(
+        header.joint_limits_min, num_joints_);
+    joint_limits_max_ = Eigen::Map<const Eigen::VectorXd>(
+        header.joint_limits_max, num_joints_);
+  }
+
+  void HandleRecord(const RecordHeader &record_header,
+                    const std::vector<char> &payload) {
+    switch (record_header.type) {
+    case kStatus:
+      std::memcpy(&status_, payload.data(), sizeof(status_));
+      tick_events_.clear();
+      in_tick_ = true;
+      break;
+    case kPlan:
+      AddPlan(payload);
+      break;
+    case kPlanSwap:
+    case kPlanTerminated: {
+      Event event;
+      event.type = record_header.type;
+      std::memcpy(&event.swap, payload.data(),
+                  std::min(payload.size(), sizeof(event.swap)));
+      if (in_tick_) {
+        tick_events_.push_back(event);
+      } else {
+        ApplyEvent(event);
+      }
+      break;
+    }
+    case kCommand: {
+      if (!in_tick_) {
+        break;
+      }
+      CommandRecord golden;
+      std::memcpy(&golden, payload.data(), sizeof(golden));
+      RunTick(golden);
+      in_tick_ = false;
+      break;
+    }
+    case kGap:
+      // Records were lost, start over from the recorded commands.
+      num_gaps_++;
+      in_tick_ = false;
+      plan_local_.reset();
+      is_unsupported_plan_ = true;
+      break;
+    default:
+      break;
+    }
+  }
+
+  // @return true if all commands matched
+  bool PrintReport(double replay_s) const {
+    const double log_s = (last_utime_ - first_utime_) / 1e6;
+    std::printf("replayed %d ticks (%.1f s of log) in %.3f s, %.0fx real "
+                "time\n",
+                num_ticks_, log_s, replay_s,
+                replay_s > 0 ? log_s / replay_s : 0.);
+    std::printf("%d ticks of unsupported plans taken from the log, %d gaps\n",
+                num_skipped_ticks_, num_gaps_);
+
+    std::printf("\n%-32s %8s %10s %10s %10s %10s\n", "plan type", "steps",
+                "mean_ns", "p50_ns", "p99_ns", "max_ns");
+    for (const auto &entry : step_ns_) {
+      std::vector<int64_t> ns = entry.second;
+      std::sort(ns.begin(), ns.end());
+      double sum = 0;
+      for (int64_t value : ns) {
+        sum += value;
+      }
+      std::printf("%-32s %8zu %10.0f %10lld %10lld %10lld\n",
+                  entry.first.c_str(), ns.size(), sum / ns.size(),
+                  static_cast<long long>(ns[ns.size() / 2]),
+                  static_cast<long long>(ns[ns.size() * 99 / 100]),
+                  static_cast<long long>(ns.back()));
+    }
+
+    std::printf("\ncommand check: %d of %d ticks differ by more than %g, "
+                "max |dq| %.3g, max |dtau| %.3g\n",
+                num_mismatches_, num_ticks_ - num_skipped_ticks_,
+                FLAGS_tolerance, max_q_error_, max_tau_error_);
+    if (num_mismatches_ > 0) {
+      std::printf("first mismatch at utime %lld\n",
+                  static_cast<long long>(first_mismatch_utime_));
+    }
+    if (!guarded_plans_.empty()) {
+      std::printf("note: %zu plans had force guards, which are not "
+                  "recorded\n",
+                  guarded_plans_.size());
+    }
+    return num_mismatches_ == 0;
+  }
+
+private:
+  struct Event {
+    uint32_t type;
+    // PlanTerminatedRecord has the same layout up to plan_number
+    PlanSwapRecord swap;
+  };
+
+  void AddPlan(const std::vector<char> &payload) {
+    PlanRecord record;
+    PPType trajectory;
+    if (!DecodeJointTrajectory(payload, &record, &trajectory)) {
+      if (payload.size() >= sizeof(record)) {
+        std::memcpy(&record, payload.data(), sizeof(record));
+        plans_[record.plan_number] = nullptr;
+      }
+      return;
+    }
+    auto plan = std::make_shared<JointSpaceTrajectoryPlan>(tree_, trajectory);
+    plan->plan_number_ = record.plan_number;
+    if (record.baked_sample_period > 0) {
+      plan->Bake(record.baked_sample_period);
+    }
+    if (record.has_guards) {
+      guarded_plans_.insert(record.plan_number);
+    }
+    plans_[record.plan_number] = plan;
+  }
+
+  void ApplyEvent(const Event &event) {
+    if (event.type == kPlanTerminated) {
+      if (plan_local_) {
+        plan_local_->FinishWithStatus(PlanStatus::STOPPED_BY_EXTERNAL_TRIGGER);
+        plan_local_.reset();
+      }
+      is_unsupported_plan_ = false;
+      return;
+    }
+    auto it = plans_.find(event.swap.plan_number);
+    plan_local_ = it == plans_.end() ? nullptr : it->second;
+    is_unsupported_plan_ = !plan_local_;
+    if (it != plans_.end()) {
+      plans_.erase(it);
+    }
+  }
+
+  void StartPlan(const Eigen::VectorXd &q_prev,
+                 const Eigen::VectorXd &tau_prev) {
+    if (plan_local_->get_plan_status() == PlanStatus::NOT_STARTED) {
+      plan_local_->SetCurrentCommand(q_prev, tau_prev);
+      start_time_us_ = status_.utime;
+    }
+  }
+
+  void StepPlan() {
+    const double t = static_cast<double>(status_.utime - start_time_us_) / 1e6;
+    const int64_t start_ns = MonotonicTimeNs();
+    plan_local_->Step(current_robot_state_, cur_tau_external_, t,
+                      &measured_kinematics_, &q_commanded_, &v_commanded_,
+                      &tau_commanded_);
+    step_ns_[plan_local_->get_plan_type()].push_back(MonotonicTimeNs() -
+                                                     start_ns);
+  }
+
+  void RunTick(const CommandRecord &golden) {
+    num_ticks_++;
+    if (first_utime_ < 0) {
+      first_utime_ = status_.utime;
+    }
+    last_utime_ = status_.utime;
+
+    for (int i = 0; i < num_joints_; i++) {
+      current_robot_state_[i] = status_.joint_position_measured[i];
+      current_robot_state_[i + num_joints_] =
+          status_.joint_velocity_estimated[i];
+      cur_tau_external_[i] = status_.joint_torque_external[i];
+    }
+    measured_kinematics_.Reset(current_robot_state_.head(num_joints_),
+                               current_robot_state_.tail(num_joints_));
+    if (!has_published_command_) {
+      for (int i = 0; i < num_joints_; i++) {
+        prev_position_command_[i] = status_.joint_position_commanded[i];
+        prev_torque_command_[i] = status_.joint_torque_commanded[i];
+      }
+    }
+
+    const Event *same_tick_swap = nullptr;
+    for (const Event &event : tick_events_) {
+      if (event.type == kPlanSwap && event.swap.same_tick) {
+        same_tick_swap = &event;
+      } else {
+        ApplyEvent(event);
+      }
+    }
+
+    if (is_unsupported_plan_) {
+      // Can't recompute this tick, continue from what was sent.
+      AdoptCommand(golden);
+      if (same_tick_swap) {
+        ApplyEvent(*same_tick_swap);
+        if (plan_local_) {
+          // The live runner started it in this tick, from a command we don't
+          // know. Only bring it into the same state for the next tick.
+          StartPlan(q_commanded_, tau_commanded_);
+          StepPlan();
+          plan_local_->SetCurrentCommand(q_commanded_, tau_commanded_);
+        }
+      }
+      return;
+    }
+
+    if (!plan_local_) {
+      plan_local_ = JointSpaceTrajectoryPlan::MakeHoldCurrentPositionPlan(
+          tree_, prev_position_command_);
+    }
+
+    StartPlan(prev_position_command_, prev_torque_command_);
+    StepPlan();
+    if (same_tick_swap) {
+      ApplyEvent(*same_tick_swap);
+      if (is_unsupported_plan_) {
+        AdoptCommand(golden);
+        return;
+      }
+      StartPlan(q_commanded_, tau_commanded_);
+      StepPlan();
+    }
+
+    q_commanded_ =
+        q_commanded_.cwiseMax(joint_limits_min_).cwiseMin(joint_limits_max_);
+    plan_local_->SetCurrentCommand(q_commanded_, tau_commanded_);
+
+    // same checks as ControlTick
+    bool unsafe_command = false;
+    for (int i = 0; i < num_joints_; i++) {
+      if (std::abs(q_commanded_[i] - prev_position_command_[i]) >
+              header_.max_dq_per_step ||
+          std::abs(tau_commanded_[i]) > 1.0 || std::isnan(q_commanded_[i])) {
+        unsafe_command = true;
+      }
+    }
+    if (unsafe_command) {
+      q_commanded_ = prev_position_command_;
+      tau_commanded_.setZero();
+      plan_local_->set_plan_status(PlanStatus::STOPPED_BY_SAFETY_CHECK);
+      plan_local_->SetPlanFinished();
+      plan_local_.reset();
+    }
+
+    double q_error = 0, tau_error = 0;
+    for (int i = 0; i < num_joints_; i++) {
+      q_error = std::max(q_error,
+                         std::abs(q_commanded_[i] - golden.joint_position[i]));
+      tau_error = std::max(
+          tau_error, std::abs(tau_commanded_[i] - golden.joint_torque[i]));
+    }
+    max_q_error_ = std::max(max_q_error_, q_error);
+    max_tau_error_ = std::max(max_tau_error_, tau_error);
+    if (q_error > FLAGS_tolerance || tau_error > FLAGS_tolerance) {
+      if (num_mismatches_ == 0) {
+        first_mismatch_utime_ = status_.utime;
+      }
+      num_mismatches_++;
+    }
+
+    prev_position_command_ = q_commanded_;
+    prev_torque_command_ = tau_commanded_;
+    has_published_command_ = true;
+  }
+
+  // Takes the recorded command as the output of this tick.
+  void AdoptCommand(const CommandRecord &golden) {
+    num_skipped_ticks_++;
+    for (int i = 0; i < num_joints_; i++) {
+      q_commanded_[i] = golden.joint_position[i];
+      tau_commanded_[i] = golden.joint_torque[i];
+    }
+    prev_position_command_ = q_commanded_;
+    prev_torque_command_ = tau_commanded_;
+    has_published_command_ = true;
+  }
+
+  const LogHeader header_;
+  std::shared_ptr<const RigidBodyTreed> tree_;
+  const int num_joints_;
+  Eigen::VectorXd joint_limits_min_;
+  Eigen::VectorXd joint_limits_max_;
+
+  // plans recorded but not swapped in yet, null for unsupported plan types
+  std::map<int, std::shared_ptr<PlanBase>> plans_;
+  std::set<int> guarded_plans_;
+
+  // control tick state, as in RobotPlanRunner::ControlLoopState
+  std::shared_ptr<PlanBase> plan_local_;
+  bool has_published_command_;
+  bool is_unsupported_plan_;
+  int64_t start_time_us_;
+  Eigen::VectorXd q_commanded_;
+  Eigen::VectorXd v_commanded_;
+  Eigen::VectorXd tau_commanded_;
+  Eigen::VectorXd prev_position_command_;
+  Eigen::VectorXd prev_torque_command_;
+  Eigen::VectorXd current_robot_state_;
+  Eigen::VectorXd cur_tau_external_;
+  TickKinematics measured_kinematics_;
+
+  // records of the tick being read
+  StatusRecord status_;
+  std::vector<Event> tick_events_;
+  bool in_tick_;
+
+  // report
+  std::map<std::string, std::vector<int64_t>> step_ns_;
+  int num_ticks_;
+  int num_skipped_ticks_;
+  int num_mismatches_;
+  int num_gaps_;
+  double max_q_error_;
+  double max_tau_error_;
+  int64_t first_mismatch_utime_;
+  int64_t first_utime_;
+  int64_t last_utime_;
+};
+
+int DoMain() {
+  std::unique_ptr<PlanRunnerLogReader> reader =
+      PlanRunnerLogReader::Open(FLAGS_log);
+  if (!reader) {
+    std::fprintf(stderr, "could not read plan runner log '%s'\n",
+                 FLAGS_log.c_str());
+    return 2;
+  }
+
+  const std::string urdf =
+      FLAGS_urdf.empty() ? reader->header().urdf_path : FLAGS_urdf;
+  auto tree = std::make_shared<RigidBodyTreed>();
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld(
+      urdf, multibody::joints::kFixed, tree.get());
+  if (tree->get_num_positions() != reader->header().num_joints) {
+    std::fprintf(stderr, "%s has %d joints, the log has %d\n", urdf.c_str(),
+                 tree->get_num_positions(), reader->header().num_joints);
+    return 2;
+  }
+
+  PlanRunnerReplay replay(reader->header(), tree);
+  RecordHeader record_header;
+  std::vector<char> payload;
+  const int64_t start_ns = MonotonicTimeNs();
+  while (reader->Next(&record_header, &payload)) {
+    replay.HandleRecord(record_header, payload);
+  }
+  const double replay_s = (MonotonicTimeNs() - start_ns) / 1e9;
+  return replay.PrintReport(replay_s) ? 0 : 1;
+}
+
+} // namespace
+} // namespace robot_plan_runner
+} // namespace drake
+
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return drake::robot_plan_runner::DoMain();
+}
@@ -0,0 +1,93 @@
+#include <drake_robot_control/setpoint_jitter_buffer.h>
+
+#include <algorithm>
+
+#include <drake/common/drake_assert.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+SetpointJitterBufferOptions
+SetpointJitterBufferOptions::FromYaml(const YAML::Node &node) {
+  SetpointJitterBufferOptions options;
+  if (!node) {
+    return options;
+  }
+  if (node["playout_delay_s"]) {
+    options.playout_delay_s = node["playout_delay_s"].as<double>();
+  }
+  if (node["capacity"]) {
+    options.capacity = std::max(2, node["capacity"].as<int>());
+  }
+  return options;
+}
+
+SetpointJitterBuffer::SetpointJitterBuffer(
+    int num_joints, const SetpointJitterBufferOptions &options)
+    : num_joints_(num_joints),
+      playout_delay_ns_(static_cast<int64_t>(options.playout_delay_s * 1e9)),
+      points_(std::max(2, options.capacity)), begin_(0), size_(0) {
+  DRAKE_DEMAND(num_joints <= kMaxNumJoints);
+}
+
+void SetpointJitterBuffer::Insert(int64_t time_ns,
+                                  const Eigen::Ref<const Eigen::VectorXd> &q,
+                                  const Eigen::Ref<const Eigen::VectorXd> &v,
+                                  const Eigen::Ref<const Eigen::VectorXd> &tau) {
+  DRAKE_ASSERT(q.size() == num_joints_);
+  DRAKE_ASSERT(v.size() == num_joints_);
+  DRAKE_ASSERT(tau.size() == num_joints_);
+  // a revised future replaces the old one
+  while (size_ > 0 && at(size_ - 1).time_ns >= time_ns) {
+    size_--;
+  }
+  if (size_ == static_cast<int>(points_.size())) {
+    begin_ = (begin_ + 1) % points_.size();
+    size_--;
+  }
+  Point &point = at(size_);
+  point.time_ns = time_ns;
+  Eigen::Map<Eigen::VectorXd>(point.q, num_joints_) = q;
+  Eigen::Map<Eigen::VectorXd>(point.v, num_joints_) = v;
+  Eigen::Map<Eigen::VectorXd>(point.tau, num_joints_) = tau;
+  size_++;
+}
+
+bool SetpointJitterBuffer::Sample(int64_t now_ns, Eigen::VectorXd *const q,
+                                  Eigen::VectorXd *const v,
+                                  Eigen::VectorXd *const tau) {
+  if (size_ == 0) {
+    return false;
+  }
+  const int64_t playout_ns = now_ns - playout_delay_ns_;
+  // keep the last point at or before the playout time, it is the start of
+  // the segment being played
+  while (size_ > 1 && at(1).time_ns <= playout_ns) {
+    begin_ = (begin_ + 1) % points_.size();
+    size_--;
+  }
+
+  const Point &p0 = at(0);
+  if (size_ == 1 || playout_ns <= p0.time_ns) {
+    q->head(num_joints_) = Eigen::Map<const Eigen::VectorXd>(p0.q, num_joints_);
+    v->head(num_joints_) = Eigen::Map<const Eigen::VectorXd>(p0.v, num_joints_);
+    tau->head(num_joints_) =
+        Eigen::Map<const Eigen::VectorXd>(p0.tau, num_joints_);
+    return true;
+  }
+
+  const Point &p1 = at(1);
+  const double s = static_cast<double>(playout_ns - p0.time_ns) /
+                   static_cast<double>(p1.time_ns - p0.time_ns);
+  typedef Eigen::Map<const Eigen::VectorXd> ConstMap;
+  q->head(num_joints_) = (1 - s) * ConstMap(p0.q, num_joints_) +
+                         s * ConstMap(p1.q, num_joints_);
+  v->head(num_joints_) = (1 - s) * ConstMap(p0.v, num_joints_) +
+                         s * ConstMap(p1.v, num_joints_);
+  tau->head(num_joints_) = (1 - s) * ConstMap(p0.tau, num_joints_) +
+                           s * ConstMap(p1.tau, num_joints_);
+  return true;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -0,0 +1,100 @@
+#include <drake_robot_control/shared_setpoint_channel.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
+namespace drake {
+namespace robot_plan_runner {
+
+constexpr uint32_t SharedSetpointChannel::kMagic;
+constexpr int SharedSetpointChannel::kMaxReadAttempts;
+
+std::unique_ptr<SharedSetpointChannel>
+SharedSetpointChannel::Create(const std::string &name,
+                              const std::string &group) {
+  gid_t gid = static_cast<gid_t>(-1);
+  if (!group.empty()) {
+    const struct group *entry = getgrnam(group.c_str());
+    if (!entry) {
+      errno = EINVAL;
+      return nullptr;
+    }
+    gid = entry->gr_gid;
+  }
+  const mode_t mode = group.empty() ? 0600 : 0660;
+
+  const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, mode);
+  if (fd < 0) {
+    return nullptr;
+  }
+  // A segment of that name may already exist, e.g. created by another user
+  // to inject setpoints. Only reuse our own, with the permissions reset.
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok && st.st_uid != geteuid()) {
+    errno = EPERM;
+    ok = false;
+  }
+  ok = ok && (group.empty() || fchown(fd, -1, gid) == 0) &&
+       fchmod(fd, mode) == 0;
+  void *address = MAP_FAILED;
+  if (ok && ftruncate(fd, sizeof(Segment)) == 0) {
+    address = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (address == MAP_FAILED) {
+    return nullptr;
+  }
+
+  // A segment left behind by a runner that crashed is reset, its clients
+  // keep writing to it.
+  Segment *segment = new (address) Segment();
+  segment->size = sizeof(Segment);
+  segment->magic.store(kMagic, std::memory_order_release);
+  return std::unique_ptr<SharedSetpointChannel>(
+      new SharedSetpointChannel(name, segment, true));
+}
+
+std::unique_ptr<SharedSetpointChannel>
+SharedSetpointChannel::Open(const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  void *address = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size == sizeof(Segment)) {
+    address = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (address == MAP_FAILED) {
+    return nullptr;
+  }
+
+  Segment *segment = static_cast<Segment *>(address);
+  if (segment->magic.load(std::memory_order_acquire) != kMagic ||
+      segment->size != sizeof(Segment)) {
+    munmap(address, sizeof(Segment));
+    return nullptr;
+  }
+  return std::unique_ptr<SharedSetpointChannel>(
+      new SharedSetpointChannel(name, segment, false));
+}
+
+SharedSetpointChannel::~SharedSetpointChannel() {
+  munmap(segment_, sizeof(Segment));
+  if (is_owner_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
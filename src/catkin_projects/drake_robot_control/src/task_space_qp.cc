@@ -0,0 +1,164 @@
+#include <drake_robot_control/task_space_qp.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+double ToRadians(double degrees) { return degrees / 180. * M_PI; }
+
+} // namespace
+
+int BoxQpSolver::Solve(const JointMatrix &P, const JointVector &c,
+                       const JointVector &lower, const JointVector &upper,
+                       JointVector *const x) {
+  const int n = c.size();
+  // unconstrained minimum first, most ticks have no active bound
+  llt_.compute(P);
+  x_ = llt_.solve(-c);
+  if ((x_.array() >= lower.array()).all() &&
+      (x_.array() <= upper.array()).all()) {
+    *x = x_;
+    z_ = x_;
+    u_.setZero(n);
+    converged_ = true;
+    return 0;
+  }
+
+  const double rho = options_.rho_scale * P.diagonal().mean();
+  const double alpha = options_.relaxation;
+  M_ = P;
+  M_.diagonal().array() += rho;
+  llt_.compute(M_);
+
+  if (z_.size() != n) {
+    z_ = x_;
+    u_.setZero(n);
+  }
+  // bounds moved since the last tick
+  z_ = z_.cwiseMax(lower).cwiseMin(upper);
+
+  converged_ = false;
+  int iteration = 0;
+  while (iteration < options_.max_iterations) {
+    iteration++;
+    x_ = llt_.solve(rho * (z_ - u_) - c);
+    x_ = alpha * x_ + (1 - alpha) * z_;
+    z_prev_ = z_;
+    z_ = (x_ + u_).cwiseMax(lower).cwiseMin(upper);
+    u_ += x_ - z_;
+    const double primal_residual = (x_ - z_).cwiseAbs().maxCoeff();
+    const double dual_residual = rho * (z_ - z_prev_).cwiseAbs().maxCoeff();
+    if (primal_residual < options_.tolerance &&
+        dual_residual < options_.tolerance) {
+      converged_ = true;
+      break;
+    }
+  }
+  *x = z_;
+  return iteration;
+}
+
+TaskSpaceQpOptions TaskSpaceQpOptions::FromYaml(const YAML::Node &node) {
+  TaskSpaceQpOptions options;
+  if (!node) {
+    return options;
+  }
+  if (node["twist_weights"]) {
+    const std::vector<double> weights =
+        node["twist_weights"].as<std::vector<double>>();
+    for (size_t i = 0; i < weights.size() && i < 6; i++) {
+      options.twist_weights[i] = weights[i];
+    }
+  }
+  if (node["posture_weight"]) {
+    options.posture_weight = node["posture_weight"].as<double>();
+  }
+  if (node["kp_posture"]) {
+    options.kp_posture = node["kp_posture"].as<double>();
+  }
+  if (node["nominal_posture_deg"]) {
+    options.nominal_posture_deg =
+        node["nominal_posture_deg"].as<std::vector<double>>();
+  }
+  if (node["velocity_regularization"]) {
+    options.velocity_regularization =
+        node["velocity_regularization"].as<double>();
+  }
+  if (node["velocity_limit_fraction"]) {
+    options.velocity_limit_fraction =
+        node["velocity_limit_fraction"].as<double>();
+  }
+  if (node["max_joint_acceleration_deg"]) {
+    options.max_joint_acceleration_deg =
+        node["max_joint_acceleration_deg"].as<double>();
+  }
+  if (node["max_iterations"]) {
+    options.solver.max_iterations = node["max_iterations"].as<int>();
+  }
+  if (node["rho_scale"]) {
+    options.solver.rho_scale = node["rho_scale"].as<double>();
+  }
+  if (node["tolerance"]) {
+    options.solver.tolerance = node["tolerance"].as<double>();
+  }
+  return options;
+}
+
+TaskSpaceQp::TaskSpaceQp(const TaskSpaceQpOptions &options,
+                         const Eigen::VectorXd &joint_limits_min,
+                         const Eigen::VectorXd &joint_limits_max,
+                         double joint_velocity_limit, double control_period)
+    : options_(options), joint_limits_min_(joint_limits_min),
+      joint_limits_max_(joint_limits_max),
+      max_velocity_(options.velocity_limit_fraction * joint_velocity_limit),
+      max_velocity_change_(ToRadians(options.max_joint_acceleration_deg) *
+                           control_period),
+      control_period_(control_period), solver_(options.solver) {
+  const int n = joint_limits_min.size();
+  if (static_cast<int>(options_.nominal_posture_deg.size()) == n) {
+    q_nominal_.resize(n);
+    for (int i = 0; i < n; i++) {
+      q_nominal_[i] = ToRadians(options_.nominal_posture_deg[i]);
+    }
+  }
+}
+
+int TaskSpaceQp::Solve(const Eigen::Ref<const Eigen::VectorXd> &q,
+                       const JointVector &q_dot_prev, const JacobianMatrix &J,
+                       const Eigen::Matrix<double, 6, 1> &twist,
+                       JointVector *const q_dot) {
+  const int n = q.size();
+  if (!has_nominal_posture()) {
+    q_nominal_ = q;
+  }
+
+  WJ_ = options_.twist_weights.asDiagonal() * J;
+  P_.noalias() = J.transpose() * WJ_;
+  P_.diagonal().array() +=
+      options_.posture_weight + options_.velocity_regularization;
+  c_.noalias() = -WJ_.transpose() * twist;
+  c_ -= options_.posture_weight * options_.kp_posture * (q_nominal_ - q);
+
+  lower_.resize(n);
+  upper_.resize(n);
+  for (int i = 0; i < n; i++) {
+    // reach the position limit no sooner than at the end of this tick
+    double lower = std::max(
+        (joint_limits_min_[i] - q[i]) / control_period_, -max_velocity_);
+    double upper =
+        std::min((joint_limits_max_[i] - q[i]) / control_period_, max_velocity_);
+    // q outside the limits, the runner clamps the command anyway
+    upper = std::max(upper, lower);
+    const double previous = i < q_dot_prev.size() ? q_dot_prev[i] : 0.;
+    lower_[i] = std::min(std::max(previous - max_velocity_change_, lower), upper);
+    upper_[i] = std::max(std::min(previous + max_velocity_change_, upper), lower);
+  }
+
+  return solver_.Solve(P_, c_, lower_, upper_, q_dot);
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
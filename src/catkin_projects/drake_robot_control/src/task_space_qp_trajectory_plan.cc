@@ -0,0 +1,35 @@
+#include <drake_robot_control/task_space_qp_trajectory_plan.h>
+
+namespace drake {
+namespace robot_plan_runner {
+
+EndEffectorOriginQpTrajectoryPlan::EndEffectorOriginQpTrajectoryPlan(
+    std::shared_ptr<const RigidBodyTreed> tree, const PPType &xyz_ee_traj,
+    const drake::math::RotationMatrixd &R_WE_initial,
+    const drake::math::RotationMatrixd &R_WE_final,
+    const Eigen::Vector3d &kp_rotation, const Eigen::Vector3d &kp_translation,
+    const std::string &ee_body_name, const TaskSpaceQpOptions &qp_options,
+    const Eigen::VectorXd &joint_limits_min,
+    const Eigen::VectorXd &joint_limits_max, double joint_velocity_limit,
+    double control_period_s, double force_threshold)
+    : EndEffectorOriginTrajectoryPlan(
+          std::move(tree), xyz_ee_traj, R_WE_initial, R_WE_final, kp_rotation,
+          kp_translation, ee_body_name, control_period_s, force_threshold),
+      qp_(qp_options, joint_limits_min, joint_limits_max, joint_velocity_limit,
+          control_period_s),
+      q_dot_prev_(JointVector::Zero(joint_limits_min.size())),
+      num_unconverged_solves_(0) {}
+
+void EndEffectorOriginQpTrajectoryPlan::ComputeJointVelocityCommand(
+    const Eigen::Ref<const Eigen::VectorXd> &q, const JacobianMatrix &J_ee_E,
+    const Eigen::Matrix<double, 6, 1> &T_WE_E_cmd, JointVector *const q_dot) {
+  qp_.Solve(q, q_dot_prev_, J_ee_E, T_WE_E_cmd, q_dot);
+  if (!qp_.converged()) {
+    // still feasible, just not optimal
+    num_unconverged_solves_++;
+  }
+  q_dot_prev_ = *q_dot;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <exception>
 
 // ROS
@@ -17,7 +18,8 @@ typedef drake::TwistVector<double> TwistVectord;
 void TaskSpaceStreamingPlan::Step(
     const Eigen::Ref<const Eigen::VectorXd> &x,
     const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
-    Eigen::VectorXd *const q_commanded, Eigen::VectorXd *const v_commanded,
+    TickKinematics *const kinematics, Eigen::VectorXd *const q_commanded,
+    Eigen::VectorXd *const v_commanded,
     Eigen::VectorXd *const tau_commanded) {
   double dt = t - last_control_update_t_;
   last_control_update_t_ = t;
@@ -28,40 +30,44 @@ void TaskSpaceStreamingPlan::Step(
 
   plan_status_.compare_exchange_strong(not_started_status, PlanStatus::RUNNING);
 
-  // Lock so we can play with the measured state cache
   std::lock_guard<std::mutex> lock(goal_mutex_);
 
-  // do kinematics so we can check the force guards
-  Eigen::VectorXd q = x.head(this->get_num_positions());
-  Eigen::VectorXd v = x.tail(this->get_num_positions());
-  cache_measured_state_.initialize(q, v);
-  tree_->doKinematics(cache_measured_state_);
+  const auto q_measured = x.head(this->get_num_positions());
+  const auto v = x.tail(this->get_num_velocities());
+  // sized in the first tick, assigned in place afterwards
+  q_measured_ = q_measured;
+  v_measured_ = v;
+  has_measured_state_ = true;
+
+  if (shared_setpoints_) {
+    ReadSharedSetpoint(kinematics);
+  }
 
   // check if the plan has been stopped
   // if so just echo the last command
   if (this->is_stopped() || !this->have_goal_) {
     *q_commanded = q_commanded_prev_;
-    *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+    tau_commanded->setZero();
     return;
   }
 
   // Check the external force guards
   if (guard_container_) {
     std::pair<bool, std::pair<double, std::shared_ptr<ForceGuard>>> result =
-                                          guard_container_->EvaluateGuards(cache_measured_state_, q,
-                                                                           tau_external);
+        guard_container_->EvaluateGuards(kinematics, tau_external);
 
     bool guard_triggered = result.first;
 
     if (guard_triggered) {
-      std::cout << "Force Guard Triggered, commanding in direction of measured position" << std::endl;
-      std::cout << "ForceGuardType: " << result.second.second->get_type()
-                << std::endl;
+      PLAN_RUNNER_LOG_THROTTLE(kWarn, 1.0,
+                               "Force Guard Triggered, commanding in direction "
+                               "of measured position\nForceGuardType: %d",
+                               result.second.second->get_type());
       //plan_status_ = PlanStatus::STOPPED_BY_FORCE_GUARD;
       //this->SetPlanFinished();
-      *q_commanded = q_commanded_prev_*0.99 + q*0.01;
+      *q_commanded = q_commanded_prev_*0.99 + q_measured*0.01;
       q_commanded_prev_ = *q_commanded;
-      *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+      tau_commanded->setZero();
       return;
     }
   }
@@ -73,39 +79,39 @@ void TaskSpaceStreamingPlan::Step(
   // (lots of frames, gains, and goals), so breaking it out into
   // a function is pretty ugly.
   // Instead of the actual q, use the last commanded q
-  Eigen::VectorXd q_measured = x.head(this->get_num_positions());
-  q = q_commanded_prev_;
+  const Eigen::VectorXd &q = q_commanded_prev_;
 
   // std::cout << "Starting control in measured config " << q_measured << " but commanded " << q << std::endl;
   // std::cout << "xyz_ee_goal: " << xyz_ee_goal_ << std::endl;
   // std::cout << "xyz_d_ee_goal: " << xyz_d_ee_goal_ << std::endl;
   // std::cout << "quat_ee_goal_: " << quat_ee_goal_.matrix() << std::endl;
 
-  cache_.initialize(q, v);
-  tree_->doKinematics(cache_);
+  cache_->initialize(q, v);
+  tree_->doKinematics(*cache_);
 
   math::RotationMatrixd R_WEr(quat_ee_goal_);
   math::RotationMatrixd R_ErW = R_WEr.inverse();
 
-  J_ee_E_ = tree_->geometricJacobian(cache_, 0, body_index_ee_frame_, body_index_ee_frame_);
-  J_ee_W_ = tree_->geometricJacobian(cache_, 0, body_index_ee_frame_, 0);
+  // cache_ is at the commanded state, so this can't come from kinematics
+  CalcGeometricJacobian(*tree_, *cache_, 0, body_index_ee_frame_,
+                        body_index_ee_frame_, &J_ee_E_);
 
   H_WEr_.set_rotation(R_WEr);
   H_WEr_.set_translation(xyz_ee_goal_);
   Eigen::Isometry3d H_WEr = H_WEr_.GetAsIsometry3();
 
-  std::cout << "H_WEr: " << H_WEr.matrix() << std::endl;
+  PLAN_RUNNER_LOG(kDebug, "H_WEr:\n%s", MatrixString(H_WEr.matrix()).c_str());
 
   if (body_index_ee_frame_ >= 0){
-    H_WE_ = tree_->CalcBodyPoseInWorldFrame(cache_, tree_->get_body(body_index_ee_frame_));
+    H_WE_ = tree_->CalcBodyPoseInWorldFrame(*cache_, tree_->get_body(body_index_ee_frame_));
   } else {
     // frames start at -2 and count down.
-    H_WE_ = tree_->CalcFramePoseInWorldFrame(cache_, *tree_->get_frames()[-body_index_ee_frame_ - 2]);
+    H_WE_ = tree_->CalcFramePoseInWorldFrame(*cache_, *tree_->get_frames()[-body_index_ee_frame_ - 2]);
   }
-  std::cout << "H_WE_: " << H_WE_.matrix() << std::endl;
+  PLAN_RUNNER_LOG(kDebug, "H_WE_:\n%s", MatrixString(H_WE_.matrix()).c_str());
   Eigen::Isometry3d H_EW = H_WE_.inverse();
   Eigen::Isometry3d H_EEr = H_EW * H_WEr;
-  std::cout << "HEEr: " << H_EEr.matrix() << std::endl;
+  PLAN_RUNNER_LOG(kDebug, "HEEr:\n%s", MatrixString(H_EEr.matrix()).c_str());
 
   // Compute the PD part of the control
   // K_{p,w} log_{SO(3)}(R_EEr)
@@ -138,34 +144,29 @@ void TaskSpaceStreamingPlan::Step(
   TwistVectord T_WE_E_cmd = twist_pd + T_WEr_E;
 
   // q_dot_cmd = J_ee.pseudo_inverse()*T_WE_E_cmd
-  auto svd = J_ee_E_.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV);
-  // When computing the pseudoinverse, this ignores all singular
-  // values smaller than this threshold. This is raised
-  // from the Eigen default to create less jerky movements near
-  // singularities.
-  svd.setThreshold(0.01);
-  Eigen::VectorXd q_dot_cmd = svd.solve(T_WE_E_cmd);
-  std::cout << "Final q dot cmd: " << q_dot_cmd << std::endl;
-  *q_commanded = q + q_dot_cmd * dt;
-  *v_commanded = q_dot_cmd; // This is ignored when constructing iiwa_command.
+  ik_solver_->Solve(J_ee_E_, T_WE_E_cmd, &q_dot_cmd_);
+  PLAN_RUNNER_LOG(kDebug, "Final q dot cmd: %s",
+                  MatrixString(q_dot_cmd_.transpose()).c_str());
+  *q_commanded = q + q_dot_cmd_ * dt;
+  *v_commanded = q_dot_cmd_; // This is ignored when constructing iiwa_command.
 
   bool unsafe_command = Eigen::isnan(q_commanded->array()).any();
   if (unsafe_command) {
-    std::cout << "\n\nunsafe command caught inside Step()" << std::endl;
-    std::cout << "q_commanded:\n" << *q_commanded << std::endl;
-    std::cout << "q_dot_cmd:\n" << q_dot_cmd << std::endl;
-    std::cout << "q:\n" << q << std::endl;
-
-    std::cout << "\nT_WE_E_cmd:\n" << T_WE_E_cmd << std::endl;
+    PLAN_RUNNER_LOG(kError,
+                    "unsafe command caught inside Step()\nq_commanded: %s\n"
+                    "q_dot_cmd: %s\nq: %s\nT_WE_E_cmd: %s",
+                    MatrixString(q_commanded->transpose()).c_str(),
+                    MatrixString(q_dot_cmd_.transpose()).c_str(),
+                    MatrixString(q.transpose()).c_str(),
+                    MatrixString(T_WE_E_cmd.transpose()).c_str());
   }
 
   bool debug = false;
   if (debug) {
-    std::cout << "\n-------\n";
-    std::cout << "\nT_WE_E_cmd:\n" << T_WE_E_cmd << std::endl;
-
     Eigen::Isometry3d H_ErE = H_EEr.inverse();
-    std::cout << "H_ErE.translation() " << H_ErE.translation() << std::endl;
+    PLAN_RUNNER_LOG(kDebug, "T_WE_E_cmd: %s\nH_ErE.translation(): %s",
+                    MatrixString(T_WE_E_cmd.transpose()).c_str(),
+                    MatrixString(H_ErE.translation().transpose()).c_str());
   }
   // debugging prints for when things are nan . . .
 }
@@ -176,46 +177,113 @@ void TaskSpaceStreamingPlan::HandleSetpoint(
     std::cout << "In callback, but plan is stopped... forcefully unregistering." << std::endl;
     this->setpoint_subscriber_->shutdown();
   }
-  std::lock_guard<std::mutex> lock(goal_mutex_);
   //std::cout << "Starting to handle setpoint... " << std::endl;
   // Extract the body index in the RBT that this msg
   // is referring to.
   // These will throw if the frame isn't unique or doesn't exist.
-  body_index_ee_goal_ = tree_->findFrame(
+  const int body_index_ee_goal = tree_->findFrame(
     msg->xyz_point.header.frame_id)->get_frame_index();
-  body_index_ee_frame_ = tree_->findFrame(msg->ee_frame_id)->get_frame_index();
-
-  tree_->doKinematics(cache_measured_state_);
+  const int body_index_ee_frame =
+    tree_->findFrame(msg->ee_frame_id)->get_frame_index();
+
+  // Kinematics at the last observed robot posture, done outside goal_mutex_
+  // so Step isn't held up by it.
+  {
+    std::lock_guard<std::mutex> lock(goal_mutex_);
+    if (!has_measured_state_) {
+      ROS_WARN("Discarding setpoint, the plan has not been stepped yet");
+      return;
+    }
+    cache_measured_state_->initialize(q_measured_, v_measured_);
+  }
+  tree_->doKinematics(*cache_measured_state_);
 
-  xyz_ee_goal_ = Eigen::Vector3d(msg->xyz_point.point.x,
-                                 msg->xyz_point.point.y,
-                                 msg->xyz_point.point.z);
   // Transform to world frame at last observed robot posture
-  auto R = tree_->relativeTransform(
-    cache_measured_state_, 0, body_index_ee_goal_)
-    .matrix().block<3, 3>(0, 0);
-  xyz_ee_goal_ = tree_->transformPoints(
-    cache_measured_state_, xyz_ee_goal_, body_index_ee_goal_, 0);
-  xyz_d_ee_goal_ = Eigen::Vector3d(msg->xyz_d_point.x,
-                                   msg->xyz_d_point.y,
-                                   msg->xyz_d_point.z);
-  xyz_d_ee_goal_ = R*xyz_d_ee_goal_;
-  quat_ee_goal_ =  Eigen::Quaterniond(msg->quaternion.w,
-                                     msg->quaternion.x,
-                                     msg->quaternion.y,
-                                     msg->quaternion.z);
-  quat_ee_goal_ = 
+  const Eigen::Isometry3d H_W_goal = tree_->relativeTransform(
+    *cache_measured_state_, 0, body_index_ee_goal);
+
+  std::lock_guard<std::mutex> lock(goal_mutex_);
+  SetGoal(H_W_goal, body_index_ee_goal, body_index_ee_frame,
+          Eigen::Vector3d(msg->xyz_point.point.x, msg->xyz_point.point.y,
+                          msg->xyz_point.point.z),
+          Eigen::Vector3d(msg->xyz_d_point.x, msg->xyz_d_point.y,
+                          msg->xyz_d_point.z),
+          Eigen::Quaterniond(msg->quaternion.w, msg->quaternion.x,
+                             msg->quaternion.y, msg->quaternion.z),
+          Eigen::Vector3d(msg->gain.rotation.x, msg->gain.rotation.y,
+                          msg->gain.rotation.z),
+          Eigen::Vector3d(msg->gain.translation.x, msg->gain.translation.y,
+                          msg->gain.translation.z));
+  //std::cout << "Finished handling setpoint from config " << q_commanded_prev_ << std::endl;
+}
+
+void TaskSpaceStreamingPlan::SetGoal(
+    const Eigen::Isometry3d &H_W_goal, int body_index_ee_goal,
+    int body_index_ee_frame, const Eigen::Vector3d &xyz_ee_goal,
+    const Eigen::Vector3d &xyz_d_ee_goal,
+    const Eigen::Quaterniond &quat_ee_goal,
+    const Eigen::Vector3d &kp_rotation, const Eigen::Vector3d &kp_translation) {
+  const Eigen::Matrix3d R = H_W_goal.linear();
+  body_index_ee_goal_ = body_index_ee_goal;
+  body_index_ee_frame_ = body_index_ee_frame;
+  xyz_ee_goal_ = H_W_goal * xyz_ee_goal;
+  xyz_d_ee_goal_ = R * xyz_d_ee_goal;
+  quat_ee_goal_ =
     (drake::math::RotationMatrixd(R)*
-     drake::math::RotationMatrixd(quat_ee_goal_)).ToQuaternion();
-
-  kp_rotation_ = Eigen::Vector3d(msg->gain.rotation.x,
-                                 msg->gain.rotation.y,
-                                 msg->gain.rotation.z);
-  kp_translation_ = Eigen::Vector3d(msg->gain.translation.x,
-                                    msg->gain.translation.y,
-                                    msg->gain.translation.z);
+     drake::math::RotationMatrixd(quat_ee_goal)).ToQuaternion();
+  kp_rotation_ = kp_rotation;
+  kp_translation_ = kp_translation;
   have_goal_ = true;
-  //std::cout << "Finished handling setpoint from config " << q_commanded_prev_ << std::endl;
+}
+
+void TaskSpaceStreamingPlan::ReadSharedSetpoint(
+    TickKinematics *const kinematics) {
+  uint64_t sequence;
+  if (!shared_setpoints_->Read(&shared_setpoint_, &sequence) ||
+      sequence <= shared_setpoint_sequence_) {
+    return;
+  }
+  shared_setpoint_sequence_ = sequence;
+
+  const int kLength = SharedTaskSpaceSetpoint::kMaxFrameNameLength;
+  shared_setpoint_.frame_id[kLength - 1] = '\0';
+  shared_setpoint_.ee_frame_id[kLength - 1] = '\0';
+  if (!shared_setpoint_.frame_id[0] || !shared_setpoint_.ee_frame_id[0]) {
+    PLAN_RUNNER_LOG_THROTTLE(kWarn, 1.0, "Discarding shared memory setpoint "
+                                         "without frame names");
+    return;
+  }
+  // Clients rarely change frames, only a change is looked up.
+  if (std::strncmp(shared_setpoint_.frame_id, shared_frame_id_, kLength) ||
+      std::strncmp(shared_setpoint_.ee_frame_id, shared_ee_frame_id_,
+                   kLength)) {
+    try {
+      shared_body_index_ee_goal_ =
+          tree_->findFrame(shared_setpoint_.frame_id)->get_frame_index();
+      shared_body_index_ee_frame_ =
+          tree_->findFrame(shared_setpoint_.ee_frame_id)->get_frame_index();
+    } catch (const std::exception &e) {
+      shared_frame_id_[0] = '\0';
+      PLAN_RUNNER_LOG_THROTTLE(kWarn, 1.0,
+                               "Discarding shared memory setpoint: %s",
+                               e.what());
+      return;
+    }
+    std::strncpy(shared_frame_id_, shared_setpoint_.frame_id, kLength);
+    std::strncpy(shared_ee_frame_id_, shared_setpoint_.ee_frame_id, kLength);
+  }
+
+  const SharedTaskSpaceSetpoint &s = shared_setpoint_;
+  SetGoal(kinematics->RelativeTransform(0, shared_body_index_ee_goal_),
+          shared_body_index_ee_goal_, shared_body_index_ee_frame_,
+          Eigen::Vector3d(s.xyz[0], s.xyz[1], s.xyz[2]),
+          Eigen::Vector3d(s.xyz_d[0], s.xyz_d[1], s.xyz_d[2]),
+          Eigen::Quaterniond(s.quaternion[0], s.quaternion[1],
+                             s.quaternion[2], s.quaternion[3]),
+          Eigen::Vector3d(s.kp_rotation[0], s.kp_rotation[1],
+                          s.kp_rotation[2]),
+          Eigen::Vector3d(s.kp_translation[0], s.kp_translation[1],
+                          s.kp_translation[2]));
 }
 
 } // namespace robot_plan_runner
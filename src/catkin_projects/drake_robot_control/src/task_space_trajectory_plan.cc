@@ -42,10 +42,11 @@ typedef drake::TwistVector<double> TwistVectord;
 void EndEffectorOriginTrajectoryPlan::Step(
     const Eigen::Ref<const Eigen::VectorXd> &x,
     const Eigen::Ref<const Eigen::VectorXd> &tau_external, double t,
-    Eigen::VectorXd *const q_commanded, Eigen::VectorXd *const v_commanded,
+    TickKinematics *const kinematics, Eigen::VectorXd *const q_commanded,
+    Eigen::VectorXd *const v_commanded,
     Eigen::VectorXd *const tau_commanded) {
 
-  *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+  tau_commanded->setZero();
   DRAKE_ASSERT(t >= 0);
 
   PlanStatus not_started_status = PlanStatus::NOT_STARTED;
@@ -53,13 +54,13 @@ void EndEffectorOriginTrajectoryPlan::Step(
 
   if (plan_status_.compare_exchange_strong(not_started_status,
                                            PlanStatus::RUNNING)) {
-    std::cout << "plan status was NOT_STARTED, setting it to RUNNING"
-              << std::endl;
+    PLAN_RUNNER_LOG(kInfo,
+                    "plan status was NOT_STARTED, setting it to RUNNING");
   }
 
   if (this->is_stopped()) {
     *q_commanded = q_commanded_prev_;
-    *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+    tau_commanded->setZero();
     return;
   }
 
@@ -67,49 +68,46 @@ void EndEffectorOriginTrajectoryPlan::Step(
 
   // Eigen::VectorXd q = x.head(this->get_num_positions());
   // Instead of the actual q, use the last commanded q
-  Eigen::VectorXd q_measured = x.head(this->get_num_positions());
-  Eigen::VectorXd q = q_commanded_prev_;
-  Eigen::VectorXd v = x.tail(this->get_num_velocities());
+  const Eigen::VectorXd &q = q_commanded_prev_;
+  const auto v = x.tail(this->get_num_velocities());
 
-  Eigen::Vector3d xyz_ee_ref = traj_.value(t);     // expressed in world
-  Eigen::Vector3d xyz_d_ee_ref = traj_d_.value(t); // expressed in world
+  // expressed in world
+  Eigen::Vector3d xyz_ee_ref;
+  Eigen::Vector3d xyz_d_ee_ref;
+  traj_table_.Evaluate(t, xyz_ee_ref, xyz_d_ee_ref);
 
   double t_fraction = std::min(t / this->duration(), 1.0);
   math::RotationMatrixd R_WEr(
       quat_WE_initial_.slerp(t_fraction, quat_WE_final_));
   math::RotationMatrixd R_ErW = R_WEr.inverse();
 
-  // compute KinematicsCache off of measured states
-  // for use in computing the force guards
-  cache_measured_state_.initialize(q_measured, v);
-  tree_->doKinematics(cache_measured_state_);
-
-  // Check the external force guards
+  // Check the external force guards, on the measured state
   if (guard_container_) {
     std::pair<bool, std::pair<double, std::shared_ptr<ForceGuard>>> result =
-        guard_container_->EvaluateGuards(cache_measured_state_, q_measured,
-                                         tau_external);
+        guard_container_->EvaluateGuards(kinematics, tau_external);
 
     bool guard_triggered = result.first;
 
     if (guard_triggered) {
-      std::cout << "Force Guard Triggered, stopping plan" << std::endl;
-      std::cout << "ForceGuardType: " << result.second.second->get_type()
-                << std::endl;
+      PLAN_RUNNER_LOG(kWarn,
+                      "Force Guard Triggered, stopping plan\n"
+                      "ForceGuardType: %d",
+                      result.second.second->get_type());
       plan_status_ = PlanStatus::STOPPED_BY_FORCE_GUARD;
       this->SetPlanFinished();
 
       *q_commanded = q_commanded_prev_;
-      *tau_commanded = Eigen::VectorXd::Zero(this->get_num_positions());
+      tau_commanded->setZero();
       return;
     }
   }
 
-  cache_.initialize(q, v);
-  tree_->doKinematics(cache_);
+  cache_->initialize(q, v);
+  tree_->doKinematics(*cache_);
 
-  J_ee_E_ = tree_->geometricJacobian(cache_, idx_world_, idx_ee_, idx_ee_);
-  J_ee_W_ = tree_->geometricJacobian(cache_, idx_world_, idx_ee_, idx_world_);
+  // cache_ is at the commanded state, so this can't come from kinematics
+  CalcGeometricJacobian(*tree_, *cache_, idx_world_, idx_ee_, idx_ee_,
+                        &J_ee_E_);
 
   PlanStatus plan_status = this->get_plan_status();
   if (this->get_plan_status() == PlanStatus::RUNNING) {
@@ -119,7 +117,7 @@ void EndEffectorOriginTrajectoryPlan::Step(
       // RUNNING and t > this->duration()
       if (plan_status_.compare_exchange_strong(running_status,
                                                PlanStatus::FINISHED_NORMALLY)) {
-        ROS_INFO("plan finished normally");
+        PLAN_RUNNER_LOG(kInfo, "plan finished normally");
         // notify the condition variable
         q_command_final_ = q_commanded_prev_;
         this->SetPlanFinished();
@@ -131,7 +129,7 @@ void EndEffectorOriginTrajectoryPlan::Step(
   H_WEr_.set_translation(xyz_ee_ref);
   Eigen::Isometry3d H_WEr = H_WEr_.GetAsIsometry3();
 
-  H_WE_ = tree_->CalcBodyPoseInWorldFrame(cache_, tree_->get_body(idx_ee_));
+  H_WE_ = tree_->CalcBodyPoseInWorldFrame(*cache_, tree_->get_body(idx_ee_));
 
   Eigen::Isometry3d H_EW = H_WE_.inverse();
   Eigen::Isometry3d H_EEr = H_EW * H_WEr;
@@ -175,35 +173,36 @@ void EndEffectorOriginTrajectoryPlan::Step(
 
 
   // q_dot_cmd = J_ee.pseudo_inverse()*T_WE_E_cmd
-  auto svd = J_ee_E_.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV);
-  // When computing the pseudoinverse, this ignores all singular
-  // values smaller than this threshold. This is raised
-  // from the Eigen default to create less jerky movements near
-  // singularities.
-  svd.setThreshold(0.01);
-  Eigen::VectorXd q_dot_cmd = svd.solve(T_WE_E_cmd);
-  *q_commanded = q + q_dot_cmd * control_period_s_;
-  *v_commanded = q_dot_cmd; // This is ignored when constructing iiwa_command.
+  ComputeJointVelocityCommand(q, J_ee_E_, T_WE_E_cmd, &q_dot_cmd_);
+  *q_commanded = q + q_dot_cmd_ * control_period_s_;
+  *v_commanded = q_dot_cmd_; // This is ignored when constructing iiwa_command.
 
   bool unsafe_command = Eigen::isnan(q_commanded->array()).any();
   if (unsafe_command) {
-    std::cout << "\n\nunsafe command caught inside Step()" << std::endl;
-    std::cout << "q_commanded:\n" << *q_commanded << std::endl;
-    std::cout << "q_dot_cmd:\n" << q_dot_cmd << std::endl;
-    std::cout << "q:\n" << q << std::endl;
-
-    std::cout << "\nT_WE_E_cmd:\n" << T_WE_E_cmd << std::endl;
+    PLAN_RUNNER_LOG(kError,
+                    "unsafe command caught inside Step()\nq_commanded: %s\n"
+                    "q_dot_cmd: %s\nq: %s\nT_WE_E_cmd: %s",
+                    MatrixString(q_commanded->transpose()).c_str(),
+                    MatrixString(q_dot_cmd_.transpose()).c_str(),
+                    MatrixString(q.transpose()).c_str(),
+                    MatrixString(T_WE_E_cmd.transpose()).c_str());
   }
 
   bool debug = false;
   if (debug) {
-    std::cout << "\n-------\n";
-    std::cout << "\nT_WE_E_cmd:\n" << T_WE_E_cmd << std::endl;
-
     Eigen::Isometry3d H_ErE = H_EEr.inverse();
-    std::cout << "H_ErE.translation() " << H_ErE.translation() << std::endl;
+    PLAN_RUNNER_LOG(kDebug, "T_WE_E_cmd: %s\nH_ErE.translation(): %s",
+                    MatrixString(T_WE_E_cmd.transpose()).c_str(),
+                    MatrixString(H_ErE.translation().transpose()).c_str());
   }
   // debugging prints for when things are nan . . .
 }
+
+void EndEffectorOriginTrajectoryPlan::ComputeJointVelocityCommand(
+    const Eigen::Ref<const Eigen::VectorXd> &q, const JacobianMatrix &J_ee_E,
+    const Eigen::Matrix<double, 6, 1> &T_WE_E_cmd, JointVector *const q_dot) {
+  ik_solver_->Solve(J_ee_E, T_WE_E_cmd, q_dot);
+}
+
 } // namespace robot_plan_runner
 } // namespace drake
\ No newline at end of file
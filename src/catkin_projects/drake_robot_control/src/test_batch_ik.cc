@@ -0,0 +1,155 @@
+#include <cmath>
+#include <iostream>
+
+#include <drake/common/find_resource.h>
+#include <drake/multibody/parsers/urdf_parser.h>
+#include <drake_robot_control/batch_ik.h>
+#include <gtest/gtest.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+typedef std::vector<Eigen::Isometry3d,
+                    Eigen::aligned_allocator<Eigen::Isometry3d>>
+    PoseVector;
+
+bool SameSolutions(const std::vector<IkSolution> &a,
+                   const std::vector<IkSolution> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].success != b[i].success || a[i].q != b[i].q ||
+        a[i].num_iterations != b[i].num_iterations) {
+      return false;
+    }
+  }
+  return true;
+}
+
+class BatchIkTest : public ::testing::TestWithParam<bool> {
+protected:
+  static constexpr int kNumTargets = 200;
+
+  BatchIkTest()
+      : tree_(std::make_shared<RigidBodyTreed>()), q_max_(7), q_seed_(7) {
+    parsers::urdf::AddModelInstanceFromUrdfFileToWorld(
+        FindResourceOrThrow("drake/manipulation/models/iiwa_description/"
+                            "urdf/iiwa14_primitive_collision.urdf"),
+        multibody::joints::kFixed, tree_.get());
+    idx_ee_ = tree_->FindBodyIndex("iiwa_link_ee");
+
+    // the iiwa14 joint limits, a little inside
+    q_max_ << 170, 120, 170, 120, 170, 120, 175;
+    q_max_ *= 0.97 * M_PI / 180;
+    q_min_ = -q_max_;
+
+    // grasp candidates around an object: neighbouring poses along a closed
+    // curve, reachable by construction
+    q_seed_ << 0, 0.6, 0, -1.3, 0, 1.0, 0;
+    KinematicsCache<double> cache = tree_->CreateKinematicsCache();
+    for (int i = 0; i < kNumTargets; i++) {
+      const double s = static_cast<double>(i) / kNumTargets;
+      Eigen::VectorXd q = q_seed_;
+      q[0] += 0.8 * std::sin(2 * M_PI * s);
+      q[1] += 0.3 * std::cos(2 * M_PI * s);
+      q[3] += 0.3 * std::sin(4 * M_PI * s);
+      q[5] += 0.4 * s;
+      q[6] += 1.5 * s - 0.7;
+      targets_.push_back(EndEffectorPose(&cache, q));
+    }
+
+    options_.num_threads = 4;
+  }
+
+  Eigen::Isometry3d EndEffectorPose(KinematicsCache<double> *cache,
+                                    const Eigen::VectorXd &q) const {
+    cache->initialize(q);
+    tree_->doKinematics(*cache);
+    return tree_->relativeTransform(
+        *cache, RigidBodyTreeConstants::kWorldBodyIndex, idx_ee_);
+  }
+
+  bool WithinLimits(const Eigen::VectorXd &q) const {
+    return (q.array() >= q_min_.array()).all() &&
+           (q.array() <= q_max_.array()).all();
+  }
+
+  std::shared_ptr<RigidBodyTreed> tree_;
+  int idx_ee_;
+  Eigen::VectorXd q_max_;
+  Eigen::VectorXd q_min_;
+  Eigen::VectorXd q_seed_;
+  PoseVector targets_;
+  BatchIkOptions options_;
+};
+
+constexpr int BatchIkTest::kNumTargets;
+
+// every pose solved, checked with a forward kinematics of our own, from the
+// seed and warm started
+TEST_P(BatchIkTest, SolvesEveryPose) {
+  const bool warm_start = GetParam();
+  BatchIkSolver solver(tree_, options_, q_min_, q_max_);
+  std::vector<IkSolution> solutions;
+  solver.Solve(idx_ee_, targets_, q_seed_, warm_start, 0, 0, &solutions);
+  ASSERT_EQ(static_cast<size_t>(kNumTargets), solutions.size());
+
+  KinematicsCache<double> cache = tree_->CreateKinematicsCache();
+  int num_iterations = 0;
+  for (int i = 0; i < kNumTargets; i++) {
+    const IkSolution &solution = solutions[i];
+    num_iterations += solution.num_iterations;
+    EXPECT_TRUE(solution.success) << "pose " << i;
+    EXPECT_TRUE(WithinLimits(solution.q)) << "pose " << i;
+    const Eigen::Isometry3d H_WE = EndEffectorPose(&cache, solution.q);
+    EXPECT_LE((H_WE.translation() - targets_[i].translation()).norm(),
+              options_.position_tolerance * (1 + 1e-9))
+        << "pose " << i;
+    EXPECT_LE(std::abs(Eigen::AngleAxisd(H_WE.linear().transpose() *
+                                         targets_[i].linear())
+                           .angle()),
+              options_.orientation_tolerance * (1 + 1e-9))
+        << "pose " << i;
+  }
+  std::cout << (warm_start ? "warm started" : "from the seed") << ": "
+            << static_cast<double>(num_iterations) / kNumTargets
+            << " iterations per pose" << std::endl;
+}
+
+INSTANTIATE_TEST_CASE_P(WarmStart, BatchIkTest, ::testing::Bool());
+
+// warm starts follow the fixed chunks of the batch, not the order in which
+// threads pick them up, so solving again gives the same result
+TEST_F(BatchIkTest, WarmStartsAreDeterministic) {
+  BatchIkSolver solver(tree_, options_, q_min_, q_max_);
+  std::vector<IkSolution> first, second, other_solver;
+  solver.Solve(idx_ee_, targets_, q_seed_, true, 0, 0, &first);
+  solver.Solve(idx_ee_, targets_, q_seed_, true, 0, 0, &second);
+  BatchIkSolver same_options(tree_, options_, q_min_, q_max_);
+  same_options.Solve(idx_ee_, targets_, q_seed_, true, 0, 0, &other_solver);
+  EXPECT_TRUE(SameSolutions(first, second));
+  EXPECT_TRUE(SameSolutions(first, other_solver));
+}
+
+// out of reach: fails after the restarts, still within the limits
+TEST_F(BatchIkTest, UnreachablePose) {
+  BatchIkSolver solver(tree_, options_, q_min_, q_max_);
+  PoseVector far(1, Eigen::Isometry3d::Identity());
+  far[0].translation() << 3, 0, 0;
+  std::vector<IkSolution> solutions;
+  solver.Solve(idx_ee_, far, q_seed_, true, 0, 0, &solutions);
+  ASSERT_EQ(1u, solutions.size());
+  EXPECT_FALSE(solutions[0].success);
+  EXPECT_TRUE(WithinLimits(solutions[0].q));
+}
+
+} // namespace
+} // namespace robot_plan_runner
+} // namespace drake
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,357 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include <drake/common/find_resource.h>
+#include <drake/multibody/parsers/urdf_parser.h>
+#include <drake_robot_control/joint_name_permutation.h>
+#include <drake_robot_control/joint_space_streaming_plan.h>
+#include <drake_robot_control/joint_space_trajectory_plan.h>
+#include <drake_robot_control/task_space_qp_trajectory_plan.h>
+#include <drake_robot_control/task_space_streaming_plan.h>
+#include <drake_robot_control/task_space_trajectory_plan.h>
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+// Every heap allocation goes through these, operator new included. They are
+// counted while counting is set on the calling thread.
+namespace {
+__thread bool counting = false;
+std::atomic<int64_t> num_allocations(0);
+
+void CountAllocation() {
+  if (counting) {
+    num_allocations++;
+  }
+}
+} // namespace
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) {
+  CountAllocation();
+  return __libc_malloc(size);
+}
+void *calloc(size_t num, size_t size) {
+  CountAllocation();
+  return __libc_calloc(num, size);
+}
+void *realloc(void *ptr, size_t size) {
+  CountAllocation();
+  return __libc_realloc(ptr, size);
+}
+void *memalign(size_t alignment, size_t size) {
+  CountAllocation();
+  return __libc_memalign(alignment, size);
+}
+void *aligned_alloc(size_t alignment, size_t size) {
+  CountAllocation();
+  return __libc_memalign(alignment, size);
+}
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  CountAllocation();
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+}
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// Runs fn and returns the number of heap allocations it made.
+template <typename Function> int64_t CountAllocations(const Function &fn) {
+  num_allocations = 0;
+  counting = true;
+  fn();
+  counting = false;
+  return num_allocations;
+}
+
+// Drives plans the way RobotPlanRunner::ControlTick does, at the iiwa's
+// 5 ms period, so everything Step touches runs under the hook.
+class TickDriver {
+public:
+  explicit TickDriver(std::shared_ptr<const RigidBodyTreed> tree)
+      : kinematics_(tree), x_(Eigen::VectorXd::Zero(14)),
+        tau_external_(Eigen::VectorXd::Zero(7)),
+        q_commanded_(Eigen::VectorXd::Zero(7)),
+        v_commanded_(Eigen::VectorXd::Zero(7)),
+        tau_commanded_(Eigen::VectorXd::Zero(7)) {
+    x_.head(7) << 0.1, 0.4, 0, -1.2, 0, 1.1, 0.3;
+  }
+
+  void Start(PlanBase *plan) {
+    plan->SetCurrentCommand(x_.head(7), tau_commanded_);
+  }
+
+  void Tick(PlanBase *plan, double t) {
+    kinematics_.Reset(x_.head(7), x_.tail(7));
+    plan->Step(x_, tau_external_, t, &kinematics_, &q_commanded_,
+               &v_commanded_, &tau_commanded_);
+    plan->SetCurrentCommand(q_commanded_, tau_commanded_);
+  }
+
+  // runs plan from t_start to t_end
+  void Run(PlanBase *plan, double t_start, double t_end) {
+    for (double t = t_start; t <= t_end; t += 0.005) {
+      Tick(plan, t);
+    }
+  }
+
+  TickKinematics *kinematics() { return &kinematics_; }
+  Eigen::VectorXd q() const { return x_.head(7); }
+  const Eigen::VectorXd &q_commanded() const { return q_commanded_; }
+  const Eigen::VectorXd &v_commanded() const { return v_commanded_; }
+
+private:
+  TickKinematics kinematics_;
+  Eigen::VectorXd x_;
+  Eigen::VectorXd tau_external_;
+  Eigen::VectorXd q_commanded_;
+  Eigen::VectorXd v_commanded_;
+  Eigen::VectorXd tau_commanded_;
+};
+
+class ControlTickAllocationTest : public ::testing::Test {
+protected:
+  static void SetUpTestCase() {
+    auto tree = std::make_shared<RigidBodyTreed>();
+    parsers::urdf::AddModelInstanceFromUrdfFileToWorld(
+        FindResourceOrThrow("drake/manipulation/models/iiwa_description/"
+                            "urdf/iiwa14_primitive_collision.urdf"),
+        multibody::joints::kFixed, tree.get());
+    // the task space streaming plan takes frames, not bodies
+    tree->addFrame(std::make_shared<RigidBodyFrame<double>>(
+        "test_world_frame", &tree->world(), Eigen::Isometry3d::Identity()));
+    tree->addFrame(std::make_shared<RigidBodyFrame<double>>(
+        "test_ee_frame", tree->FindBody("iiwa_link_ee"),
+        Eigen::Isometry3d::Identity()));
+    tree_ = tree;
+    // creates the ring and the drain thread
+    AsyncLogger::Get();
+  }
+
+  static void TearDownTestCase() {
+    AsyncLogger::Get().Flush();
+    tree_.reset();
+  }
+
+  ControlTickAllocationTest()
+      : driver_(tree_), idx_ee_(tree_->FindBodyIndex("iiwa_link_ee")) {}
+
+  // a cubic joint space trajectory
+  static PPType MakeJointTrajectory() {
+    std::vector<double> times{0, 0.5, 1.2, 2};
+    std::vector<Eigen::MatrixXd> knots;
+    for (int i = 0; i < 4; i++) {
+      knots.push_back(Eigen::VectorXd::Constant(7, 0.2 * i));
+      knots.back()(3, 0) = -1.2 + 0.1 * i;
+    }
+    return PPType::Cubic(times, knots, Eigen::VectorXd::Zero(7),
+                         Eigen::VectorXd::Zero(7));
+  }
+
+  // a straight end effector line at a fixed orientation
+  static PPType MakeEndEffectorTrajectory() {
+    std::vector<double> times{0, 2};
+    std::vector<Eigen::MatrixXd> knots{Eigen::Vector3d(0.5, 0, 0.5),
+                                       Eigen::Vector3d(0.5, 0.1, 0.4)};
+    return PPType::FirstOrderHold(times, knots);
+  }
+
+  // shared memory segment unique to this process
+  static std::unique_ptr<SharedSetpointChannel> CreateSharedSetpoints() {
+    return SharedSetpointChannel::Create("/test_control_tick_allocations_" +
+                                         std::to_string(getpid()));
+  }
+
+  static std::shared_ptr<const RigidBodyTreed> tree_;
+  TickDriver driver_;
+  const int idx_ee_;
+};
+
+std::shared_ptr<const RigidBodyTreed> ControlTickAllocationTest::tree_;
+
+TEST_F(ControlTickAllocationTest, CalcGeometricJacobianMatchesTree) {
+  Eigen::VectorXd q(7);
+  q << 0.3, -0.5, 0.8, -1.4, 0.2, 0.9, -0.6;
+  driver_.kinematics()->Reset(q, Eigen::VectorXd::Zero(7));
+  const KinematicsCache<double> &cache = driver_.kinematics()->cache();
+  for (int expressed_in : {0, idx_ee_}) {
+    const Eigen::MatrixXd J_expected =
+        tree_->geometricJacobian(cache, 0, idx_ee_, expressed_in);
+    JacobianMatrix J;
+    CalcGeometricJacobian(*tree_, cache, 0, idx_ee_, expressed_in, &J);
+    EXPECT_LT((J - J_expected).cwiseAbs().maxCoeff(), 1e-12)
+        << "expressed in " << expressed_in;
+  }
+}
+
+TEST_F(ControlTickAllocationTest, PolynomialTableMatchesTrajectory) {
+  const PPType traj = MakeJointTrajectory();
+  const PPType traj_d = traj.derivative(1);
+  PolynomialTable table(traj);
+  Eigen::VectorXd q(7), v(7);
+  for (double t = -0.1; t < 2.2; t += 0.013) {
+    table.Evaluate(t, q, v);
+    EXPECT_LT(std::max((q - traj.value(t)).cwiseAbs().maxCoeff(),
+                       (v - traj_d.value(t)).cwiseAbs().maxCoeff()),
+              1e-12)
+        << "at " << t;
+  }
+}
+
+TEST_F(ControlTickAllocationTest, JointSpaceTrajectoryPlan) {
+  JointSpaceTrajectoryPlan plan(tree_, MakeJointTrajectory());
+  driver_.Start(&plan);
+  driver_.Tick(&plan, 0);
+  EXPECT_EQ(0, CountAllocations([&]() { driver_.Run(&plan, 0.005, 2.1); }));
+}
+
+TEST_F(ControlTickAllocationTest, BakedJointSpaceTrajectoryPlan) {
+  JointSpaceTrajectoryPlan plan(tree_, MakeJointTrajectory());
+  plan.Bake(0.005);
+  driver_.Start(&plan);
+  driver_.Tick(&plan, 0);
+  EXPECT_EQ(0, CountAllocations([&]() { driver_.Run(&plan, 0.005, 2.1); }));
+}
+
+// the hold plan the runner falls back to is reset in place
+TEST_F(ControlTickAllocationTest, HoldPlan) {
+  std::shared_ptr<JointSpaceTrajectoryPlan> hold_plan =
+      JointSpaceTrajectoryPlan::MakeHoldCurrentPositionPlan(
+          tree_, Eigen::VectorXd::Zero(7));
+  const Eigen::VectorXd q_hold = Eigen::VectorXd::Constant(7, 0.3);
+  EXPECT_EQ(0, CountAllocations([&]() {
+              hold_plan->ResetHoldPosition(q_hold);
+              driver_.Start(hold_plan.get());
+              driver_.Run(hold_plan.get(), 0, 1.5);
+            }));
+  EXPECT_EQ(q_hold, driver_.q_commanded());
+  EXPECT_TRUE(driver_.v_commanded().isZero());
+}
+
+TEST_F(ControlTickAllocationTest, TickKinematics) {
+  const Eigen::VectorXd q = Eigen::VectorXd::Constant(7, 0.3);
+  const Eigen::VectorXd v = Eigen::VectorXd::Zero(7);
+  TickKinematics *kinematics = driver_.kinematics();
+  EXPECT_EQ(0, CountAllocations([&]() {
+              kinematics->Reset(q, v);
+              kinematics->RelativeTransform(0, idx_ee_);
+              kinematics->GeometricJacobian(0, idx_ee_, idx_ee_);
+            }));
+}
+
+TEST_F(ControlTickAllocationTest, EndEffectorOriginTrajectoryPlan) {
+  const math::RotationMatrixd R_WE(math::RollPitchYawd(M_PI, 0, 0));
+  EndEffectorOriginTrajectoryPlan plan(
+      tree_, MakeEndEffectorTrajectory(), R_WE, R_WE,
+      Eigen::Vector3d::Constant(1), Eigen::Vector3d::Constant(1),
+      "iiwa_link_ee");
+  driver_.Start(&plan);
+  driver_.Tick(&plan, 0);
+  EXPECT_EQ(0, CountAllocations([&]() { driver_.Run(&plan, 0.005, 2.1); }));
+}
+
+TEST_F(ControlTickAllocationTest, EndEffectorOriginQpTrajectoryPlan) {
+  const math::RotationMatrixd R_WE(math::RollPitchYawd(M_PI, 0, 0));
+  // the iiwa14 joint limits
+  Eigen::VectorXd q_max(7);
+  q_max << 170, 120, 170, 120, 170, 120, 175;
+  q_max *= M_PI / 180;
+  EndEffectorOriginQpTrajectoryPlan plan(
+      tree_, MakeEndEffectorTrajectory(), R_WE, R_WE,
+      Eigen::Vector3d::Constant(1), Eigen::Vector3d::Constant(1),
+      "iiwa_link_ee", TaskSpaceQpOptions(), -q_max, q_max, 1.0);
+  driver_.Start(&plan);
+  driver_.Tick(&plan, 0);
+  EXPECT_EQ(0, CountAllocations([&]() { driver_.Run(&plan, 0.005, 2.1); }));
+}
+
+// Streaming setpoints arrive through shared memory, which Step polls. The
+// ROS topics are handled on the spinner threads, outside the tick.
+TEST_F(ControlTickAllocationTest, JointSpaceStreamingPlan) {
+  std::shared_ptr<SharedSetpointChannel> channel = CreateSharedSetpoints();
+  ASSERT_TRUE(channel) << std::strerror(errno);
+  ros::NodeHandle nh("~");
+  JointSpaceStreamingPlan plan(
+      tree_, nh, std::make_shared<JointNamePermutationCache>(*tree_));
+  plan.set_shared_setpoints(channel);
+  driver_.Start(&plan);
+  driver_.Tick(&plan, 0);
+
+  SharedJointSpaceSetpoint setpoint{};
+  setpoint.num_joints = 7;
+  Eigen::Map<Eigen::VectorXd>(setpoint.position, 7) = driver_.q();
+  EXPECT_EQ(0, CountAllocations([&]() {
+              for (int i = 1; i <= 400; i++) {
+                setpoint.position[0] += 1e-4;
+                channel->Write(setpoint);
+                driver_.Tick(&plan, 0.005 * i);
+              }
+            }));
+  // every setpoint was played out, stamped when it was read
+  EXPECT_NEAR(setpoint.position[0], driver_.q_commanded()[0], 1e-12);
+}
+
+TEST_F(ControlTickAllocationTest, TaskSpaceStreamingPlan) {
+  std::shared_ptr<SharedSetpointChannel> channel = CreateSharedSetpoints();
+  ASSERT_TRUE(channel) << std::strerror(errno);
+  ros::NodeHandle nh("~");
+  TaskSpaceStreamingPlan plan(tree_, nh);
+  plan.set_shared_setpoints(channel);
+  driver_.Start(&plan);
+
+  // a goal a few cm off the current end effector pose, in the world frame
+  driver_.kinematics()->Reset(driver_.q(), Eigen::VectorXd::Zero(7));
+  const Eigen::Isometry3d H_WE =
+      driver_.kinematics()->RelativeTransform(0, idx_ee_);
+  const Eigen::Quaterniond quat_WE(H_WE.linear());
+  SharedTaskSpaceSetpoint setpoint{};
+  std::strncpy(setpoint.frame_id, "test_world_frame",
+               sizeof(setpoint.frame_id));
+  std::strncpy(setpoint.ee_frame_id, "test_ee_frame",
+               sizeof(setpoint.ee_frame_id));
+  Eigen::Map<Eigen::Vector3d>(setpoint.xyz) =
+      H_WE.translation() + Eigen::Vector3d(0, 0.03, -0.02);
+  setpoint.quaternion[0] = quat_WE.w();
+  setpoint.quaternion[1] = quat_WE.x();
+  setpoint.quaternion[2] = quat_WE.y();
+  setpoint.quaternion[3] = quat_WE.z();
+  Eigen::Map<Eigen::Vector3d>(setpoint.kp_rotation).setConstant(1);
+  Eigen::Map<Eigen::Vector3d>(setpoint.kp_translation).setConstant(1);
+  // the first setpoint looks its frames up in the tree
+  channel->Write(setpoint);
+  driver_.Tick(&plan, 0);
+
+  EXPECT_EQ(0, CountAllocations([&]() {
+              for (int i = 1; i <= 400; i++) {
+                setpoint.xyz[0] += 1e-5;
+                channel->Write(setpoint);
+                driver_.Tick(&plan, 0.005 * i);
+              }
+            }));
+  EXPECT_FALSE(driver_.q_commanded().isApprox(driver_.q()))
+      << "the plan did not move towards its goal";
+}
+
+} // namespace
+} // namespace robot_plan_runner
+} // namespace drake
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  // the streaming plans subscribe to their topics, run by rostest
+  ros::init(argc, argv, "test_control_tick_allocations");
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,134 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <drake_robot_control/iiwa_status_decoder.h>
+#include <gtest/gtest.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+std::vector<char> Encode(const lcmt_iiwa_status &message) {
+  std::vector<char> buffer(message.getEncodedSize());
+  message.encode(buffer.data(), 0, buffer.size());
+  return buffer;
+}
+
+// bitwise, so NaNs and signed zeros count too
+bool SameDoubles(const double *a, const std::vector<double> &b) {
+  return std::memcmp(a, b.data(), sizeof(double) * b.size()) == 0;
+}
+
+// Decodes buffer with decoder and with the generated decoder and compares
+// every field the snapshot holds.
+bool DecodesLikeGenerated(IiwaStatusDecoder *decoder,
+                          const std::vector<char> &buffer) {
+  lcmt_iiwa_status expected;
+  if (expected.decode(buffer.data(), 0, buffer.size()) < 0) {
+    return false;
+  }
+  RobotStatusSnapshot status;
+  if (!decoder->Decode(buffer.data(), buffer.size(), &status)) {
+    return false;
+  }
+  return status.utime == expected.utime &&
+         status.num_joints == expected.num_joints &&
+         SameDoubles(status.joint_position_measured,
+                     expected.joint_position_measured) &&
+         SameDoubles(status.joint_velocity_estimated,
+                     expected.joint_velocity_estimated) &&
+         SameDoubles(status.joint_position_commanded,
+                     expected.joint_position_commanded) &&
+         SameDoubles(status.joint_torque_commanded,
+                     expected.joint_torque_commanded) &&
+         SameDoubles(status.joint_torque_external,
+                     expected.joint_torque_external);
+}
+
+class IiwaStatusDecoderTest : public ::testing::Test {
+protected:
+  static constexpr int kNumJoints = 7;
+
+  IiwaStatusDecoderTest()
+      : decoder_(kNumJoints),
+        fields_{&message_.joint_position_measured,
+                &message_.joint_velocity_estimated,
+                &message_.joint_position_commanded,
+                &message_.joint_position_ipo,
+                &message_.joint_torque_measured,
+                &message_.joint_torque_commanded,
+                &message_.joint_torque_external} {
+    message_.num_joints = kNumJoints;
+    for (std::vector<double> *field : fields_) {
+      field->assign(kNumJoints, 0.5);
+    }
+  }
+
+  IiwaStatusDecoder decoder_;
+  lcmt_iiwa_status message_;
+  std::vector<double> *const fields_[7];
+};
+
+constexpr int IiwaStatusDecoderTest::kNumJoints;
+
+TEST_F(IiwaStatusDecoderTest, IsDirect) { EXPECT_TRUE(decoder_.is_direct()); }
+
+TEST_F(IiwaStatusDecoderTest, RandomMessages) {
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<double> value(-10, 10);
+  for (int n = 0; n < 1000; n++) {
+    message_.utime = static_cast<int64_t>(rng()) << 20 | rng();
+    for (std::vector<double> *field : fields_) {
+      for (double &x : *field) {
+        x = value(rng);
+      }
+    }
+    ASSERT_TRUE(DecodesLikeGenerated(&decoder_, Encode(message_)))
+        << "message " << n;
+  }
+}
+
+// values whose bytes are easy to get wrong
+TEST_F(IiwaStatusDecoderTest, SpecialValues) {
+  message_.utime = -1;
+  message_.joint_position_measured[0] = -0.;
+  message_.joint_velocity_estimated[1] =
+      std::numeric_limits<double>::infinity();
+  message_.joint_position_commanded[2] =
+      std::numeric_limits<double>::denorm_min();
+  message_.joint_torque_commanded[3] =
+      std::numeric_limits<double>::quiet_NaN();
+  message_.joint_torque_external[6] = std::numeric_limits<double>::max();
+  EXPECT_TRUE(DecodesLikeGenerated(&decoder_, Encode(message_)));
+}
+
+// messages the generated decoder rejects as well
+TEST_F(IiwaStatusDecoderTest, RejectsInvalidMessages) {
+  RobotStatusSnapshot status;
+  std::vector<char> buffer = Encode(message_);
+  EXPECT_FALSE(decoder_.Decode(buffer.data(), buffer.size() - 1, &status))
+      << "truncated";
+  buffer[0] ^= 1;
+  EXPECT_FALSE(decoder_.Decode(buffer.data(), buffer.size(), &status))
+      << "another fingerprint";
+
+  message_.num_joints = 6;
+  for (std::vector<double> *field : fields_) {
+    field->resize(6);
+  }
+  buffer = Encode(message_);
+  EXPECT_FALSE(decoder_.Decode(buffer.data(), buffer.size(), &status))
+      << "another number of joints";
+}
+
+} // namespace
+} // namespace robot_plan_runner
+} // namespace drake
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include <drake_robot_control/joint_trajectory_fit.h>
+#include <gtest/gtest.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// largest joint error of the chord between knots first and last at knot i
+double ChordError(const std::vector<double> &times,
+                  const Eigen::MatrixXd &knots, int first, int last, int i) {
+  const double s = (times[i] - times[first]) / (times[last] - times[first]);
+  return (knots.col(i) - (1 - s) * knots.col(first) - s * knots.col(last))
+      .cwiseAbs()
+      .maxCoeff();
+}
+
+// a recorded demonstration: smooth motion plus sensor noise, 5 ms apart
+class RecordedDemonstration : public ::testing::Test {
+protected:
+  static constexpr int kNumKnots = 801;
+
+  RecordedDemonstration() : times_(kNumKnots), knots_(7, kNumKnots) {
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0, 1e-4);
+    for (int i = 0; i < kNumKnots; i++) {
+      times_[i] = 0.005 * i;
+      for (int j = 0; j < 7; j++) {
+        knots_(j, i) =
+            0.5 * std::sin(0.7 * (j + 1) * times_[i] + j) + noise(rng);
+      }
+    }
+  }
+
+  std::vector<double> times_;
+  Eigen::MatrixXd knots_;
+};
+
+constexpr int RecordedDemonstration::kNumKnots;
+
+TEST(JointTrajectoryFitTest, TimesStrictlyIncrease) {
+  EXPECT_TRUE(TimesStrictlyIncrease({0, 0.1, 0.5}));
+  EXPECT_FALSE(TimesStrictlyIncrease({0, 0.1, 0.1}));
+  EXPECT_FALSE(TimesStrictlyIncrease({0, 0.2, 0.1}));
+  EXPECT_FALSE(TimesStrictlyIncrease({0, NAN, 0.1}));
+}
+
+// knots on a straight line in joint space, unevenly spaced in time
+TEST(JointTrajectoryFitTest, DecimateCollinearKnots) {
+  std::vector<double> times{0, 0.1, 0.4, 0.5, 1.3, 2};
+  Eigen::MatrixXd knots(7, times.size());
+  for (int i = 0; i < knots.cols(); i++) {
+    knots.col(i) = Eigen::VectorXd::LinSpaced(7, -1, 1) * times[i];
+  }
+  EXPECT_EQ(std::vector<int>({0, 5}), DecimateKnots(times, knots, 1e-6));
+
+  // one knot moved off the line by more than the tolerance
+  knots(2, 3) += 0.01;
+  EXPECT_EQ(std::vector<int>({0, 3, 5}), DecimateKnots(times, knots, 0.009));
+  EXPECT_EQ(std::vector<int>({0, 5}), DecimateKnots(times, knots, 0.02));
+  // zero tolerance keeps every knot
+  EXPECT_EQ(times.size(), DecimateKnots(times, knots, 0).size());
+}
+
+// every dropped knot is within tolerance of the chord between the kept knots
+// around it
+TEST_F(RecordedDemonstration, DecimateKnots) {
+  const double tolerance = 0.5 * M_PI / 180;
+  const std::vector<int> kept = DecimateKnots(times_, knots_, tolerance);
+  EXPECT_EQ(0, kept.front());
+  EXPECT_EQ(kNumKnots - 1, kept.back());
+  EXPECT_LT(kept.size(), times_.size() / 10);
+  double max_error = 0;
+  for (size_t k = 0; k + 1 < kept.size(); k++) {
+    for (int i = kept[k] + 1; i < kept[k + 1]; i++) {
+      max_error = std::max(
+          max_error, ChordError(times_, knots_, kept[k], kept[k + 1], i));
+    }
+  }
+  EXPECT_LE(max_error, tolerance);
+}
+
+// FitCubicSpline against PPType::Cubic with the same end velocities
+TEST_F(RecordedDemonstration, FitCubicSpline) {
+  std::vector<double> spline_times;
+  std::vector<Eigen::MatrixXd> knot_matrices;
+  Eigen::MatrixXd spline_knots(7, 9);
+  for (int i = 0; i < 9; i++) {
+    spline_times.push_back(times_[100 * i]);
+    knot_matrices.push_back(knots_.col(100 * i));
+    spline_knots.col(i) = knots_.col(100 * i);
+  }
+  const Eigen::VectorXd v_start = Eigen::VectorXd::Constant(7, 0.2);
+  const Eigen::VectorXd v_end = Eigen::VectorXd::Constant(7, -0.1);
+  const PPType spline =
+      FitCubicSpline(spline_times, spline_knots, v_start, v_end);
+  const PPType expected =
+      PPType::Cubic(spline_times, knot_matrices, v_start, v_end);
+  double max_error = 0;
+  for (double t = 0; t <= spline_times.back(); t += 0.001) {
+    max_error =
+        std::max(max_error,
+                 (spline.value(t) - expected.value(t)).cwiseAbs().maxCoeff());
+  }
+  EXPECT_LT(max_error, 1e-9);
+
+  const PPType spline_d = spline.derivative(1);
+  const PPType spline_dd = spline.derivative(2);
+  for (int i = 0; i < 9; i++) {
+    EXPECT_LT((spline.value(spline_times[i]) - spline_knots.col(i))
+                  .cwiseAbs()
+                  .maxCoeff(),
+              1e-12)
+        << "the spline passes through knot " << i;
+    if (i > 0 && i < 8) {
+      EXPECT_LT((spline_dd.value(spline_times[i] - 1e-9) -
+                 spline_dd.value(spline_times[i] + 1e-9))
+                    .cwiseAbs()
+                    .maxCoeff(),
+                1e-6)
+          << "the acceleration is continuous at knot " << i;
+    }
+  }
+  EXPECT_LT((spline_d.value(0) - v_start).cwiseAbs().maxCoeff(), 1e-12);
+  EXPECT_LT(
+      (spline_d.value(spline_times.back()) - v_end).cwiseAbs().maxCoeff(),
+      1e-12);
+}
+
+// FitJointTrajectory: within tolerance of every input knot, at rest at both
+// ends
+TEST_F(RecordedDemonstration, FitJointTrajectory) {
+  JointTrajectoryFitOptions options;
+  options.decimation_tolerance = 0.2 * M_PI / 180;
+  JointTrajectoryFitStats stats;
+  const PPType spline = FitJointTrajectory(times_, knots_, options, &stats);
+  EXPECT_EQ(kNumKnots, stats.num_input_knots);
+  EXPECT_LT(stats.num_knots, kNumKnots / 4);
+  double max_error = 0;
+  for (int i = 0; i < kNumKnots; i++) {
+    max_error = std::max(
+        max_error,
+        (spline.value(times_[i]) - knots_.col(i)).cwiseAbs().maxCoeff());
+  }
+  EXPECT_LE(max_error, options.decimation_tolerance);
+  const PPType spline_d = spline.derivative(1);
+  EXPECT_TRUE(spline_d.value(times_.front()).isZero());
+  EXPECT_TRUE(spline_d.value(times_.back()).isZero());
+  std::cout << "fit " << stats.num_knots << " of " << stats.num_input_knots
+            << " knots, max error " << max_error * 180 / M_PI << " deg"
+            << std::endl;
+}
+
+} // namespace
+} // namespace robot_plan_runner
+} // namespace drake
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include <drake_robot_control/joint_trajectory_fit.h>
+#include <drake_robot_control/joint_trajectory_retiming.h>
+#include <gtest/gtest.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// iiwa joint names, the last with a lower acceleration limit
+class JointTrajectoryRetimingTest : public ::testing::TestWithParam<double> {
+protected:
+  JointTrajectoryRetimingTest() {
+    options_.max_joint_acceleration_deg = 300;
+    options_.joint_acceleration_limits_deg["iiwa_joint_7"] = 100;
+    std::vector<std::string> joint_names;
+    for (int i = 1; i <= 7; i++) {
+      joint_names.push_back("iiwa_joint_" + std::to_string(i));
+    }
+    options_.GetLimits(joint_names, 120, &max_velocity_, &max_acceleration_);
+  }
+
+  JointTrajectoryRetimingOptions options_;
+  Eigen::VectorXd max_velocity_;
+  Eigen::VectorXd max_acceleration_;
+};
+
+TEST_F(JointTrajectoryRetimingTest, GetLimits) {
+  EXPECT_EQ(100 * M_PI / 180, max_acceleration_[6]);
+  EXPECT_EQ(300 * M_PI / 180, max_acceleration_[0]);
+  EXPECT_EQ(0.9 * 120 * M_PI / 180, max_velocity_[0]);
+}
+
+// random knots GetParam() seconds apart, starting at t = 1 s
+TEST_P(JointTrajectoryRetimingTest, RetimeJointTrajectory) {
+  const double spacing = GetParam();
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> position(-1.5, 1.5);
+  const int num_knots = 8;
+  std::vector<double> times(num_knots);
+  Eigen::MatrixXd knots(7, num_knots);
+  for (int i = 0; i < num_knots; i++) {
+    times[i] = 1 + i * spacing;
+    for (int j = 0; j < 7; j++) {
+      knots(j, i) = position(rng);
+    }
+  }
+  const Eigen::VectorXd zero = Eigen::VectorXd::Zero(7);
+  const PPType path = FitCubicSpline(times, knots, zero, zero);
+
+  PPType retimed;
+  JointTrajectoryRetimingStats stats;
+  ASSERT_TRUE(RetimeJointTrajectory(
+      path, max_velocity_, max_acceleration_, options_.grid_step_s,
+      options_.grid_step_deg * M_PI / 180, &retimed, &stats));
+
+  // durations are measured from the start of the trajectories
+  EXPECT_NEAR(retimed.end_time() - retimed.start_time(), stats.duration,
+              1e-9);
+  EXPECT_NEAR(path.end_time() - path.start_time(), stats.input_duration,
+              1e-9);
+  EXPECT_LT(
+      (retimed.value(retimed.start_time()) - path.value(path.start_time()))
+          .cwiseAbs()
+          .maxCoeff(),
+      1e-9);
+  EXPECT_LT((retimed.value(retimed.end_time()) - path.value(path.end_time()))
+                .cwiseAbs()
+                .maxCoeff(),
+            1e-9);
+
+  // Velocities and accelerations, the latter by differencing the velocity,
+  // relative to the limits. The limits hold at the grid points and are
+  // slightly overshot between them.
+  const PPType retimed_d = retimed.derivative(1);
+  const double dt = 0.001;
+  double velocity_ratio = 0, acceleration_ratio = 0;
+  Eigen::VectorXd v_previous = retimed_d.value(retimed.start_time());
+  for (double t = retimed.start_time() + dt; t <= retimed.end_time();
+       t += dt) {
+    const Eigen::VectorXd v = retimed_d.value(t);
+    velocity_ratio = std::max(
+        velocity_ratio, v.cwiseAbs().cwiseQuotient(max_velocity_).maxCoeff());
+    acceleration_ratio =
+        std::max(acceleration_ratio, ((v - v_previous) / dt)
+                                         .cwiseAbs()
+                                         .cwiseQuotient(max_acceleration_)
+                                         .maxCoeff());
+    v_previous = v;
+  }
+  EXPECT_LT(velocity_ratio, 1.01);
+  EXPECT_LT(acceleration_ratio, 1.02);
+  // time optimal: some joint is at a limit somewhere
+  EXPECT_GT(std::max(velocity_ratio, acceleration_ratio), 0.98);
+  EXPECT_TRUE(retimed_d.value(retimed.start_time()).isZero());
+  EXPECT_TRUE(retimed_d.value(retimed.end_time()).isZero());
+
+  // stays on the path: every retimed sample is close to a path sample
+  std::vector<Eigen::VectorXd> path_samples;
+  for (double s = path.start_time(); s <= path.end_time();
+       s += (path.end_time() - path.start_time()) / 20000) {
+    path_samples.push_back(path.value(s));
+  }
+  double deviation = 0;
+  for (double t = retimed.start_time(); t <= retimed.end_time(); t += 0.05) {
+    const Eigen::VectorXd q = retimed.value(t);
+    double closest = INFINITY;
+    for (const Eigen::VectorXd &p : path_samples) {
+      closest = std::min(closest, (p - q).cwiseAbs().maxCoeff());
+    }
+    deviation = std::max(deviation, closest);
+  }
+  EXPECT_LT(deviation, 2e-3);
+
+  std::cout << "knots " << spacing << " s apart: " << stats.input_duration
+            << " s retimed to " << stats.duration << " s, max v/limit "
+            << velocity_ratio << ", a/limit " << acceleration_ratio
+            << ", deviation " << deviation << " rad" << std::endl;
+}
+
+// the same knots far too fast, about right and too slow for the limits
+INSTANTIATE_TEST_CASE_P(KnotSpacing, JointTrajectoryRetimingTest,
+                        ::testing::Values(0.05, 0.3, 2.));
+
+} // namespace
+} // namespace robot_plan_runner
+} // namespace drake
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
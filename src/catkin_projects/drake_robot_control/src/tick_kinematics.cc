@@ -0,0 +1,140 @@
+#include <drake_robot_control/tick_kinematics.h>
+
+namespace drake {
+namespace robot_plan_runner {
+namespace {
+
+// true if ancestor is body or one of its ancestors
+bool IsAncestorOrSelf(const RigidBody<double> &ancestor,
+                      const RigidBody<double> *body) {
+  for (; body; body = body->get_parent()) {
+    if (body == &ancestor) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Writes sign times the motion subspaces (in world) of the joints from body
+// up to, not including, the first ancestor shared with other.
+void AddPathColumns(const RigidBodyTreed &tree,
+                    const KinematicsCache<double> &cache, int body_index,
+                    int other_index, double sign, JacobianMatrix *const J) {
+  const RigidBody<double> &other = tree.get_body(other_index);
+  for (const RigidBody<double> *body = &tree.get_body(body_index);
+       body->has_parent_body() && !IsAncestorOrSelf(*body, &other);
+       body = body->get_parent()) {
+    const int num_velocities = body->getJoint().get_num_velocities();
+    if (num_velocities > 0) {
+      J->middleCols(body->get_velocity_start_index(), num_velocities) =
+          sign *
+          cache.get_element(body->get_body_index()).motion_subspace_in_world;
+    }
+  }
+}
+
+} // namespace
+
+void CalcGeometricJacobian(const RigidBodyTreed &tree,
+                           const KinematicsCache<double> &cache,
+                           int base_body_or_frame_ind,
+                           int end_effector_body_or_frame_ind,
+                           int expressed_in_body_or_frame_ind,
+                           JacobianMatrix *const J) {
+  J->setZero(6, tree.get_num_velocities());
+  const int base = tree.parseBodyOrFrameID(base_body_or_frame_ind);
+  const int end_effector =
+      tree.parseBodyOrFrameID(end_effector_body_or_frame_ind);
+  // joints between the common ancestor and the end effector move it along,
+  // joints between the common ancestor and the base move it the other way
+  AddPathColumns(tree, cache, end_effector, base, 1., J);
+  AddPathColumns(tree, cache, base, end_effector, -1., J);
+
+  if (expressed_in_body_or_frame_ind != 0) {
+    // twists in world to twists in the expressed in frame, like
+    // transformSpatialMotion
+    const Eigen::Isometry3d H =
+        tree.relativeTransform(cache, expressed_in_body_or_frame_ind, 0);
+    for (int i = 0; i < J->cols(); i++) {
+      const Eigen::Vector3d w = H.linear() * J->col(i).head<3>();
+      const Eigen::Vector3d v =
+          H.linear() * J->col(i).tail<3>() + H.translation().cross(w);
+      J->col(i) << w, v;
+    }
+  }
+}
+
+TickKinematics::TickKinematics(std::shared_ptr<const RigidBodyTreed> tree)
+    : tree_(std::move(tree)), cache_(tree_->CreateKinematicsCache()),
+      is_cache_valid_(false), num_kinematics_updates_(0),
+      q_(Eigen::VectorXd::Zero(tree_->get_num_positions())),
+      v_(Eigen::VectorXd::Zero(tree_->get_num_velocities())),
+      num_transforms_(0), num_jacobians_(0) {}
+
+void TickKinematics::Reset(const Eigen::Ref<const Eigen::VectorXd> &q,
+                           const Eigen::Ref<const Eigen::VectorXd> &v) {
+  q_ = q;
+  v_ = v;
+  is_cache_valid_ = false;
+  num_transforms_ = 0;
+  num_jacobians_ = 0;
+}
+
+const KinematicsCache<double> &TickKinematics::cache() {
+  if (!is_cache_valid_) {
+    cache_.initialize(q_, v_);
+    tree_->doKinematics(cache_);
+    is_cache_valid_ = true;
+    num_kinematics_updates_++;
+  }
+  return cache_;
+}
+
+const Eigen::Isometry3d &TickKinematics::RelativeTransform(
+    int base_or_frame_ind, int body_or_frame_ind) {
+  for (int i = 0; i < num_transforms_; i++) {
+    const TransformEntry &entry = transforms_[i];
+    if (entry.base == base_or_frame_ind && entry.body == body_or_frame_ind) {
+      return entry.value;
+    }
+  }
+  Eigen::Isometry3d *value = &overflow_transform_;
+  if (num_transforms_ < kMaxNumMemoized) {
+    TransformEntry &entry = transforms_[num_transforms_++];
+    entry.base = base_or_frame_ind;
+    entry.body = body_or_frame_ind;
+    value = &entry.value;
+  }
+  *value = tree_->relativeTransform(cache(), base_or_frame_ind,
+                                    body_or_frame_ind);
+  return *value;
+}
+
+const JacobianMatrix &
+TickKinematics::GeometricJacobian(int base_body_or_frame_ind,
+                                  int end_effector_body_or_frame_ind,
+                                  int expressed_in_body_or_frame_ind) {
+  for (int i = 0; i < num_jacobians_; i++) {
+    const JacobianEntry &entry = jacobians_[i];
+    if (entry.base == base_body_or_frame_ind &&
+        entry.end_effector == end_effector_body_or_frame_ind &&
+        entry.expressed_in == expressed_in_body_or_frame_ind) {
+      return entry.value;
+    }
+  }
+  JacobianMatrix *value = &overflow_jacobian_;
+  if (num_jacobians_ < kMaxNumMemoized) {
+    JacobianEntry &entry = jacobians_[num_jacobians_++];
+    entry.base = base_body_or_frame_ind;
+    entry.end_effector = end_effector_body_or_frame_ind;
+    entry.expressed_in = expressed_in_body_or_frame_ind;
+    value = &entry.value;
+  }
+  CalcGeometricJacobian(*tree_, cache(), base_body_or_frame_ind,
+                        end_effector_body_or_frame_ind,
+                        expressed_in_body_or_frame_ind, value);
+  return *value;
+}
+
+} // namespace robot_plan_runner
+} // namespace drake